@@ -183,6 +183,7 @@ Requires: %{name}-ldap
 Requires: %{name}-load
 Requires: %{name}-log
 Requires: %{name}-mailq
+Requires: %{name}-memory
 Requires: %{name}-mrtg
 Requires: %{name}-mrtgtraf
 %if 0%{?rhel} == 7
@@ -585,6 +586,19 @@ Provides check_mailq of the Monitoring Plugins.
 
 
 
+# check_memory
+%package memory
+Summary:  Monitoring Plugins - check_memory
+Requires: %{name} = %{version}-%{release}
+
+%description memory
+Provides check_memory of the Monitoring Plugins.
+
+%files memory
+%{plugindir}/check_memory
+
+
+
 # check_mrtg
 %package mrtg
 Summary:  Monitoring Plugins - check_mrtg
@@ -0,0 +1,75 @@
+/*****************************************************************************
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "common.h"
+#include "utils_meminfo.h"
+#include "tap.h"
+
+int main(void) {
+	plan_tests(20);
+
+	mp_meminfo_result result = mp_meminfo_read("./var/proc_meminfo");
+	ok(result.errorcode == OK, "Read meminfo");
+	ok(result.meminfo.mem_total == 32767776ULL * 1024, "MemTotal converted to Bytes");
+	ok(result.meminfo.mem_available == 23807480ULL * 1024, "MemAvailable");
+	ok(result.meminfo.swap_total == 33431548ULL * 1024, "SwapTotal");
+	ok(result.meminfo.dirty == 784ULL * 1024, "Dirty");
+	ok(result.meminfo.slab == 3801908ULL * 1024, "Slab");
+	ok(result.meminfo.hugepagesize == 2048ULL * 1024, "Hugepagesize");
+	ok(mp_meminfo_has(&result.meminfo, MP_MEMINFO_HUGEPAGES_TOTAL | MP_MEMINFO_HUGEPAGES_FREE) &&
+		   result.meminfo.hugepages_total == 0,
+	   "HugePages_Total is a page count without unit");
+	ok(result.meminfo.active == 7860680ULL * 1024, "Active(anon) does not overwrite Active");
+	ok(!mp_meminfo_has(&result.meminfo, MP_MEMINFO_SWAP_SUMMARY), "No swap summary line");
+
+	result = mp_meminfo_read("./var/does_not_exist");
+	ok(result.errorcode == ERROR, "Missing meminfo file is an error");
+
+	const char netbsd_meminfo[] = "        total:    used:    free:\n"
+								  "Mem:  1000 500 500\n"
+								  "Swap: 4096 1024 3072\n"
+								  "MemTotal:      1000 kB\n";
+	result = mp_meminfo_parse(netbsd_meminfo, sizeof(netbsd_meminfo) - 1);
+	ok(mp_meminfo_has(&result.meminfo, MP_MEMINFO_SWAP_SUMMARY) &&
+		   result.meminfo.swap_summary_total == 4096 && result.meminfo.swap_summary_free == 3072,
+	   "Swap summary line");
+
+	const char truncated_meminfo[] = "MemTotal: 1000 kB\nMemFree: 12";
+	result = mp_meminfo_parse(truncated_meminfo, sizeof(truncated_meminfo) - 1);
+	ok(result.meminfo.mem_total == 1000 * 1024 && result.meminfo.mem_free == 12,
+	   "Last line without newline is parsed");
+
+	result = mp_meminfo_parse("garbage\n", 8);
+	ok(result.errorcode == ERROR, "No known keys is an error");
+
+	mp_swaps_result swaps = mp_swaps_read("./var/proc_swaps");
+	ok(swaps.errorcode == OK && swaps.count == 2, "Read two swap devices");
+	ok(strcmp(swaps.devices[0].filename, "/dev/dm-1") == 0 &&
+		   strcmp(swaps.devices[0].type, "partition") == 0,
+	   "Device name and type");
+	ok(swaps.devices[0].size == 33431548ULL * 1024 && swaps.devices[0].used == 1024ULL * 1024,
+	   "Device size and usage in Bytes");
+	ok(swaps.devices[0].priority == -2, "Negative priority");
+	ok(strcmp(swaps.devices[1].filename, "/var/swap file") == 0, "Escaped blank in file name");
+	mp_swaps_free(&swaps);
+
+	swaps = mp_swaps_read("./var/does_not_exist");
+	ok(swaps.errorcode == ERROR, "Missing swaps file is an error");
+
+	return exit_status();
+}
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "common.h"
+#include "utils_state.h"
+#include "tap.h"
+
+#include <sys/stat.h>
+
+int main(int argc, char **argv) {
+	plan_tests(14);
+
+	state_key test_key = {
+		.name = "statefile",
+		.plugin_name = "check_test",
+		.data_version = 54,
+		._filename = "var/statefile",
+		.state_data = NULL,
+	};
+
+	state_data *test_data = np_state_read(test_key);
+	ok(test_data->errorcode == OK, "State file read");
+	ok(test_data->time == 1234567890, "Got time from state file");
+	ok(test_data->length == 14 && !strcmp(test_data->data, "String to read"),
+	   "Data as expected");
+
+	test_key.data_version = 53;
+	ok(np_state_read(test_key)->errorcode == ERROR, "Older data version is rejected");
+	test_key.data_version = 54;
+
+	test_key._filename = "var/oldformat";
+	ok(np_state_read(test_key)->errorcode == ERROR, "Old file format is rejected");
+
+	test_key._filename = "var/baddate";
+	ok(np_state_read(test_key)->errorcode == ERROR, "Timestamp in the future is rejected");
+
+	test_key._filename = "var/missingdataline";
+	ok(np_state_read(test_key)->errorcode == ERROR, "Missing data line is rejected");
+
+	test_key._filename = "var/nonexistent";
+	ok(np_state_read(test_key) == NULL, "No state for a missing file");
+
+	setenv("MP_STATE_PATH", "var", 1);
+	state_key enabled_key =
+		np_enable_state("allowedchars_in_keyname", 77, "check_test", argc, argv);
+	char *expected_filename = NULL;
+	asprintf(&expected_filename, "var/%lu/check_test/allowedchars_in_keyname",
+			 (unsigned long)geteuid());
+	ok(!strcmp(enabled_key._filename, expected_filename), "Filename is built from the key");
+	ok(enabled_key.data_version == 77, "Data version is kept");
+
+	state_key generated_key = np_enable_state(NULL, 1, "check_test", argc, argv);
+	ok(strlen(generated_key.name) == 40, "Key is generated from the arguments");
+
+	/* The state string is not limited in size */
+	size_t long_string_length = 20000;
+	char *long_string = calloc(long_string_length + 1, sizeof(char));
+	memset(long_string, 'x', long_string_length);
+	np_state_write_string(enabled_key, 1234567890, long_string);
+
+	state_data *written_data = np_state_read(enabled_key);
+	ok(written_data->errorcode == OK, "Written state file read back");
+	ok(written_data->time == 1234567890, "Written timestamp read back");
+	ok(written_data->length == long_string_length && !strcmp(written_data->data, long_string),
+	   "Long state string read back");
+
+	unlink(enabled_key._filename);
+	char *directory = NULL;
+	asprintf(&directory, "var/%lu/check_test", (unsigned long)geteuid());
+	rmdir(directory);
+	asprintf(&directory, "var/%lu", (unsigned long)geteuid());
+	rmdir(directory);
+
+	return exit_status();
+}
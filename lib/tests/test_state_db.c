@@ -0,0 +1,188 @@
+/*****************************************************************************
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "common.h"
+#include "utils_state.h"
+#include "utils_state_db.h"
+#include "tap.h"
+
+#include <sys/stat.h>
+#include <time.h>
+
+#define BENCHMARK_WRITES 1000
+
+static double now(void) {
+	struct timespec current;
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return (double)current.tv_sec + ((double)current.tv_nsec / 1e9);
+}
+
+static off_t file_size(const char *path) {
+	struct stat file_stat;
+	if (stat(path, &file_stat) != 0) {
+		return -1;
+	}
+	return file_stat.st_size;
+}
+
+/* Average time of one np_state_write_string with the backend selected in the environment */
+static double write_latency(state_key key) {
+	char data[64];
+	double start = now();
+	for (int i = 0; i < BENCHMARK_WRITES; i++) {
+		snprintf(data, sizeof(data), "%d 123456789 987654321", i);
+		np_state_write_string(key, 1234567890, data);
+	}
+	return (now() - start) / BENCHMARK_WRITES;
+}
+
+int main(int argc, char **argv) {
+	plan_tests(18);
+
+	const char *path = "var/test_state.db";
+	unlink(path);
+
+	np_state_db database = np_state_db_open(path);
+	ok(database.errorcode == OK, "Database opened");
+	ok(np_state_db_get(&database, "check_test/missing").errorcode == ERROR,
+	   "No entry for a missing key");
+
+	ok(np_state_db_put(&database, "check_test/key", 3, 1234567890, "first", 5) == OK,
+	   "Value stored");
+	np_state_db_entry entry = np_state_db_get(&database, "check_test/key");
+	ok(entry.errorcode == OK && entry.time == 1234567890 && entry.data_version == 3 &&
+		   entry.length == 5 && !strcmp(entry.data, "first"),
+	   "Value read back");
+
+	np_state_db_put(&database, "check_test/key", 3, 1234567891, "second", 6);
+	entry = np_state_db_get(&database, "check_test/key");
+	ok(entry.errorcode == OK && entry.time == 1234567891 && !strcmp(entry.data, "second"),
+	   "Newest value is returned");
+
+	/* More keys than buckets, so the chains get longer than one record */
+	char key[64];
+	char data[64];
+	for (int i = 0; i < 3 * NP_STATE_DB_MIN_BUCKETS; i++) {
+		snprintf(key, sizeof(key), "check_many/%d", i);
+		snprintf(data, sizeof(data), "value %d", i);
+		np_state_db_put(&database, key, 1, 1234567890, data, strlen(data));
+	}
+	bool all_found = true;
+	for (int i = 0; i < 3 * NP_STATE_DB_MIN_BUCKETS; i++) {
+		snprintf(key, sizeof(key), "check_many/%d", i);
+		snprintf(data, sizeof(data), "value %d", i);
+		entry = np_state_db_get(&database, key);
+		all_found = all_found && entry.errorcode == OK && !strcmp(entry.data, data);
+	}
+	ok(all_found, "All keys found with collisions");
+	np_state_db_close(&database);
+
+	database = np_state_db_open(path);
+	entry = np_state_db_get(&database, "check_test/key");
+	ok(entry.errorcode == OK && !strcmp(entry.data, "second"), "Value kept after reopening");
+
+	/* Overwriting a key leaves outdated records behind until the compaction */
+	char medium_value[1024];
+	memset(medium_value, 'm', sizeof(medium_value));
+	for (int i = 0; i < 512; i++) {
+		np_state_db_put(&database, "check_test/medium", 1, 1234567890, medium_value,
+						sizeof(medium_value));
+	}
+	np_state_db_put(&database, "check_test/key", 3, 1234567892, "third", 5);
+	off_t size_before = file_size(path);
+	ok(np_state_db_compact(&database) == OK, "Database compacted");
+	ok(file_size(path) < size_before - (256 * 1024), "Compaction removes outdated records");
+	entry = np_state_db_get(&database, "check_test/key");
+	ok(entry.errorcode == OK && !strcmp(entry.data, "third"), "Value kept by the compaction");
+	entry = np_state_db_get(&database, "check_many/4711");
+	ok(entry.errorcode == OK && !strcmp(entry.data, "value 4711"),
+	   "Other keys kept by the compaction");
+
+	/* Rewriting the same key again and again triggers the compaction on its own */
+	char big_value[4096];
+	memset(big_value, 'x', sizeof(big_value));
+	for (int i = 0; i < 1024; i++) {
+		np_state_db_put(&database, "check_test/big", 1, 1234567890, big_value,
+						sizeof(big_value));
+	}
+	ok(file_size(path) < 2 * NP_STATE_DB_COMPACTION_THRESHOLD + 1024 * 1024,
+	   "Outdated records are removed automatically");
+	np_state_db_close(&database);
+
+	/* A damaged record is skipped instead of being returned */
+	database = np_state_db_open(path);
+	np_state_db_put(&database, "check_test/damaged", 1, 1234567890, "intact", 6);
+	np_state_db_close(&database);
+	FILE *damage = fopen(path, "r+");
+	fseek(damage, -2, SEEK_END);
+	fputc('X', damage);
+	fclose(damage);
+	database = np_state_db_open(path);
+	ok(np_state_db_get(&database, "check_test/damaged").errorcode == ERROR,
+	   "Damaged record is ignored");
+	np_state_db_close(&database);
+	unlink(path);
+
+	/* A file which is not a database is left alone */
+	FILE *foreign = fopen(path, "w");
+	fputs("not a state database, but somebody's data", foreign);
+	fclose(foreign);
+	off_t foreign_size = file_size(path);
+	database = np_state_db_open(path);
+	ok(np_state_db_put(&database, "check_test/key", 1, 1234567890, "value", 5) == ERROR &&
+		   file_size(path) == foreign_size,
+	   "Unusable file is not overwritten");
+	np_state_db_close(&database);
+	unlink(path);
+
+	/* np_state with the database backend */
+	setenv("MP_STATE_PATH", "var", 1);
+	setenv("MP_STATE_BACKEND", "database", 1);
+	state_key enabled_key = np_enable_state("database_key", 5, "check_test", argc, argv);
+	ok(np_state_read(enabled_key) == NULL, "No state for a missing key");
+	np_state_write_string(enabled_key, 1234567890, "String to read");
+	state_data *state = np_state_read(enabled_key);
+	ok(state != NULL && state->errorcode == OK && state->time == 1234567890 &&
+		   state->length == 14 && !strcmp(state->data, "String to read"),
+	   "State read back from the database");
+	enabled_key.data_version = 4;
+	state = np_state_read(enabled_key);
+	ok(state != NULL && state->errorcode == ERROR, "Other data version is rejected");
+	enabled_key.data_version = 5;
+	np_state_write_string(enabled_key, time(NULL) + 3600, "future");
+	state = np_state_read(enabled_key);
+	ok(state != NULL && state->errorcode == ERROR, "Timestamp in the future is rejected");
+
+	double database_latency = write_latency(enabled_key);
+	unsetenv("MP_STATE_BACKEND");
+	double file_latency = write_latency(enabled_key);
+	diag("Average write: %.1f us with a file per key, %.1f us with the database",
+		 file_latency * 1e6, database_latency * 1e6);
+
+	char *database_filename = NULL;
+	asprintf(&database_filename, "var/%lu/%s", (unsigned long)geteuid(), NP_STATE_DB_FILENAME);
+	unlink(database_filename);
+	unlink(enabled_key._filename);
+	char *directory = NULL;
+	asprintf(&directory, "var/%lu/check_test", (unsigned long)geteuid());
+	rmdir(directory);
+	asprintf(&directory, "var/%lu", (unsigned long)geteuid());
+	rmdir(directory);
+
+	return exit_status();
+}
@@ -0,0 +1,6 @@
+#!/usr/bin/perl
+use Test::More;
+if (! -e "./test_state_db") {
+	plan skip_all => "./test_state_db not compiled - please enable libtap library to test";
+}
+exec "./test_state_db";
@@ -21,7 +21,7 @@
 #include "tap.h"
 
 int main(void) {
-	plan_tests(9);
+	plan_tests(16);
 
 	char **server_expect;
 	const int server_expect_count = 3;
@@ -56,5 +56,83 @@ int main(void) {
 	ok(np_expect_match("XX XX", server_expect, server_expect_count, NP_MATCH_ALL) == NP_MATCH_RETRY,
 	   "Test not matching any string (testing all)");
 
+	/* The streaming matcher gives the result of np_expect_match() for the data so far */
+	const char *inputs[] = {"AA bb CC XX", "bb AA CC XX", "b",           "XX bb AA CC XX",
+							"XX CC XX",    "XX",          "XX AA bb CC", "XX bb CC XX",
+							"CbbAAC",      "",            "C"};
+	const int input_count = sizeof(inputs) / sizeof(inputs[0]);
+	const int flag_sets[] = {0, NP_MATCH_EXACT, NP_MATCH_ALL, NP_MATCH_EXACT | NP_MATCH_ALL};
+	bool same_results = true;
+	for (int i = 0; i < input_count; i++) {
+		for (int j = 0; j < 4; j++) {
+			np_expect_matcher matcher =
+				np_expect_matcher_init(server_expect, server_expect_count, flag_sets[j]);
+			enum np_match_result result =
+				np_expect_matcher_feed(&matcher, inputs[i], strlen(inputs[i]));
+			same_results = same_results &&
+						   result == np_expect_match((char *)inputs[i], server_expect,
+													 server_expect_count, flag_sets[j]);
+			np_expect_matcher_free(&matcher);
+		}
+	}
+	ok(same_results, "Streaming matcher agrees with np_expect_match");
+
+	/* Every split into two chunks must give the same result as one chunk */
+	char *overlapping[] = {"he", "she", "hers", "his"};
+	const char *text = "ushers and his";
+	bool splits_agree = true;
+	for (size_t split = 0; split <= strlen(text); split++) {
+		for (int j = 0; j < 4; j++) {
+			np_expect_matcher matcher = np_expect_matcher_init(overlapping, 4, flag_sets[j]);
+			enum np_match_result first = np_expect_matcher_feed(&matcher, text, split);
+			char prefix[32];
+			snprintf(prefix, sizeof(prefix), "%.*s", (int)split, text);
+			splits_agree = splits_agree && first == np_expect_match(prefix, overlapping, 4,
+																	flag_sets[j]);
+			if (first == NP_MATCH_RETRY) {
+				enum np_match_result second =
+					np_expect_matcher_feed(&matcher, text + split, strlen(text) - split);
+				splits_agree = splits_agree && second == np_expect_match((char *)text,
+																		 overlapping, 4,
+																		 flag_sets[j]);
+			}
+			np_expect_matcher_free(&matcher);
+		}
+	}
+	ok(splits_agree, "Results agree for every chunk boundary");
+
+	np_expect_matcher matcher = np_expect_matcher_init(overlapping, 4, NP_MATCH_ALL);
+	ok(np_expect_matcher_feed(&matcher, "us", 2) == NP_MATCH_RETRY &&
+		   np_expect_matcher_feed(&matcher, "he", 2) == NP_MATCH_RETRY &&
+		   np_expect_matcher_feed(&matcher, "rs h", 4) == NP_MATCH_RETRY &&
+		   np_expect_matcher_feed(&matcher, "i", 1) == NP_MATCH_RETRY &&
+		   np_expect_matcher_feed(&matcher, "s", 1) == NP_MATCH_SUCCESS,
+	   "Expect strings split over several chunks are found");
+	np_expect_matcher_free(&matcher);
+
+	matcher = np_expect_matcher_init(server_expect, server_expect_count, NP_MATCH_EXACT);
+	ok(np_expect_matcher_feed(&matcher, "b", 1) == NP_MATCH_RETRY &&
+		   np_expect_matcher_feed(&matcher, "b", 1) == NP_MATCH_SUCCESS,
+	   "Expect string at the beginning split over two chunks");
+	np_expect_matcher_free(&matcher);
+
+	matcher = np_expect_matcher_init(server_expect, server_expect_count, NP_MATCH_EXACT);
+	ok(np_expect_matcher_feed(&matcher, "X", 1) == NP_MATCH_FAILURE &&
+		   np_expect_matcher_feed(&matcher, "AA", 2) == NP_MATCH_FAILURE,
+	   "No match at the beginning stays a failure");
+	np_expect_matcher_free(&matcher);
+
+	/* Data with a NUL Byte does not hide an expect string behind it */
+	matcher = np_expect_matcher_init(server_expect, server_expect_count, 0);
+	ok(np_expect_matcher_feed(&matcher, "XX\0CC", 5) == NP_MATCH_SUCCESS,
+	   "Expect string after a NUL Byte");
+	np_expect_matcher_free(&matcher);
+
+	char *empty[] = {""};
+	matcher = np_expect_matcher_init(empty, 1, NP_MATCH_EXACT);
+	ok(np_expect_matcher_feed(&matcher, "", 0) == NP_MATCH_SUCCESS,
+	   "Empty expect string matches right away");
+	np_expect_matcher_free(&matcher);
+
 	return exit_status();
 }
@@ -0,0 +1,371 @@
+/*****************************************************************************
+ *
+ * utils_meminfo.c
+ *
+ * License: GPL
+ * Copyright (c) 2025 Monitoring Plugins Development Team
+ *
+ * Parser for /proc/meminfo and /proc/swaps, shared by check_swap and
+ * check_memory
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "../plugins/common.h"
+#include "utils_meminfo.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef struct {
+	const char *name;
+	size_t name_length;
+	size_t offset;
+	mp_meminfo_field field;
+} meminfo_key;
+
+#define MEMINFO_KEY(NAME, MEMBER, FIELD)                                                           \
+	{NAME, sizeof(NAME) - 1, offsetof(mp_meminfo, MEMBER), FIELD}
+
+static const meminfo_key meminfo_keys[] = {
+	MEMINFO_KEY("MemTotal", mem_total, MP_MEMINFO_MEM_TOTAL),
+	MEMINFO_KEY("MemFree", mem_free, MP_MEMINFO_MEM_FREE),
+	MEMINFO_KEY("MemAvailable", mem_available, MP_MEMINFO_MEM_AVAILABLE),
+	MEMINFO_KEY("Buffers", buffers, MP_MEMINFO_BUFFERS),
+	MEMINFO_KEY("Cached", cached, MP_MEMINFO_CACHED),
+	MEMINFO_KEY("SwapCached", swap_cached, MP_MEMINFO_SWAP_CACHED),
+	MEMINFO_KEY("Active", active, MP_MEMINFO_ACTIVE),
+	MEMINFO_KEY("Inactive", inactive, MP_MEMINFO_INACTIVE),
+	MEMINFO_KEY("SwapTotal", swap_total, MP_MEMINFO_SWAP_TOTAL),
+	MEMINFO_KEY("SwapFree", swap_free, MP_MEMINFO_SWAP_FREE),
+	MEMINFO_KEY("Dirty", dirty, MP_MEMINFO_DIRTY),
+	MEMINFO_KEY("Writeback", writeback, MP_MEMINFO_WRITEBACK),
+	MEMINFO_KEY("Shmem", shmem, MP_MEMINFO_SHMEM),
+	MEMINFO_KEY("Slab", slab, MP_MEMINFO_SLAB),
+	MEMINFO_KEY("SReclaimable", s_reclaimable, MP_MEMINFO_SRECLAIMABLE),
+	MEMINFO_KEY("SUnreclaim", s_unreclaim, MP_MEMINFO_SUNRECLAIM),
+	MEMINFO_KEY("CommitLimit", commit_limit, MP_MEMINFO_COMMIT_LIMIT),
+	MEMINFO_KEY("Committed_AS", committed_as, MP_MEMINFO_COMMITTED_AS),
+	MEMINFO_KEY("HugePages_Total", hugepages_total, MP_MEMINFO_HUGEPAGES_TOTAL),
+	MEMINFO_KEY("HugePages_Free", hugepages_free, MP_MEMINFO_HUGEPAGES_FREE),
+	MEMINFO_KEY("HugePages_Rsvd", hugepages_rsvd, MP_MEMINFO_HUGEPAGES_RSVD),
+	MEMINFO_KEY("HugePages_Surp", hugepages_surp, MP_MEMINFO_HUGEPAGES_SURP),
+	MEMINFO_KEY("Hugepagesize", hugepagesize, MP_MEMINFO_HUGEPAGESIZE),
+};
+
+#define MEMINFO_KEY_COUNT (sizeof(meminfo_keys) / sizeof(meminfo_keys[0]))
+
+static const char *skip_blanks(const char *position, const char *end) {
+	while (position < end && (*position == ' ' || *position == '\t')) {
+		position++;
+	}
+	return position;
+}
+
+/*
+ * Parses an unsigned decimal number at position, returns the position after
+ * the last digit or position itself if there was no digit
+ */
+static const char *parse_number(const char *position, const char *end, uint64_t *value) {
+	uint64_t result = 0;
+	while (position < end && *position >= '0' && *position <= '9') {
+		result = (result * 10) + (uint64_t)(*position - '0');
+		position++;
+	}
+	*value = result;
+	return position;
+}
+
+static void parse_meminfo_line(mp_meminfo *meminfo, const char *line, const char *line_end) {
+	const char *colon = memchr(line, ':', (size_t)(line_end - line));
+	if (colon == NULL) {
+		return;
+	}
+	size_t key_length = (size_t)(colon - line);
+
+	const char *position = skip_blanks(colon + 1, line_end);
+	uint64_t value;
+	const char *number_end = parse_number(position, line_end, &value);
+	if (number_end == position) {
+		return;
+	}
+
+	if (key_length == 4 && memcmp(line, "Swap", 4) == 0) {
+		/* "Swap: total used free", already in Bytes */
+		uint64_t used;
+		uint64_t free;
+		position = skip_blanks(number_end, line_end);
+		const char *used_end = parse_number(position, line_end, &used);
+		if (used_end == position) {
+			return;
+		}
+		position = skip_blanks(used_end, line_end);
+		if (parse_number(position, line_end, &free) == position) {
+			return;
+		}
+		meminfo->swap_summary_total = value;
+		meminfo->swap_summary_used = used;
+		meminfo->swap_summary_free = free;
+		meminfo->present |= MP_MEMINFO_SWAP_SUMMARY;
+		return;
+	}
+
+	for (size_t i = 0; i < MEMINFO_KEY_COUNT; i++) {
+		if (meminfo_keys[i].name_length != key_length ||
+			memcmp(meminfo_keys[i].name, line, key_length) != 0) {
+			continue;
+		}
+
+		position = skip_blanks(number_end, line_end);
+		if (line_end - position >= 2 && position[0] == 'k' && position[1] == 'B') {
+			value *= 1024;
+		}
+
+		*(uint64_t *)((char *)meminfo + meminfo_keys[i].offset) = value;
+		meminfo->present |= (uint32_t)meminfo_keys[i].field;
+		return;
+	}
+}
+
+/*
+ * Parses the content of /proc/meminfo in one pass. Unknown keys are skipped,
+ * the fields which were found are flagged in meminfo.present.
+ */
+mp_meminfo_result mp_meminfo_parse(const char *buffer, size_t length) {
+	mp_meminfo_result result = {
+		.errorcode = OK,
+		.meminfo = {0},
+	};
+
+	const char *position = buffer;
+	const char *end = buffer + length;
+	while (position < end) {
+		const char *line_end = memchr(position, '\n', (size_t)(end - position));
+		if (line_end == NULL) {
+			line_end = end;
+		}
+		parse_meminfo_line(&result.meminfo, position, line_end);
+		position = line_end + 1;
+	}
+
+	if (result.meminfo.present == 0) {
+		result.errorcode = ERROR;
+	}
+	return result;
+}
+
+/*
+ * Reads a small proc file into buffer, returns the number of Bytes read or
+ * -1 on error. The size of a proc file is not known beforehand, so read until
+ * EOF or until the buffer is full.
+ */
+static ssize_t read_proc_file(const char *path, char *buffer, size_t buffer_size) {
+	int file_descriptor = open(path, O_RDONLY);
+	if (file_descriptor < 0) {
+		return -1;
+	}
+
+	size_t buffer_used = 0;
+	while (buffer_used < buffer_size) {
+		ssize_t read_result =
+			read(file_descriptor, buffer + buffer_used, buffer_size - buffer_used);
+		if (read_result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			close(file_descriptor);
+			return -1;
+		}
+		if (read_result == 0) {
+			break;
+		}
+		buffer_used += (size_t)read_result;
+	}
+
+	close(file_descriptor);
+	return (ssize_t)buffer_used;
+}
+
+/*
+ * A truncated last line would yield a wrong value, so only complete lines are
+ * passed on if the buffer was filled completely
+ */
+static size_t complete_lines_length(const char *buffer, size_t length, size_t buffer_size) {
+	if (length < buffer_size) {
+		return length;
+	}
+	while (length > 0 && buffer[length - 1] != '\n') {
+		length--;
+	}
+	return length;
+}
+
+mp_meminfo_result mp_meminfo_read(const char *path) {
+	char buffer[MP_MEMINFO_BUFFER_SIZE];
+
+	ssize_t length = read_proc_file(path, buffer, sizeof(buffer));
+	if (length < 0) {
+		mp_meminfo_result result = {
+			.errorcode = ERROR,
+		};
+		return result;
+	}
+
+	return mp_meminfo_parse(buffer,
+							complete_lines_length(buffer, (size_t)length, sizeof(buffer)));
+}
+
+/*
+ * Finds the next whitespace separated field of a line, returns the position
+ * after it or NULL if there was none
+ */
+static const char *next_field(const char *position, const char *line_end, const char **field,
+							  size_t *field_length) {
+	position = skip_blanks(position, line_end);
+	if (position == line_end) {
+		return NULL;
+	}
+	*field = position;
+	while (position < line_end && *position != ' ' && *position != '\t') {
+		position++;
+	}
+	*field_length = (size_t)(position - *field);
+	return position;
+}
+
+/* The kernel escapes blanks in the file name of a swap file as octal \040 */
+static char *unescape_swap_filename(const char *field, size_t field_length) {
+	char *result = malloc(field_length + 1);
+	if (result == NULL) {
+		die(STATE_UNKNOWN, _("Could not allocate memory for swap device name\n"));
+	}
+
+	size_t result_length = 0;
+	for (size_t i = 0; i < field_length; i++) {
+		if (field[i] == '\\' && i + 3 < field_length && field[i + 1] >= '0' &&
+			field[i + 1] <= '3' && field[i + 2] >= '0' && field[i + 2] <= '7' &&
+			field[i + 3] >= '0' && field[i + 3] <= '7') {
+			result[result_length++] =
+				(char)(((field[i + 1] - '0') << 6) | ((field[i + 2] - '0') << 3) |
+					   (field[i + 3] - '0'));
+			i += 3;
+		} else {
+			result[result_length++] = field[i];
+		}
+	}
+	result[result_length] = '\0';
+	return result;
+}
+
+/*
+ * Parses the content of /proc/swaps, the first line is the table header:
+ * Filename  Type  Size  Used  Priority
+ */
+mp_swaps_result mp_swaps_parse(const char *buffer, size_t length) {
+	mp_swaps_result result = {
+		.errorcode = OK,
+		.count = 0,
+		.devices = NULL,
+	};
+
+	const char *end = buffer + length;
+	const char *position = memchr(buffer, '\n', length);
+	if (position == NULL) {
+		result.errorcode = ERROR;
+		return result;
+	}
+	position++;
+
+	size_t allocated = 0;
+	while (position < end) {
+		const char *line_end = memchr(position, '\n', (size_t)(end - position));
+		if (line_end == NULL) {
+			line_end = end;
+		}
+		const char *line = position;
+		position = line_end + 1;
+
+		const char *name;
+		size_t name_length;
+		const char *type;
+		size_t type_length;
+		const char *field;
+		size_t field_length;
+		uint64_t size;
+		uint64_t used;
+
+		const char *cursor = next_field(line, line_end, &name, &name_length);
+		if (cursor == NULL ||
+			(cursor = next_field(cursor, line_end, &type, &type_length)) == NULL ||
+			(cursor = next_field(cursor, line_end, &field, &field_length)) == NULL ||
+			parse_number(field, field + field_length, &size) != field + field_length ||
+			(cursor = next_field(cursor, line_end, &field, &field_length)) == NULL ||
+			parse_number(field, field + field_length, &used) != field + field_length) {
+			continue;
+		}
+
+		int priority = 0;
+		if (next_field(cursor, line_end, &field, &field_length) != NULL) {
+			priority = (int)strtol(field, NULL, 10);
+		}
+
+		if (result.count == allocated) {
+			allocated = allocated == 0 ? 4 : allocated * 2;
+			mp_swap_device *devices = realloc(result.devices, allocated * sizeof(mp_swap_device));
+			if (devices == NULL) {
+				die(STATE_UNKNOWN, _("Could not allocate memory for swap devices\n"));
+			}
+			result.devices = devices;
+		}
+
+		mp_swap_device *device = &result.devices[result.count++];
+		device->filename = unescape_swap_filename(name, name_length);
+		if (type_length >= sizeof(device->type)) {
+			type_length = sizeof(device->type) - 1;
+		}
+		memcpy(device->type, type, type_length);
+		device->type[type_length] = '\0';
+		/* sizes are in kB */
+		device->size = size * 1024;
+		device->used = used * 1024;
+		device->priority = priority;
+	}
+
+	return result;
+}
+
+mp_swaps_result mp_swaps_read(const char *path) {
+	char buffer[MP_MEMINFO_BUFFER_SIZE];
+
+	ssize_t length = read_proc_file(path, buffer, sizeof(buffer));
+	if (length < 0) {
+		mp_swaps_result result = {
+			.errorcode = ERROR,
+		};
+		return result;
+	}
+
+	return mp_swaps_parse(buffer, complete_lines_length(buffer, (size_t)length, sizeof(buffer)));
+}
+
+void mp_swaps_free(mp_swaps_result *swaps) {
+	for (size_t i = 0; i < swaps->count; i++) {
+		free(swaps->devices[i].filename);
+	}
+	free(swaps->devices);
+	swaps->devices = NULL;
+	swaps->count = 0;
+}
@@ -0,0 +1,119 @@
+#pragma once
+/* Header file for the /proc/meminfo and /proc/swaps parser in utils_meminfo.c */
+
+#include "../config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MP_PROC_MEMINFO
+#	define MP_PROC_MEMINFO "/proc/meminfo"
+#endif
+
+#ifndef MP_PROC_SWAPS
+#	define MP_PROC_SWAPS "/proc/swaps"
+#endif
+
+/* Both files are read with a single read() into a buffer of this size on the stack */
+#define MP_MEMINFO_BUFFER_SIZE 8192
+
+/*
+ * Flags for the fields of mp_meminfo, set in mp_meminfo.present if the
+ * corresponding line was found
+ */
+typedef enum {
+	MP_MEMINFO_MEM_TOTAL = 1 << 0,
+	MP_MEMINFO_MEM_FREE = 1 << 1,
+	MP_MEMINFO_MEM_AVAILABLE = 1 << 2,
+	MP_MEMINFO_BUFFERS = 1 << 3,
+	MP_MEMINFO_CACHED = 1 << 4,
+	MP_MEMINFO_SWAP_CACHED = 1 << 5,
+	MP_MEMINFO_ACTIVE = 1 << 6,
+	MP_MEMINFO_INACTIVE = 1 << 7,
+	MP_MEMINFO_SWAP_TOTAL = 1 << 8,
+	MP_MEMINFO_SWAP_FREE = 1 << 9,
+	MP_MEMINFO_DIRTY = 1 << 10,
+	MP_MEMINFO_WRITEBACK = 1 << 11,
+	MP_MEMINFO_SHMEM = 1 << 12,
+	MP_MEMINFO_SLAB = 1 << 13,
+	MP_MEMINFO_SRECLAIMABLE = 1 << 14,
+	MP_MEMINFO_SUNRECLAIM = 1 << 15,
+	MP_MEMINFO_COMMIT_LIMIT = 1 << 16,
+	MP_MEMINFO_COMMITTED_AS = 1 << 17,
+	MP_MEMINFO_HUGEPAGES_TOTAL = 1 << 18,
+	MP_MEMINFO_HUGEPAGES_FREE = 1 << 19,
+	MP_MEMINFO_HUGEPAGES_RSVD = 1 << 20,
+	MP_MEMINFO_HUGEPAGES_SURP = 1 << 21,
+	MP_MEMINFO_HUGEPAGESIZE = 1 << 22,
+	/* "Swap: total used free" summary line, e.g. on NetBSD */
+	MP_MEMINFO_SWAP_SUMMARY = 1 << 23,
+} mp_meminfo_field;
+
+/*
+ * Contents of /proc/meminfo. Sizes are in Bytes, the HugePages_* values are
+ * numbers of pages.
+ */
+typedef struct {
+	uint32_t present; /* mp_meminfo_field flags */
+
+	uint64_t mem_total;
+	uint64_t mem_free;
+	uint64_t mem_available;
+	uint64_t buffers;
+	uint64_t cached;
+	uint64_t swap_cached;
+	uint64_t active;
+	uint64_t inactive;
+	uint64_t swap_total;
+	uint64_t swap_free;
+	uint64_t dirty;
+	uint64_t writeback;
+	uint64_t shmem;
+	uint64_t slab;
+	uint64_t s_reclaimable;
+	uint64_t s_unreclaim;
+	uint64_t commit_limit;
+	uint64_t committed_as;
+	uint64_t hugepages_total;
+	uint64_t hugepages_free;
+	uint64_t hugepages_rsvd;
+	uint64_t hugepages_surp;
+	uint64_t hugepagesize;
+
+	uint64_t swap_summary_total;
+	uint64_t swap_summary_used;
+	uint64_t swap_summary_free;
+} mp_meminfo;
+
+typedef struct {
+	int errorcode;
+	mp_meminfo meminfo;
+} mp_meminfo_result;
+
+mp_meminfo_result mp_meminfo_parse(const char *buffer, size_t length);
+mp_meminfo_result mp_meminfo_read(const char *path);
+
+static inline bool mp_meminfo_has(const mp_meminfo *meminfo, mp_meminfo_field field) {
+	return (meminfo->present & (uint32_t)field) == (uint32_t)field;
+}
+
+/*
+ * One line of /proc/swaps, sizes in Bytes
+ */
+typedef struct {
+	char *filename;
+	char type[16];
+	uint64_t size;
+	uint64_t used;
+	int priority;
+} mp_swap_device;
+
+typedef struct {
+	int errorcode;
+	size_t count;
+	mp_swap_device *devices;
+} mp_swaps_result;
+
+mp_swaps_result mp_swaps_parse(const char *buffer, size_t length);
+mp_swaps_result mp_swaps_read(const char *path);
+void mp_swaps_free(mp_swaps_result *swaps);
@@ -0,0 +1,467 @@
+/*****************************************************************************
+ *
+ * utils_state.c
+ *
+ * License: GPL
+ * Copyright (c) 2006 - 2024 Monitoring Plugins Development Team
+ *
+ * State retention for plugins which need data of previous runs
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "../plugins/common.h"
+#include "utils_base.h"
+#include "utils_state.h"
+#include "utils_state_db.h"
+#include <ctype.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+char *_np_state_generate_key(int argc, char **argv);
+char *_np_state_calculate_location_prefix(void);
+
+/*
+ * Creates the missing parent directories of a state file.
+ * Will die with UNKNOWN if errors
+ */
+void np_state_create_directories(const char *filename) {
+	if (access(filename, F_OK) == 0) {
+		return;
+	}
+
+	char *directories = strdup(filename);
+	if (directories == NULL) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+
+	for (char *p = directories + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			if ((access(directories, F_OK) != 0) && (mkdir(directories, S_IRWXU) != 0)) {
+				/* Can't free this! Otherwise error message is wrong! */
+				/* np_free(directories); */
+				die(STATE_UNKNOWN, _("Cannot create directory: %s"), directories);
+			}
+			*p = '/';
+		}
+	}
+
+	free(directories);
+}
+
+/*
+ * Internal function. The shared state database instead of one file per key
+ * is selected with MP_STATE_BACKEND=database, except for setuid plugins.
+ */
+static bool _np_state_use_database(void) {
+	if (mp_suid()) {
+		return false;
+	}
+
+	char *backend = getenv("MP_STATE_BACKEND");
+	return backend != NULL && strcmp(backend, "database") == 0;
+}
+
+/* All plugins of a user share one database next to their state files */
+char *np_state_database_filename(void) {
+	char *result = NULL;
+	if (asprintf(&result, "%s/%lu/%s", _np_state_calculate_location_prefix(),
+				 (unsigned long)geteuid(), NP_STATE_DB_FILENAME) < 0) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+	return result;
+}
+
+static char *_np_state_database_key(state_key stateKey) {
+	char *result = NULL;
+	if (asprintf(&result, "%s/%s", stateKey.plugin_name, stateKey.name) < 0) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+	return result;
+}
+
+static void _np_state_database_write(state_key stateKey, time_t timestamp, char *stringToStore) {
+	char *filename = np_state_database_filename();
+	char *key = _np_state_database_key(stateKey);
+
+	np_state_db database = np_state_db_open(filename);
+	if (np_state_db_put(&database, key, stateKey.data_version, timestamp, stringToStore,
+						strlen(stringToStore)) != OK) {
+		die(STATE_UNKNOWN, _("Cannot write state database %s"), filename);
+	}
+
+	np_state_db_close(&database);
+	free(key);
+	free(filename);
+}
+
+/* Same semantics as the file backend: NULL if there is no data, ERROR if it is unusable */
+static state_data *_np_state_database_read(state_key stateKey) {
+	char *filename = np_state_database_filename();
+	char *key = _np_state_database_key(stateKey);
+
+	np_state_db database = np_state_db_open(filename);
+	np_state_db_entry entry = np_state_db_get(&database, key);
+	np_state_db_close(&database);
+	free(key);
+	free(filename);
+
+	if (entry.errorcode != OK) {
+		return NULL;
+	}
+
+	state_data *result = (state_data *)calloc(1, sizeof(state_data));
+	if (result == NULL) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+
+	time_t current_time;
+	time(&current_time);
+	if (entry.data_version != stateKey.data_version || entry.time > current_time) {
+		free(entry.data);
+		result->errorcode = ERROR;
+		return result;
+	}
+
+	result->time = entry.time;
+	result->data = entry.data;
+	result->length = entry.length;
+	result->errorcode = OK;
+	return result;
+}
+
+/*
+ * If time=NULL, use current time. Create state file, with state format
+ * version, default text. Writes version, time, and data. Avoid locking
+ * problems - use mv to write and then swap. Possible loss of state data if
+ * two things writing to same key at same time.
+ * Will die with UNKNOWN if errors
+ */
+void np_state_write_string(state_key stateKey, time_t timestamp, char *stringToStore) {
+	time_t current_time;
+	if (timestamp == 0) {
+		time(&current_time);
+	} else {
+		current_time = timestamp;
+	}
+
+	if (_np_state_use_database()) {
+		_np_state_database_write(stateKey, current_time, stringToStore);
+		return;
+	}
+
+	int result = 0;
+
+	/* If file doesn't currently exist, create directories */
+	np_state_create_directories(stateKey._filename);
+
+	char *temp_file = NULL;
+	result = asprintf(&temp_file, "%s.XXXXXX", stateKey._filename);
+	if (result < 0) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+
+	int temp_file_desc = 0;
+	if ((temp_file_desc = mkstemp(temp_file)) == -1) {
+		if (temp_file) {
+			free(temp_file);
+		}
+		die(STATE_UNKNOWN, _("Cannot create temporary filename"));
+	}
+
+	FILE *temp_file_pointer = fdopen(temp_file_desc, "w");
+	if (temp_file_pointer == NULL) {
+		close(temp_file_desc);
+		unlink(temp_file);
+		if (temp_file) {
+			free(temp_file);
+		}
+		die(STATE_UNKNOWN, _("Unable to open temporary state file"));
+	}
+
+	fprintf(temp_file_pointer, "# NP State file\n");
+	fprintf(temp_file_pointer, "%d\n", NP_STATE_FORMAT_VERSION);
+	fprintf(temp_file_pointer, "%d\n", stateKey.data_version);
+	fprintf(temp_file_pointer, "%lu\n", current_time);
+	fprintf(temp_file_pointer, "%s\n", stringToStore);
+
+	fchmod(temp_file_desc, S_IRUSR | S_IWUSR | S_IRGRP);
+
+	fflush(temp_file_pointer);
+
+	result = fclose(temp_file_pointer);
+
+	fsync(temp_file_desc);
+
+	if (result != 0) {
+		unlink(temp_file);
+		if (temp_file) {
+			free(temp_file);
+		}
+		die(STATE_UNKNOWN, _("Error writing temp file"));
+	}
+
+	if (rename(temp_file, stateKey._filename) != 0) {
+		unlink(temp_file);
+		if (temp_file) {
+			free(temp_file);
+		}
+		die(STATE_UNKNOWN, _("Cannot rename state temp file"));
+	}
+
+	if (temp_file) {
+		free(temp_file);
+	}
+}
+
+/*
+ * Read the state file
+ */
+bool _np_state_read_file(FILE *state_file, state_key stateKey) {
+	time_t current_time;
+	time(&current_time);
+
+	char *line = NULL;
+	size_t line_buffer_size = 0;
+
+	bool status = false;
+	enum {
+		STATE_FILE_VERSION,
+		STATE_DATA_VERSION,
+		STATE_DATA_TIME,
+		STATE_DATA_TEXT,
+		STATE_DATA_END
+	} expected = STATE_FILE_VERSION;
+
+	int failure = 0;
+	ssize_t line_length;
+	while (!failure && (line_length = getline(&line, &line_buffer_size, state_file)) > 0) {
+		if (line[line_length - 1] == '\n') {
+			line[line_length - 1] = '\0';
+		}
+
+		if (line[0] == '#') {
+			continue;
+		}
+
+		switch (expected) {
+		case STATE_FILE_VERSION: {
+			int i = atoi(line);
+			if (i != NP_STATE_FORMAT_VERSION) {
+				failure++;
+			} else {
+				expected = STATE_DATA_VERSION;
+			}
+		} break;
+		case STATE_DATA_VERSION: {
+			int i = atoi(line);
+			if (i != stateKey.data_version) {
+				failure++;
+			} else {
+				expected = STATE_DATA_TIME;
+			}
+		} break;
+		case STATE_DATA_TIME: {
+			/* If time > now, error */
+			time_t data_time = strtoul(line, NULL, 10);
+			if (data_time > current_time) {
+				failure++;
+			} else {
+				stateKey.state_data->time = data_time;
+				expected = STATE_DATA_TEXT;
+			}
+		} break;
+		case STATE_DATA_TEXT:
+			stateKey.state_data->data = strdup(line);
+			if (stateKey.state_data->data == NULL) {
+				die(STATE_UNKNOWN, _("Cannot execute strdup: %s"), strerror(errno));
+			}
+			stateKey.state_data->length = strlen(line);
+			expected = STATE_DATA_END;
+			status = true;
+			break;
+		case STATE_DATA_END:;
+		}
+	}
+
+	if (line) {
+		free(line);
+	}
+	return status;
+}
+/*
+ * Will return NULL if no data is available (first run). If key currently
+ * exists, read data. If state file format version is not expected, return
+ * as if no data. Get state data version number and compares to expected.
+ * If numerically lower, then return as no previous state. die with UNKNOWN
+ * if exceptional error.
+ */
+state_data *np_state_read(state_key stateKey) {
+	if (_np_state_use_database()) {
+		return _np_state_database_read(stateKey);
+	}
+
+	/* Open file. If this fails, no previous state found */
+	FILE *statefile = fopen(stateKey._filename, "r");
+	state_data *this_state_data = (state_data *)calloc(1, sizeof(state_data));
+	if (statefile != NULL) {
+
+		if (this_state_data == NULL) {
+			die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+		}
+
+		this_state_data->data = NULL;
+		stateKey.state_data = this_state_data;
+
+		if (_np_state_read_file(statefile, stateKey)) {
+			this_state_data->errorcode = OK;
+		} else {
+			this_state_data->errorcode = ERROR;
+		}
+
+		fclose(statefile);
+	} else {
+		// Failed to open state file
+		this_state_data->errorcode = ERROR;
+	}
+
+	return stateKey.state_data;
+}
+
+/*
+ * Internal function. Returns either:
+ *   envvar NAGIOS_PLUGIN_STATE_DIRECTORY
+ *   statically compiled shared state directory
+ */
+char *_np_state_calculate_location_prefix(void) {
+	char *env_dir;
+
+	/* Do not allow passing MP_STATE_PATH in setuid plugins
+	 * for security reasons */
+	if (!mp_suid()) {
+		env_dir = getenv("MP_STATE_PATH");
+		if (env_dir && env_dir[0] != '\0') {
+			return env_dir;
+		}
+		/* This is the former ENV, for backward-compatibility */
+		env_dir = getenv("NAGIOS_PLUGIN_STATE_DIRECTORY");
+		if (env_dir && env_dir[0] != '\0') {
+			return env_dir;
+		}
+	}
+
+	return NP_STATE_DIR_PREFIX;
+}
+
+/*
+ * Initiatializer for state routines.
+ * Sets variables. Generates filename. Returns np_state_key. die with
+ * UNKNOWN if exception
+ */
+state_key np_enable_state(char *keyname, int expected_data_version, const char *plugin_name,
+						  int argc, char **argv) {
+	state_key *this_state = (state_key *)calloc(1, sizeof(state_key));
+	if (this_state == NULL) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+
+	char *temp_keyname = NULL;
+	if (keyname == NULL) {
+		temp_keyname = _np_state_generate_key(argc, argv);
+	} else {
+		temp_keyname = strdup(keyname);
+		if (temp_keyname == NULL) {
+			die(STATE_UNKNOWN, _("Cannot execute strdup: %s"), strerror(errno));
+		}
+	}
+
+	/* Die if invalid characters used for keyname */
+	char *tmp_char = temp_keyname;
+	while (*tmp_char != '\0') {
+		if (!(isalnum(*tmp_char) || *tmp_char == '_')) {
+			die(STATE_UNKNOWN, _("Invalid character for keyname - only alphanumerics or '_'"));
+		}
+		tmp_char++;
+	}
+	this_state->name = temp_keyname;
+	this_state->plugin_name = (char *)plugin_name;
+	this_state->data_version = expected_data_version;
+	this_state->state_data = NULL;
+
+	/* Calculate filename */
+	char *temp_filename = NULL;
+	int error = asprintf(&temp_filename, "%s/%lu/%s/%s", _np_state_calculate_location_prefix(),
+						 (unsigned long)geteuid(), plugin_name, this_state->name);
+	if (error < 0) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+
+	this_state->_filename = temp_filename;
+
+	return *this_state;
+}
+
+/*
+ * Returns a string to use as a keyname, based on an md5 hash of argv, thus
+ * hopefully a unique key per service/plugin invocation. Use the extra-opts
+ * parse of argv, so that uniqueness in parameters are reflected there.
+ */
+char *_np_state_generate_key(int argc, char **argv) {
+	unsigned char result[256];
+
+#ifdef MOPL_USE_OPENSSL
+	/*
+	 * This code path is chosen if openssl is available (which should be the most common
+	 * scenario). Alternatively, the gnulib implementation/
+	 *
+	 */
+	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+
+	EVP_DigestInit(ctx, EVP_sha256());
+
+	for (int i = 0; i < argc; i++) {
+		EVP_DigestUpdate(ctx, argv[i], strlen(argv[i]));
+	}
+
+	EVP_DigestFinal(ctx, result, NULL);
+#else
+
+	struct sha256_ctx ctx;
+	sha256_init_ctx(&ctx);
+
+	for (int i = 0; i < argc; i++) {
+		sha256_process_bytes(argv[i], strlen(argv[i]), &ctx);
+	}
+
+	sha256_finish_ctx(&ctx, result);
+#endif // MOPL_USE_OPENSSL
+
+	char keyname[41];
+	for (int i = 0; i < 20; ++i) {
+		sprintf(&keyname[2 * i], "%02x", result[i]);
+	}
+
+	keyname[40] = '\0';
+
+	char *keyname_copy = strdup(keyname);
+	if (keyname_copy == NULL) {
+		die(STATE_UNKNOWN, _("Cannot execute strdup: %s"), strerror(errno));
+	}
+
+	return keyname_copy;
+}
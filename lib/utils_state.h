@@ -0,0 +1,31 @@
+#pragma once
+/* Header file for the state retention routines in utils_state.c */
+
+#include "../config.h"
+#include <stddef.h>
+#include <time.h>
+
+#define NP_STATE_FORMAT_VERSION 1
+
+typedef struct state_data_struct {
+	time_t time;
+	void *data;
+	size_t length; /* Of binary data */
+	int errorcode;
+} state_data;
+
+typedef struct state_key_struct {
+	char *name;
+	char *plugin_name;
+	int data_version;
+	char *_filename;
+	state_data *state_data;
+} state_key;
+
+state_data *np_state_read(state_key stateKey);
+state_key np_enable_state(char *keyname, int expected_data_version, const char *plugin_name,
+						  int argc, char **argv);
+void np_state_write_string(state_key stateKey, time_t timestamp, char *stringToStore);
+void np_state_create_directories(const char *filename);
+/* Path of the shared state database (see utils_state_db.h), to be freed */
+char *np_state_database_filename(void);
@@ -0,0 +1,556 @@
+/*****************************************************************************
+ *
+ * utils_state_db.c
+ *
+ * License: GPL
+ * Copyright (c) 2026 Monitoring Plugins Development Team
+ *
+ * Shared state database, keeps the state of all plugins of a user in one
+ * file instead of one file per key
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "../plugins/common.h"
+#include "utils_base.h"
+#include "utils_state.h"
+#include "utils_state_db.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NP_STATE_DB_MAGIC "MPSTATDB"
+#define RECORD_ALIGNMENT  8
+
+static uint64_t hash_key(const char *key, size_t key_length) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < key_length; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/* Covers everything but next, which changes when the record is copied by the compaction */
+static uint32_t record_checksum(const np_state_db_record *record, const char *key,
+								const char *data) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const unsigned char *fields = (const unsigned char *)&record->time;
+	size_t fields_length =
+		offsetof(np_state_db_record, checksum) - offsetof(np_state_db_record, time);
+	for (size_t i = 0; i < fields_length; i++) {
+		hash = (hash ^ fields[i]) * 0x100000001b3ULL;
+	}
+	for (size_t i = 0; i < record->key_length; i++) {
+		hash = (hash ^ (unsigned char)key[i]) * 0x100000001b3ULL;
+	}
+	for (size_t i = 0; i < record->data_length; i++) {
+		hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+	}
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static size_t record_size(size_t key_length, size_t data_length) {
+	size_t size = sizeof(np_state_db_record) + key_length + data_length;
+	return (size + RECORD_ALIGNMENT - 1) & ~((size_t)RECORD_ALIGNMENT - 1);
+}
+
+static uint64_t log_start(uint32_t number_of_buckets) {
+	return sizeof(np_state_db_header) + ((uint64_t)number_of_buckets * sizeof(uint64_t));
+}
+
+static bool header_is_valid(const np_state_db_header *header, size_t file_size) {
+	return memcmp(header->magic, NP_STATE_DB_MAGIC, sizeof(header->magic)) == 0 &&
+		   header->version == NP_STATE_DB_VERSION && header->number_of_buckets > 0 &&
+		   (header->number_of_buckets & (header->number_of_buckets - 1)) == 0 &&
+		   header->log_end >= log_start(header->number_of_buckets) &&
+		   header->log_end <= file_size;
+}
+
+/*
+ * Locks the whole database. A compaction replaces the file, so after
+ * waiting for the lock the file might not be the one at path any more.
+ */
+static int lock_database(np_state_db *database, short lock_type) {
+	while (true) {
+		struct flock lock = {
+			.l_type = lock_type,
+			.l_whence = SEEK_SET,
+			.l_start = 0,
+			.l_len = 0,
+		};
+		if (fcntl(database->file_descriptor, F_SETLKW, &lock) != 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return ERROR;
+		}
+
+		struct stat locked_stat;
+		struct stat path_stat;
+		if (fstat(database->file_descriptor, &locked_stat) == 0 &&
+			stat(database->path, &path_stat) == 0 && locked_stat.st_ino == path_stat.st_ino &&
+			locked_stat.st_dev == path_stat.st_dev) {
+			return OK;
+		}
+
+		// Replaced in the meantime, closing the file releases the lock
+		close(database->file_descriptor);
+		database->file_descriptor = open(database->path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+		if (database->file_descriptor < 0) {
+			database->errorcode = ERROR;
+			return ERROR;
+		}
+	}
+}
+
+static void unlock_database(np_state_db *database) {
+	struct flock lock = {
+		.l_type = F_UNLCK,
+		.l_whence = SEEK_SET,
+		.l_start = 0,
+		.l_len = 0,
+	};
+	fcntl(database->file_descriptor, F_SETLK, &lock);
+}
+
+static int write_all(int file_descriptor, const void *buffer, size_t length, off_t offset) {
+	const unsigned char *position = buffer;
+	while (length > 0) {
+		ssize_t written = pwrite(file_descriptor, position, length, offset);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return ERROR;
+		}
+		position += written;
+		length -= (size_t)written;
+		offset += written;
+	}
+	return OK;
+}
+
+/* Writes an empty database with number_of_buckets, needs the exclusive lock */
+static int initialize_database(int file_descriptor, uint32_t number_of_buckets) {
+	if (ftruncate(file_descriptor, 0) != 0) {
+		return ERROR;
+	}
+
+	np_state_db_header header = {
+		.version = NP_STATE_DB_VERSION,
+		.number_of_buckets = number_of_buckets,
+		.log_end = log_start(number_of_buckets),
+		.live_bytes = 0,
+	};
+	memcpy(header.magic, NP_STATE_DB_MAGIC, sizeof(header.magic));
+
+	// The bucket table is zero, ftruncate fills the gap with zeros
+	if (ftruncate(file_descriptor, (off_t)header.log_end) != 0 ||
+		write_all(file_descriptor, &header, sizeof(header), 0) != OK) {
+		return ERROR;
+	}
+	return OK;
+}
+
+/* A read only mapping of the whole database, valid as long as the lock is held */
+typedef struct {
+	int errorcode;
+	unsigned char *base;
+	size_t length;
+	const np_state_db_header *header;
+	const uint64_t *buckets;
+} database_mapping;
+
+static database_mapping map_database(np_state_db *database) {
+	database_mapping result = {
+		.errorcode = ERROR,
+		.base = NULL,
+	};
+
+	struct stat file_stat;
+	if (fstat(database->file_descriptor, &file_stat) != 0 ||
+		(size_t)file_stat.st_size < sizeof(np_state_db_header)) {
+		return result;
+	}
+
+	void *base = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_SHARED,
+					  database->file_descriptor, 0);
+	if (base == MAP_FAILED) {
+		return result;
+	}
+
+	result.base = base;
+	result.length = (size_t)file_stat.st_size;
+	result.header = base;
+	if (!header_is_valid(result.header, result.length)) {
+		munmap(result.base, result.length);
+		result.base = NULL;
+		return result;
+	}
+
+	result.buckets = (const uint64_t *)(result.base + sizeof(np_state_db_header));
+	result.errorcode = OK;
+	return result;
+}
+
+static void unmap_database(database_mapping *mapping) {
+	if (mapping->base != NULL) {
+		munmap(mapping->base, mapping->length);
+	}
+	mapping->base = NULL;
+}
+
+/* Returns the record at offset or NULL if it is not a complete and intact record */
+static const np_state_db_record *get_record(const database_mapping *mapping, uint64_t offset) {
+	const np_state_db_header *header = mapping->header;
+	if (offset < log_start(header->number_of_buckets) || offset % RECORD_ALIGNMENT != 0 ||
+		offset + sizeof(np_state_db_record) > header->log_end) {
+		return NULL;
+	}
+
+	const np_state_db_record *record = (const np_state_db_record *)(mapping->base + offset);
+	if (offset + record_size(record->key_length, record->data_length) > header->log_end) {
+		return NULL;
+	}
+
+	const char *key = (const char *)(record + 1);
+	if (record_checksum(record, key, key + record->key_length) != record->checksum) {
+		return NULL;
+	}
+	return record;
+}
+
+/* Offset of the current record of key, 0 if there is none */
+static uint64_t find_record(const database_mapping *mapping, const char *key, size_t key_length,
+							uint64_t hash) {
+	uint64_t offset = mapping->buckets[hash & (mapping->header->number_of_buckets - 1)];
+	while (offset != 0) {
+		const np_state_db_record *record = get_record(mapping, offset);
+		if (record == NULL) {
+			// Broken chain, the older records are lost
+			return 0;
+		}
+
+		if (record->key_length == key_length && memcmp(record + 1, key, key_length) == 0) {
+			return offset;
+		}
+
+		// Records only link to older ones, which also ends loops in damaged files
+		if (record->next >= offset) {
+			return 0;
+		}
+		offset = record->next;
+	}
+	return 0;
+}
+
+np_state_db np_state_db_open(const char *path) {
+	np_state_db result = {
+		.errorcode = ERROR,
+		.file_descriptor = -1,
+		.path = strdup(path),
+	};
+	if (result.path == NULL) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+
+	np_state_create_directories(path);
+
+	result.file_descriptor = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+	if (result.file_descriptor < 0) {
+		return result;
+	}
+	result.errorcode = OK;
+	return result;
+}
+
+void np_state_db_close(np_state_db *database) {
+	if (database->file_descriptor >= 0) {
+		close(database->file_descriptor);
+	}
+	database->file_descriptor = -1;
+	free(database->path);
+	database->path = NULL;
+	database->errorcode = ERROR;
+}
+
+np_state_db_entry np_state_db_get(np_state_db *database, const char *key) {
+	np_state_db_entry result = {
+		.errorcode = ERROR,
+		.data = NULL,
+	};
+
+	if (database->errorcode != OK || lock_database(database, F_RDLCK) != OK) {
+		return result;
+	}
+
+	database_mapping mapping = map_database(database);
+	if (mapping.errorcode == OK) {
+		size_t key_length = strlen(key);
+		uint64_t offset = find_record(&mapping, key, key_length, hash_key(key, key_length));
+		if (offset != 0) {
+			const np_state_db_record *record =
+				(const np_state_db_record *)(mapping.base + offset);
+
+			result.data = malloc(record->data_length + 1);
+			if (result.data == NULL) {
+				die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+			}
+			memcpy(result.data, (const char *)(record + 1) + record->key_length,
+				   record->data_length);
+			result.data[record->data_length] = '\0';
+			result.length = record->data_length;
+			result.time = (time_t)record->time;
+			result.data_version = record->data_version;
+			result.errorcode = OK;
+		}
+		unmap_database(&mapping);
+	}
+
+	unlock_database(database);
+	return result;
+}
+
+/* Next power of two with room for twice the number of keys */
+static uint32_t bucket_count_for(size_t number_of_keys) {
+	uint32_t result = NP_STATE_DB_MIN_BUCKETS;
+	while (result < number_of_keys * 2 && result < (UINT32_MAX / 2) + 1) {
+		result *= 2;
+	}
+	return result;
+}
+
+/*
+ * Copies the current record of every key into a new file and replaces the
+ * database with it. Needs the exclusive lock, which is moved to the new file.
+ */
+static int compact_locked(np_state_db *database) {
+	database_mapping mapping = map_database(database);
+	if (mapping.errorcode != OK) {
+		return ERROR;
+	}
+
+	// Walk all chains, the first record of a key in its chain is the current one
+	size_t number_of_live = 0;
+	size_t capacity = 0;
+	uint64_t *live_offsets = NULL;
+	for (uint32_t bucket = 0; bucket < mapping.header->number_of_buckets; bucket++) {
+		for (uint64_t offset = mapping.buckets[bucket]; offset != 0;) {
+			const np_state_db_record *record = get_record(&mapping, offset);
+			if (record == NULL) {
+				break;
+			}
+
+			const char *key = (const char *)(record + 1);
+			uint64_t hash = hash_key(key, record->key_length);
+			if (find_record(&mapping, key, record->key_length, hash) == offset) {
+				if (number_of_live == capacity) {
+					capacity = (capacity == 0) ? 1024 : capacity * 2;
+					uint64_t *tmp = realloc(live_offsets, capacity * sizeof(uint64_t));
+					if (tmp == NULL) {
+						die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+					}
+					live_offsets = tmp;
+				}
+				live_offsets[number_of_live++] = offset;
+			}
+
+			if (record->next >= offset) {
+				break;
+			}
+			offset = record->next;
+		}
+	}
+
+	uint32_t number_of_buckets = bucket_count_for(number_of_live);
+	uint64_t *buckets = calloc(number_of_buckets, sizeof(uint64_t));
+	size_t log_length = 0;
+	for (size_t i = 0; i < number_of_live; i++) {
+		const np_state_db_record *record =
+			(const np_state_db_record *)(mapping.base + live_offsets[i]);
+		log_length += record_size(record->key_length, record->data_length);
+	}
+	unsigned char *log = malloc(log_length > 0 ? log_length : 1);
+	if (buckets == NULL || log == NULL) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+
+	uint64_t new_log_start = log_start(number_of_buckets);
+	size_t position = 0;
+	for (size_t i = 0; i < number_of_live; i++) {
+		const np_state_db_record *record =
+			(const np_state_db_record *)(mapping.base + live_offsets[i]);
+		size_t size = record_size(record->key_length, record->data_length);
+		memcpy(log + position, record, size);
+
+		const char *key = (const char *)(record + 1);
+		uint32_t bucket =
+			(uint32_t)(hash_key(key, record->key_length) & (number_of_buckets - 1));
+		np_state_db_record *copy = (np_state_db_record *)(log + position);
+		copy->next = buckets[bucket];
+		buckets[bucket] = new_log_start + position;
+		position += size;
+	}
+	free(live_offsets);
+	unmap_database(&mapping);
+
+	np_state_db_header header = {
+		.version = NP_STATE_DB_VERSION,
+		.number_of_buckets = number_of_buckets,
+		.log_end = new_log_start + log_length,
+		.live_bytes = log_length,
+	};
+	memcpy(header.magic, NP_STATE_DB_MAGIC, sizeof(header.magic));
+
+	char *temp_file = NULL;
+	if (asprintf(&temp_file, "%s.XXXXXX", database->path) < 0) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+
+	int result = ERROR;
+	int new_file_descriptor = mkstemp(temp_file);
+	if (new_file_descriptor >= 0) {
+		struct flock lock = {
+			.l_type = F_WRLCK,
+			.l_whence = SEEK_SET,
+			.l_start = 0,
+			.l_len = 0,
+		};
+		fchmod(new_file_descriptor, S_IRUSR | S_IWUSR);
+
+		// Nobody else knows the new file yet, so the lock is granted at once
+		if (fcntl(new_file_descriptor, F_SETLK, &lock) == 0 &&
+			write_all(new_file_descriptor, &header, sizeof(header), 0) == OK &&
+			write_all(new_file_descriptor, buckets, number_of_buckets * sizeof(uint64_t),
+					  sizeof(header)) == OK &&
+			write_all(new_file_descriptor, log, log_length, (off_t)new_log_start) == OK &&
+			fsync(new_file_descriptor) == 0 && rename(temp_file, database->path) == 0) {
+			// Closing the old file releases its lock, waiting processes notice the new file
+			close(database->file_descriptor);
+			database->file_descriptor = new_file_descriptor;
+			result = OK;
+		} else {
+			close(new_file_descriptor);
+			unlink(temp_file);
+		}
+	}
+
+	free(temp_file);
+	free(buckets);
+	free(log);
+	return result;
+}
+
+int np_state_db_compact(np_state_db *database) {
+	if (database->errorcode != OK || lock_database(database, F_WRLCK) != OK) {
+		return ERROR;
+	}
+
+	int result = compact_locked(database);
+	unlock_database(database);
+	return result;
+}
+
+/*
+ * Appends the new value of key. The record is written first, then the end
+ * of the log in the header commits it and only then the bucket points to
+ * it, so a head never refers beyond the end of the log. Readers and a
+ * plugin killed in between see the old value, at worst the record stays
+ * unreferenced until the next compaction. There is no fsync, a damaged
+ * chain after a crash of the system is detected by the checksums and costs
+ * the previous values in this bucket.
+ */
+int np_state_db_put(np_state_db *database, const char *key, int data_version, time_t timestamp,
+					const char *data, size_t length) {
+	size_t key_length = strlen(key);
+	if (database->errorcode != OK || key_length > UINT32_MAX || length > UINT32_MAX ||
+		lock_database(database, F_WRLCK) != OK) {
+		return ERROR;
+	}
+
+	database_mapping mapping = map_database(database);
+	if (mapping.errorcode != OK) {
+		// Only a new, empty file is set up, anything else is not ours to overwrite
+		struct stat file_stat;
+		if (fstat(database->file_descriptor, &file_stat) != 0 || file_stat.st_size != 0 ||
+			initialize_database(database->file_descriptor, NP_STATE_DB_MIN_BUCKETS) != OK) {
+			unlock_database(database);
+			return ERROR;
+		}
+		mapping = map_database(database);
+		if (mapping.errorcode != OK) {
+			unlock_database(database);
+			return ERROR;
+		}
+	}
+
+	np_state_db_header header = *mapping.header;
+	uint64_t hash = hash_key(key, key_length);
+	uint32_t bucket = (uint32_t)(hash & (header.number_of_buckets - 1));
+	uint64_t previous_head = mapping.buckets[bucket];
+
+	size_t replaced_size = 0;
+	uint64_t replaced_offset = find_record(&mapping, key, key_length, hash);
+	if (replaced_offset != 0) {
+		const np_state_db_record *replaced =
+			(const np_state_db_record *)(mapping.base + replaced_offset);
+		replaced_size = record_size(replaced->key_length, replaced->data_length);
+	}
+	unmap_database(&mapping);
+
+	size_t size = record_size(key_length, length);
+	unsigned char *buffer = calloc(1, size);
+	if (buffer == NULL) {
+		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
+	}
+
+	np_state_db_record *record = (np_state_db_record *)buffer;
+	record->next = previous_head;
+	record->time = (int64_t)timestamp;
+	record->key_length = (uint32_t)key_length;
+	record->data_length = (uint32_t)length;
+	record->data_version = data_version;
+	memcpy(buffer + sizeof(*record), key, key_length);
+	memcpy(buffer + sizeof(*record) + key_length, data, length);
+	record->checksum = record_checksum(record, key, data);
+
+	uint64_t offset = header.log_end;
+	header.log_end += size;
+	header.live_bytes = header.live_bytes + size - replaced_size;
+
+	int result = ERROR;
+	if (write_all(database->file_descriptor, buffer, size, (off_t)offset) == OK &&
+		write_all(database->file_descriptor, &header, sizeof(header), 0) == OK &&
+		write_all(database->file_descriptor, &offset, sizeof(offset),
+				  (off_t)(sizeof(header) + (bucket * sizeof(uint64_t)))) == OK) {
+		result = OK;
+	}
+	free(buffer);
+
+	uint64_t outdated_bytes =
+		header.log_end - log_start(header.number_of_buckets) - header.live_bytes;
+	if (result == OK && outdated_bytes > NP_STATE_DB_COMPACTION_THRESHOLD &&
+		outdated_bytes > header.live_bytes) {
+		// A failed compaction leaves the database as it is
+		compact_locked(database);
+	}
+
+	unlock_database(database);
+	return result;
+}
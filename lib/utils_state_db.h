@@ -0,0 +1,68 @@
+#pragma once
+/* Header file for the shared state database in utils_state_db.c */
+
+#include "../config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define NP_STATE_DB_FILENAME "state.db"
+#define NP_STATE_DB_VERSION  1
+
+/* Buckets of a new database, compaction resizes the table to the number of keys */
+#define NP_STATE_DB_MIN_BUCKETS 4096
+
+/* Compact if the outdated records take more than this and more than the current ones */
+#define NP_STATE_DB_COMPACTION_THRESHOLD (1024 * 1024)
+
+/*
+ * All keys are kept in one file, all numbers in host byte order:
+ *
+ *   np_state_db_header
+ *   uint64_t buckets[number_of_buckets]  offset of the newest record per hash bucket
+ *   np_state_db_record, key, data ...    the log, padded to 8 Byte per record
+ *
+ * New values are appended and become the head of their bucket, the record
+ * links to the previous head. Readers walk the chain, so the first record
+ * with the key is the current one. Readers hold a shared, writers an
+ * exclusive lock on the whole file.
+ */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t number_of_buckets;
+	uint64_t log_end;    /* end of the last complete record */
+	uint64_t live_bytes; /* size of the current record of every key */
+} np_state_db_header;
+
+typedef struct {
+	uint64_t next; /* previous record in this bucket, 0 if none */
+	int64_t time;
+	uint32_t key_length;
+	uint32_t data_length;
+	int32_t data_version;
+	uint32_t checksum;
+} np_state_db_record;
+
+typedef struct {
+	int errorcode;
+	int file_descriptor;
+	char *path;
+} np_state_db;
+
+typedef struct {
+	int errorcode; /* OK if the key was found */
+	time_t time;
+	int data_version;
+	char *data;
+	size_t length;
+} np_state_db_entry;
+
+np_state_db np_state_db_open(const char *path);
+void np_state_db_close(np_state_db *database);
+
+np_state_db_entry np_state_db_get(np_state_db *database, const char *key);
+int np_state_db_put(np_state_db *database, const char *key, int data_version, time_t timestamp,
+					const char *data, size_t length);
+int np_state_db_compact(np_state_db *database);
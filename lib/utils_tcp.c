@@ -28,7 +28,9 @@
 
 #include "../config.h"
 #include "utils_tcp.h"
+#include "utils_base.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define VERBOSE(message)                                                                           \
@@ -76,3 +78,162 @@ enum np_match_result np_expect_match(char *status, char **server_expect, int exp
 	}
 	return NP_MATCH_FAILURE;
 }
+
+static void *np_expect_matcher_alloc(size_t count, size_t size) {
+	void *result = calloc(count, size);
+	if (result == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+	return result;
+}
+
+static void np_expect_matcher_report(np_expect_matcher *matcher, int state) {
+	for (int i = matcher->first_expect[state]; i >= 0; i = matcher->next_expect[i]) {
+		if (!matcher->found[i]) {
+			matcher->found[i] = true;
+			matcher->found_count++;
+			if (matcher->flags & NP_MATCH_VERBOSE) {
+				printf("found [%s]\n", matcher->server_expect[i]);
+			}
+		}
+	}
+}
+
+np_expect_matcher np_expect_matcher_init(char **server_expect, int expect_count, int flags) {
+	np_expect_matcher result = {
+		.server_expect = server_expect,
+		.expect_count = expect_count,
+		.flags = flags,
+		.state = 0,
+	};
+
+	size_t max_states = 1;
+	for (int i = 0; i < expect_count; i++) {
+		max_states += strlen(server_expect[i]);
+	}
+	result.transitions = np_expect_matcher_alloc(max_states, sizeof(*result.transitions));
+	result.output_link = np_expect_matcher_alloc(max_states, sizeof(int));
+	result.first_expect = np_expect_matcher_alloc(max_states, sizeof(int));
+	result.has_children = np_expect_matcher_alloc(max_states, sizeof(bool));
+	result.reported = np_expect_matcher_alloc(max_states, sizeof(bool));
+	result.next_expect = np_expect_matcher_alloc(expect_count > 0 ? expect_count : 1, sizeof(int));
+	result.found = np_expect_matcher_alloc(expect_count > 0 ? expect_count : 1, sizeof(bool));
+	memset(result.transitions, -1, max_states * sizeof(*result.transitions));
+	memset(result.first_expect, -1, max_states * sizeof(int));
+
+	/* the trie of all expect strings */
+	result.number_of_states = 1;
+	for (int i = 0; i < expect_count; i++) {
+		int state = 0;
+		for (const unsigned char *character = (const unsigned char *)server_expect[i];
+			 *character != '\0'; character++) {
+			if (result.transitions[state][*character] < 0) {
+				result.has_children[state] = true;
+				result.transitions[state][*character] = (int)result.number_of_states++;
+			}
+			state = result.transitions[state][*character];
+		}
+		result.next_expect[i] = result.first_expect[state];
+		result.first_expect[state] = i;
+	}
+
+	/*
+	 * Anywhere in the data: complete the trie to the automaton, missing
+	 * transitions continue from the longest suffix which is in the trie
+	 */
+	if (!(flags & NP_MATCH_EXACT)) {
+		int *failure = np_expect_matcher_alloc(result.number_of_states, sizeof(int));
+		int *queue = np_expect_matcher_alloc(result.number_of_states, sizeof(int));
+		size_t head = 0;
+		size_t tail = 0;
+
+		result.output_link[0] = -1;
+		for (int character = 0; character < 256; character++) {
+			int child = result.transitions[0][character];
+			if (child < 0) {
+				result.transitions[0][character] = 0;
+			} else {
+				failure[child] = 0;
+				result.output_link[child] = (result.first_expect[0] >= 0) ? 0 : -1;
+				queue[tail++] = child;
+			}
+		}
+		while (head < tail) {
+			int state = queue[head++];
+			for (int character = 0; character < 256; character++) {
+				int child = result.transitions[state][character];
+				int fallback = result.transitions[failure[state]][character];
+				if (child < 0) {
+					result.transitions[state][character] = fallback;
+					continue;
+				}
+				failure[child] = fallback;
+				result.output_link[child] =
+					(result.first_expect[fallback] >= 0) ? fallback : result.output_link[fallback];
+				queue[tail++] = child;
+			}
+		}
+		free(queue);
+		free(failure);
+	}
+
+	/* An empty expect string matches before any data */
+	np_expect_matcher_report(&result, 0);
+	result.reported[0] = true;
+	return result;
+}
+
+static enum np_match_result np_expect_matcher_result(const np_expect_matcher *matcher) {
+	if ((matcher->flags & NP_MATCH_ALL && matcher->found_count == matcher->expect_count) ||
+		(!(matcher->flags & NP_MATCH_ALL) && matcher->found_count >= 1)) {
+		return NP_MATCH_SUCCESS;
+	}
+	if (!(matcher->flags & NP_MATCH_EXACT)) {
+		return NP_MATCH_RETRY;
+	}
+	/* The data is the beginning of a longer expect string */
+	if (matcher->state >= 0 && matcher->has_children[matcher->state]) {
+		return NP_MATCH_RETRY;
+	}
+	return NP_MATCH_FAILURE;
+}
+
+enum np_match_result np_expect_matcher_feed(np_expect_matcher *matcher, const char *data,
+											size_t length) {
+	const unsigned char *bytes = (const unsigned char *)data;
+
+	for (size_t i = 0; i < length && matcher->state >= 0; i++) {
+		matcher->state = matcher->transitions[matcher->state][bytes[i]];
+		if (matcher->state < 0) {
+			break;
+		}
+
+		/* Walk the expect strings ending here, a reported state reported its chain as well */
+		int state = matcher->state;
+		if (matcher->first_expect[state] < 0) {
+			state = (matcher->flags & NP_MATCH_EXACT) ? -1 : matcher->output_link[state];
+		}
+		while (state > 0 && !matcher->reported[state]) {
+			np_expect_matcher_report(matcher, state);
+			matcher->reported[state] = true;
+			state = (matcher->flags & NP_MATCH_EXACT) ? -1 : matcher->output_link[state];
+		}
+
+		if (np_expect_matcher_result(matcher) == NP_MATCH_SUCCESS) {
+			return NP_MATCH_SUCCESS;
+		}
+	}
+
+	return np_expect_matcher_result(matcher);
+}
+
+void np_expect_matcher_free(np_expect_matcher *matcher) {
+	free(matcher->transitions);
+	free(matcher->output_link);
+	free(matcher->first_expect);
+	free(matcher->next_expect);
+	free(matcher->has_children);
+	free(matcher->reported);
+	free(matcher->found);
+	matcher->transitions = NULL;
+}
@@ -1,5 +1,9 @@
+#pragma once
 /* Header file for utils_tcp */
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #define NP_MATCH_ALL     0x1
 #define NP_MATCH_EXACT   0x2
 #define NP_MATCH_VERBOSE 0x4
@@ -19,3 +23,33 @@ enum np_match_result {
 
 enum np_match_result np_expect_match(char *status, char **server_expect, int server_expect_count,
 									 int flags);
+
+/*
+ * Streaming variant of np_expect_match() for data arriving in chunks. The
+ * expect strings are compiled into an Aho-Corasick automaton (a plain trie
+ * with NP_MATCH_EXACT), so every received Byte is looked at once no matter
+ * how many expect strings there are. The result after each chunk is the
+ * one np_expect_match() gives for all data received so far.
+ */
+typedef struct {
+	char **server_expect;
+	int expect_count;
+	int flags;
+
+	size_t number_of_states;
+	int (*transitions)[256]; /* -1 if there is no transition, only with NP_MATCH_EXACT */
+	int *output_link;        /* next state on the failure chain which ends an expect string */
+	int *first_expect;       /* first expect string ending in a state, -1 if none */
+	int *next_expect;        /* next expect string ending in the same state */
+	bool *has_children;
+	bool *reported;
+
+	int state; /* -1 once the data can not be the beginning of an expect string */
+	bool *found;
+	int found_count;
+} np_expect_matcher;
+
+np_expect_matcher np_expect_matcher_init(char **server_expect, int expect_count, int flags);
+enum np_match_result np_expect_matcher_feed(np_expect_matcher *matcher, const char *data,
+											size_t length);
+void np_expect_matcher_free(np_expect_matcher *matcher);
@@ -36,6 +36,7 @@ const char *email = "devel@monitoring-plugins.org";
 #include "output.h"
 #include "perfdata.h"
 #include "utils_base.h"
+#include "utils_state.h"
 #include "lib/thresholds.h"
 
 #ifdef HAVE_SYS_STAT_H
@@ -82,7 +83,10 @@ static void set_all_thresholds(parameter_list_elem *path, char *warn_freespace_u
 							   char *crit_freespace_units, char *warn_freespace_percent,
 							   char *crit_freespace_percent, char *warn_freeinodes_percent,
 							   char *crit_freeinodes_percent);
+static void apply_ignore_patterns(filesystem_list *path_select_list,
+								  struct regex_list **ignore_patterns);
 static double calculate_percent(uintmax_t /*value*/, uintmax_t /*total*/);
+static void load_mount_list(check_disk_config * /*config*/);
 static bool stat_path(parameter_list_elem * /*parameters*/, bool /*ignore_missing*/);
 
 /*
@@ -93,6 +97,9 @@ static parameter_list_elem get_path_stats(parameter_list_elem parameters, struct
 										  bool freespace_ignore_reserved);
 static mp_subcheck evaluate_filesystem(measurement_unit measurement_unit,
 									   bool display_inodes_perfdata, byte_unit unit);
+static mp_subcheck evaluate_fill_rate(measurement_unit measurement_unit,
+									  mp_int_fill_state_entry fill_state,
+									  mp_thresholds time_to_full_thresholds);
 
 void print_usage(void);
 static void print_help(void);
@@ -142,8 +149,8 @@ int main(int argc, char **argv) {
 	}
 
 	if (!config.path_ignored) {
-		mp_int_fs_list_set_best_match(config.path_select_list, config.mount_list,
-									  config.exact_match);
+		mp_int_fs_list_set_best_match_indexed(config.path_select_list, config.mount_index,
+											  config.exact_match);
 	}
 
 	// Error if no match found for specified paths
@@ -209,24 +216,9 @@ int main(int argc, char **argv) {
 		}
 
 		if (path->group == NULL) {
-			if (config.fs_exclude_list &&
-				np_find_regmatch(config.fs_exclude_list, mount_entry->me_type)) {
-				// Skip excluded fs's
-				path = mp_int_fs_list_del(&config.path_select_list, path);
-				continue;
-			}
-
-			if (config.device_path_exclude_list &&
-				(np_find_name(config.device_path_exclude_list, mount_entry->me_devname) ||
-				 np_find_name(config.device_path_exclude_list, mount_entry->me_mountdir))) {
-				// Skip excluded device or mount paths
-				path = mp_int_fs_list_del(&config.path_select_list, path);
-				continue;
-			}
-
-			if (config.fs_include_list &&
-				!np_find_regmatch(config.fs_include_list, mount_entry->me_type)) {
-				// Skip not included fstypes
+			if (!mp_int_mount_filter_passes(&config.mount_filter, mount_entry->me_devname,
+											mount_entry->me_mountdir, mount_entry->me_type)) {
+				// Skip excluded fs types, devices or mount paths and not included fs types
 				path = mp_int_fs_list_del(&config.path_select_list, path);
 				continue;
 			}
@@ -333,13 +325,47 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	/* Retained usage of the previous run for the fill rate */
+	state_key fill_state_key = {0};
+	mp_int_fill_state previous_fill_state = mp_int_fill_state_parse(NULL);
+	mp_int_fill_state current_fill_state = mp_int_fill_state_parse(NULL);
+	time_t current_time = time(NULL);
+	double elapsed_seconds = 0;
+	if (config.fill_rate_enabled) {
+		fill_state_key = np_enable_state(NULL, 1, progname, argc, argv);
+		state_data *previous_state = np_state_read(fill_state_key);
+		if (previous_state != NULL && previous_state->errorcode == OK) {
+			previous_fill_state = mp_int_fill_state_parse(previous_state->data);
+			elapsed_seconds = difftime(current_time, previous_state->time);
+		}
+	}
+
 	/* Process for every path in list */
 	if (measurements != NULL) {
 		for (measurement_unit_list *unit = measurements; unit; unit = unit->next) {
 			mp_subcheck unit_sc = evaluate_filesystem(unit->unit, config.display_inodes_perfdata,
 													  config.display_unit);
+
+			if (config.fill_rate_enabled) {
+				uint64_t key = mp_int_fill_state_key(unit->unit.name);
+				mp_int_fill_state_entry fill_state = mp_int_fill_state_update(
+					mp_int_fill_state_find(previous_fill_state, key), key, unit->unit.used_bytes,
+					elapsed_seconds, config.fill_rate_smoothing);
+				mp_int_fill_state_insert(&current_fill_state, fill_state);
+
+				mp_add_subcheck_to_subcheck(
+					&unit_sc,
+					evaluate_fill_rate(unit->unit, fill_state, config.time_to_full_thresholds));
+			}
+
 			mp_add_subcheck_to_check(&overall, unit_sc);
 		}
+
+		/* Two runs within the same second would not yield a rate, keep the older sample then */
+		if (config.fill_rate_enabled && (previous_fill_state.length == 0 || elapsed_seconds > 0)) {
+			np_state_write_string(fill_state_key, current_time,
+								  mp_int_fill_state_serialize(current_fill_state));
+		}
 	} else {
 		// Apparently no machting fs found
 		mp_subcheck none_sc = mp_subcheck_init();
@@ -356,6 +382,35 @@ int main(int argc, char **argv) {
 	mp_exit(overall);
 }
 
+/* Drops every selected path whose mount entry matches one of the ignore patterns and
+ * releases the patterns */
+void apply_ignore_patterns(filesystem_list *path_select_list, struct regex_list **ignore_patterns) {
+	mp_int_regex_search_set ignore_set = mp_int_regex_search_set_init(*ignore_patterns);
+
+	for (parameter_list_elem *elem = path_select_list->first; elem;) {
+		if (elem->best_match &&
+			mp_int_regex_search_set_match_mount_entry(&ignore_set, elem->best_match)) {
+			if (verbose >= 3) {
+				printf("ignoring %s matching regex\n", elem->name);
+			}
+
+			elem = mp_int_fs_list_del(path_select_list, elem);
+			continue;
+		}
+
+		elem = mp_int_fs_list_get_next(elem);
+	}
+
+	mp_int_regex_search_set_free(&ignore_set);
+	while (*ignore_patterns) {
+		struct regex_list *next = (*ignore_patterns)->next;
+		regfree(&(*ignore_patterns)->regex);
+		free((*ignore_patterns)->pattern);
+		free(*ignore_patterns);
+		*ignore_patterns = next;
+	}
+}
+
 double calculate_percent(uintmax_t value, uintmax_t total) {
 	double pct = -1;
 	if (value <= DBL_MAX && total != 0) {
@@ -381,6 +436,10 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 	enum {
 		output_format_index = CHAR_MAX + 1,
 		display_unit_index,
+		fill_rate_index,
+		fill_rate_smoothing_index,
+		time_to_full_warning_index,
+		time_to_full_critical_index,
 	};
 
 	static struct option longopts[] = {{"timeout", required_argument, 0, 't'},
@@ -421,6 +480,13 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 									   {"help", no_argument, 0, 'h'},
 									   {"output-format", required_argument, 0, output_format_index},
 									   {"display-unit", required_argument, 0, display_unit_index},
+									   {"fill-rate", no_argument, 0, fill_rate_index},
+									   {"fill-rate-smoothing", required_argument, 0,
+										fill_rate_smoothing_index},
+									   {"time-to-full-warning", required_argument, 0,
+										time_to_full_warning_index},
+									   {"time-to-full-critical", required_argument, 0,
+										time_to_full_critical_index},
 									   {0, 0, 0, 0}};
 
 	for (int index = 1; index < argc; index++) {
@@ -440,10 +506,10 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 
 	bool path_selected = false;
 	char *group = NULL;
+	/* consecutive -i/-I patterns, applied together to the paths selected before them */
+	struct regex_list *ignore_patterns = NULL;
 	byte_unit unit = MebiBytes_factor;
 
-	result.config.mount_list = read_file_system_list(false);
-
 	np_add_regex(&result.config.fs_exclude_list, "iso9660", REG_EXTENDED);
 
 	while (true) {
@@ -451,6 +517,11 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 		int option_index = getopt_long(
 			argc, argv, "+?VqhvefCt:c:w:K:W:u:p:x:X:N:mklLPg:R:r:i:I:MEAn", longopts, &option);
 
+		if (ignore_patterns != NULL &&
+			(CHECK_EOF(option_index) || (option_index != 'i' && option_index != 'I'))) {
+			apply_ignore_patterns(&result.config.path_select_list, &ignore_patterns);
+		}
+
 		if (CHECK_EOF(option_index)) {
 			break;
 		}
@@ -600,6 +671,8 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 					_("Must set a threshold value before using -p\n"));
 			}
 
+			load_mount_list(&result.config);
+
 			/* add parameter if not found. overwrite thresholds if path has already been added  */
 			parameter_list_elem *search_entry;
 			if (!(search_entry = mp_int_fs_list_find(result.config.path_select_list, optarg))) {
@@ -621,8 +694,9 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 			// if (!stat_path(se, result.config.ignore_missing)) {
 			// break;
 			// }
-			mp_int_fs_list_set_best_match(result.config.path_select_list, result.config.mount_list,
-										  result.config.exact_match);
+			mp_int_fs_list_set_best_match_indexed(result.config.path_select_list,
+												  result.config.mount_index,
+												  result.config.exact_match);
 
 			path_selected = true;
 		} break;
@@ -683,31 +757,15 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 					_("Paths need to be selected before using -i/-I. Use -A to select all paths "
 					  "explicitly"));
 			}
-			regex_t regex;
-			int err = regcomp(&regex, optarg, cflags);
+			int err = np_add_regex(&ignore_patterns, optarg, cflags);
 			if (err != 0) {
 				char errbuf[MAX_INPUT_BUFFER];
-				regerror(err, &regex, errbuf, MAX_INPUT_BUFFER);
+				/* the list is left unchanged, regerror only needs the error code */
+				regerror(err, NULL, errbuf, MAX_INPUT_BUFFER);
 				die(STATE_UNKNOWN, "DISK %s: %s - %s\n", _("UNKNOWN"),
 					_("Could not compile regular expression"), errbuf);
 			}
 
-			for (parameter_list_elem *elem = result.config.path_select_list.first; elem;) {
-				if (elem->best_match) {
-					if (np_regex_match_mount_entry(elem->best_match, &regex)) {
-
-						if (verbose >= 3) {
-							printf("ignoring %s matching regex\n", elem->name);
-						}
-
-						elem = mp_int_fs_list_del(&result.config.path_select_list, elem);
-						continue;
-					}
-				}
-
-				elem = mp_int_fs_list_get_next(elem);
-			}
-
 			cflags = default_cflags;
 		} break;
 		case 'n':
@@ -736,6 +794,8 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 					_("Could not compile regular expression"), errbuf);
 			}
 
+			load_mount_list(&result.config);
+
 			bool found = false;
 			for (struct mount_entry *me = result.config.mount_list; me; me = me->me_next) {
 				if (np_regex_match_mount_entry(me, &regex)) {
@@ -772,8 +832,9 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 			}
 
 			path_selected = true;
-			mp_int_fs_list_set_best_match(result.config.path_select_list, result.config.mount_list,
-										  result.config.exact_match);
+			mp_int_fs_list_set_best_match_indexed(result.config.path_select_list,
+												  result.config.mount_index,
+												  result.config.exact_match);
 			cflags = default_cflags;
 
 		} break;
@@ -784,6 +845,8 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 			/* add all mount entries to path_select list if no partitions have been explicitly
 			 * defined using -p */
 			if (!path_selected) {
+				load_mount_list(&result.config);
+
 				parameter_list_elem *path;
 				for (struct mount_entry *me = result.config.mount_list; me; me = me->me_next) {
 					if (!(path = mp_int_fs_list_find(result.config.path_select_list,
@@ -817,6 +880,43 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 			exit(STATE_UNKNOWN);
 		case '?': /* help */
 			usage(_("Unknown argument"));
+		case fill_rate_index:
+			result.config.fill_rate_enabled = true;
+			break;
+		case fill_rate_smoothing_index: {
+			char *end = NULL;
+			double smoothing = strtod(optarg, &end);
+			if (end == optarg || *end != '\0' || smoothing <= 0 || smoothing > 1) {
+				die(STATE_UNKNOWN, _("Fill rate smoothing factor must be within (0, 1]: %s\n"),
+					optarg);
+			}
+			result.config.fill_rate_smoothing = smoothing;
+			result.config.fill_rate_enabled = true;
+		} break;
+		case time_to_full_warning_index:
+		case time_to_full_critical_index: {
+			/* A plain number of hours alerts if the filesystem is full in less than that */
+			char *range_string = optarg;
+			if (is_numeric(optarg)) {
+				xasprintf(&range_string, "%s:", optarg);
+			}
+
+			mp_range_parsed tmp = mp_parse_range_string(range_string);
+			if (tmp.error != MP_PARSING_SUCCESS) {
+				die(STATE_UNKNOWN, _("failed to parse time to full threshold: %s\n"), optarg);
+			}
+
+			/* the thresholds are given in hours, the time to full is computed in seconds */
+			mp_range range = mp_range_multiply(tmp.range, mp_create_pd_value(3600));
+			if (option_index == time_to_full_warning_index) {
+				result.config.time_to_full_thresholds =
+					mp_thresholds_set_warn(result.config.time_to_full_thresholds, range);
+			} else {
+				result.config.time_to_full_thresholds =
+					mp_thresholds_set_crit(result.config.time_to_full_thresholds, range);
+			}
+			result.config.fill_rate_enabled = true;
+		} break;
 		case output_format_index: {
 			parsed_output_format parser = mp_parse_output_format(optarg);
 			if (!parser.parsing_success) {
@@ -889,27 +989,39 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 						   crit_freeinodes_percent);
 	}
 
+	result.config.mount_filter =
+		mp_int_mount_filter_init(result.config.fs_exclude_list, result.config.fs_include_list,
+								 result.config.device_path_exclude_list);
+
 	// If a list of paths has not been explicitly selected, find entire
 	// mount list and create list of paths
 	if (!path_selected && !result.config.path_ignored) {
-		for (struct mount_entry *me = result.config.mount_list; me; me = me->me_next) {
-			if (me->me_dummy != 0) {
-				// just do not add dummy filesystems
-				continue;
-			}
+		load_mount_list(&result.config);
 
-			parameter_list_elem *path = NULL;
-			if (!(path = mp_int_fs_list_find(result.config.path_select_list, me->me_mountdir))) {
-				path = mp_int_fs_list_append(&result.config.path_select_list, me->me_mountdir);
-			}
-			path->best_match = me;
+		const mp_int_mount_index *mount_index = result.config.mount_index;
+		struct mount_entry **selected = calloc(mount_index->length + 1, sizeof(*selected));
+		if (selected == NULL) {
+			die(STATE_UNKNOWN, _("allocation failed"));
+		}
+		size_t number_selected =
+			mp_int_mount_index_select(mount_index, &result.config.mount_filter, selected);
+
+		// Every mount directory is selected at most once
+		for (size_t i = 0; i < number_selected; i++) {
+			parameter_list_elem *path =
+				mp_int_fs_list_append(&result.config.path_select_list, selected[i]->me_mountdir);
+			path->best_match = selected[i];
 			path->group = group;
 			set_all_thresholds(path, warn_freespace_units, crit_freespace_units,
 							   warn_freespace_percent, crit_freespace_percent,
 							   warn_freeinodes_percent, crit_freeinodes_percent);
 		}
+		free(selected);
 	}
 
+	// Explicitly selected paths (positional argument) still need the complete mount list
+	load_mount_list(&result.config);
+
 	// Set thresholds to the appropriate unit
 	for (parameter_list_elem *tmp = result.config.path_select_list.first; tmp;
 		 tmp = mp_int_fs_list_get_next(tmp)) {
@@ -928,6 +1040,33 @@ check_disk_config_wrapper process_arguments(int argc, char **argv) {
 	return result;
 }
 
+/*
+ * Reads the mount list on first use. Excluded mounts stay in the list, they still hide the
+ * filesystem they are mounted on.
+ */
+void load_mount_list(check_disk_config *config) {
+	if (config->mount_index != NULL) {
+		return;
+	}
+
+	bool mount_list_read = false;
+#ifdef __linux__
+	mp_int_mountinfo_result mountinfo = mp_int_read_mountinfo("/proc/self/mountinfo");
+	if (mountinfo.errorcode == OK) {
+		config->mount_list = mountinfo.mount_list;
+		mount_list_read = true;
+		if (verbose >= 3) {
+			printf("Read %zu lines of /proc/self/mountinfo\n", mountinfo.lines_read);
+		}
+	}
+#endif
+
+	if (!mount_list_read) {
+		config->mount_list = read_file_system_list(false);
+	}
+	config->mount_index = mp_int_mount_index_build(config->mount_list);
+}
+
 void set_all_thresholds(parameter_list_elem *path, char *warn_freespace_units,
 						char *crit_freespace_units, char *warn_freespace_percent,
 						char *crit_freespace_percent, char *warn_freeinodes_percent,
@@ -1071,6 +1210,18 @@ void print_help(void) {
 	printf(
 		"    %s\n",
 		_("Check only filesystems where the type matches this given regex(7) (may be repeated)"));
+	printf(" %s\n", "--fill-rate");
+	printf("    %s\n", _("Retain the used space between runs and report the rate at which the"));
+	printf("    %s\n", _("filesystems fill up and the projected time until they are full"));
+	printf(" %s\n", "--fill-rate-smoothing=FACTOR");
+	printf("    %s\n", _("Weight of the newest sample in the averaged fill rate, between 0 and 1"));
+	printf("    %s\n", _("(default: 0.3, implies --fill-rate)"));
+	printf(" %s\n", "--time-to-full-warning=HOURS");
+	printf("    %s\n", _("Exit with WARNING status if a filesystem is projected to be full in"));
+	printf("    %s\n", _("less than HOURS (or a range of hours, implies --fill-rate)"));
+	printf(" %s\n", "--time-to-full-critical=HOURS");
+	printf("    %s\n", _("Exit with CRITICAL status if a filesystem is projected to be full in"));
+	printf("    %s\n", _("less than HOURS (or a range of hours, implies --fill-rate)"));
 	printf(UT_OUTPUT_FORMAT);
 
 	printf("\n");
@@ -1108,6 +1259,7 @@ void print_usage(void) {
 		   progname);
 	printf("[-C] [-E] [-e] [-f] [-g group ] [-k] [-l] [-M] [-m] [-R path ] [-r path ]\n");
 	printf("[-t timeout] [-u unit] [-v] [-X type_regex] [-N type]\n");
+	printf("[--fill-rate] [--time-to-full-warning hours] [--time-to-full-critical hours]\n");
 }
 
 bool stat_path(parameter_list_elem *parameters, bool ignore_missing) {
@@ -1347,3 +1499,46 @@ mp_subcheck evaluate_filesystem(measurement_unit measurement_unit, bool display_
 
 	return result;
 }
+
+mp_subcheck evaluate_fill_rate(measurement_unit measurement_unit,
+							   mp_int_fill_state_entry fill_state,
+							   mp_thresholds time_to_full_thresholds) {
+	mp_subcheck result = mp_subcheck_init();
+	result = mp_set_subcheck_default_state(result, STATE_OK);
+
+	if (!fill_state.fill_rate_is_set) {
+		xasprintf(&result.output, "Fill rate: no previous data to calculate the rate yet");
+		return result;
+	}
+
+	double fill_rate_per_hour = fill_state.fill_rate * 3600;
+	char *humanized_rate = humanize_byte_value(
+		(unsigned long long)(fill_rate_per_hour < 0 ? -fill_rate_per_hour : fill_rate_per_hour),
+		false);
+
+	mp_perfdata fill_rate_pd = perfdata_init();
+	xasprintf(&fill_rate_pd.label, "%s (fill rate)", measurement_unit.name);
+	fill_rate_pd = mp_set_pd_value(fill_rate_pd, fill_state.fill_rate);
+	mp_add_perfdata_to_subcheck(&result, fill_rate_pd);
+
+	double time_to_full = mp_int_time_to_full(fill_state, measurement_unit.free_bytes);
+	if (time_to_full < 0) {
+		xasprintf(&result.output, "Fill rate: %s%s/h, not filling up",
+				  fill_rate_per_hour < 0 ? "-" : "", humanized_rate);
+		return result;
+	}
+
+	xasprintf(&result.output, "Fill rate: %s/h, full in %.1f hours", humanized_rate,
+			  time_to_full / 3600);
+
+	mp_perfdata time_to_full_pd = perfdata_init();
+	xasprintf(&time_to_full_pd.label, "%s (time to full)", measurement_unit.name);
+	time_to_full_pd = mp_set_pd_value(time_to_full_pd, time_to_full);
+	time_to_full_pd.uom = "s";
+	time_to_full_pd = mp_set_pd_min_value(time_to_full_pd, mp_create_pd_value(0));
+	time_to_full_pd = mp_pd_set_thresholds(time_to_full_pd, time_to_full_thresholds);
+	result = mp_set_subcheck_state(result, mp_get_pd_status(time_to_full_pd));
+	mp_add_perfdata_to_subcheck(&result, time_to_full_pd);
+
+	return result;
+}
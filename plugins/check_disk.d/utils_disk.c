@@ -31,10 +31,19 @@
 #include "../../gl/fsusage.h"
 #include "../../lib/thresholds.h"
 #include "../../lib/states.h"
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if MAJOR_IN_MKDEV
+#	include <sys/mkdev.h>
+#elif MAJOR_IN_SYSMACROS
+#	include <sys/sysmacros.h>
+#endif
 
 void np_add_name(struct name_list **list, const char *name) {
 	struct name_list *new_entry;
@@ -64,6 +73,8 @@ int np_add_regex(struct regex_list **list, const char *regex, int cflags) {
 
 	if (!regcomp_result) {
 		// regcomp succeeded
+		new_entry->pattern = strdup(regex);
+		new_entry->cflags = cflags;
 		new_entry->next = *list;
 		*list = new_entry;
 
@@ -114,6 +125,14 @@ bool np_find_name(struct name_list *list, const char *name) {
 	return false;
 }
 
+/* Emulate a full match as if surrounded with ^( )$
+ * by checking whether the match spans the whole name */
+static bool regex_matches_fully(const regex_t *regex, const char *name, size_t len) {
+	regmatch_t dummy_match;
+	return !regexec(regex, name, 1, &dummy_match, 0) && dummy_match.rm_so == 0 &&
+		   (size_t)dummy_match.rm_eo == len;
+}
+
 /* Returns true if name is in list */
 bool np_find_regmatch(struct regex_list *list, const char *name) {
 	if (name == NULL) {
@@ -123,11 +142,7 @@ bool np_find_regmatch(struct regex_list *list, const char *name) {
 	size_t len = strlen(name);
 
 	for (; list; list = list->next) {
-		/* Emulate a full match as if surrounded with ^( )$
-		   by checking whether the match spans the whole name */
-		regmatch_t dummy_match;
-		if (!regexec(&list->regex, name, 1, &dummy_match, 0) && dummy_match.rm_so == 0 &&
-			dummy_match.rm_eo == len) {
+		if (regex_matches_fully(&list->regex, name, len)) {
 			return true;
 		}
 	}
@@ -135,6 +150,439 @@ bool np_find_regmatch(struct regex_list *list, const char *name) {
 	return false;
 }
 
+/* FNV-1a, applied incrementally so that the hashes of all prefixes of a path
+ * are available after a single pass over it */
+#define STRING_HASH_OFFSET 14695981039346656037ULL
+#define STRING_HASH_PRIME 1099511628211ULL
+
+static uint64_t string_hash_step(uint64_t hash, unsigned char character) {
+	hash ^= character;
+	hash *= STRING_HASH_PRIME;
+	return hash;
+}
+
+static uint64_t string_hash(const char *string, size_t *length) {
+	uint64_t hash = STRING_HASH_OFFSET;
+	size_t index = 0;
+	for (; string[index] != '\0'; index++) {
+		hash = string_hash_step(hash, (unsigned char)string[index]);
+	}
+	if (length != NULL) {
+		*length = index;
+	}
+	return hash;
+}
+
+mp_int_string_set mp_int_string_set_init(struct name_list *list) {
+	mp_int_string_set result = {
+		.length = 0,
+		.bucket_mask = 0,
+		.names = NULL,
+		.hashes = NULL,
+	};
+
+	size_t list_length = 0;
+	for (struct name_list *iterator = list; iterator; iterator = iterator->next) {
+		list_length++;
+	}
+	if (list_length == 0) {
+		return result;
+	}
+
+	/* open addressing, keep the load factor below 0.5 */
+	size_t bucket_count = 8;
+	while (bucket_count < 2 * list_length) {
+		bucket_count *= 2;
+	}
+	result.bucket_mask = bucket_count - 1;
+	result.names = calloc(bucket_count, sizeof(char *));
+	result.hashes = calloc(bucket_count, sizeof(uint64_t));
+	if (result.names == NULL || result.hashes == NULL) {
+		die(STATE_UNKNOWN, _("allocation failed"));
+	}
+
+	for (struct name_list *iterator = list; iterator; iterator = iterator->next) {
+		if (mp_int_string_set_contains(&result, iterator->name)) {
+			continue;
+		}
+
+		uint64_t hash = string_hash(iterator->name, NULL);
+		size_t bucket = hash & result.bucket_mask;
+		while (result.names[bucket] != NULL) {
+			bucket = (bucket + 1) & result.bucket_mask;
+		}
+		result.names[bucket] = iterator->name;
+		result.hashes[bucket] = hash;
+		result.length++;
+	}
+
+	return result;
+}
+
+/* Returns true if name is in the set, same as np_find_name on the original list */
+bool mp_int_string_set_contains(const mp_int_string_set *set, const char *name) {
+	if (set->length == 0 || name == NULL) {
+		return false;
+	}
+
+	uint64_t hash = string_hash(name, NULL);
+	for (size_t bucket = hash & set->bucket_mask; set->names[bucket] != NULL;
+		 bucket = (bucket + 1) & set->bucket_mask) {
+		if (set->hashes[bucket] == hash && strcmp(set->names[bucket], name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* A pattern without any special characters only matches itself in full */
+static bool regex_pattern_is_literal(const char *pattern, int cflags) {
+	if (cflags & REG_ICASE) {
+		return false;
+	}
+	return strpbrk(pattern, ".[]()*+?{}|^$\\") == NULL;
+}
+
+/* A pattern can be wrapped in a group of an alternation if its own groups are balanced and
+ * it does not refer to them */
+static bool regex_pattern_is_combinable(const char *pattern) {
+	int depth = 0;
+	for (const char *character = pattern; *character != '\0'; character++) {
+		switch (*character) {
+		case '\\':
+			if (character[1] >= '0' && character[1] <= '9') {
+				/* back references would be renumbered */
+				return false;
+			}
+			if (character[1] == '\0') {
+				return false;
+			}
+			character++;
+			break;
+		case '[':
+			/* skip bracket expressions, a leading ] or ^] is part of the set */
+			character++;
+			if (*character == '^') {
+				character++;
+			}
+			if (*character == ']') {
+				character++;
+			}
+			while (*character != '\0' && *character != ']') {
+				if (*character == '[' && (character[1] == ':' || character[1] == '.' ||
+										  character[1] == '=')) {
+					char terminator = character[1];
+					character += 2;
+					while (*character != '\0' &&
+						   !(*character == terminator && character[1] == ']')) {
+						character++;
+					}
+					if (*character == '\0') {
+						return false;
+					}
+					character++;
+				}
+				character++;
+			}
+			if (*character == '\0') {
+				return false;
+			}
+			break;
+		case '(':
+			depth++;
+			break;
+		case ')':
+			if (--depth < 0) {
+				return false;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return depth == 0;
+}
+
+/* @brief Compiles a regex_list into a mp_int_regex_set
+ *
+ * @details The list has to outlive the set, the literal patterns and the regexes that
+ * 					could not be combined are not copied
+ * @param list linked list created with np_add_regex, may be NULL
+ */
+mp_int_regex_set mp_int_regex_set_init(struct regex_list *list) {
+	mp_int_regex_set result = {
+		.length = 0,
+		.literals = mp_int_string_set_init(NULL),
+		.combined_is_set = false,
+		.remaining_length = 0,
+		.remaining = NULL,
+	};
+
+	struct name_list *literals = NULL;
+
+	for (struct regex_list *iterator = list; iterator; iterator = iterator->next) {
+		result.length++;
+	}
+	if (result.length == 0) {
+		return result;
+	}
+
+	result.remaining = calloc(result.length, sizeof(regex_t *));
+	const regex_t **combinable = calloc(result.length, sizeof(regex_t *));
+	const char **combinable_patterns = calloc(result.length, sizeof(char *));
+	if (result.remaining == NULL || combinable == NULL || combinable_patterns == NULL) {
+		die(STATE_UNKNOWN, _("allocation failed"));
+	}
+
+	size_t combinable_length = 0;
+	/* "^(" and ")$" plus the terminating zero */
+	size_t combined_pattern_length = 5;
+	int combined_cflags = 0;
+
+	for (struct regex_list *iterator = list; iterator; iterator = iterator->next) {
+		if (iterator->pattern == NULL) {
+			result.remaining[result.remaining_length++] = &iterator->regex;
+		} else if (regex_pattern_is_literal(iterator->pattern, iterator->cflags)) {
+			np_add_name(&literals, iterator->pattern);
+		} else if ((iterator->cflags & REG_EXTENDED) &&
+				   regex_pattern_is_combinable(iterator->pattern) &&
+				   (combinable_length == 0 || (iterator->cflags | REG_NOSUB) == combined_cflags)) {
+			combined_cflags = iterator->cflags | REG_NOSUB;
+			combinable[combinable_length] = &iterator->regex;
+			combinable_patterns[combinable_length++] = iterator->pattern;
+			/* "(pattern)" and the "|" in front of it */
+			combined_pattern_length += strlen(iterator->pattern) + 3;
+		} else {
+			result.remaining[result.remaining_length++] = &iterator->regex;
+		}
+	}
+
+	result.literals = mp_int_string_set_init(literals);
+
+	if (combinable_length > 0) {
+		char *combined_pattern = calloc(combined_pattern_length, sizeof(char));
+		if (combined_pattern == NULL) {
+			die(STATE_UNKNOWN, _("allocation failed"));
+		}
+
+		strcpy(combined_pattern, "^(");
+		for (size_t index = 0; index < combinable_length; index++) {
+			if (index > 0) {
+				strcat(combined_pattern, "|");
+			}
+			strcat(combined_pattern, "(");
+			strcat(combined_pattern, combinable_patterns[index]);
+			strcat(combined_pattern, ")");
+		}
+		strcat(combined_pattern, ")$");
+
+		if (regcomp(&result.combined, combined_pattern, combined_cflags) == 0) {
+			result.combined_is_set = true;
+		} else {
+			/* should not happen, since all parts compiled on their own, but stay correct */
+			for (size_t index = 0; index < combinable_length; index++) {
+				result.remaining[result.remaining_length++] = combinable[index];
+			}
+		}
+		free(combined_pattern);
+	}
+
+	free(combinable);
+	free(combinable_patterns);
+
+	return result;
+}
+
+/* Returns true if any of the patterns matches name in full, same as np_find_regmatch */
+bool mp_int_regex_set_match(const mp_int_regex_set *set, const char *name) {
+	if (name == NULL || set->length == 0) {
+		return false;
+	}
+
+	if (mp_int_string_set_contains(&set->literals, name)) {
+		return true;
+	}
+
+	if (set->combined_is_set && regexec(&set->combined, name, 0, NULL, 0) == 0) {
+		return true;
+	}
+
+	size_t len = strlen(name);
+	for (size_t index = 0; index < set->remaining_length; index++) {
+		if (regex_matches_fully(set->remaining[index], name, len)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* @brief Compiles a regex_list into a mp_int_regex_search_set
+ *
+ * @details The list has to outlive the set, the regexes that could not be combined are not
+ * 					copied
+ * @param list linked list created with np_add_regex, may be NULL
+ */
+mp_int_regex_search_set mp_int_regex_search_set_init(struct regex_list *list) {
+	mp_int_regex_search_set result = {
+		.length = 0,
+		.combined_length = 0,
+		.combined = NULL,
+		.remaining_length = 0,
+		.remaining = NULL,
+	};
+
+	for (struct regex_list *iterator = list; iterator; iterator = iterator->next) {
+		result.length++;
+	}
+	if (result.length == 0) {
+		return result;
+	}
+
+	/* one group of combinable patterns per distinct cflags, at most one per pattern */
+	result.combined = calloc(result.length, sizeof(regex_t));
+	result.remaining = calloc(result.length, sizeof(regex_t *));
+	int *group_cflags = calloc(result.length, sizeof(int));
+	size_t *group_pattern_length = calloc(result.length, sizeof(size_t));
+	struct regex_list **members = calloc(result.length, sizeof(struct regex_list *));
+	size_t *member_group = calloc(result.length, sizeof(size_t));
+	if (result.combined == NULL || result.remaining == NULL || group_cflags == NULL ||
+		group_pattern_length == NULL || members == NULL || member_group == NULL) {
+		die(STATE_UNKNOWN, _("allocation failed"));
+	}
+
+	size_t number_of_groups = 0;
+	size_t number_of_members = 0;
+	for (struct regex_list *iterator = list; iterator; iterator = iterator->next) {
+		if (iterator->pattern == NULL || !(iterator->cflags & REG_EXTENDED) ||
+			!regex_pattern_is_combinable(iterator->pattern)) {
+			result.remaining[result.remaining_length++] = &iterator->regex;
+			continue;
+		}
+
+		int cflags = iterator->cflags | REG_NOSUB;
+		size_t group = 0;
+		while (group < number_of_groups && group_cflags[group] != cflags) {
+			group++;
+		}
+		if (group == number_of_groups) {
+			group_cflags[number_of_groups++] = cflags;
+			/* the terminating zero */
+			group_pattern_length[group] = 1;
+		}
+		/* "(pattern)" and the "|" in front of it */
+		group_pattern_length[group] += strlen(iterator->pattern) + 3;
+		members[number_of_members] = iterator;
+		member_group[number_of_members++] = group;
+	}
+
+	for (size_t group = 0; group < number_of_groups; group++) {
+		char *group_pattern = calloc(group_pattern_length[group], sizeof(char));
+		if (group_pattern == NULL) {
+			die(STATE_UNKNOWN, _("allocation failed"));
+		}
+		for (size_t member = 0; member < number_of_members; member++) {
+			if (member_group[member] == group) {
+				if (group_pattern[0] != '\0') {
+					strcat(group_pattern, "|");
+				}
+				strcat(group_pattern, "(");
+				strcat(group_pattern, members[member]->pattern);
+				strcat(group_pattern, ")");
+			}
+		}
+
+		if (regcomp(&result.combined[result.combined_length], group_pattern,
+					group_cflags[group]) == 0) {
+			result.combined_length++;
+		} else {
+			/* should not happen, since all parts compiled on their own, but stay correct */
+			for (size_t member = 0; member < number_of_members; member++) {
+				if (member_group[member] == group) {
+					result.remaining[result.remaining_length++] = &members[member]->regex;
+				}
+			}
+		}
+		free(group_pattern);
+	}
+
+	free(group_cflags);
+	free(group_pattern_length);
+	free(members);
+	free(member_group);
+
+	return result;
+}
+
+static bool regex_search_set_match(const mp_int_regex_search_set *set, const char *name) {
+	for (size_t index = 0; index < set->combined_length; index++) {
+		if (regexec(&set->combined[index], name, 0, NULL, 0) == 0) {
+			return true;
+		}
+	}
+	for (size_t index = 0; index < set->remaining_length; index++) {
+		if (regexec(set->remaining[index], name, 0, NULL, 0) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Returns true if any of the patterns matches the device or the mount point, same as
+ * np_regex_match_mount_entry for each of them */
+bool mp_int_regex_search_set_match_mount_entry(const mp_int_regex_search_set *set,
+											   const struct mount_entry *mount_entry) {
+	if (set->length == 0) {
+		return false;
+	}
+	return regex_search_set_match(set, mount_entry->me_devname) ||
+		   regex_search_set_match(set, mount_entry->me_mountdir);
+}
+
+void mp_int_regex_search_set_free(mp_int_regex_search_set *set) {
+	for (size_t index = 0; index < set->combined_length; index++) {
+		regfree(&set->combined[index]);
+	}
+	free(set->combined);
+	free(set->remaining);
+	set->length = 0;
+	set->combined_length = 0;
+	set->combined = NULL;
+	set->remaining_length = 0;
+	set->remaining = NULL;
+}
+
+mp_int_mount_filter mp_int_mount_filter_init(struct regex_list *fs_exclude_list,
+											 struct regex_list *fs_include_list,
+											 struct name_list *device_path_exclude_list) {
+	mp_int_mount_filter result = {
+		.fs_exclude = mp_int_regex_set_init(fs_exclude_list),
+		.fs_include = mp_int_regex_set_init(fs_include_list),
+		.device_path_exclude = mp_int_string_set_init(device_path_exclude_list),
+	};
+	return result;
+}
+
+/* Returns true if a filesystem is neither excluded by type, device or mount point,
+ * nor missing from the included types */
+bool mp_int_mount_filter_passes(const mp_int_mount_filter *filter, const char *devname,
+								const char *mountdir, const char *fs_type) {
+	if (mp_int_regex_set_match(&filter->fs_exclude, fs_type)) {
+		return false;
+	}
+
+	if (mp_int_string_set_contains(&filter->device_path_exclude, devname) ||
+		mp_int_string_set_contains(&filter->device_path_exclude, mountdir)) {
+		return false;
+	}
+
+	if (filter->fs_include.length > 0 && !mp_int_regex_set_match(&filter->fs_include, fs_type)) {
+		return false;
+	}
+
+	return true;
+}
+
 bool np_seen_name(struct name_list *list, const char *name) {
 	for (struct name_list *iterator = list; iterator; iterator = iterator->next) {
 		if (!strcmp(iterator->name, name)) {
@@ -172,11 +620,16 @@ check_disk_config check_disk_config_init() {
 		.path_select_list = filesystem_list_init(),
 
 		.mount_list = NULL,
+		.mount_index = NULL,
 		.seen = NULL,
 
 		.display_unit = Humanized,
 		// .unit = MebiBytes,
 
+		.fill_rate_enabled = false,
+		.fill_rate_smoothing = 0.3,
+		.time_to_full_thresholds = mp_thresholds_init(),
+
 		.output_format_is_set = false,
 	};
 	return tmp;
@@ -311,6 +764,182 @@ measurement_unit create_measurement_unit_from_filesystem(parameter_list_elem fil
 	return result;
 }
 
+uint64_t mp_int_fill_state_key(const char *name) { return string_hash(name, NULL); }
+
+static int fill_state_entry_compare(const void *first, const void *second) {
+	uint64_t first_key = ((const mp_int_fill_state_entry *)first)->key;
+	uint64_t second_key = ((const mp_int_fill_state_entry *)second)->key;
+	return (first_key > second_key) - (first_key < second_key);
+}
+
+/* @brief Parses the retained fill state
+ *
+ * @details The format is a sequence of "key:used_bytes:fill_rate;" with the key in hex and
+ * 					"-" as fill rate if none was calculated yet. Malformed entries are skipped.
+ * @param state_string may be NULL (no previous state)
+ */
+mp_int_fill_state mp_int_fill_state_parse(const char *state_string) {
+	mp_int_fill_state result = {
+		.length = 0,
+		.entries = NULL,
+	};
+
+	if (state_string == NULL) {
+		return result;
+	}
+
+	size_t capacity = 0;
+	for (const char *character = state_string; *character != '\0'; character++) {
+		if (*character == ';') {
+			capacity++;
+		}
+	}
+	if (capacity == 0) {
+		return result;
+	}
+
+	result.entries = calloc(capacity, sizeof(mp_int_fill_state_entry));
+	if (result.entries == NULL) {
+		die(STATE_UNKNOWN, _("allocation failed"));
+	}
+
+	const char *position = state_string;
+	while (*position != '\0' && result.length < capacity) {
+		const char *entry_end = strchr(position, ';');
+		if (entry_end == NULL) {
+			break;
+		}
+
+		mp_int_fill_state_entry entry = {0};
+		char *end = NULL;
+		errno = 0;
+		entry.key = strtoull(position, &end, 16);
+		bool valid = (errno == 0 && end != position && *end == ':');
+
+		if (valid) {
+			const char *used_start = end + 1;
+			entry.used_bytes = strtoumax(used_start, &end, 10);
+			valid = (errno == 0 && end != used_start && *end == ':');
+		}
+
+		if (valid) {
+			const char *rate_start = end + 1;
+			if (*rate_start == '-' && rate_start + 1 == entry_end) {
+				entry.fill_rate_is_set = false;
+			} else {
+				entry.fill_rate = strtod(rate_start, &end);
+				entry.fill_rate_is_set = true;
+				valid = (errno == 0 && end != rate_start && end == entry_end);
+			}
+		}
+
+		if (valid) {
+			result.entries[result.length++] = entry;
+		}
+		position = entry_end + 1;
+	}
+
+	qsort(result.entries, result.length, sizeof(mp_int_fill_state_entry),
+		  fill_state_entry_compare);
+	return result;
+}
+
+char *mp_int_fill_state_serialize(mp_int_fill_state state) {
+	/* 16 hex digits, 20 decimal digits, the rate and the separators */
+	const size_t max_entry_length = 16 + 1 + 20 + 1 + 32 + 1;
+	char *result = calloc(state.length * max_entry_length + 1, sizeof(char));
+	if (result == NULL) {
+		die(STATE_UNKNOWN, _("allocation failed"));
+	}
+
+	char *position = result;
+	for (size_t index = 0; index < state.length; index++) {
+		mp_int_fill_state_entry entry = state.entries[index];
+		if (entry.fill_rate_is_set) {
+			position += snprintf(position, max_entry_length + 1, "%" PRIx64 ":%ju:%.6g;", entry.key,
+								 entry.used_bytes, entry.fill_rate);
+		} else {
+			position += snprintf(position, max_entry_length + 1, "%" PRIx64 ":%ju:-;", entry.key,
+								 entry.used_bytes);
+		}
+	}
+	return result;
+}
+
+/* Adds an entry, keeping the entries sorted. An existing entry with the same key is replaced */
+void mp_int_fill_state_insert(mp_int_fill_state *state, mp_int_fill_state_entry entry) {
+	mp_int_fill_state_entry *existing = mp_int_fill_state_find(*state, entry.key);
+	if (existing != NULL) {
+		*existing = entry;
+		return;
+	}
+
+	mp_int_fill_state_entry *entries =
+		realloc(state->entries, (state->length + 1) * sizeof(mp_int_fill_state_entry));
+	if (entries == NULL) {
+		die(STATE_UNKNOWN, _("allocation failed"));
+	}
+	state->entries = entries;
+
+	size_t index = state->length;
+	while (index > 0 && state->entries[index - 1].key > entry.key) {
+		state->entries[index] = state->entries[index - 1];
+		index--;
+	}
+	state->entries[index] = entry;
+	state->length++;
+}
+
+mp_int_fill_state_entry *mp_int_fill_state_find(mp_int_fill_state state, uint64_t key) {
+	if (state.length == 0) {
+		return NULL;
+	}
+	mp_int_fill_state_entry needle = {.key = key};
+	return bsearch(&needle, state.entries, state.length, sizeof(mp_int_fill_state_entry),
+				   fill_state_entry_compare);
+}
+
+/* @brief Calculates the new fill state of a measurement unit
+ *
+ * @details The fill rate is an exponentially weighted moving average of the usage change
+ * 					per second between runs, the first sample is taken as is.
+ * @param previous state of the last run, NULL if there is none
+ * @param smoothing weight of the newest sample, between 0 and 1
+ */
+mp_int_fill_state_entry mp_int_fill_state_update(const mp_int_fill_state_entry *previous,
+												 uint64_t key, uintmax_t used_bytes,
+												 double elapsed_seconds, double smoothing) {
+	mp_int_fill_state_entry result = {
+		.key = key,
+		.used_bytes = used_bytes,
+		.fill_rate_is_set = false,
+		.fill_rate = 0,
+	};
+
+	if (previous == NULL || elapsed_seconds <= 0) {
+		return result;
+	}
+
+	double sample = ((double)used_bytes - (double)previous->used_bytes) / elapsed_seconds;
+	if (previous->fill_rate_is_set) {
+		result.fill_rate = smoothing * sample + (1 - smoothing) * previous->fill_rate;
+	} else {
+		result.fill_rate = sample;
+	}
+	result.fill_rate_is_set = true;
+
+	return result;
+}
+
+/* Returns the projected seconds until the filesystem is full or a negative value if it is
+ * not filling up (or there is no fill rate yet) */
+double mp_int_time_to_full(mp_int_fill_state_entry entry, uintmax_t free_bytes) {
+	if (!entry.fill_rate_is_set || entry.fill_rate <= 0) {
+		return -1;
+	}
+	return (double)free_bytes / entry.fill_rate;
+}
+
 #define RANDOM_STRING_LENGTH 64
 
 char *humanize_byte_value(unsigned long long value, bool use_si_units) {
@@ -473,56 +1102,428 @@ parameter_list_elem *mp_int_fs_list_get_next(parameter_list_elem *current) {
 	return current->next;
 }
 
-void mp_int_fs_list_set_best_match(filesystem_list list, struct mount_entry *mount_list,
-								   bool exact) {
+/* Same classification as ME_DUMMY in gl/mountlist.c, mountinfo never lists type "none" */
+static bool mountinfo_is_dummy(const char *fs_type) {
+	static const char *dummy_types[] = {"autofs", "proc",   "subfs",      "debugfs",
+										"devpts", "fusectl", "fuse.portal", "mqueue",
+										"rpc_pipefs", "sysfs", "devfs",   "kernfs"};
+	for (size_t index = 0; index < sizeof(dummy_types) / sizeof(dummy_types[0]); index++) {
+		if (strcmp(fs_type, dummy_types[index]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Same classification as ME_REMOTE in gl/mountlist.c */
+static bool mountinfo_is_remote(const char *devname, const char *fs_type) {
+	if (strchr(devname, ':') != NULL || strcmp(devname, "-hosts") == 0) {
+		return true;
+	}
+
+	if (devname[0] == '/' && devname[1] == '/' &&
+		(strcmp(fs_type, "smbfs") == 0 || strcmp(fs_type, "smb3") == 0 ||
+		 strcmp(fs_type, "cifs") == 0)) {
+		return true;
+	}
+
+	static const char *remote_types[] = {"acfs", "afs",  "coda",  "auristorfs", "fhgfs",
+										 "gpfs", "ibrix", "ocfs2", "vxfs"};
+	for (size_t index = 0; index < sizeof(remote_types) / sizeof(remote_types[0]); index++) {
+		if (strcmp(fs_type, remote_types[index]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Terminates the field starting at field in place and returns the start of the next one */
+static char *mountinfo_next_field(char *field) {
+	char *blank = strchr(field, ' ');
+	if (blank == NULL) {
+		return NULL;
+	}
+	*blank = '\0';
+	return blank + 1;
+}
+
+/* Resolves the octal escapes (\040 for a space and so on) of the kernel in place */
+static void mountinfo_unescape(char *field) {
+	char *target = field;
+	for (char *source = field; *source != '\0'; source++) {
+		if (source[0] == '\\' && source[1] >= '0' && source[1] <= '3' && source[2] >= '0' &&
+			source[2] <= '7' && source[3] >= '0' && source[3] <= '7') {
+			*target++ = (char)((source[1] - '0') * 64 + (source[2] - '0') * 8 + (source[3] - '0'));
+			source += 3;
+		} else {
+			*target++ = *source;
+		}
+	}
+	*target = '\0';
+}
+
+/* @brief Reads a Linux mountinfo table (usually /proc/self/mountinfo)
+ *
+ * @details The table is read into one buffer and parsed in place, the strings of the
+ * 					resulting mount entries point into that buffer.
+ * 					The result has the same order and classification (dummy, remote) as
+ * 					read_file_system_list
+ * @param mountinfo_path path of the table
+ */
+mp_int_mountinfo_result mp_int_read_mountinfo(const char *mountinfo_path) {
+	mp_int_mountinfo_result result = {
+		.errorcode = OK,
+		.mount_list = NULL,
+		.lines_read = 0,
+	};
+
+	int mountinfo_fd = open(mountinfo_path, O_RDONLY | O_CLOEXEC);
+	if (mountinfo_fd < 0) {
+		result.errorcode = ERROR;
+		return result;
+	}
+
+	/* procfs does not report a size, so the buffer grows until a read returns nothing */
+	size_t buffer_size = 64 * 1024;
+	size_t buffer_used = 0;
+	char *buffer = malloc(buffer_size);
+	if (buffer == NULL) {
+		die(STATE_UNKNOWN, _("allocation failed"));
+	}
+
+	while (true) {
+		if (buffer_size - buffer_used < 2) {
+			buffer_size *= 2;
+			buffer = realloc(buffer, buffer_size);
+			if (buffer == NULL) {
+				die(STATE_UNKNOWN, _("allocation failed"));
+			}
+		}
+
+		ssize_t read_result =
+			read(mountinfo_fd, buffer + buffer_used, buffer_size - buffer_used - 1);
+		if (read_result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			close(mountinfo_fd);
+			free(buffer);
+			result.errorcode = ERROR;
+			return result;
+		}
+		if (read_result == 0) {
+			break;
+		}
+		buffer_used += (size_t)read_result;
+	}
+	close(mountinfo_fd);
+	buffer[buffer_used] = '\0';
+
+	struct mount_entry **mtail = &result.mount_list;
+	char *next_line = NULL;
+	for (char *line = buffer; line != NULL && *line != '\0'; line = next_line) {
+		char *newline = strchr(line, '\n');
+		if (newline) {
+			*newline = '\0';
+			next_line = newline + 1;
+		} else {
+			next_line = NULL;
+		}
+		result.lines_read++;
+
+		/* id parent major:minor root mount_point options [optional fields] - type source
+		 * super_options */
+		char *major_minor = strchr(line, ' ');
+		major_minor = major_minor ? strchr(major_minor + 1, ' ') : NULL;
+		if (major_minor == NULL) {
+			continue;
+		}
+		major_minor++;
+
+		char *end = NULL;
+		unsigned long device_major = strtoul(major_minor, &end, 10);
+		if (*end != ':') {
+			continue;
+		}
+		unsigned long device_minor = strtoul(end + 1, &end, 10);
+		if (*end != ' ') {
+			continue;
+		}
+
+		char *mntroot = end + 1;
+		char *mountdir = mountinfo_next_field(mntroot);
+		char *options = mountdir ? mountinfo_next_field(mountdir) : NULL;
+		char *separator = options ? strstr(options, " - ") : NULL;
+		if (separator == NULL) {
+			continue;
+		}
+
+		char *fs_type = separator + 3;
+		char *devname = mountinfo_next_field(fs_type);
+		if (devname == NULL || mountinfo_next_field(devname) == NULL) {
+			continue;
+		}
+
+		mountinfo_unescape(fs_type);
+		mountinfo_unescape(devname);
+		mountinfo_unescape(mountdir);
+		mountinfo_unescape(mntroot);
+
+		struct mount_entry *mount_entry = calloc(1, sizeof(struct mount_entry));
+		if (mount_entry == NULL) {
+			die(STATE_UNKNOWN, _("allocation failed"));
+		}
+
+		mount_entry->me_devname = devname;
+		mount_entry->me_mountdir = mountdir;
+		mount_entry->me_mntroot = mntroot;
+		mount_entry->me_type = fs_type;
+		mount_entry->me_type_malloced = 0;
+		mount_entry->me_dev = makedev(device_major, device_minor);
+		mount_entry->me_dummy = mountinfo_is_dummy(fs_type);
+		mount_entry->me_remote = mountinfo_is_remote(devname, fs_type);
+
+		*mtail = mount_entry;
+		mtail = &mount_entry->me_next;
+	}
+	*mtail = NULL;
+
+	/* The buffer holds the strings of the entries and lives as long as the plugin */
+	if (result.mount_list == NULL) {
+		free(buffer);
+	}
+
+	return result;
+}
+
+/* @brief Creates a lookup index over a mount list
+ *
+ * @details The index does not copy the mount entries, the mount list has to outlive it.
+ * 					Chains in the index start with the last matching entry of the mount list,
+ * 					since later mounts hide earlier ones on the same mount point.
+ * @param mount_list linked list of mount entries as returned by read_file_system_list
+ */
+mp_int_mount_index *mp_int_mount_index_build(struct mount_entry *mount_list) {
+	mp_int_mount_index *result = calloc(1, sizeof(mp_int_mount_index));
+	if (result == NULL) {
+		die(STATE_UNKNOWN, _("allocation failed"));
+	}
+
+	for (struct mount_entry *mount_entry = mount_list; mount_entry;
+		 mount_entry = mount_entry->me_next) {
+		result->length++;
+	}
+
+	/* keep the load factor below 0.5 */
+	size_t bucket_count = 16;
+	while (bucket_count < 2 * result->length) {
+		bucket_count *= 2;
+	}
+	result->bucket_mask = bucket_count - 1;
+
+	result->entries = calloc(result->length + 1, sizeof(struct mount_entry *));
+	result->devname_buckets = calloc(bucket_count, sizeof(size_t));
+	result->devname_next = calloc(result->length + 1, sizeof(size_t));
+	result->mountdir_buckets = calloc(bucket_count, sizeof(size_t));
+	result->mountdir_next = calloc(result->length + 1, sizeof(size_t));
+	result->mountdir_length = calloc(result->length + 1, sizeof(size_t));
+	result->mountdir_hash = calloc(result->length + 1, sizeof(uint64_t));
+	result->short_mountdir_next = calloc(result->length + 1, sizeof(size_t));
+
+	if (result->entries == NULL || result->devname_buckets == NULL ||
+		result->devname_next == NULL || result->mountdir_buckets == NULL ||
+		result->mountdir_next == NULL || result->mountdir_length == NULL ||
+		result->mountdir_hash == NULL || result->short_mountdir_next == NULL) {
+		die(STATE_UNKNOWN, _("allocation failed"));
+	}
+
+	/* Slot 0 marks the end of a chain, the entries are stored from 1 on */
+	size_t slot = 1;
+	for (struct mount_entry *mount_entry = mount_list; mount_entry;
+		 mount_entry = mount_entry->me_next, slot++) {
+		result->entries[slot] = mount_entry;
+
+		size_t devname_bucket = string_hash(mount_entry->me_devname, NULL) & result->bucket_mask;
+		result->devname_next[slot] = result->devname_buckets[devname_bucket];
+		result->devname_buckets[devname_bucket] = slot;
+
+		result->mountdir_hash[slot] =
+			string_hash(mount_entry->me_mountdir, &result->mountdir_length[slot]);
+		size_t mountdir_bucket = result->mountdir_hash[slot] & result->bucket_mask;
+		result->mountdir_next[slot] = result->mountdir_buckets[mountdir_bucket];
+		result->mountdir_buckets[mountdir_bucket] = slot;
+
+		size_t mountdir_length = result->mountdir_length[slot];
+		if (mountdir_length <= 1) {
+			result->short_mountdir_next[slot] = result->short_mountdir_buckets[mountdir_length];
+			result->short_mountdir_buckets[mountdir_length] = slot;
+		}
+	}
+
+	return result;
+}
+
+void mp_int_mount_index_free(mp_int_mount_index *mount_index) {
+	if (mount_index == NULL) {
+		return;
+	}
+	free(mount_index->entries);
+	free(mount_index->devname_buckets);
+	free(mount_index->devname_next);
+	free(mount_index->mountdir_buckets);
+	free(mount_index->mountdir_next);
+	free(mount_index->mountdir_length);
+	free(mount_index->mountdir_hash);
+	free(mount_index->short_mountdir_next);
+	free(mount_index);
+}
+
+/* Whether no later entry of the index is mounted on the same directory as the one in slot */
+static bool mount_index_is_top_most(const mp_int_mount_index *mount_index, size_t slot) {
+	uint64_t hash = mount_index->mountdir_hash[slot];
+	size_t length = mount_index->mountdir_length[slot];
+	const char *mountdir = mount_index->entries[slot]->me_mountdir;
+
+	/* the chain starts with the last entry and contains slot itself */
+	for (size_t other = mount_index->mountdir_buckets[hash & mount_index->bucket_mask];
+		 other != slot; other = mount_index->mountdir_next[other]) {
+		if (mount_index->mountdir_hash[other] == hash &&
+			mount_index->mountdir_length[other] == length &&
+			strcmp(mount_index->entries[other]->me_mountdir, mountdir) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* @brief Selects the mount entries to check if no path was given
+ *
+ * @details Only the top-most mount of a directory is seen by statvfs. A directory whose
+ * 					top-most mount is excluded by the filter or a dummy filesystem is skipped
+ * 					instead of reporting a hidden filesystem with the numbers of the other one.
+ * @param selected room for mount_index->length entries, filled in the order of the mount list
+ * @return the number of selected entries
+ */
+size_t mp_int_mount_index_select(const mp_int_mount_index *mount_index,
+								 const mp_int_mount_filter *filter, struct mount_entry **selected) {
+	size_t result = 0;
+	for (size_t slot = 1; slot <= mount_index->length; slot++) {
+		struct mount_entry *mount_entry = mount_index->entries[slot];
+		if (mount_entry->me_dummy != 0 || !mount_index_is_top_most(mount_index, slot) ||
+			!mp_int_mount_filter_passes(filter, mount_entry->me_devname,
+										mount_entry->me_mountdir, mount_entry->me_type)) {
+			continue;
+		}
+		selected[result++] = mount_entry;
+	}
+	return result;
+}
+
+static bool mount_entry_is_usable(struct mount_entry *mount_entry) {
+	struct fs_usage fsp;
+	return get_fs_usage(mount_entry->me_mountdir, mount_entry->me_devname, &fsp) >= 0;
+}
+
+/* Returns the last usable entry whose device name is exactly name */
+static struct mount_entry *mount_index_find_devname(const mp_int_mount_index *mount_index,
+													const char *name) {
+	size_t bucket = string_hash(name, NULL) & mount_index->bucket_mask;
+	for (size_t slot = mount_index->devname_buckets[bucket]; slot;
+		 slot = mount_index->devname_next[slot]) {
+		struct mount_entry *mount_entry = mount_index->entries[slot];
+		if (strcmp(mount_entry->me_devname, name) == 0 && mount_entry_is_usable(mount_entry)) {
+			return mount_entry;
+		}
+	}
+	return NULL;
+}
+
+/* Returns the last usable entry whose mount directory is the first length bytes of name */
+static struct mount_entry *mount_index_find_mountdir(const mp_int_mount_index *mount_index,
+													 const char *name, size_t length,
+													 uint64_t hash) {
+	for (size_t slot = mount_index->mountdir_buckets[hash & mount_index->bucket_mask]; slot;
+		 slot = mount_index->mountdir_next[slot]) {
+		if (mount_index->mountdir_hash[slot] != hash ||
+			mount_index->mountdir_length[slot] != length) {
+			continue;
+		}
+
+		struct mount_entry *mount_entry = mount_index->entries[slot];
+		if (strncmp(mount_entry->me_mountdir, name, length) == 0 &&
+			mount_entry_is_usable(mount_entry)) {
+			return mount_entry;
+		}
+	}
+	return NULL;
+}
+
+/* Returns the last usable entry with a mount directory of length zero or one, regardless of
+ * its content. This mirrors the historic behaviour for the root directory */
+static struct mount_entry *mount_index_find_short_mountdir(const mp_int_mount_index *mount_index,
+														   size_t length) {
+	for (size_t slot = mount_index->short_mountdir_buckets[length]; slot;
+		 slot = mount_index->short_mountdir_next[slot]) {
+		if (mount_entry_is_usable(mount_index->entries[slot])) {
+			return mount_index->entries[slot];
+		}
+	}
+	return NULL;
+}
+
+void mp_int_fs_list_set_best_match_indexed(filesystem_list list,
+										   const mp_int_mount_index *mount_index, bool exact) {
 	for (parameter_list_elem *elem = list.first; elem; elem = mp_int_fs_list_get_next(elem)) {
-		if (!elem->best_match) {
+		if (elem->best_match) {
+			continue;
+		}
+
+		/* set best match if path name exactly matches a mounted device name */
+		struct mount_entry *best_match = mount_index_find_devname(mount_index, elem->name);
+
+		/* set best match by directory name if no match was found by devname */
+		if (!best_match && exact) {
+			size_t name_len = 0;
+			uint64_t hash = string_hash(elem->name, &name_len);
+			best_match = mount_index_find_mountdir(mount_index, elem->name, name_len, hash);
+		} else if (!best_match) {
+			/* Every prefix of the path is a candidate, the longest one wins */
 			size_t name_len = strlen(elem->name);
-			struct mount_entry *best_match = NULL;
-
-			/* set best match if path name exactly matches a mounted device name */
-			for (struct mount_entry *mount_entry = mount_list; mount_entry;
-				 mount_entry = mount_entry->me_next) {
-				if (strcmp(mount_entry->me_devname, elem->name) == 0) {
-					struct fs_usage fsp;
-					if (get_fs_usage(mount_entry->me_mountdir, mount_entry->me_devname, &fsp) >=
-						0) {
-						best_match = mount_entry;
-					}
-				}
+			uint64_t *prefix_hashes = calloc(name_len + 1, sizeof(uint64_t));
+			if (prefix_hashes == NULL) {
+				die(STATE_UNKNOWN, _("allocation failed"));
 			}
 
-			/* set best match by directory name if no match was found by devname */
-			if (!best_match) {
-				size_t best_match_len = 0;
-				for (struct mount_entry *mount_entry = mount_list; mount_entry;
-					 mount_entry = mount_entry->me_next) {
-					size_t len = strlen(mount_entry->me_mountdir);
-
-					if ((!exact &&
-						 (best_match_len <= len && len <= name_len &&
-						  (len == 1 || strncmp(mount_entry->me_mountdir, elem->name, len) == 0))) ||
-						(exact && strcmp(mount_entry->me_mountdir, elem->name) == 0)) {
-						struct fs_usage fsp;
-
-						if (get_fs_usage(mount_entry->me_mountdir, mount_entry->me_devname, &fsp) >=
-							0) {
-							best_match = mount_entry;
-							best_match_len = len;
-						}
-					}
-				}
+			prefix_hashes[0] = STRING_HASH_OFFSET;
+			for (size_t index = 0; index < name_len; index++) {
+				prefix_hashes[index + 1] =
+					string_hash_step(prefix_hashes[index], (unsigned char)elem->name[index]);
 			}
 
-			if (best_match) {
-				elem->best_match = best_match;
-			} else {
-				elem->best_match =
-					NULL; /* Not sure why this is needed as it should be null on initialisation */
+			for (size_t length = name_len; length > 1 && !best_match; length--) {
+				best_match = mount_index_find_mountdir(mount_index, elem->name, length,
+													   prefix_hashes[length]);
 			}
+			free(prefix_hashes);
 
-			// No filesystem without a mount_entry!
-			// assert(elem->best_match != NULL);
+			if (!best_match && name_len >= 1) {
+				best_match = mount_index_find_short_mountdir(mount_index, 1);
+			}
+			if (!best_match) {
+				best_match = mount_index_find_short_mountdir(mount_index, 0);
+			}
 		}
+
+		elem->best_match = best_match;
+
+		// No filesystem without a mount_entry!
+		// assert(elem->best_match != NULL);
 	}
 }
+
+void mp_int_fs_list_set_best_match(filesystem_list list, struct mount_entry *mount_list,
+								   bool exact) {
+	mp_int_mount_index *mount_index = mp_int_mount_index_build(mount_list);
+	mp_int_fs_list_set_best_match_indexed(list, mount_index, exact);
+	mp_int_mount_index_free(mount_index);
+}
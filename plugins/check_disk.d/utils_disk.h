@@ -35,9 +35,52 @@ struct name_list {
 
 struct regex_list {
 	regex_t regex;
+	char *pattern;
+	int cflags;
 	struct regex_list *next;
 };
 
+/*
+ * Hash set of strings, built once from a name_list for repeated lookups
+ */
+typedef struct {
+	size_t length;
+	size_t bucket_mask;
+	const char **names;
+	uint64_t *hashes;
+} mp_int_string_set;
+
+/*
+ * Compiled form of a regex_list with the same full match semantics as np_find_regmatch.
+ * Patterns without any special characters are looked up in a hash set, the others are
+ * combined into one alternation where possible and only the rest is tried one by one.
+ */
+typedef struct {
+	size_t length;
+	mp_int_string_set literals;
+
+	bool combined_is_set;
+	regex_t combined;
+
+	size_t remaining_length;
+	const regex_t **remaining;
+} mp_int_regex_set;
+
+/*
+ * Compiled form of a regex_list for matching anywhere in a name like np_regex_match_mount_entry,
+ * used for the -i/-I ignore patterns. Patterns with the same cflags are combined into one
+ * alternation where possible and only the rest is tried one by one.
+ */
+typedef struct {
+	size_t length;
+
+	size_t combined_length;
+	regex_t *combined;
+
+	size_t remaining_length;
+	const regex_t **remaining;
+} mp_int_regex_search_set;
+
 typedef struct parameter_list parameter_list_elem;
 struct parameter_list {
 	char *name;
@@ -94,6 +137,59 @@ struct measurement_unit_list {
 	measurement_unit_list *next;
 };
 
+/*
+ * Lookup index over a mount list, so that matching a path against thousands
+ * of mount entries does not require comparing it with every single one of them.
+ * Entries are hashed by device name and by mount directory, both chains are
+ * ordered from the last to the first entry of the mount list.
+ */
+typedef struct {
+	struct mount_entry **entries;
+	size_t length;
+
+	size_t bucket_mask;
+	size_t *devname_buckets;
+	size_t *devname_next;
+	size_t *mountdir_buckets;
+	size_t *mountdir_next;
+	size_t *mountdir_length;
+	uint64_t *mountdir_hash;
+
+	/* mount directories of length zero and one match every path */
+	size_t short_mountdir_buckets[2];
+	size_t *short_mountdir_next;
+} mp_int_mount_index;
+
+/*
+ * The filesystem type and device/path filters of check_disk, an empty set does not filter
+ */
+typedef struct {
+	mp_int_regex_set fs_exclude;
+	mp_int_regex_set fs_include;
+	mp_int_string_set device_path_exclude;
+} mp_int_mount_filter;
+
+typedef struct {
+	int errorcode;
+	struct mount_entry *mount_list;
+	size_t lines_read;
+} mp_int_mountinfo_result;
+
+/*
+ * Retained usage of one measurement unit between runs for the fill rate prediction
+ */
+typedef struct {
+	uint64_t key; // hash of the measurement unit name
+	uintmax_t used_bytes;
+	bool fill_rate_is_set;
+	double fill_rate; // bytes per second, exponentially weighted
+} mp_int_fill_state_entry;
+
+typedef struct {
+	size_t length;
+	mp_int_fill_state_entry *entries; // sorted by key
+} mp_int_fill_state;
+
 typedef struct {
 	// Output options
 	bool erronly;
@@ -117,14 +213,22 @@ typedef struct {
 	   If the list is empty, include all types.  */
 	struct regex_list *fs_include_list;
 	struct name_list *device_path_exclude_list;
+	/* Compiled form of the three lists above */
+	mp_int_mount_filter mount_filter;
 	filesystem_list path_select_list;
 	/* Linked list of mounted filesystems. */
 	struct mount_entry *mount_list;
+	mp_int_mount_index *mount_index;
 	struct name_list *seen;
 
 	byte_unit_enum display_unit;
 	// byte_unit unit;
 
+	/* fill rate prediction, retained via np_state */
+	bool fill_rate_enabled;
+	double fill_rate_smoothing;
+	mp_thresholds time_to_full_thresholds;
+
 	bool output_format_is_set;
 	mp_output_format output_format;
 } check_disk_config;
@@ -135,6 +239,20 @@ bool np_seen_name(struct name_list *list, const char *name);
 int np_add_regex(struct regex_list **list, const char *regex, int cflags);
 bool np_find_regmatch(struct regex_list *list, const char *name);
 
+mp_int_string_set mp_int_string_set_init(struct name_list *list);
+bool mp_int_string_set_contains(const mp_int_string_set *set, const char *name);
+mp_int_regex_set mp_int_regex_set_init(struct regex_list *list);
+bool mp_int_regex_set_match(const mp_int_regex_set *set, const char *name);
+mp_int_regex_search_set mp_int_regex_search_set_init(struct regex_list *list);
+bool mp_int_regex_search_set_match_mount_entry(const mp_int_regex_search_set *set,
+											   const struct mount_entry *mount_entry);
+void mp_int_regex_search_set_free(mp_int_regex_search_set *set);
+mp_int_mount_filter mp_int_mount_filter_init(struct regex_list *fs_exclude_list,
+											 struct regex_list *fs_include_list,
+											 struct name_list *device_path_exclude_list);
+bool mp_int_mount_filter_passes(const mp_int_mount_filter *filter, const char *devname,
+								const char *mountdir, const char *fs_type);
+
 parameter_list_elem parameter_list_init(const char *);
 
 parameter_list_elem *mp_int_fs_list_append(filesystem_list *list, const char *name);
@@ -143,6 +261,15 @@ parameter_list_elem *mp_int_fs_list_del(filesystem_list *list, parameter_list_el
 parameter_list_elem *mp_int_fs_list_get_next(parameter_list_elem *current);
 void mp_int_fs_list_set_best_match(filesystem_list list, struct mount_entry *mount_list,
 								   bool exact);
+void mp_int_fs_list_set_best_match_indexed(filesystem_list list,
+										   const mp_int_mount_index *mount_index, bool exact);
+
+mp_int_mountinfo_result mp_int_read_mountinfo(const char *mountinfo_path);
+
+mp_int_mount_index *mp_int_mount_index_build(struct mount_entry *mount_list);
+void mp_int_mount_index_free(mp_int_mount_index *mount_index);
+size_t mp_int_mount_index_select(const mp_int_mount_index *mount_index,
+								 const mp_int_mount_filter *filter, struct mount_entry **selected);
 
 measurement_unit measurement_unit_init();
 measurement_unit_list *add_measurement_list(measurement_unit_list *list, measurement_unit elem);
@@ -157,4 +284,14 @@ bool np_regex_match_mount_entry(struct mount_entry *, regex_t *);
 char *get_unit_string(byte_unit_enum);
 check_disk_config check_disk_config_init();
 
+uint64_t mp_int_fill_state_key(const char *name);
+mp_int_fill_state mp_int_fill_state_parse(const char *state_string);
+char *mp_int_fill_state_serialize(mp_int_fill_state state);
+void mp_int_fill_state_insert(mp_int_fill_state *state, mp_int_fill_state_entry entry);
+mp_int_fill_state_entry *mp_int_fill_state_find(mp_int_fill_state state, uint64_t key);
+mp_int_fill_state_entry mp_int_fill_state_update(const mp_int_fill_state_entry *previous,
+												 uint64_t key, uintmax_t used_bytes,
+												 double elapsed_seconds, double smoothing);
+double mp_int_time_to_full(mp_int_fill_state_entry entry, uintmax_t free_bytes);
+
 char *humanize_byte_value(unsigned long long value, bool use_si_units);
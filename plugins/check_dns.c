@@ -9,9 +9,6 @@
  *
  * This file contains the check_dns plugin
  *
- * LIMITATION: nslookup on Solaris 7 can return output over 2 lines, which
- * will not be picked up by this plugin
- *
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -37,10 +34,13 @@ const char *email = "devel@monitoring-plugins.org";
 #include "utils.h"
 #include "utils_base.h"
 #include "netutils.h"
-#include "runcmd.h"
 
 #include "states.h"
 #include "check_dns.d/config.h"
+#include "check_dns.d/dns_client.h"
+
+/* Name servers used if no server is given, as nslookup or dig do */
+#define RESOLV_CONF "/etc/resolv.conf"
 
 typedef struct {
 	int errorcode;
@@ -48,8 +48,10 @@ typedef struct {
 } check_dns_config_wrapper;
 static check_dns_config_wrapper process_arguments(int /*argc*/, char ** /*argv*/);
 static check_dns_config_wrapper validate_arguments(check_dns_config_wrapper /*config_wrapper*/);
-static mp_state_enum error_scan(char * /*input_buffer*/, bool * /*is_nxdomain*/,
-								const char /*dns_server*/[ADDRESS_LENGTH]);
+static void default_dns_server(char /*dns_server*/[ADDRESS_LENGTH]);
+static size_t add_queries(dns_query * /*queries*/, const char * /*query_address*/,
+						  const uint16_t * /*record_type*/, size_t /*record_type_cnt*/);
+static void print_query(const dns_query * /*query*/);
 static bool ip_match_cidr(const char * /*addr*/, const char * /*cidr_ro*/);
 static unsigned long ip2long(const char * /*src*/);
 static void print_help(void);
@@ -70,7 +72,7 @@ int main(int argc, char **argv) {
 	textdomain(PACKAGE);
 
 	/* Set signal handling and alarm */
-	if (signal(SIGALRM, runcmd_timeout_alarm_handler) == SIG_ERR) {
+	if (signal(SIGALRM, socket_timeout_alarm_handler) == SIG_ERR) {
 		usage_va(_("Cannot catch SIGALRM"));
 	}
 
@@ -85,175 +87,173 @@ int main(int argc, char **argv) {
 
 	const check_dns_config config = tmp.config;
 
-	char *command_line = NULL;
-	/* get the command to run */
-	xasprintf(&command_line, "%s %s %s", NSLOOKUP_COMMAND, config.query_address, config.dns_server);
-
+	/* The queries stop at their own deadline, the alarm catches a hanging name resolution of the
+	 * server */
 	struct timeval tv;
-	alarm(timeout_interval);
 	gettimeofday(&tv, NULL);
+	alarm(socket_timeout + 1);
+
+	char dns_server[ADDRESS_LENGTH];
+	if (strlen(config.dns_server) > 0) {
+		strcpy(dns_server, config.dns_server);
+	} else {
+		default_dns_server(dns_server);
+	}
+
+	char port[8];
+	snprintf(port, sizeof(port), "%d", config.dns_port);
+	struct addrinfo hints = {
+		.ai_family = AF_UNSPEC,
+		.ai_socktype = SOCK_DGRAM,
+		.ai_flags = AI_NUMERICSERV,
+	};
+	struct addrinfo *server = NULL;
+	int resolve_result = getaddrinfo(dns_server, port, &hints, &server);
+	if (resolve_result != 0) {
+		die(STATE_UNKNOWN, _("Invalid hostname/address - %s: %s\n"), dns_server,
+			gai_strerror(resolve_result));
+	}
+
+	/* every name with every record type, A and AAAA by default */
+	size_t queries_per_name = (config.record_type_cnt > 0) ? config.record_type_cnt : 2;
+	dns_query *queries = calloc(config.query_address_cnt * queries_per_name, sizeof(dns_query));
+	if (queries == NULL) {
+		die(STATE_UNKNOWN, _("Could not allocate memory for the queries\n"));
+	}
+	size_t number_of_queries = 0;
+	char *query_string = NULL; /* comma separated names for the output */
+	for (size_t i = 0; i < config.query_address_cnt; i++) {
+		number_of_queries += add_queries(&queries[number_of_queries], config.query_address[i],
+										 config.record_type, config.record_type_cnt);
+		if (query_string == NULL) {
+			query_string = config.query_address[i];
+		} else {
+			xasprintf(&query_string, "%s,%s", query_string, config.query_address[i]);
+		}
+	}
 
 	if (verbose) {
-		printf("%s\n", command_line);
+		printf(_("Sending %zu queries to %s port %d\n"), number_of_queries, dns_server,
+			   config.dns_port);
 	}
 
-	output chld_out;
-	output chld_err;
-	char *msg = NULL;
-	mp_state_enum result = STATE_UNKNOWN;
-	/* run the command */
-	if ((np_runcmd(command_line, &chld_out, &chld_err, 0)) != 0) {
-		msg = (char *)_("nslookup returned an error status");
-		result = STATE_WARNING;
+	double timeout = socket_timeout - ((double)deltime(tv) / 1.0e6);
+	if (dns_send_queries(server->ai_addr, server->ai_addrlen, queries, number_of_queries,
+						 timeout) != OK) {
+		die(STATE_UNKNOWN, _("Cannot create socket: %s\n"), strerror(errno));
 	}
+	freeaddrinfo(server);
 
 	/* =====
-	 * scan stdout, main results get retrieved here
+	 * evaluate the responses, main results get retrieved here
 	 * =====
 	 */
+	char *msg = "";
+	mp_state_enum result = STATE_OK;
 	char *address = NULL;    /* comma separated str with addrs/ptrs (sorted) */
-	char **addresses = NULL; // All addresses parsed from stdout
+	char **addresses = NULL; // All addresses of all responses
 	size_t n_addresses = 0;  // counter for retrieved addresses
 	bool non_authoritative = false;
 	bool is_nxdomain = false;
-	bool parse_address = false; /* This flag scans for Address: but only after Name: */
-	for (size_t i = 0; i < chld_out.lines; i++) {
-		if (addresses == NULL) {
-			addresses = malloc(sizeof(*addresses) * 10);
-		} else if (!(n_addresses % 10)) {
-			addresses = realloc(addresses, sizeof(*addresses) * (n_addresses + 10));
-		}
-
+	/* SERVFAIL or REFUSED only fails the run if no other query got an answer */
+	size_t number_of_answered = 0;
+	const dns_query *failed_query = NULL;
+	/* The queries run concurrently, so the slowest one is the response time */
+	double elapsed_time = 0;
+	for (size_t i = 0; i < number_of_queries; i++) {
+		const dns_query *query = &queries[i];
 		if (verbose) {
-			puts(chld_out.line[i]);
+			print_query(query);
 		}
 
-		if (strcasestr(chld_out.line[i], ".in-addr.arpa") ||
-			strcasestr(chld_out.line[i], ".ip6.arpa")) {
-			if ((strstr(chld_out.line[i], "canonical name = ") != NULL)) {
-				continue;
-			}
-			char *temp_buffer = NULL;
-			if ((temp_buffer = strstr(chld_out.line[i], "name = "))) {
-				addresses[n_addresses++] = strdup(temp_buffer + 7);
-			} else {
-				msg = (char *)_("Warning plugin error");
-				result = STATE_WARNING;
-			}
+		switch (query->status) {
+		case DNS_QUERY_ANSWERED:
+			break;
+		case DNS_QUERY_REFUSED:
+			die(STATE_CRITICAL, _("Connection to DNS %s was refused\n"), dns_server);
+		case DNS_QUERY_UNREACHABLE:
+			die(STATE_CRITICAL, _("Network is unreachable\n"));
+		case DNS_QUERY_INVALID:
+			result = max_state(result, STATE_WARNING);
+			xasprintf(&msg, _("Invalid response from DNS %s"), dns_server);
+			continue;
+		default:
+			die(STATE_CRITICAL, _("No response from DNS %s\n"), dns_server);
 		}
 
-		/* bug ID: 2946553 - Older versions of bind will use all available dns
-							 servers, we have to match the one specified */
-		if (strstr(chld_out.line[i], "Server:") && strlen(config.dns_server) > 0) {
-			char *temp_buffer = strchr(chld_out.line[i], ':');
-			if (temp_buffer == NULL) {
-				die(STATE_UNKNOWN, _("'%s' returned a weirdly formatted Server line\n"),
-					NSLOOKUP_COMMAND);
-			}
-
-			temp_buffer++;
-
-			/* Strip leading tabs */
-			for (; *temp_buffer != '\0' && *temp_buffer == '\t'; temp_buffer++) {
-				/* NOOP */;
-			}
-
-			strip(temp_buffer);
-			if (strlen(temp_buffer) == 0) {
-				die(STATE_CRITICAL, _("DNS CRITICAL - '%s' returned empty server string\n"),
-					NSLOOKUP_COMMAND);
-			}
-
-			if (strcmp(temp_buffer, config.dns_server) != 0) {
-				die(STATE_CRITICAL, _("DNS CRITICAL - No response from DNS %s\n"),
-					config.dns_server);
-			}
+		if (query->latency > elapsed_time) {
+			elapsed_time = query->latency;
 		}
 
-		/* the server is responding, we just got the host name... */
-		if (strstr(chld_out.line[i], "Name:")) {
-			parse_address = true;
-		} else if (parse_address && (strstr(chld_out.line[i], "Address:") ||
-									 strstr(chld_out.line[i], "Addresses:"))) {
-			char *temp_buffer = strchr(chld_out.line[i], ':');
-			if (temp_buffer == NULL) {
-				die(STATE_UNKNOWN, _("'%s' returned a weirdly formatted Address line\n"),
-					NSLOOKUP_COMMAND);
-			}
-
-			temp_buffer++;
-
-			/* Strip leading spaces */
-			while (*temp_buffer == ' ') {
-				temp_buffer++;
-			}
-
-			strip(temp_buffer);
-			if (strlen(temp_buffer) == 0) {
-				die(STATE_CRITICAL, _("DNS CRITICAL - '%s' returned empty host name string\n"),
-					NSLOOKUP_COMMAND);
-			}
+		switch (query->response.rcode) {
+		case DNS_RCODE_NOERROR:
+			break;
+		case DNS_RCODE_NXDOMAIN:
+			is_nxdomain = true;
+			break;
+		case DNS_RCODE_SERVFAIL:
+		case DNS_RCODE_REFUSED:
+			failed_query = query;
+			continue;
+		default:
+			/* Request error, e.g. FORMERR or NOTIMP */
+			result = max_state(result, STATE_WARNING);
+			xasprintf(&msg, _("DNS %s returned %s for %s"), dns_server,
+					  dns_rcode_to_string(query->response.rcode), query->name);
+			continue;
+		}
 
-			addresses[n_addresses++] = strdup(temp_buffer);
-		} else if (strstr(chld_out.line[i], _("Non-authoritative answer:"))) {
+		number_of_answered++;
+		if (!query->response.authoritative) {
 			non_authoritative = true;
 		}
 
-		result = error_scan(chld_out.line[i], &is_nxdomain, config.dns_server);
-		if (result != STATE_OK) {
-			msg = strchr(chld_out.line[i], ':');
-			if (msg) {
-				msg++;
-			}
-			break;
+		addresses = realloc(addresses,
+							(n_addresses + query->response.number_of_answers) * sizeof(*addresses));
+		for (size_t j = 0; j < query->response.number_of_answers; j++) {
+			addresses[n_addresses++] = query->response.answers[j].data;
 		}
 	}
 
-	char input_buffer[MAX_INPUT_BUFFER];
-	/* scan stderr */
-	for (size_t i = 0; i < chld_err.lines; i++) {
-		if (verbose) {
-			puts(chld_err.line[i]);
-		}
-
-		if (error_scan(chld_err.line[i], &is_nxdomain, config.dns_server) != STATE_OK) {
-			result =
-				max_state(result, error_scan(chld_err.line[i], &is_nxdomain, config.dns_server));
-			msg = strchr(input_buffer, ':');
-			if (msg) {
-				msg++;
-			} else {
-				msg = input_buffer;
+	if (failed_query != NULL) {
+		if (number_of_answered == 0 && result == STATE_OK) {
+			if (failed_query->response.rcode == DNS_RCODE_SERVFAIL) {
+				die(STATE_CRITICAL, _("DNS failure for %s\n"), dns_server);
 			}
+			die(STATE_CRITICAL, _("Query was refused by DNS server at %s\n"), dns_server);
 		}
+		/* e.g. only the AAAA query failed, the answers of the others are still valid */
+		result = max_state(result, STATE_WARNING);
+		xasprintf(&msg, _("DNS %s returned %s for the %s query of %s"), dns_server,
+				  dns_rcode_to_string(failed_query->response.rcode),
+				  dns_type_to_string(failed_query->type), failed_query->name);
 	}
 
 	if (is_nxdomain && !config.expect_nxdomain) {
-		die(STATE_CRITICAL, _("Domain '%s' was not found by the server\n"), config.query_address);
+		die(STATE_CRITICAL, _("Domain '%s' was not found by the server\n"), query_string);
 	}
 
-	if (addresses) {
-		size_t slen = 1;
-		char *adrp = NULL;
-		qsort(addresses, n_addresses, sizeof(*addresses), qstrcmp);
-		for (size_t i = 0; i < n_addresses; i++) {
-			slen += strlen(addresses[i]) + 1;
-		}
+	if (result == STATE_OK && n_addresses == 0 && !is_nxdomain) {
+		die(STATE_CRITICAL, _("DNS %s has no records for %s\n"), dns_server, query_string);
+	}
 
-		// Temporary pointer adrp gets moved, address stays on the beginning
-		adrp = address = malloc(slen);
-		for (size_t i = 0; i < n_addresses; i++) {
-			if (i) {
-				*adrp++ = ',';
-			}
-			strcpy(adrp, addresses[i]);
-			adrp += strlen(addresses[i]);
+	size_t slen = 1;
+	char *adrp = NULL;
+	qsort(addresses, n_addresses, sizeof(*addresses), qstrcmp);
+	for (size_t i = 0; i < n_addresses; i++) {
+		slen += strlen(addresses[i]) + 1;
+	}
+
+	// Temporary pointer adrp gets moved, address stays on the beginning
+	adrp = address = malloc(slen);
+	for (size_t i = 0; i < n_addresses; i++) {
+		if (i) {
+			*adrp++ = ',';
 		}
-		*adrp = 0;
-	} else {
-		die(STATE_CRITICAL, _("DNS CRITICAL - '%s' msg parsing exited with no address\n"),
-			NSLOOKUP_COMMAND);
+		strcpy(adrp, addresses[i]);
+		adrp += strlen(addresses[i]);
 	}
+	*adrp = 0;
 
 	/* compare to expected address */
 	if (result == STATE_OK && config.expected_address_cnt > 0) {
@@ -290,7 +290,7 @@ int main(int argc, char **argv) {
 	if (config.expect_nxdomain) {
 		if (!is_nxdomain) {
 			result = STATE_CRITICAL;
-			xasprintf(&msg, _("Domain '%s' was found by the server: '%s'\n"), config.query_address,
+			xasprintf(&msg, _("Domain '%s' was found by the server: '%s'\n"), query_string,
 					  address);
 		} else {
 			if (address != NULL) {
@@ -303,13 +303,9 @@ int main(int argc, char **argv) {
 	/* check if authoritative */
 	if (result == STATE_OK && config.expect_authority && non_authoritative) {
 		result = STATE_CRITICAL;
-		xasprintf(&msg, _("server %s is not authoritative for %s"), config.dns_server,
-				  config.query_address);
+		xasprintf(&msg, _("server %s is not authoritative for %s"), dns_server, query_string);
 	}
 
-	long microsec = deltime(tv);
-	double elapsed_time = (double)microsec / 1.0e6;
-
 	if (result == STATE_OK) {
 		result = get_status(elapsed_time, config.time_thresholds);
 		if (result == STATE_OK) {
@@ -321,7 +317,7 @@ int main(int argc, char **argv) {
 		}
 		printf(ngettext("%.3f second response time", "%.3f seconds response time", elapsed_time),
 			   elapsed_time);
-		printf(_(". %s returns %s"), config.query_address, address);
+		printf(_(". %s returns %s"), query_string, address);
 		if ((config.time_thresholds->warning != NULL) &&
 			(config.time_thresholds->critical != NULL)) {
 			printf("|%s\n",
@@ -380,70 +376,79 @@ unsigned long ip2long(const char *src) {
 			   : 0;
 }
 
-mp_state_enum error_scan(char *input_buffer, bool *is_nxdomain,
-						 const char dns_server[ADDRESS_LENGTH]) {
-
-	const int nxdomain = strstr(input_buffer, "Non-existent") ||
-						 strstr(input_buffer, "** server can't find") ||
-						 strstr(input_buffer, "** Can't find") || strstr(input_buffer, "NXDOMAIN");
-	if (nxdomain) {
-		*is_nxdomain = true;
-	}
-
-	/* the DNS lookup timed out */
-	if (strstr(input_buffer,
-			   _("Note: nslookup is deprecated and may be removed from future releases.")) ||
-		strstr(input_buffer,
-			   _("Consider using the `dig' or `host' programs instead.  Run nslookup with")) ||
-		strstr(input_buffer, _("the `-sil[ent]' option to prevent this message from appearing."))) {
-		return STATE_OK;
-	}
-
-	/* DNS server is not running... */
-	else if (strstr(input_buffer, "No response from server")) {
-		die(STATE_CRITICAL, _("No response from DNS %s\n"), dns_server);
-	} else if (strstr(input_buffer, "no servers could be reached")) {
-		die(STATE_CRITICAL, _("No response from DNS %s\n"), dns_server);
-	}
+/* The first name server of the resolver configuration, the resolver's default otherwise */
+void default_dns_server(char dns_server[ADDRESS_LENGTH]) {
+	strcpy(dns_server, "127.0.0.1");
 
-	/* Host name is valid, but server doesn't have records... */
-	else if (strstr(input_buffer, "No records")) {
-		die(STATE_CRITICAL, _("DNS %s has no records\n"), dns_server);
+	FILE *resolv_conf = fopen(RESOLV_CONF, "r");
+	if (resolv_conf == NULL) {
+		return;
 	}
 
-	/* Connection was refused */
-	else if (strstr(input_buffer, "Connection refused") ||
-			 strstr(input_buffer, "Couldn't find server") || strstr(input_buffer, "Refused") ||
-			 (strstr(input_buffer, "** server can't find") && strstr(input_buffer, ": REFUSED"))) {
-		die(STATE_CRITICAL, _("Connection to DNS %s was refused\n"), dns_server);
-	}
-
-	/* Query refused (usually by an ACL in the namserver) */
-	else if (strstr(input_buffer, "Query refused")) {
-		die(STATE_CRITICAL, _("Query was refused by DNS server at %s\n"), dns_server);
-	}
-
-	/* No information (e.g. nameserver IP has two PTR records) */
-	else if (strstr(input_buffer, "No information")) {
-		die(STATE_CRITICAL, _("No information returned by DNS server at %s\n"), dns_server);
+	char line[MAX_INPUT_BUFFER];
+	char keyword[16];
+	char server[ADDRESS_LENGTH];
+	while (fgets(line, sizeof(line), resolv_conf) != NULL) {
+		if (sscanf(line, "%15s %255s", keyword, server) == 2 &&
+			strcmp(keyword, "nameserver") == 0) {
+			strcpy(dns_server, server);
+			break;
+		}
 	}
+	fclose(resolv_conf);
+}
 
-	/* Network is unreachable */
-	else if (strstr(input_buffer, "Network is unreachable")) {
-		die(STATE_CRITICAL, _("Network is unreachable\n"));
+/*
+ * Adds the queries for one name. An address is looked up in the reverse
+ * zone like nslookup does, so PTR is the default for it.
+ */
+size_t add_queries(dns_query *queries, const char *query_address, const uint16_t *record_type,
+				   size_t record_type_cnt) {
+	char reverse_name[DNS_MAX_NAME_LENGTH + 1];
+	bool is_address = dns_reverse_name(query_address, reverse_name, sizeof(reverse_name));
+	const char *ptr_name = is_address ? strdup(reverse_name) : query_address;
+
+	if (record_type_cnt == 0) {
+		if (is_address) {
+			dns_query_init(&queries[0], ptr_name, DNS_TYPE_PTR);
+			return 1;
+		}
+		dns_query_init(&queries[0], query_address, DNS_TYPE_A);
+		dns_query_init(&queries[1], query_address, DNS_TYPE_AAAA);
+		return 2;
 	}
 
-	/* Internal server failure */
-	else if (strstr(input_buffer, "Server failure")) {
-		die(STATE_CRITICAL, _("DNS failure for %s\n"), dns_server);
+	for (size_t i = 0; i < record_type_cnt; i++) {
+		dns_query_init(&queries[i], (record_type[i] == DNS_TYPE_PTR) ? ptr_name : query_address,
+					   record_type[i]);
 	}
+	return record_type_cnt;
+}
 
-	/* Request error or the DNS lookup timed out */
-	else if (strstr(input_buffer, "Format error") || strstr(input_buffer, "Timed out")) {
-		return STATE_WARNING;
+void print_query(const dns_query *query) {
+	printf("%s %s: ", dns_type_to_string(query->type), query->name);
+	switch (query->status) {
+	case DNS_QUERY_ANSWERED:
+		printf(_("%s, %zu answers%s in %.6f seconds%s\n"),
+			   dns_rcode_to_string(query->response.rcode), query->response.number_of_answers,
+			   query->response.authoritative ? "" : _(" (non-authoritative)"), query->latency,
+			   query->over_tcp ? _(" over TCP") : "");
+		for (size_t i = 0; i < query->response.number_of_answers; i++) {
+			printf("  %s\n", query->response.answers[i].data);
+		}
+		break;
+	case DNS_QUERY_REFUSED:
+		printf("%s\n", _("connection refused"));
+		break;
+	case DNS_QUERY_UNREACHABLE:
+		printf("%s\n", _("network unreachable"));
+		break;
+	case DNS_QUERY_INVALID:
+		printf("%s\n", _("invalid response"));
+		break;
+	default:
+		printf("%s\n", _("no response"));
 	}
-
-	return STATE_OK;
 }
 
 /* process command-line arguments */
@@ -454,6 +459,8 @@ check_dns_config_wrapper process_arguments(int argc, char **argv) {
 										{"timeout", required_argument, 0, 't'},
 										{"hostname", required_argument, 0, 'H'},
 										{"server", required_argument, 0, 's'},
+										{"port", required_argument, 0, 'p'},
+										{"record-type", required_argument, 0, 'T'},
 										{"reverse-server", required_argument, 0, 'r'},
 										{"expected-address", required_argument, 0, 'a'},
 										{"expect-nxdomain", no_argument, 0, 'n'},
@@ -484,7 +491,7 @@ check_dns_config_wrapper process_arguments(int argc, char **argv) {
 	int opt_index = 0;
 	int index = 0;
 	while (true) {
-		index = getopt_long(argc, argv, "hVvALnt:H:s:r:a:w:c:", long_opts, &opt_index);
+		index = getopt_long(argc, argv, "hVvALnt:H:s:p:T:r:a:w:c:", long_opts, &opt_index);
 
 		if (index == -1 || index == EOF) {
 			break;
@@ -501,13 +508,16 @@ check_dns_config_wrapper process_arguments(int argc, char **argv) {
 			verbose = true;
 			break;
 		case 't': /* timeout period */
-			timeout_interval = atoi(optarg);
+			socket_timeout = atoi(optarg);
 			break;
-		case 'H': /* hostname */
+		case 'H': /* hostname, can be repeated */
 			if (strlen(optarg) >= ADDRESS_LENGTH) {
 				die(STATE_UNKNOWN, _("Input buffer overflow\n"));
 			}
-			strcpy(result.config.query_address, optarg);
+			result.config.query_address =
+				realloc(result.config.query_address,
+						(result.config.query_address_cnt + 1) * sizeof(char *));
+			result.config.query_address[result.config.query_address_cnt++] = strdup(optarg);
 			break;
 		case 's': /* server name */
 			/* TODO: this host_or_die check is probably unnecessary.
@@ -518,6 +528,24 @@ check_dns_config_wrapper process_arguments(int argc, char **argv) {
 			}
 			strcpy(result.config.dns_server, optarg);
 			break;
+		case 'p': /* server port */
+			result.config.dns_port = atoi(optarg);
+			if (result.config.dns_port <= 0 || result.config.dns_port > 65535) {
+				usage2(_("Port must be a positive integer"), optarg);
+			}
+			break;
+		case 'T': /* record types, comma separated and can be repeated */
+			for (char *type = strtok(optarg, ","); type != NULL; type = strtok(NULL, ",")) {
+				int record_type = dns_type_from_string(type);
+				if (record_type < 0) {
+					usage2(_("Unknown record type"), type);
+				}
+				result.config.record_type =
+					realloc(result.config.record_type,
+							(result.config.record_type_cnt + 1) * sizeof(uint16_t));
+				result.config.record_type[result.config.record_type_cnt++] = (uint16_t)record_type;
+			}
+			break;
 		case 'r': /* reverse server name */
 			/* TODO: Is this host_or_die necessary? */
 			// TODO This does not do anything!!! 2025-03-08 rincewind
@@ -578,11 +606,12 @@ check_dns_config_wrapper process_arguments(int argc, char **argv) {
 	}
 
 	index = optind;
-	if (strlen(result.config.query_address) == 0 && index < argc) {
+	if (result.config.query_address_cnt == 0 && index < argc) {
 		if (strlen(argv[index]) >= ADDRESS_LENGTH) {
 			die(STATE_UNKNOWN, _("Input buffer overflow\n"));
 		}
-		strcpy(result.config.query_address, argv[index++]);
+		result.config.query_address = malloc(sizeof(char *));
+		result.config.query_address[result.config.query_address_cnt++] = strdup(argv[index++]);
 	}
 
 	if (strlen(result.config.dns_server) == 0 && index < argc) {
@@ -600,7 +629,7 @@ check_dns_config_wrapper process_arguments(int argc, char **argv) {
 }
 
 check_dns_config_wrapper validate_arguments(check_dns_config_wrapper config_wrapper) {
-	if (config_wrapper.config.query_address[0] == 0) {
+	if (config_wrapper.config.query_address_cnt == 0) {
 		printf("missing --host argument\n");
 		config_wrapper.errorcode = ERROR;
 		return config_wrapper;
@@ -621,8 +650,10 @@ void print_help(void) {
 	printf("Copyright (c) 1999 Ethan Galstad <nagios@nagios.org>\n");
 	printf(COPYRIGHT, copyright, email);
 
-	printf("%s\n", _("This plugin uses the nslookup program to obtain the IP address for the given "
-					 "host/domain query."));
+	printf("%s\n", _("This plugin queries a DNS server directly to obtain the IP address for the "
+					 "given host/domain query."));
+	printf("%s\n", _("Several names and record types are queried at the same time, truncated"));
+	printf("%s\n", _("responses are repeated over TCP."));
 	printf("%s\n", _("An optional DNS server to use may be specified."));
 	printf("%s\n", _("If no DNS server is specified, the default server(s) specified in "
 					 "/etc/resolv.conf will be used."));
@@ -635,9 +666,15 @@ void print_help(void) {
 	printf(UT_EXTRA_OPTS);
 
 	printf(" -H, --hostname=HOST\n");
-	printf("    %s\n", _("The name or address you want to query"));
+	printf("    %s\n", _("The name or address you want to query. This option can be repeated to"));
+	printf("    %s\n", _("query several names, the answers of all of them are combined."));
 	printf(" -s, --server=HOST\n");
 	printf("    %s\n", _("Optional DNS server you want to use for the lookup"));
+	printf(" -p, --port=INTEGER\n");
+	printf("    %s (%s: %d)\n", _("Port of the DNS server"), _("default"), DNS_PORT);
+	printf(" -T, --record-type=TYPE[,TYPE...]\n");
+	printf("    %s\n", _("Record types to query: A, AAAA, CNAME, MX, NS, PTR, SOA or TXT."));
+	printf("    %s\n", _("Default is A and AAAA for names and PTR for addresses"));
 	printf(" -a, --expected-address=IP-ADDRESS|CIDR|HOST\n");
 	printf("    %s\n",
 		   _("Optional IP-ADDRESS/CIDR you expect the DNS server to return. HOST must end"));
@@ -666,7 +703,6 @@ void print_help(void) {
 
 void print_usage(void) {
 	printf("%s\n", _("Usage:"));
-	printf("%s -H host [-s server] [-a expected-address] [-n] [-A] [-t timeout] [-w warn] [-c "
-		   "crit] [-L]\n",
-		   progname);
+	printf("%s -H host [-H host...] [-s server] [-p port] [-T type[,type...]]\n", progname);
+	printf("[-a expected-address] [-n] [-A] [-t timeout] [-w warn] [-c crit] [-L]\n");
 }
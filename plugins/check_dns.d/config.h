@@ -2,14 +2,20 @@
 
 #include "../../config.h"
 #include "thresholds.h"
+#include "./dns_client.h"
 #include <stddef.h>
+#include <stdint.h>
 
 #define ADDRESS_LENGTH 256
 
 typedef struct {
 	bool all_match;
 	char dns_server[ADDRESS_LENGTH];
-	char query_address[ADDRESS_LENGTH];
+	int dns_port;
+	char **query_address;
+	size_t query_address_cnt;
+	uint16_t *record_type; /* none means A and AAAA for names, PTR for addresses */
+	size_t record_type_cnt;
 	bool expect_nxdomain;
 	bool expect_authority;
 	char **expected_address;
@@ -22,7 +28,11 @@ check_dns_config check_dns_config_init() {
 	check_dns_config tmp = {
 		.all_match = false,
 		.dns_server = "",
-		.query_address = "",
+		.dns_port = DNS_PORT,
+		.query_address = NULL,
+		.query_address_cnt = 0,
+		.record_type = NULL,
+		.record_type_cnt = 0,
 		.expect_nxdomain = false,
 		.expect_authority = false,
 		.expected_address = NULL,
@@ -0,0 +1,780 @@
+#include "./dns_client.h"
+#include "../common.h"
+#include "../utils.h"
+#include "../../lib/utils_base.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Pointers are only followed this often, so a compression loop ends */
+#define DNS_MAX_COMPRESSION_POINTERS 64
+
+static const struct {
+	const char *name;
+	uint16_t type;
+} dns_types[] = {
+	{"A", DNS_TYPE_A},     {"NS", DNS_TYPE_NS}, {"CNAME", DNS_TYPE_CNAME}, {"SOA", DNS_TYPE_SOA},
+	{"PTR", DNS_TYPE_PTR}, {"MX", DNS_TYPE_MX}, {"TXT", DNS_TYPE_TXT},     {"AAAA", DNS_TYPE_AAAA},
+};
+
+/* State of one query while it is in flight */
+typedef struct {
+	uint16_t id;
+	uint8_t request[DNS_MAX_QUERY_LENGTH];
+	size_t request_length;
+	bool edns;
+	double first_sent;
+	double next_transmission;
+	double retransmit_interval;
+	bool needs_tcp;
+} dns_transaction;
+
+static double now(void) {
+	struct timespec current;
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return (double)current.tv_sec + ((double)current.tv_nsec / 1e9);
+}
+
+static uint16_t get16(const uint8_t *buffer) { return (uint16_t)((buffer[0] << 8) | buffer[1]); }
+
+static uint32_t get32(const uint8_t *buffer) {
+	return ((uint32_t)get16(buffer) << 16) | get16(buffer + 2);
+}
+
+static uint8_t *put16(uint8_t *buffer, uint16_t value) {
+	buffer[0] = (uint8_t)(value >> 8);
+	buffer[1] = (uint8_t)value;
+	return buffer + 2;
+}
+
+int dns_type_from_string(const char *name) {
+	for (size_t i = 0; i < sizeof(dns_types) / sizeof(dns_types[0]); i++) {
+		if (strcasecmp(name, dns_types[i].name) == 0) {
+			return dns_types[i].type;
+		}
+	}
+	return -1;
+}
+
+const char *dns_type_to_string(uint16_t type) {
+	for (size_t i = 0; i < sizeof(dns_types) / sizeof(dns_types[0]); i++) {
+		if (dns_types[i].type == type) {
+			return dns_types[i].name;
+		}
+	}
+	return "UNKNOWN";
+}
+
+const char *dns_rcode_to_string(int rcode) {
+	switch (rcode) {
+	case DNS_RCODE_NOERROR:
+		return "NOERROR";
+	case DNS_RCODE_FORMERR:
+		return "FORMERR";
+	case DNS_RCODE_SERVFAIL:
+		return "SERVFAIL";
+	case DNS_RCODE_NXDOMAIN:
+		return "NXDOMAIN";
+	case DNS_RCODE_NOTIMP:
+		return "NOTIMP";
+	case DNS_RCODE_REFUSED:
+		return "REFUSED";
+	default:
+		return "UNKNOWN";
+	}
+}
+
+/* The in-addr.arpa or ip6.arpa name of an address, false if it is no address */
+bool dns_reverse_name(const char *address, char *name, size_t size) {
+	struct in_addr ipv4;
+	struct in6_addr ipv6;
+	size_t used = 0;
+
+	if (inet_pton(AF_INET, address, &ipv4) == 1) {
+		const uint8_t *bytes = (const uint8_t *)&ipv4;
+		used = snprintf(name, size, "%u.%u.%u.%u.in-addr.arpa.", bytes[3], bytes[2], bytes[1],
+						bytes[0]);
+	} else if (inet_pton(AF_INET6, address, &ipv6) == 1) {
+		static const char hex[] = "0123456789abcdef";
+		if (size < (16 * 4) + strlen("ip6.arpa.") + 1) {
+			return false;
+		}
+		for (int i = 15; i >= 0; i--) {
+			name[used++] = hex[ipv6.s6_addr[i] & 0x0F];
+			name[used++] = '.';
+			name[used++] = hex[ipv6.s6_addr[i] >> 4];
+			name[used++] = '.';
+		}
+		used += snprintf(name + used, size - used, "ip6.arpa.");
+	} else {
+		return false;
+	}
+	return used < size;
+}
+
+/*
+ * Writes a query with recursion desired for one name and type (RFC 1035,
+ * 4.1), with an OPT record (RFC 6891) if edns is set. Returns the length of
+ * the message or 0 if the name can not be encoded.
+ */
+size_t dns_build_query(uint8_t *buffer, size_t size, uint16_t id, const char *name, uint16_t type,
+					   bool edns) {
+	if (size < DNS_MAX_QUERY_LENGTH) {
+		return 0;
+	}
+
+	memset(buffer, 0, DNS_HEADER_LENGTH);
+	put16(buffer, id);
+	buffer[2] = 0x01; /* RD */
+	put16(buffer + 4, 1);
+	put16(buffer + 10, edns ? 1 : 0);
+
+	uint8_t *position = buffer + DNS_HEADER_LENGTH;
+	const char *label = name;
+	while (*label != '\0' && strcmp(label, ".") != 0) {
+		const char *end = strchr(label, '.');
+		size_t label_length = (end != NULL) ? (size_t)(end - label) : strlen(label);
+		if (label_length == 0 || label_length > 63) {
+			return 0;
+		}
+		/* The encoded name including the root label may not exceed 255 Byte */
+		if ((size_t)(position - buffer) - DNS_HEADER_LENGTH + label_length + 2 >
+			DNS_MAX_NAME_LENGTH) {
+			return 0;
+		}
+		*position++ = (uint8_t)label_length;
+		memcpy(position, label, label_length);
+		position += label_length;
+		if (end == NULL) {
+			break;
+		}
+		label = end + 1;
+	}
+	*position++ = 0;
+	position = put16(position, type);
+	position = put16(position, DNS_CLASS_IN);
+
+	if (edns) {
+		*position++ = 0; /* root */
+		position = put16(position, DNS_TYPE_OPT);
+		position = put16(position, DNS_EDNS_PAYLOAD_SIZE);
+		/* Extended rcode, version and flags in the TTL, no options */
+		memset(position, 0, 6);
+		position += 6;
+	}
+	return (size_t)(position - buffer);
+}
+
+/*
+ * Reads a possibly compressed name at *offset into its presentation
+ * format and moves *offset behind it.
+ */
+static bool read_name(const uint8_t *message, size_t length, size_t *offset, char *name,
+					  size_t size) {
+	size_t position = *offset;
+	size_t used = 0;
+	size_t end_of_name = 0;
+	int pointers = 0;
+
+	while (true) {
+		if (position >= length) {
+			return false;
+		}
+		uint8_t label_length = message[position];
+		if ((label_length & 0xC0) == 0xC0) {
+			if (position + 1 >= length || ++pointers > DNS_MAX_COMPRESSION_POINTERS) {
+				return false;
+			}
+			if (end_of_name == 0) {
+				end_of_name = position + 2;
+			}
+			position = ((label_length & 0x3F) << 8) | message[position + 1];
+			continue;
+		}
+		if (label_length > 63) {
+			return false;
+		}
+		position++;
+		if (label_length == 0) {
+			break;
+		}
+		if (position + label_length > length) {
+			return false;
+		}
+		for (size_t i = 0; i < label_length; i++) {
+			uint8_t character = message[position + i];
+			/* Room for an escaped character, the dot and the terminator */
+			if (used + 6 > size) {
+				return false;
+			}
+			if (character == '.' || character == '\\') {
+				name[used++] = '\\';
+				name[used++] = (char)character;
+			} else if (character > 0x20 && character < 0x7F) {
+				name[used++] = (char)character;
+			} else {
+				used += snprintf(name + used, size - used, "\\%03u", character);
+			}
+		}
+		name[used++] = '.';
+		position += label_length;
+	}
+
+	if (used == 0) {
+		if (size < 2) {
+			return false;
+		}
+		name[used++] = '.';
+	}
+	name[used] = '\0';
+	*offset = (end_of_name != 0) ? end_of_name : position;
+	return true;
+}
+
+/* Presentation format of the record data, NULL if the type is not supported or malformed */
+static char *format_rdata(const uint8_t *message, size_t offset, uint16_t type,
+						  uint16_t rdata_length) {
+	char name[DNS_MAX_NAME_TEXT_LENGTH];
+	char text[INET6_ADDRSTRLEN];
+	char *result = NULL;
+	size_t position = offset;
+
+	switch (type) {
+	case DNS_TYPE_A:
+		if (rdata_length != 4 || inet_ntop(AF_INET, message + offset, text, sizeof(text)) == NULL) {
+			return NULL;
+		}
+		return strdup(text);
+	case DNS_TYPE_AAAA:
+		if (rdata_length != 16 ||
+			inet_ntop(AF_INET6, message + offset, text, sizeof(text)) == NULL) {
+			return NULL;
+		}
+		return strdup(text);
+	case DNS_TYPE_NS:
+	case DNS_TYPE_CNAME:
+	case DNS_TYPE_PTR:
+		if (!read_name(message, offset + rdata_length, &position, name, sizeof(name))) {
+			return NULL;
+		}
+		return strdup(name);
+	case DNS_TYPE_MX:
+		if (rdata_length < 3) {
+			return NULL;
+		}
+		position += 2;
+		if (!read_name(message, offset + rdata_length, &position, name, sizeof(name))) {
+			return NULL;
+		}
+		xasprintf(&result, "%u %s", get16(message + offset), name);
+		return result;
+	case DNS_TYPE_SOA: {
+		char mailbox[sizeof(name)];
+		if (!read_name(message, offset + rdata_length, &position, name, sizeof(name)) ||
+			!read_name(message, offset + rdata_length, &position, mailbox, sizeof(mailbox)) ||
+			position + 20 != offset + rdata_length) {
+			return NULL;
+		}
+		xasprintf(&result, "%s %s %u %u %u %u %u", name, mailbox, get32(message + position),
+				  get32(message + position + 4), get32(message + position + 8),
+				  get32(message + position + 12), get32(message + position + 16));
+		return result;
+	}
+	case DNS_TYPE_TXT:
+		/* The character strings are concatenated, as SPF and DKIM do */
+		result = calloc(rdata_length + 1, 1);
+		if (result == NULL) {
+			die(STATE_UNKNOWN, "memory allocation failed");
+		}
+		size_t used = 0;
+		while (position < offset + rdata_length) {
+			uint8_t string_length = message[position++];
+			if (position + string_length > offset + rdata_length) {
+				free(result);
+				return NULL;
+			}
+			memcpy(result + used, message + position, string_length);
+			used += string_length;
+			position += string_length;
+		}
+		return result;
+	default:
+		return NULL;
+	}
+}
+
+static bool add_answer(dns_response *response, uint16_t type, uint32_t ttl, char *data) {
+	dns_record *answers =
+		realloc(response->answers, (response->number_of_answers + 1) * sizeof(dns_record));
+	if (answers == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+	response->answers = answers;
+	response->answers[response->number_of_answers++] = (dns_record){
+		.type = type,
+		.ttl = ttl,
+		.data = data,
+	};
+	return true;
+}
+
+/*
+ * Parses a response. A truncated response may end in the middle of a
+ * record, everything before is kept then.
+ */
+dns_response dns_parse_response(const uint8_t *message, size_t length) {
+	dns_response result = {
+		.errorcode = ERROR,
+	};
+
+	if (length < DNS_HEADER_LENGTH) {
+		return result;
+	}
+
+	result.id = get16(message);
+	if ((message[2] & 0x80) == 0) {
+		/* not a response */
+		return result;
+	}
+	result.authoritative = (message[2] & 0x04) != 0;
+	result.truncated = (message[2] & 0x02) != 0;
+	result.rcode = message[3] & 0x0F;
+
+	uint16_t question_count = get16(message + 4);
+	uint16_t record_counts[3] = {get16(message + 6), get16(message + 8), get16(message + 10)};
+	size_t position = DNS_HEADER_LENGTH;
+
+	if (question_count > 1) {
+		return result;
+	}
+	if (question_count == 1) {
+		if (!read_name(message, length, &position, result.question_name,
+					   sizeof(result.question_name)) ||
+			position + 4 > length) {
+			return result;
+		}
+		result.question_type = get16(message + position);
+		position += 4;
+	}
+
+	for (int section = 0; section < 3; section++) {
+		for (uint16_t i = 0; i < record_counts[section]; i++) {
+			char owner[DNS_MAX_NAME_TEXT_LENGTH];
+			if (!read_name(message, length, &position, owner, sizeof(owner)) ||
+				position + 10 > length) {
+				result.errorcode = result.truncated ? OK : ERROR;
+				return result;
+			}
+			uint16_t type = get16(message + position);
+			uint32_t ttl = get32(message + position + 4);
+			uint16_t rdata_length = get16(message + position + 8);
+			position += 10;
+			if (position + rdata_length > length) {
+				result.errorcode = result.truncated ? OK : ERROR;
+				return result;
+			}
+
+			if (section == 0 && type == result.question_type) {
+				char *data = format_rdata(message, position, type, rdata_length);
+				if (data == NULL) {
+					dns_response_free(&result);
+					return result;
+				}
+				add_answer(&result, type, ttl, data);
+			} else if (section == 2 && type == DNS_TYPE_OPT) {
+				/* The upper 8 bits of the extended rcode are in the TTL */
+				result.edns = true;
+				result.rcode |= (int)((ttl >> 24) << 4);
+			}
+			position += rdata_length;
+		}
+	}
+
+	result.errorcode = OK;
+	return result;
+}
+
+void dns_response_free(dns_response *response) {
+	for (size_t i = 0; i < response->number_of_answers; i++) {
+		free(response->answers[i].data);
+	}
+	free(response->answers);
+	response->answers = NULL;
+	response->number_of_answers = 0;
+}
+
+void dns_query_init(dns_query *query, const char *name, uint16_t type) {
+	*query = (dns_query){
+		.name = name,
+		.type = type,
+		.status = DNS_QUERY_PENDING,
+	};
+}
+
+static bool same_name(const char *left, const char *right) {
+	size_t left_length = strlen(left);
+	size_t right_length = strlen(right);
+	/* The trailing dot is optional in queries */
+	if (left_length > 1 && left[left_length - 1] == '.') {
+		left_length--;
+	}
+	if (right_length > 1 && right[right_length - 1] == '.') {
+		right_length--;
+	}
+	return left_length == right_length && strncasecmp(left, right, left_length) == 0;
+}
+
+/* Finds the pending query a response belongs to */
+static dns_query *match_response(const dns_response *response, dns_query *queries,
+								 dns_transaction *transactions, size_t number_of_queries,
+								 dns_transaction **transaction) {
+	for (size_t i = 0; i < number_of_queries; i++) {
+		if (transactions[i].id != response->id || queries[i].status != DNS_QUERY_PENDING ||
+			transactions[i].needs_tcp) {
+			continue;
+		}
+		/* Some servers drop the question from a FORMERR */
+		bool has_question = response->question_name[0] != '\0';
+		if (has_question && (response->question_type != queries[i].type ||
+							 !same_name(response->question_name, queries[i].name))) {
+			return NULL;
+		}
+		*transaction = &transactions[i];
+		return &queries[i];
+	}
+	return NULL;
+}
+
+static void set_pending_status(dns_query *queries, dns_transaction *transactions,
+							   size_t number_of_queries, dns_query_status status) {
+	for (size_t i = 0; i < number_of_queries; i++) {
+		if (queries[i].status == DNS_QUERY_PENDING && !transactions[i].needs_tcp) {
+			queries[i].status = status;
+		}
+	}
+}
+
+static dns_query_status status_from_errno(int error) {
+	if (error == ECONNREFUSED) {
+		return DNS_QUERY_REFUSED;
+	}
+	if (error == ENETUNREACH || error == EHOSTUNREACH) {
+		return DNS_QUERY_UNREACHABLE;
+	}
+	return DNS_QUERY_PENDING;
+}
+
+static int poll_timeout(double until) {
+	double remaining = until - now();
+	return (remaining > 0) ? (int)ceil(remaining * 1000) : 0;
+}
+
+/* Waits until the socket is ready, false on the deadline */
+static bool wait_for(int socket, short events, double deadline) {
+	struct pollfd descriptor = {.fd = socket, .events = events};
+	while (true) {
+		int ready = poll(&descriptor, 1, poll_timeout(deadline));
+		if (ready > 0) {
+			return true;
+		}
+		if (ready == 0 || errno != EINTR) {
+			return false;
+		}
+	}
+}
+
+static bool write_all(int socket, const uint8_t *buffer, size_t length, double deadline) {
+	while (length > 0) {
+		if (!wait_for(socket, POLLOUT, deadline)) {
+			return false;
+		}
+		ssize_t written = send(socket, buffer, length, 0);
+		if (written < 0) {
+			if (errno == EINTR || errno == EAGAIN) {
+				continue;
+			}
+			return false;
+		}
+		buffer += written;
+		length -= (size_t)written;
+	}
+	return true;
+}
+
+static bool read_all(int socket, uint8_t *buffer, size_t length, double deadline) {
+	while (length > 0) {
+		if (!wait_for(socket, POLLIN, deadline)) {
+			return false;
+		}
+		ssize_t received = recv(socket, buffer, length, 0);
+		if (received < 0 && (errno == EINTR || errno == EAGAIN)) {
+			continue;
+		}
+		if (received <= 0) {
+			return false;
+		}
+		buffer += received;
+		length -= (size_t)received;
+	}
+	return true;
+}
+
+/*
+ * Repeats the queries with a truncated UDP response over one TCP
+ * connection. The queries are pipelined (RFC 7766, 6.2.1) and the
+ * responses may arrive in any order.
+ */
+static void send_tcp_queries(const struct sockaddr *server, socklen_t server_length,
+							 dns_query *queries, dns_transaction *transactions,
+							 size_t number_of_queries, double deadline) {
+	size_t pending = 0;
+	for (size_t i = 0; i < number_of_queries; i++) {
+		if (transactions[i].needs_tcp) {
+			pending++;
+		}
+	}
+	if (pending == 0) {
+		return;
+	}
+
+	dns_query_status failure = DNS_QUERY_TIMEOUT;
+	int tcp_socket = socket(server->sa_family, SOCK_STREAM, 0);
+	if (tcp_socket < 0) {
+		failure = DNS_QUERY_UNREACHABLE;
+		goto finish;
+	}
+	fcntl(tcp_socket, F_SETFL, fcntl(tcp_socket, F_GETFL) | O_NONBLOCK);
+
+	if (connect(tcp_socket, server, server_length) != 0 && errno != EINPROGRESS) {
+		failure = status_from_errno(errno);
+		goto finish;
+	}
+	if (!wait_for(tcp_socket, POLLOUT, deadline)) {
+		goto finish;
+	}
+	int socket_error = 0;
+	socklen_t error_length = sizeof(socket_error);
+	getsockopt(tcp_socket, SOL_SOCKET, SO_ERROR, &socket_error, &error_length);
+	if (socket_error != 0) {
+		failure = status_from_errno(socket_error);
+		goto finish;
+	}
+
+	for (size_t i = 0; i < number_of_queries; i++) {
+		if (!transactions[i].needs_tcp) {
+			continue;
+		}
+		uint8_t length_prefix[2];
+		put16(length_prefix, (uint16_t)transactions[i].request_length);
+		if (!write_all(tcp_socket, length_prefix, 2, deadline) ||
+			!write_all(tcp_socket, transactions[i].request, transactions[i].request_length,
+					   deadline)) {
+			goto finish;
+		}
+	}
+
+	uint8_t *message = malloc(DNS_MAX_MESSAGE_LENGTH);
+	if (message == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+	while (pending > 0) {
+		uint8_t length_prefix[2];
+		if (!read_all(tcp_socket, length_prefix, 2, deadline) ||
+			!read_all(tcp_socket, message, get16(length_prefix), deadline)) {
+			break;
+		}
+		double received = now();
+		dns_response response = dns_parse_response(message, get16(length_prefix));
+		bool stored = false;
+		for (size_t i = 0; i < number_of_queries && !stored; i++) {
+			if (!transactions[i].needs_tcp || transactions[i].id != response.id) {
+				continue;
+			}
+			transactions[i].needs_tcp = false;
+			queries[i].over_tcp = true;
+			queries[i].latency = received - transactions[i].first_sent;
+			queries[i].status =
+				(response.errorcode == OK) ? DNS_QUERY_ANSWERED : DNS_QUERY_INVALID;
+			queries[i].response = response;
+			stored = true;
+			pending--;
+		}
+		if (!stored) {
+			dns_response_free(&response);
+		}
+	}
+	free(message);
+
+finish:
+	if (tcp_socket >= 0) {
+		close(tcp_socket);
+	}
+	for (size_t i = 0; i < number_of_queries; i++) {
+		if (transactions[i].needs_tcp) {
+			transactions[i].needs_tcp = false;
+			queries[i].over_tcp = true;
+			queries[i].status = (failure == DNS_QUERY_PENDING) ? DNS_QUERY_TIMEOUT : failure;
+		}
+	}
+}
+
+static bool transmit(int udp_socket, dns_transaction *transaction, dns_query *query,
+					 double current) {
+	if (send(udp_socket, transaction->request, transaction->request_length, 0) < 0) {
+		dns_query_status status = status_from_errno(errno);
+		if (status != DNS_QUERY_PENDING) {
+			query->status = status;
+			return false;
+		}
+	}
+	transaction->next_transmission = current + transaction->retransmit_interval;
+	transaction->retransmit_interval *= 2;
+	return true;
+}
+
+/*
+ * Sends all queries at the same time over one UDP socket and waits for the
+ * responses until the timeout. Unanswered queries are retransmitted, a
+ * server which does not understand EDNS0 gets the query again without it
+ * and truncated responses are repeated over TCP. Returns ERROR if no socket
+ * could be created, the result of every query is in its status.
+ */
+int dns_send_queries(const struct sockaddr *server, socklen_t server_length, dns_query *queries,
+					 size_t number_of_queries, double timeout) {
+	double start = now();
+	double deadline = start + timeout;
+
+	int udp_socket = socket(server->sa_family, SOCK_DGRAM, 0);
+	if (udp_socket < 0) {
+		return ERROR;
+	}
+	/* A connected socket only receives from the server and reports ICMP errors */
+	if (connect(udp_socket, server, server_length) != 0) {
+		dns_query_status status = status_from_errno(errno);
+		for (size_t i = 0; i < number_of_queries; i++) {
+			queries[i].status = (status == DNS_QUERY_PENDING) ? DNS_QUERY_UNREACHABLE : status;
+		}
+		close(udp_socket);
+		return OK;
+	}
+
+	dns_transaction *transactions = calloc(number_of_queries, sizeof(dns_transaction));
+	uint8_t *message = malloc(DNS_MAX_MESSAGE_LENGTH);
+	if (transactions == NULL || message == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+
+	srand((unsigned int)time(NULL) ^ (unsigned int)getpid());
+	uint16_t first_id = (uint16_t)rand();
+	size_t pending = 0;
+	for (size_t i = 0; i < number_of_queries; i++) {
+		dns_transaction *transaction = &transactions[i];
+		transaction->id = (uint16_t)(first_id + i);
+		transaction->edns = true;
+		transaction->retransmit_interval = DNS_RETRANSMIT_INTERVAL;
+		transaction->request_length =
+			dns_build_query(transaction->request, sizeof(transaction->request), transaction->id,
+							queries[i].name, queries[i].type, true);
+		if (transaction->request_length == 0) {
+			queries[i].status = DNS_QUERY_INVALID;
+			continue;
+		}
+		transaction->first_sent = now();
+		if (transmit(udp_socket, transaction, &queries[i], transaction->first_sent)) {
+			pending++;
+		}
+	}
+
+	while (pending > 0) {
+		double current = now();
+		if (current >= deadline) {
+			break;
+		}
+
+		double wake_up = deadline;
+		for (size_t i = 0; i < number_of_queries; i++) {
+			if (queries[i].status == DNS_QUERY_PENDING && !transactions[i].needs_tcp &&
+				transactions[i].next_transmission < wake_up) {
+				wake_up = transactions[i].next_transmission;
+			}
+		}
+
+		struct pollfd descriptor = {.fd = udp_socket, .events = POLLIN};
+		int ready = poll(&descriptor, 1, poll_timeout(wake_up));
+		if (ready < 0 && errno != EINTR) {
+			break;
+		}
+		if (ready <= 0) {
+			current = now();
+			for (size_t i = 0; i < number_of_queries; i++) {
+				if (queries[i].status == DNS_QUERY_PENDING && !transactions[i].needs_tcp &&
+					transactions[i].next_transmission <= current &&
+					!transmit(udp_socket, &transactions[i], &queries[i], current)) {
+					pending--;
+				}
+			}
+			continue;
+		}
+
+		ssize_t received = recv(udp_socket, message, DNS_MAX_MESSAGE_LENGTH, 0);
+		double received_time = now();
+		if (received < 0) {
+			dns_query_status status = status_from_errno(errno);
+			if (status != DNS_QUERY_PENDING) {
+				set_pending_status(queries, transactions, number_of_queries, status);
+				pending = 0;
+			}
+			continue;
+		}
+
+		dns_response response = dns_parse_response(message, (size_t)received);
+		dns_transaction *transaction = NULL;
+		dns_query *query =
+			match_response(&response, queries, transactions, number_of_queries, &transaction);
+		if (query == NULL) {
+			/* late duplicate or not ours */
+			dns_response_free(&response);
+			continue;
+		}
+
+		if (response.errorcode == OK && response.rcode == DNS_RCODE_FORMERR && transaction->edns &&
+			!response.edns) {
+			/* The server does not know EDNS0 (RFC 6891, 7) */
+			dns_response_free(&response);
+			transaction->edns = false;
+			transaction->request_length =
+				dns_build_query(transaction->request, sizeof(transaction->request),
+								transaction->id, query->name, query->type, false);
+			if (!transmit(udp_socket, transaction, query, received_time)) {
+				pending--;
+			}
+			continue;
+		}
+
+		pending--;
+		if (response.errorcode == OK && response.truncated) {
+			dns_response_free(&response);
+			transaction->needs_tcp = true;
+			continue;
+		}
+		query->status = (response.errorcode == OK) ? DNS_QUERY_ANSWERED : DNS_QUERY_INVALID;
+		query->latency = received_time - transaction->first_sent;
+		query->response = response;
+	}
+	close(udp_socket);
+	free(message);
+
+	set_pending_status(queries, transactions, number_of_queries, DNS_QUERY_TIMEOUT);
+	send_tcp_queries(server, server_length, queries, transactions, number_of_queries, deadline);
+
+	free(transactions);
+	return OK;
+}
@@ -0,0 +1,98 @@
+#pragma once
+/* Header file for the DNS client of check_dns in dns_client.c */
+
+#include "../../config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define DNS_PORT 53
+
+#define DNS_HEADER_LENGTH 12
+/* Longest encoded name */
+#define DNS_MAX_NAME_LENGTH 255
+/* Buffer for a name in presentation format, unprintable characters take 4 Byte as \DDD */
+#define DNS_MAX_NAME_TEXT_LENGTH ((DNS_MAX_NAME_LENGTH * 4) + 1)
+/* Receive buffer size announced with EDNS0, the value recommended by the DNS flag day 2020 */
+#define DNS_EDNS_PAYLOAD_SIZE 1232
+#define DNS_MAX_MESSAGE_LENGTH 65535
+/* Header, question with the longest name and the OPT record */
+#define DNS_MAX_QUERY_LENGTH (DNS_HEADER_LENGTH + DNS_MAX_NAME_LENGTH + 1 + 4 + 11)
+
+/* Unanswered UDP queries are sent again after this many seconds, doubled every time */
+#define DNS_RETRANSMIT_INTERVAL 1.0
+
+#define DNS_CLASS_IN 1
+
+#define DNS_TYPE_A     1
+#define DNS_TYPE_NS    2
+#define DNS_TYPE_CNAME 5
+#define DNS_TYPE_SOA   6
+#define DNS_TYPE_PTR   12
+#define DNS_TYPE_MX    15
+#define DNS_TYPE_TXT   16
+#define DNS_TYPE_AAAA  28
+#define DNS_TYPE_OPT   41
+
+#define DNS_RCODE_NOERROR  0
+#define DNS_RCODE_FORMERR  1
+#define DNS_RCODE_SERVFAIL 2
+#define DNS_RCODE_NXDOMAIN 3
+#define DNS_RCODE_NOTIMP   4
+#define DNS_RCODE_REFUSED  5
+
+typedef struct {
+	uint16_t type;
+	uint32_t ttl;
+	char *data; /* presentation format, names end with a dot */
+} dns_record;
+
+typedef struct {
+	int errorcode; /* ERROR if the message is malformed */
+	uint16_t id;
+	bool authoritative;
+	bool truncated;
+	bool edns; /* the response contains an OPT record */
+	int rcode;
+
+	char question_name[DNS_MAX_NAME_TEXT_LENGTH];
+	uint16_t question_type;
+
+	/* Only the records of the question type, a CNAME chain leading there is skipped */
+	dns_record *answers;
+	size_t number_of_answers;
+} dns_response;
+
+typedef enum {
+	DNS_QUERY_PENDING,
+	DNS_QUERY_ANSWERED,
+	DNS_QUERY_TIMEOUT,
+	DNS_QUERY_REFUSED,     /* the server port is closed */
+	DNS_QUERY_UNREACHABLE, /* no route to the server */
+	DNS_QUERY_INVALID,     /* the server sent an unparsable response */
+} dns_query_status;
+
+typedef struct {
+	const char *name;
+	uint16_t type;
+
+	dns_query_status status;
+	bool over_tcp;  /* the UDP response was truncated */
+	double latency; /* seconds from the first transmission to the response */
+	dns_response response;
+} dns_query;
+
+size_t dns_build_query(uint8_t *buffer, size_t size, uint16_t id, const char *name, uint16_t type,
+					   bool edns);
+dns_response dns_parse_response(const uint8_t *message, size_t length);
+void dns_response_free(dns_response *response);
+
+void dns_query_init(dns_query *query, const char *name, uint16_t type);
+int dns_send_queries(const struct sockaddr *server, socklen_t server_length, dns_query *queries,
+					 size_t number_of_queries, double timeout);
+
+int dns_type_from_string(const char *name);
+const char *dns_type_to_string(uint16_t type);
+const char *dns_rcode_to_string(int rcode);
+bool dns_reverse_name(const char *address, char *name, size_t size);
@@ -0,0 +1,349 @@
+/*****************************************************************************
+ *
+ * Monitoring check_memory plugin
+ *
+ * License: GPL
+ * Copyright (c) 2025 Monitoring Plugins Development Team
+ *
+ * Description:
+ *
+ * This file contains the check_memory plugin
+ *
+ * This plugin checks the available memory, the amount of dirty pages, the
+ * size of the kernel slab caches and the free huge pages on the local system.
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+const char *progname = "check_memory";
+const char *copyright = "2025";
+const char *email = "devel@monitoring-plugins.org";
+
+#include "./common.h"
+#include "./utils.h"
+#include "output.h"
+#include "perfdata.h"
+#include "states.h"
+#include "thresholds.h"
+#include "utils_meminfo.h"
+#include "check_memory.d/config.h"
+
+typedef struct {
+	int errorcode;
+	check_memory_config config;
+} check_memory_config_wrapper;
+static check_memory_config_wrapper process_arguments(int /*argc*/, char ** /*argv*/);
+
+void print_help(void);
+void print_usage(void);
+
+static mp_subcheck evaluate_bytes(const char *label, const char *description, uint64_t value,
+								  mp_thresholds thresholds);
+
+int main(int argc, char **argv) {
+	setlocale(LC_ALL, "");
+	bindtextdomain(PACKAGE, LOCALEDIR);
+	textdomain(PACKAGE);
+
+	/* Parse extra opts if any */
+	argv = np_extra_opts(&argc, argv, progname);
+
+	check_memory_config_wrapper tmp_config = process_arguments(argc, argv);
+	if (tmp_config.errorcode == ERROR) {
+		usage4(_("Could not parse arguments"));
+	}
+
+	const check_memory_config config = tmp_config.config;
+
+	mp_check overall = mp_check_init();
+	if (config.output_format_is_set) {
+		mp_set_format(config.output_format);
+	}
+
+	mp_meminfo_result meminfo_result = mp_meminfo_read(config.meminfo_path);
+	if (meminfo_result.errorcode != OK ||
+		!mp_meminfo_has(&meminfo_result.meminfo, MP_MEMINFO_MEM_TOTAL) ||
+		meminfo_result.meminfo.mem_total == 0) {
+		mp_subcheck sc_meminfo = mp_subcheck_init();
+		sc_meminfo = mp_set_subcheck_state(sc_meminfo, STATE_UNKNOWN);
+		xasprintf(&sc_meminfo.output, _("Failed to read memory statistics from %s"),
+				  config.meminfo_path);
+		mp_add_subcheck_to_check(&overall, sc_meminfo);
+		mp_exit(overall);
+	}
+	const mp_meminfo meminfo = meminfo_result.meminfo;
+
+	/* MemAvailable exists since Linux 3.14, estimate it on older kernels */
+	uint64_t available = meminfo.mem_available;
+	if (!mp_meminfo_has(&meminfo, MP_MEMINFO_MEM_AVAILABLE)) {
+		available = meminfo.mem_free + meminfo.buffers + meminfo.cached;
+	}
+	double available_percent = 100 * ((double)available / (double)meminfo.mem_total);
+
+	mp_subcheck sc_available = mp_subcheck_init();
+
+	mp_perfdata available_pd = perfdata_init();
+	available_pd.label = "available";
+	available_pd = mp_set_pd_value(available_pd, (unsigned long long)available);
+	available_pd.uom = "B";
+	available_pd = mp_set_pd_min_value(available_pd, mp_create_pd_value(0));
+	available_pd = mp_set_pd_max_value(available_pd,
+									   mp_create_pd_value((unsigned long long)meminfo.mem_total));
+	mp_add_perfdata_to_subcheck(&sc_available, available_pd);
+
+	mp_perfdata available_percent_pd = perfdata_init();
+	available_percent_pd.label = "available_percent";
+	available_percent_pd = mp_set_pd_value(available_percent_pd, available_percent);
+	available_percent_pd.uom = "%";
+	available_percent_pd = mp_pd_set_thresholds(available_percent_pd, config.available_thresholds);
+	mp_add_perfdata_to_subcheck(&sc_available, available_percent_pd);
+
+	sc_available = mp_set_subcheck_state(sc_available, mp_get_pd_status(available_percent_pd));
+	xasprintf(&sc_available.output, _("%g%% available (%lluMiB out of %lluMiB)"),
+			  available_percent, (unsigned long long)(available >> 20),
+			  (unsigned long long)(meminfo.mem_total >> 20));
+	mp_add_subcheck_to_check(&overall, sc_available);
+
+	if (mp_meminfo_has(&meminfo, MP_MEMINFO_DIRTY)) {
+		mp_add_subcheck_to_check(
+			&overall, evaluate_bytes("dirty", _("Dirty"), meminfo.dirty, config.dirty_thresholds));
+	}
+
+	if (mp_meminfo_has(&meminfo, MP_MEMINFO_SLAB)) {
+		mp_subcheck sc_slab =
+			evaluate_bytes("slab", _("Slab"), meminfo.slab, config.slab_thresholds);
+		if (mp_meminfo_has(&meminfo, MP_MEMINFO_SRECLAIMABLE)) {
+			mp_perfdata reclaimable_pd = perfdata_init();
+			reclaimable_pd.label = "slab_reclaimable";
+			reclaimable_pd =
+				mp_set_pd_value(reclaimable_pd, (unsigned long long)meminfo.s_reclaimable);
+			reclaimable_pd.uom = "B";
+			mp_add_perfdata_to_subcheck(&sc_slab, reclaimable_pd);
+		}
+		mp_add_subcheck_to_check(&overall, sc_slab);
+	}
+
+	/* Huge pages are only of interest if they are configured or a threshold was given */
+	bool hugepages_thresholds_set = config.hugepages_thresholds.warning_is_set ||
+									config.hugepages_thresholds.critical_is_set;
+	if (mp_meminfo_has(&meminfo, MP_MEMINFO_HUGEPAGES_TOTAL | MP_MEMINFO_HUGEPAGES_FREE) &&
+		(meminfo.hugepages_total > 0 || hugepages_thresholds_set)) {
+		mp_subcheck sc_hugepages = mp_subcheck_init();
+
+		mp_perfdata hugepages_pd = perfdata_init();
+		hugepages_pd.label = "hugepages_free";
+		hugepages_pd = mp_set_pd_value(hugepages_pd, (unsigned long long)meminfo.hugepages_free);
+		hugepages_pd = mp_set_pd_min_value(hugepages_pd, mp_create_pd_value(0));
+		hugepages_pd = mp_set_pd_max_value(
+			hugepages_pd, mp_create_pd_value((unsigned long long)meminfo.hugepages_total));
+		hugepages_pd = mp_pd_set_thresholds(hugepages_pd, config.hugepages_thresholds);
+		mp_add_perfdata_to_subcheck(&sc_hugepages, hugepages_pd);
+
+		sc_hugepages = mp_set_subcheck_state(sc_hugepages, mp_get_pd_status(hugepages_pd));
+		xasprintf(&sc_hugepages.output, _("%llu of %llu huge pages free (%llu reserved)"),
+				  (unsigned long long)meminfo.hugepages_free,
+				  (unsigned long long)meminfo.hugepages_total,
+				  (unsigned long long)meminfo.hugepages_rsvd);
+		mp_add_subcheck_to_check(&overall, sc_hugepages);
+	}
+
+	mp_exit(overall);
+}
+
+static mp_subcheck evaluate_bytes(const char *label, const char *description, uint64_t value,
+								  mp_thresholds thresholds) {
+	mp_subcheck result = mp_subcheck_init();
+
+	mp_perfdata value_pd = perfdata_init();
+	value_pd.label = (char *)label;
+	value_pd = mp_set_pd_value(value_pd, (unsigned long long)value);
+	value_pd.uom = "B";
+	value_pd = mp_set_pd_min_value(value_pd, mp_create_pd_value(0));
+	value_pd = mp_pd_set_thresholds(value_pd, thresholds);
+	mp_add_perfdata_to_subcheck(&result, value_pd);
+
+	result = mp_set_subcheck_state(result, mp_get_pd_status(value_pd));
+	xasprintf(&result.output, "%s: %lluMiB", description, (unsigned long long)(value >> 20));
+	return result;
+}
+
+/* Parses a range or dies with a message naming the option */
+static mp_range parse_range_or_die(const char *option_name, const char *range_string) {
+	mp_range_parsed tmp = mp_parse_range_string(range_string);
+	if (tmp.error != MP_PARSING_SUCCESS) {
+		die(STATE_UNKNOWN, _("Failed to parse %s range: %s\n"), option_name, range_string);
+	}
+	return tmp.range;
+}
+
+/* process command-line arguments */
+static check_memory_config_wrapper process_arguments(int argc, char **argv) {
+	enum {
+		output_format_index = CHAR_MAX + 1,
+		dirty_warning_index,
+		dirty_critical_index,
+		slab_warning_index,
+		slab_critical_index,
+		hugepages_warning_index,
+		hugepages_critical_index,
+		meminfo_index,
+	};
+
+	static struct option longopts[] = {
+		{"warning", required_argument, 0, 'w'},
+		{"critical", required_argument, 0, 'c'},
+		{"dirty-warning", required_argument, 0, dirty_warning_index},
+		{"dirty-critical", required_argument, 0, dirty_critical_index},
+		{"slab-warning", required_argument, 0, slab_warning_index},
+		{"slab-critical", required_argument, 0, slab_critical_index},
+		{"hugepages-warning", required_argument, 0, hugepages_warning_index},
+		{"hugepages-critical", required_argument, 0, hugepages_critical_index},
+		{"meminfo", required_argument, 0, meminfo_index},
+		{"version", no_argument, 0, 'V'},
+		{"help", no_argument, 0, 'h'},
+		{"output-format", required_argument, 0, output_format_index},
+		{0, 0, 0, 0}};
+
+	check_memory_config_wrapper result = {
+		.errorcode = OK,
+		.config = check_memory_config_init(),
+	};
+
+	while (true) {
+		int option = 0;
+		int option_index = getopt_long(argc, argv, "Vhw:c:", longopts, &option);
+
+		if (CHECK_EOF(option_index)) {
+			break;
+		}
+
+		switch (option_index) {
+		case 'w':
+			result.config.available_thresholds = mp_thresholds_set_warn(
+				result.config.available_thresholds, parse_range_or_die("warning", optarg));
+			break;
+		case 'c':
+			result.config.available_thresholds = mp_thresholds_set_crit(
+				result.config.available_thresholds, parse_range_or_die("critical", optarg));
+			break;
+		case dirty_warning_index:
+			result.config.dirty_thresholds = mp_thresholds_set_warn(
+				result.config.dirty_thresholds, parse_range_or_die("dirty-warning", optarg));
+			break;
+		case dirty_critical_index:
+			result.config.dirty_thresholds = mp_thresholds_set_crit(
+				result.config.dirty_thresholds, parse_range_or_die("dirty-critical", optarg));
+			break;
+		case slab_warning_index:
+			result.config.slab_thresholds = mp_thresholds_set_warn(
+				result.config.slab_thresholds, parse_range_or_die("slab-warning", optarg));
+			break;
+		case slab_critical_index:
+			result.config.slab_thresholds = mp_thresholds_set_crit(
+				result.config.slab_thresholds, parse_range_or_die("slab-critical", optarg));
+			break;
+		case hugepages_warning_index:
+			result.config.hugepages_thresholds =
+				mp_thresholds_set_warn(result.config.hugepages_thresholds,
+									   parse_range_or_die("hugepages-warning", optarg));
+			break;
+		case hugepages_critical_index:
+			result.config.hugepages_thresholds =
+				mp_thresholds_set_crit(result.config.hugepages_thresholds,
+									   parse_range_or_die("hugepages-critical", optarg));
+			break;
+		case meminfo_index:
+			result.config.meminfo_path = optarg;
+			break;
+		case output_format_index: {
+			parsed_output_format parser = mp_parse_output_format(optarg);
+			if (!parser.parsing_success) {
+				printf("Invalid output format: %s\n", optarg);
+				exit(STATE_UNKNOWN);
+			}
+
+			result.config.output_format_is_set = true;
+			result.config.output_format = parser.output_format;
+			break;
+		}
+		case 'V': /* version */
+			print_revision(progname, NP_VERSION);
+			exit(STATE_UNKNOWN);
+		case 'h': /* help */
+			print_help();
+			exit(STATE_UNKNOWN);
+		case '?': /* help */
+			usage5();
+		}
+	}
+
+	return result;
+}
+
+void print_help(void) {
+	print_revision(progname, NP_VERSION);
+
+	printf(COPYRIGHT, copyright, email);
+
+	printf("%s\n", _("This plugin checks the available memory on the local system."));
+	printf("%s\n", _("Optionally the amount of dirty pages, the size of the kernel slab caches"));
+	printf("%s\n", _("and the number of free huge pages can be checked as well."));
+
+	printf("\n\n");
+
+	print_usage();
+
+	printf(UT_HELP_VRSN);
+	printf(UT_EXTRA_OPTS);
+
+	printf(" %s\n", "-w, --warning=RANGE");
+	printf("    %s\n", _("Exit with WARNING status if the percentage of available memory is "
+						 "outside of RANGE"));
+	printf(" %s\n", "-c, --critical=RANGE");
+	printf("    %s\n", _("Exit with CRITICAL status if the percentage of available memory is "
+						 "outside of RANGE"));
+	printf(" %s\n", "--dirty-warning=RANGE, --dirty-critical=RANGE");
+	printf("    %s\n", _("Thresholds for the memory waiting to be written back to disk, in Bytes"));
+	printf(" %s\n", "--slab-warning=RANGE, --slab-critical=RANGE");
+	printf("    %s\n", _("Thresholds for the memory used by the kernel slab caches, in Bytes"));
+	printf(" %s\n", "--hugepages-warning=RANGE, --hugepages-critical=RANGE");
+	printf("    %s\n", _("Thresholds for the number of free huge pages"));
+	printf(" %s\n", "--meminfo=PATH");
+	printf("    %s %s\n", _("Read the memory statistics from PATH. Default:"), PROC_MEMINFO);
+	printf(UT_OUTPUT_FORMAT);
+
+	printf("\n");
+	printf("%s\n", _("Notes:"));
+	printf(" %s\n", _("Available memory is MemAvailable from /proc/meminfo, an estimate of the"));
+	printf(" %s\n", _("memory available for new applications without swapping."));
+	printf(" %s\n", _("To alert if less than 10% of the memory is available, use \"-w 10:\"."));
+
+	printf("\n");
+	printf("%s\n", _("Examples:"));
+	printf(" %s\n", "check_memory -w 20: -c 10: --dirty-critical 1073741824");
+	printf("    %s\n", _("Checks the available memory and the dirty pages"));
+
+	printf(UT_SUPPORT);
+}
+
+void print_usage(void) {
+	printf("%s\n", _("Usage:"));
+	printf("%s [-w <range>] [-c <range>] [--dirty-warning <range>] [--dirty-critical <range>]\n",
+		   progname);
+	printf("  [--slab-warning <range>] [--slab-critical <range>]\n");
+	printf("  [--hugepages-warning <range>] [--hugepages-critical <range>]\n");
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "output.h"
+#include "thresholds.h"
+
+typedef struct check_memory_config {
+	/* thresholds for MemAvailable in percent of MemTotal */
+	mp_thresholds available_thresholds;
+	/* thresholds in Bytes */
+	mp_thresholds dirty_thresholds;
+	mp_thresholds slab_thresholds;
+	/* thresholds for the number of free huge pages */
+	mp_thresholds hugepages_thresholds;
+
+	char *meminfo_path;
+
+	bool output_format_is_set;
+	mp_output_format output_format;
+} check_memory_config;
+
+check_memory_config check_memory_config_init() {
+	check_memory_config tmp = {
+		.available_thresholds = mp_thresholds_init(),
+		.dirty_thresholds = mp_thresholds_init(),
+		.slab_thresholds = mp_thresholds_init(),
+		.hugepages_thresholds = mp_thresholds_init(),
+
+		.meminfo_path = PROC_MEMINFO,
+
+		.output_format_is_set = false,
+	};
+	return tmp;
+}
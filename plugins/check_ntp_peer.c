@@ -48,6 +48,7 @@ const char *email = "devel@monitoring-plugins.org";
 #include "utils.h"
 #include "../lib/states.h"
 #include "check_ntp_peer.d/config.h"
+#include "check_ntp_peer.d/readvar.h"
 
 static int verbose = 0;
 
@@ -59,22 +60,6 @@ static check_ntp_peer_config_wrapper process_arguments(int /*argc*/, char ** /*a
 static void print_help(void);
 void print_usage(void);
 
-/* max size of control message data */
-#define MAX_CM_SIZE 468
-
-/* this structure holds everything in an ntp control message as per rfc1305 */
-typedef struct {
-	uint8_t flags;          /* byte with leapindicator,vers,mode. see macros */
-	uint8_t op;             /* R,E,M bits and Opcode */
-	uint16_t seq;           /* Packet sequence */
-	uint16_t status;        /* Clock status */
-	uint16_t assoc;         /* Association */
-	uint16_t offset;        /* Similar to TCP sequence # */
-	uint16_t count;         /* # bytes of data */
-	char data[MAX_CM_SIZE]; /* ASCII data of the request */
-							/* NB: not necessarily NULL terminated! */
-} ntp_control_message;
-
 /* this is an association/status-word pair found in control packet responses */
 typedef struct {
 	uint16_t assoc;
@@ -111,11 +96,6 @@ typedef struct {
 /* here are some values */
 #define MODE_CLIENT     0x03
 #define MODE_CONTROLMSG 0x06
-/* In control message, bits 8-10 are R,E,M bits */
-#define REM_MASK  0xe0
-#define REM_RESP  0x80
-#define REM_ERROR 0x40
-#define REM_MORE  0x20
 /* In control message, bits 11 - 15 are opcode */
 #define OP_MASK 0x1f
 #define OP_SET(x, y)                                                                               \
@@ -191,6 +171,82 @@ void setup_control_request(ntp_control_message *message, uint8_t opcode, uint16_
 	/* Remaining fields are zero for requests */
 }
 
+/* Sends the READVAR requests of all exchanges which are not done at once,
+ * each with its own sequence number, and collects the responses in the
+ * order they arrive. So the whole round takes about one round trip time
+ * instead of one per association. */
+static void readvar_round(int conn, ntp_readvar *readvars, size_t num_readvars,
+						  uint16_t *next_seq) {
+	size_t outstanding = 0;
+	for (size_t i = 0; i < num_readvars; i++) {
+		if (readvars[i].done) {
+			continue;
+		}
+		if (verbose) {
+			printf("Getting offset, jitter and stratum for peer %.2x\n",
+				   ntohs(readvars[i].assoc));
+		}
+
+		/* a new sequence number, so late answers to an earlier round are ignored */
+		readvars[i].seq = (*next_seq)++;
+		if (*next_seq < 2) {
+			*next_seq = 2;
+		}
+
+		ntp_control_message req;
+		setup_control_request(&req, OP_READVAR, readvars[i].seq);
+		req.assoc = readvars[i].assoc;
+		/* Putting the wanted variable names in the request
+		 * cause the server to provide _only_ the requested values.
+		 * thus reducing net traffic, guaranteeing us only a single
+		 * datagram in reply, and making interpretation much simpler
+		 */
+		strncpy(req.data, readvars[i].getvar, MAX_CM_SIZE - 1);
+		req.count = htons(strlen(readvars[i].getvar));
+		DBG(printf("sending READVAR request...\n"));
+		write(conn, &req, SIZEOF_NTPCM(req));
+		DBG(print_ntp_control_message(&req));
+		outstanding++;
+	}
+
+	while (outstanding > 0) {
+		ntp_control_message response;
+		response.count = htons(MAX_CM_SIZE);
+		DBG(printf("receiving READVAR response...\n"));
+		if (read(conn, &response, SIZEOF_NTPCM(response)) == -1) {
+			die(STATE_CRITICAL, "NTP CRITICAL: No response from NTP server\n");
+		}
+		DBG(print_ntp_control_message(&response));
+
+		/* discard obviously invalid packets and answers to other requests */
+		if (ntohs(response.count) > MAX_CM_SIZE || !(response.op & REM_RESP) ||
+			(response.op & OP_MASK) != OP_READVAR) {
+			continue;
+		}
+		ntp_readvar *readvar = NULL;
+		for (size_t i = 0; i < num_readvars; i++) {
+			if (!readvars[i].done && readvars[i].seq == ntohs(response.seq) &&
+				readvars[i].assoc == response.assoc) {
+				readvar = &readvars[i];
+				break;
+			}
+		}
+		if (readvar == NULL) {
+			continue;
+		}
+
+		if (response.op & REM_ERROR) {
+			readvar->error = true;
+			readvar->done = true;
+		} else if (ntp_readvar_add_fragment(readvar, &response) != OK) {
+			die(STATE_CRITICAL, "NTP CRITICAL: Too many fragments in response from NTP server\n");
+		}
+		if (readvar->done) {
+			outstanding--;
+		}
+	}
+}
+
 /* This function does all the actual work; roughly here's what it does
  * beside setting the offset, jitter and stratum passed as argument:
  *  - offset can be negative, so if it cannot get the offset, offset_result
@@ -323,151 +379,143 @@ ntp_request_result ntp_request(const check_ntp_peer_config config) {
 		}
 	}
 
-	const char *getvar = "stratum,offset,jitter";
-	char *data;
+	/* Only query the current sync source */
+	/* If there's no sync.peer, query all candidates and use the best one */
+	ntp_readvar *readvars = calloc(npeers > 0 ? npeers : 1, sizeof(ntp_readvar));
+	if (readvars == NULL) {
+		die(STATE_UNKNOWN, "can not allocate READVAR array\n");
+	}
+	size_t num_readvars = 0;
 	for (size_t i = 0; i < npeers; i++) {
-		/* Only query this server if it is the current sync source */
-		/* If there's no sync.peer, query all candidates and use the best one */
 		if (PEER_SEL(peers[i].status) >= min_peer_sel) {
-			if (verbose) {
-				printf("Getting offset, jitter and stratum for peer %.2x\n", ntohs(peers[i].assoc));
-			}
-			data = strdup("");
-			do {
-				setup_control_request(&req, OP_READVAR, 2);
-				req.assoc = peers[i].assoc;
-				/* Putting the wanted variable names in the request
-				 * cause the server to provide _only_ the requested values.
-				 * thus reducing net traffic, guaranteeing us only a single
-				 * datagram in reply, and making interpretation much simpler
-				 */
-				/* Older servers doesn't know what jitter is, so if we get an
-				 * error on the first pass we redo it with "dispersion" */
-				strncpy(req.data, getvar, MAX_CM_SIZE - 1);
-				req.count = htons(strlen(getvar));
-				DBG(printf("sending READVAR request...\n"));
-				write(conn, &req, SIZEOF_NTPCM(req));
-				DBG(print_ntp_control_message(&req));
-
-				do {
-					req.count = htons(MAX_CM_SIZE);
-					DBG(printf("receiving READVAR response...\n"));
-					read(conn, &req, SIZEOF_NTPCM(req));
-					DBG(print_ntp_control_message(&req));
-				} while (!(req.op & OP_READVAR && ntohs(req.seq) == 2));
-
-				if (!(req.op & REM_ERROR)) {
-					xasprintf(&data, "%s%s", data, req.data);
-				}
-			} while (req.op & REM_MORE);
-
-			if (req.op & REM_ERROR) {
-				if (strstr(getvar, "jitter")) {
-					if (verbose) {
-						printf("The command failed. This is usually caused by servers refusing the "
-							   "'jitter'\nvariable. Restarting with "
-							   "'dispersion'...\n");
-					}
-					getvar = "stratum,offset,dispersion";
-					i--;
-					continue;
-				}
-				if (strlen(getvar)) {
-					if (verbose) {
-						printf("Server didn't like dispersion either; will retrieve everything\n");
-					}
-					getvar = "";
-					i--;
-					continue;
+			readvars[num_readvars].assoc = peers[i].assoc;
+			readvars[num_readvars].getvar = "stratum,offset,jitter";
+			num_readvars++;
+		}
+	}
+
+	/* Older servers doesn't know what jitter is, so if we get an
+	 * error we redo it with "dispersion", and then with everything */
+	const char *fallback_getvars[] = {"stratum,offset,dispersion", ""};
+	uint16_t next_seq = 2;
+	for (size_t round = 0; num_readvars > 0; round++) {
+		readvar_round(conn, readvars, num_readvars, &next_seq);
+
+		bool retry = false;
+		for (size_t i = 0; i < num_readvars; i++) {
+			if (readvars[i].error && round < sizeof(fallback_getvars) / sizeof(char *)) {
+				if (verbose) {
+					printf("The command failed for peer %.2x. Restarting with '%s'...\n",
+						   ntohs(readvars[i].assoc), fallback_getvars[round]);
 				}
+				readvars[i].getvar = fallback_getvars[round];
+				readvars[i].done = false;
+				readvars[i].error = false;
+				readvars[i].received_length = 0;
+				readvars[i].total_length = 0;
+				readvars[i].number_of_fragments = 0;
+				retry = true;
 			}
+		}
+		if (!retry) {
+			break;
+		}
+	}
 
-			if (verbose > 1) {
-				printf("Server responded: >>>%s<<<\n", data);
-			}
+	for (size_t i = 0; i < num_readvars; i++) {
+		const char *getvar = readvars[i].getvar;
+		const char *data = (!readvars[i].error && readvars[i].data != NULL) ? readvars[i].data : "";
+
+		if (verbose > 1) {
+			printf("Server responded: >>>%s<<<\n", data);
+		}
+
+		double tmp_offset = 0;
+		char *value;
+		char *nptr;
+		/* get the offset */
+		if (verbose) {
+			printf("parsing offset from peer %.2x: ", ntohs(readvars[i].assoc));
+		}
 
-			double tmp_offset = 0;
-			char *value;
-			char *nptr;
-			/* get the offset */
+		value = np_extract_ntpvar(data, "offset");
+		nptr = NULL;
+		/* Convert the value if we have one */
+		if (value != NULL) {
+			tmp_offset = strtod(value, &nptr) / 1000;
+		}
+		/* If value is null or no conversion was performed */
+		if (value == NULL || value == nptr) {
+			if (verbose) {
+				printf("error: unable to read server offset response.\n");
+			}
+		} else {
 			if (verbose) {
-				printf("parsing offset from peer %.2x: ", ntohs(peers[i].assoc));
+				printf("%.10g\n", tmp_offset);
 			}
+			if (result.offset_result == STATE_UNKNOWN ||
+				fabs(tmp_offset) < fabs(result.offset)) {
+				result.offset = tmp_offset;
+				result.offset_result = STATE_OK;
+			} else {
+				/* Skip this one; move to the next */
+				continue;
+			}
+		}
 
-			value = np_extract_ntpvar(data, "offset");
+		if (config.do_jitter) {
+			/* get the jitter */
+			if (verbose) {
+				printf("parsing %s from peer %.2x: ",
+					   strstr(getvar, "dispersion") != NULL ? "dispersion" : "jitter",
+					   ntohs(readvars[i].assoc));
+			}
+			value = np_extract_ntpvar(data, strstr(getvar, "dispersion") != NULL ? "dispersion"
+																				 : "jitter");
 			nptr = NULL;
 			/* Convert the value if we have one */
 			if (value != NULL) {
-				tmp_offset = strtod(value, &nptr) / 1000;
+				result.jitter = strtod(value, &nptr);
 			}
 			/* If value is null or no conversion was performed */
 			if (value == NULL || value == nptr) {
 				if (verbose) {
-					printf("error: unable to read server offset response.\n");
-				}
-			} else {
-				if (verbose) {
-					printf("%.10g\n", tmp_offset);
-				}
-				if (result.offset_result == STATE_UNKNOWN ||
-					fabs(tmp_offset) < fabs(result.offset)) {
-					result.offset = tmp_offset;
-					result.offset_result = STATE_OK;
-				} else {
-					/* Skip this one; move to the next */
-					continue;
+					printf("error: unable to read server jitter/dispersion response.\n");
 				}
+				result.jitter = -1;
+			} else if (verbose) {
+				printf("%.10g\n", result.jitter);
 			}
+		}
 
-			if (config.do_jitter) {
-				/* get the jitter */
-				if (verbose) {
-					printf("parsing %s from peer %.2x: ",
-						   strstr(getvar, "dispersion") != NULL ? "dispersion" : "jitter",
-						   ntohs(peers[i].assoc));
-				}
-				value = np_extract_ntpvar(data, strstr(getvar, "dispersion") != NULL ? "dispersion"
-																					 : "jitter");
-				nptr = NULL;
-				/* Convert the value if we have one */
-				if (value != NULL) {
-					result.jitter = strtod(value, &nptr);
-				}
-				/* If value is null or no conversion was performed */
-				if (value == NULL || value == nptr) {
-					if (verbose) {
-						printf("error: unable to read server jitter/dispersion response.\n");
-					}
-					result.jitter = -1;
-				} else if (verbose) {
-					printf("%.10g\n", result.jitter);
-				}
+		if (config.do_stratum) {
+			/* get the stratum */
+			if (verbose) {
+				printf("parsing stratum from peer %.2x: ", ntohs(readvars[i].assoc));
 			}
-
-			if (config.do_stratum) {
-				/* get the stratum */
+			value = np_extract_ntpvar(data, "stratum");
+			nptr = NULL;
+			/* Convert the value if we have one */
+			if (value != NULL) {
+				result.stratum = strtol(value, &nptr, 10);
+			}
+			if (value == NULL || value == nptr) {
 				if (verbose) {
-					printf("parsing stratum from peer %.2x: ", ntohs(peers[i].assoc));
-				}
-				value = np_extract_ntpvar(data, "stratum");
-				nptr = NULL;
-				/* Convert the value if we have one */
-				if (value != NULL) {
-					result.stratum = strtol(value, &nptr, 10);
+					printf("error: unable to read server stratum response.\n");
 				}
-				if (value == NULL || value == nptr) {
-					if (verbose) {
-						printf("error: unable to read server stratum response.\n");
-					}
-					result.stratum = -1;
-				} else {
-					if (verbose) {
-						printf("%li\n", result.stratum);
-					}
+				result.stratum = -1;
+			} else {
+				if (verbose) {
+					printf("%li\n", result.stratum);
 				}
 			}
-		} /* if (PEER_SEL(peers[i].status) >= min_peer_sel) */
-	} /* for (i = 0; i < npeers; i++) */
+		}
+	}
+
+	for (size_t i = 0; i < num_readvars; i++) {
+		free(readvars[i].data);
+	}
+	free(readvars);
 
 	close(conn);
 	if (peers != NULL) {
@@ -0,0 +1,47 @@
+#include "./readvar.h"
+#include "../common.h"
+#include "../../lib/utils_base.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Adds one fragment of a response at its offset, so fragments may arrive in
+ * any order and duplicates are ignored. Marks the exchange done once all
+ * arrived, that is the last fragment and everything in front of it.
+ */
+int ntp_readvar_add_fragment(ntp_readvar *readvar, const ntp_control_message *response) {
+	size_t offset = ntohs(response->offset);
+	size_t count = ntohs(response->count);
+
+	for (int i = 0; i < readvar->number_of_fragments; i++) {
+		if (readvar->fragment_offsets[i] == offset) {
+			return OK;
+		}
+	}
+	if (readvar->number_of_fragments == MAX_READVAR_FRAGMENTS) {
+		return ERROR;
+	}
+	readvar->fragment_offsets[readvar->number_of_fragments++] = (uint16_t)offset;
+
+	if (offset + count + 1 > readvar->data_size) {
+		char *tmp = realloc(readvar->data, offset + count + 1);
+		if (tmp == NULL) {
+			die(STATE_UNKNOWN, "can not (re)allocate READVAR buffer\n");
+		}
+		memset(tmp + readvar->data_size, 0, offset + count + 1 - readvar->data_size);
+		readvar->data = tmp;
+		readvar->data_size = offset + count + 1;
+	}
+	memcpy(readvar->data + offset, response->data, count);
+	readvar->received_length += count;
+
+	if (!(response->op & REM_MORE)) {
+		readvar->total_length = offset + count;
+	}
+	if (readvar->total_length > 0 && readvar->received_length >= readvar->total_length) {
+		readvar->data[readvar->total_length] = '\0';
+		readvar->done = true;
+	}
+	return OK;
+}
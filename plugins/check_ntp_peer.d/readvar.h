@@ -0,0 +1,50 @@
+#pragma once
+/* Header file for the READVAR reassembly of check_ntp_peer in readvar.c */
+
+#include "../../config.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* max size of control message data */
+#define MAX_CM_SIZE 468
+
+/* this structure holds everything in an ntp control message as per rfc1305 */
+typedef struct {
+	uint8_t flags;          /* byte with leapindicator,vers,mode. see macros */
+	uint8_t op;             /* R,E,M bits and Opcode */
+	uint16_t seq;           /* Packet sequence */
+	uint16_t status;        /* Clock status */
+	uint16_t assoc;         /* Association */
+	uint16_t offset;        /* Similar to TCP sequence # */
+	uint16_t count;         /* # bytes of data */
+	char data[MAX_CM_SIZE]; /* ASCII data of the request */
+							/* NB: not necessarily NULL terminated! */
+} ntp_control_message;
+
+/* In control message, bits 8-10 are R,E,M bits */
+#define REM_MASK  0xe0
+#define REM_RESP  0x80
+#define REM_ERROR 0x40
+#define REM_MORE  0x20
+
+/* most fragments of one READVAR response, a response to a variable list is only one */
+#define MAX_READVAR_FRAGMENTS 32
+
+/* the READVAR exchange with one association */
+typedef struct {
+	uint16_t assoc;
+	uint16_t seq;
+	const char *getvar;
+	bool done;
+	bool error;
+	char *data; /* the reassembled response, NULL terminated once done */
+	size_t data_size;
+	size_t received_length;
+	size_t total_length; /* known when the last fragment arrived */
+	uint16_t fragment_offsets[MAX_READVAR_FRAGMENTS];
+	int number_of_fragments;
+} ntp_readvar;
+
+/* Returns ERROR if the response has more than MAX_READVAR_FRAGMENTS fragments */
+int ntp_readvar_add_fragment(ntp_readvar *readvar, const ntp_control_message *response);
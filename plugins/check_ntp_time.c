@@ -42,6 +42,7 @@
 #include "states.h"
 #include "thresholds.h"
 #include "check_ntp_time.d/config.h"
+#include "check_ntp_time.d/clock_filter.h"
 #include <netinet/in.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -323,17 +324,18 @@ static int best_offset_server(const ntp_server_results *slist, int nservers) {
 	return -1;
 }
 
-/* do everything we need to get the total average offset
- * - we use a certain amount of parallelization with poll() to ensure
- *   we don't waste time sitting around waiting for single packets.
- * - we also "manually" handle resolving host names and connecting, because
- *   we have to do it in a way that our lazy macros don't handle currently :( */
+/* one socket per address of the server, fd of ufds is -1 if it could not be connected */
 typedef struct {
-	mp_state_enum offset_result;
-	double offset;
-} offset_request_wrapper;
-static offset_request_wrapper offset_request(const char *host, const char *port, int time_offset,
-											 const struct timespec poll_delay) {
+	size_t num_hosts;
+	int *socklist;
+	struct pollfd *ufds;
+	struct addrinfo *addresses;
+} ntp_sockets;
+
+/* - we "manually" handle resolving host names and connecting, because
+ *   we have to do it in a way that our lazy macros don't handle currently :(
+ * - with rx_timestamps the kernel records when each response arrived */
+static ntp_sockets open_sockets(const char *host, const char *port, bool rx_timestamps) {
 	/* setup hints to only return results from getaddrinfo that we'd like */
 	struct addrinfo hints;
 	memset(&hints, 0, sizeof(struct addrinfo));
@@ -341,55 +343,50 @@ static offset_request_wrapper offset_request(const char *host, const char *port,
 	hints.ai_protocol = IPPROTO_UDP;
 	hints.ai_socktype = SOCK_DGRAM;
 
+	ntp_sockets result = {
+		.num_hosts = 0,
+		.addresses = NULL,
+	};
+
 	bool is_socket;
-	struct addrinfo *addresses = NULL;
-	size_t num_hosts = 0;
 	if (host[0] == '/') {
-		num_hosts = 1;
+		result.num_hosts = 1;
 		is_socket = true;
 	} else {
 		is_socket = false;
 
 		/* fill in ai with the list of hosts resolved by the host name */
-		int ga_result = getaddrinfo(host, port, &hints, &addresses);
+		int ga_result = getaddrinfo(host, port, &hints, &result.addresses);
 		if (ga_result != 0) {
 			die(STATE_UNKNOWN, "error getting address for %s: %s\n", host, gai_strerror(ga_result));
 		}
 
 		/* count the number of returned hosts, and allocate stuff accordingly */
-		for (struct addrinfo *ai_tmp = addresses; ai_tmp != NULL; ai_tmp = ai_tmp->ai_next) {
-			num_hosts++;
+		for (struct addrinfo *ai_tmp = result.addresses; ai_tmp != NULL; ai_tmp = ai_tmp->ai_next) {
+			result.num_hosts++;
 		}
 	}
 
-	ntp_message *req = (ntp_message *)malloc(sizeof(ntp_message) * num_hosts);
-
-	if (req == NULL) {
-		die(STATE_UNKNOWN, "can not allocate ntp message array");
-	}
-	int *socklist = (int *)malloc(sizeof(int) * num_hosts);
-
-	if (socklist == NULL) {
+	result.socklist = (int *)malloc(sizeof(int) * result.num_hosts);
+	if (result.socklist == NULL) {
 		die(STATE_UNKNOWN, "can not allocate socket array");
 	}
 
-	struct pollfd *ufds = (struct pollfd *)malloc(sizeof(struct pollfd) * num_hosts);
-	if (ufds == NULL) {
+	result.ufds = (struct pollfd *)malloc(sizeof(struct pollfd) * result.num_hosts);
+	if (result.ufds == NULL) {
 		die(STATE_UNKNOWN, "can not allocate socket array");
 	}
-
-	ntp_server_results *servers =
-		(ntp_server_results *)malloc(sizeof(ntp_server_results) * num_hosts);
-	if (servers == NULL) {
-		die(STATE_UNKNOWN, "can not allocate server array");
+	for (size_t i = 0; i < result.num_hosts; i++) {
+		result.ufds[i].fd = -1;
+		result.ufds[i].events = POLLIN;
+		result.ufds[i].revents = 0;
 	}
-	memset(servers, 0, sizeof(ntp_server_results) * num_hosts);
-	DBG(printf("Found %zu peers to check\n", num_hosts));
+	DBG(printf("Found %zu peers to check\n", result.num_hosts));
 
 	/* setup each socket for writing, and the corresponding struct pollfd */
 	if (is_socket) {
-		socklist[0] = socket(AF_UNIX, SOCK_STREAM, 0);
-		if (socklist[0] == -1) {
+		result.socklist[0] = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (result.socklist[0] == -1) {
 			DBG(printf("can't create socket: %s\n", strerror(errno)));
 			die(STATE_UNKNOWN, "can not create new socket\n");
 		}
@@ -403,40 +400,92 @@ static offset_request_wrapper offset_request(const char *host, const char *port,
 		}
 		strncpy(unix_socket.sun_path, host, sizeof(unix_socket.sun_path));
 
-		if (connect(socklist[0], (struct sockaddr *)&unix_socket, sizeof(unix_socket))) {
+		if (connect(result.socklist[0], (struct sockaddr *)&unix_socket, sizeof(unix_socket))) {
 			/* don't die here, because it is enough if there is one server
 			   answering in time. This also would break for dual ipv4/6 stacked
 			   ntp servers when the client only supports on of them.
 			 */
 			DBG(printf("can't create socket connection on peer %i: %s\n", 0, strerror(errno)));
 		} else {
-			ufds[0].fd = socklist[0];
-			ufds[0].events = POLLIN;
-			ufds[0].revents = 0;
+			result.ufds[0].fd = result.socklist[0];
 		}
 	} else {
-		struct addrinfo *ai_tmp = addresses;
+		struct addrinfo *ai_tmp = result.addresses;
 		for (int i = 0; ai_tmp; i++) {
-			socklist[i] = socket(ai_tmp->ai_family, SOCK_DGRAM, IPPROTO_UDP);
-			if (socklist[i] == -1) {
+			result.socklist[i] = socket(ai_tmp->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+			if (result.socklist[i] == -1) {
 				perror(NULL);
 				die(STATE_UNKNOWN, "can not create new socket");
 			}
-			if (connect(socklist[i], ai_tmp->ai_addr, ai_tmp->ai_addrlen)) {
+
+			if (rx_timestamps) {
+				int enable = 1;
+#if defined(SO_TIMESTAMPNS)
+				setsockopt(result.socklist[i], SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+						   sizeof(enable));
+#elif defined(SO_TIMESTAMP)
+				setsockopt(result.socklist[i], SOL_SOCKET, SO_TIMESTAMP, &enable, sizeof(enable));
+#else
+				(void)enable;
+#endif
+			}
+
+			if (connect(result.socklist[i], ai_tmp->ai_addr, ai_tmp->ai_addrlen)) {
 				/* don't die here, because it is enough if there is one server
 				   answering in time. This also would break for dual ipv4/6 stacked
 				   ntp servers when the client only supports on of them.
 				 */
 				DBG(printf("can't create socket connection on peer %i: %s\n", i, strerror(errno)));
 			} else {
-				ufds[i].fd = socklist[i];
-				ufds[i].events = POLLIN;
-				ufds[i].revents = 0;
+				result.ufds[i].fd = result.socklist[i];
 			}
 			ai_tmp = ai_tmp->ai_next;
 		}
 	}
 
+	return result;
+}
+
+static void close_sockets(ntp_sockets sockets) {
+	for (size_t j = 0; j < sockets.num_hosts; j++) {
+		close(sockets.socklist[j]);
+	}
+	free(sockets.socklist);
+	free(sockets.ufds);
+	if (sockets.addresses != NULL) {
+		freeaddrinfo(sockets.addresses);
+	}
+}
+
+/* do everything we need to get the total average offset
+ * - we use a certain amount of parallelization with poll() to ensure
+ *   we don't waste time sitting around waiting for single packets. */
+typedef struct {
+	mp_state_enum offset_result;
+	double offset;
+	/* only in burst mode, the filter result of the selected server */
+	bool has_filter;
+	ntp_clock_filter_result filter;
+} offset_request_wrapper;
+static offset_request_wrapper offset_request(const char *host, const char *port, int time_offset,
+											 const struct timespec poll_delay) {
+	ntp_sockets sockets = open_sockets(host, port, false);
+	size_t num_hosts = sockets.num_hosts;
+	int *socklist = sockets.socklist;
+	struct pollfd *ufds = sockets.ufds;
+
+	ntp_message *req = (ntp_message *)malloc(sizeof(ntp_message) * num_hosts);
+	if (req == NULL) {
+		die(STATE_UNKNOWN, "can not allocate ntp message array");
+	}
+
+	ntp_server_results *servers =
+		(ntp_server_results *)malloc(sizeof(ntp_server_results) * num_hosts);
+	if (servers == NULL) {
+		die(STATE_UNKNOWN, "can not allocate server array");
+	}
+	memset(servers, 0, sizeof(ntp_server_results) * num_hosts);
+
 	/* now do AVG_NUM checks to each host. We stop before timeout/2 seconds
 	 * have passed in order to ensure post-processing and jitter time. */
 	time_t start_ts = 0;
@@ -520,6 +569,7 @@ static offset_request_wrapper offset_request(const char *host, const char *port,
 	offset_request_wrapper result = {
 		.offset = 0,
 		.offset_result = STATE_UNKNOWN,
+		.has_filter = false,
 	};
 
 	/* now, pick the best server from the list */
@@ -537,14 +587,9 @@ static offset_request_wrapper offset_request(const char *host, const char *port,
 	}
 
 	/* cleanup */
-	for (size_t j = 0; j < num_hosts; j++) {
-		close(socklist[j]);
-	}
-	free(socklist);
-	free(ufds);
+	close_sockets(sockets);
 	free(servers);
 	free(req);
-	freeaddrinfo(addresses);
 
 	if (verbose) {
 		printf("overall average offset: %.10g\n", avg_offset);
@@ -554,11 +599,268 @@ static offset_request_wrapper offset_request(const char *host, const char *port,
 	return result;
 }
 
+/* seconds of an ntp 64-bit fp number since base (unix time), keeps the full precision */
+static double ntp64_since(uint64_t ntp_time, time_t base) {
+	return (double)((int64_t)ntohl(L32(ntp_time)) - (int64_t)EPOCHDIFF - (int64_t)base) +
+		   ((double)ntohl(R32(ntp_time)) / 4294967296.0);
+}
+
+static double timespec_since(struct timespec time, time_t base) {
+	return (double)(time.tv_sec - base) + ((double)time.tv_nsec / 1e9);
+}
+
+static double timespec_diff(struct timespec end, struct timespec start) {
+	return (double)(end.tv_sec - start.tv_sec) + ((double)(end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+/* Reads one response, receive_time is taken from the kernel if it recorded it */
+static ssize_t receive_response(int socket_fd, ntp_message *response,
+								struct timespec *receive_time) {
+	struct iovec iov = {
+		.iov_base = response,
+		.iov_len = sizeof(ntp_message),
+	};
+	union {
+		char buffer[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(struct timeval))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr message = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buffer,
+		.msg_controllen = sizeof(control.buffer),
+	};
+
+	ssize_t length = recvmsg(socket_fd, &message, 0);
+	clock_gettime(CLOCK_REALTIME, receive_time);
+	if (length < 0) {
+		return length;
+	}
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL;
+		 cmsg = CMSG_NXTHDR(&message, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET) {
+			continue;
+		}
+#ifdef SCM_TIMESTAMPNS
+		if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			memcpy(receive_time, CMSG_DATA(cmsg), sizeof(struct timespec));
+		}
+#endif
+#ifdef SCM_TIMESTAMP
+		if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+			struct timeval kernel_time;
+			memcpy(&kernel_time, CMSG_DATA(cmsg), sizeof(kernel_time));
+			receive_time->tv_sec = kernel_time.tv_sec;
+			receive_time->tv_nsec = kernel_time.tv_usec * 1000L;
+		}
+#endif
+	}
+	return length;
+}
+
+/* the requests of a burst to one address of the server */
+typedef struct {
+	int sent;
+	int received;
+	struct timespec next_request;
+	uint64_t request_ids[NTP_MAX_BURST];      /* the transmit timestamp, echoed by the server */
+	struct timespec request_times[NTP_MAX_BURST];
+	bool answered[NTP_MAX_BURST];
+	ntp_sample samples[NTP_MAX_BURST];
+} ntp_burst;
+
+/* burst mode: send burst requests spaced by spacing to every address of
+ * the server at the same time, and feed the responses of each address into
+ * the clock filter. The kernel timestamps the responses on arrival, so the
+ * scheduling of this process does not count as network delay. */
+static offset_request_wrapper burst_offset_request(const char *host, const char *port,
+												   int time_offset, int burst,
+												   const struct timespec spacing) {
+	ntp_sockets sockets = open_sockets(host, port, true);
+	size_t num_hosts = sockets.num_hosts;
+
+	ntp_burst *bursts = (ntp_burst *)calloc(num_hosts, sizeof(ntp_burst));
+	ntp_server_results *servers = (ntp_server_results *)calloc(num_hosts, sizeof(ntp_server_results));
+	if (bursts == NULL || servers == NULL) {
+		die(STATE_UNKNOWN, "can not allocate server array");
+	}
+
+	/* like the normal mode, stop after timeout/2 seconds to leave time for the rest.
+	 * A response which did not arrive within a second after the last request is lost. */
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	double deadline = (double)socket_timeout / 2;
+	double spacing_seconds = (double)spacing.tv_sec + ((double)spacing.tv_nsec / 1e9);
+	double last_request = 0;
+	bool one_read = false;
+
+	while (true) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		double elapsed = timespec_diff(now, start);
+
+		bool complete = true;
+		double next_event = deadline;
+		for (size_t i = 0; i < num_hosts; i++) {
+			if (sockets.ufds[i].fd < 0) {
+				continue;
+			}
+			ntp_burst *current = &bursts[i];
+			if (current->received < burst) {
+				complete = false;
+			}
+			if (current->sent == burst) {
+				continue;
+			}
+
+			double due = timespec_diff(current->next_request, start);
+			if (current->sent > 0 && due > elapsed) {
+				next_event = (due < next_event) ? due : next_event;
+				continue;
+			}
+
+			ntp_message request;
+			setup_request(&request);
+			current->request_ids[current->sent] = request.txts;
+			clock_gettime(CLOCK_REALTIME, &current->request_times[current->sent]);
+			if (verbose) {
+				printf("sending request %d to peer %zu\n", current->sent, i);
+			}
+			if (write(sockets.socklist[i], &request, sizeof(ntp_message)) < 0) {
+				DBG(printf("can't send to peer %zu: %s\n", i, strerror(errno)));
+			}
+			current->sent++;
+			last_request = elapsed;
+
+			current->next_request = now;
+			current->next_request.tv_sec += spacing.tv_sec;
+			current->next_request.tv_nsec += spacing.tv_nsec;
+			if (current->next_request.tv_nsec >= 1000000000L) {
+				current->next_request.tv_sec++;
+				current->next_request.tv_nsec -= 1000000000L;
+			}
+			if (current->sent < burst && elapsed + spacing_seconds < next_event) {
+				next_event = elapsed + spacing_seconds;
+			}
+		}
+
+		bool all_sent = true;
+		for (size_t i = 0; i < num_hosts; i++) {
+			if (sockets.ufds[i].fd >= 0 && bursts[i].sent < burst) {
+				all_sent = false;
+			}
+		}
+		if (complete || elapsed >= deadline || (all_sent && elapsed >= last_request + 1)) {
+			break;
+		}
+		if (all_sent && last_request + 1 < next_event) {
+			next_event = last_request + 1;
+		}
+
+		int wait_ms = (int)((next_event - elapsed) * 1000) + 1;
+		int servers_readable = poll(sockets.ufds, num_hosts, wait_ms);
+		if (servers_readable == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("polling ntp sockets");
+			die(STATE_UNKNOWN, "communication errors");
+		}
+
+		for (size_t i = 0; servers_readable > 0 && i < num_hosts; i++) {
+			if (!(sockets.ufds[i].revents & (POLLIN | POLLERR | POLLHUP))) {
+				continue;
+			}
+			servers_readable--;
+
+			ntp_message response;
+			struct timespec receive_time;
+			ssize_t length = receive_response(sockets.ufds[i].fd, &response, &receive_time);
+			if (length == 0 || (length < 0 && errno != EINTR && errno != EAGAIN)) {
+				/* refused or closed, nothing more to expect from this address */
+				DBG(printf("giving up on peer %zu: %s\n", i,
+						   (length == 0) ? "closed" : strerror(errno)));
+				sockets.ufds[i].fd = -1;
+				continue;
+			}
+			if (length < (ssize_t)sizeof(ntp_message)) {
+				continue;
+			}
+			DBG(print_ntp_message(&response));
+
+			/* find the request this is the answer to, ignore duplicates and strays */
+			ntp_burst *current = &bursts[i];
+			int request = -1;
+			for (int j = 0; j < current->sent; j++) {
+				if (current->request_ids[j] == response.origts && !current->answered[j]) {
+					request = j;
+					break;
+				}
+			}
+			if (request < 0) {
+				DBG(printf("ignoring unexpected response from peer %zu\n", i));
+				continue;
+			}
+			current->answered[request] = true;
+
+			time_t base = current->request_times[request].tv_sec;
+			ntp_sample sample =
+				ntp_sample_init(timespec_since(current->request_times[request], base),
+								ntp64_since(response.rxts, base), ntp64_since(response.txts, base),
+								timespec_since(receive_time, base), NTP32asDOUBLE(response.rtdisp),
+								response.precision);
+			sample.offset += time_offset;
+			current->samples[current->received++] = sample;
+			if (verbose) {
+				printf("response %d from peer %zu: offset %.10g delay %.10g\n", request, i,
+					   sample.offset, sample.delay);
+			}
+
+			servers[i].num_responses = current->received;
+			servers[i].stratum = response.stratum;
+			servers[i].rtdisp = NTP32asDOUBLE(response.rtdisp);
+			servers[i].rtdelay = NTP32asDOUBLE(response.rtdelay);
+			servers[i].flags = response.flags;
+			one_read = true;
+		}
+	}
+
+	if (!one_read) {
+		die(STATE_CRITICAL, "NTP CRITICAL: No response from NTP server\n");
+	}
+
+	offset_request_wrapper result = {
+		.offset = 0,
+		.offset_result = STATE_UNKNOWN,
+		.has_filter = false,
+	};
+
+	int best_index = best_offset_server(servers, num_hosts);
+	if (best_index >= 0) {
+		result.filter = ntp_clock_filter(bursts[best_index].samples,
+										 (size_t)bursts[best_index].received);
+		result.has_filter = true;
+		result.offset_result = STATE_OK;
+		result.offset = result.filter.offset;
+		if (verbose) {
+			printf("filtered offset of peer %d: %.10g (%zu samples)\n", best_index,
+				   result.offset, result.filter.number_of_samples);
+		}
+	}
+
+	close_sockets(sockets);
+	free(bursts);
+	free(servers);
+	return result;
+}
+
 static check_ntp_time_config_wrapper process_arguments(int argc, char **argv) {
 
 	enum {
 		output_format_index = CHAR_MAX + 1,
 		polling_delay_index,
+		burst_index,
 	};
 
 	static struct option longopts[] = {{"version", no_argument, 0, 'V'},
@@ -574,6 +876,7 @@ static check_ntp_time_config_wrapper process_arguments(int argc, char **argv) {
 									   {"hostname", required_argument, 0, 'H'},
 									   {"port", required_argument, 0, 'p'},
 									   {"poll-delay", required_argument, 0, polling_delay_index},
+									   {"burst", required_argument, 0, burst_index},
 									   {"output-format", required_argument, 0, output_format_index},
 									   {0, 0, 0, 0}};
 
@@ -663,6 +966,12 @@ static check_ntp_time_config_wrapper process_arguments(int argc, char **argv) {
 				result.config.poll_delay.tv_nsec = (tmp_time % 1000000000);
 			}
 		} break;
+		case burst_index:
+			if (!is_intpos(optarg) || atoi(optarg) > NTP_MAX_BURST) {
+				usage2(_("Burst must be between 1 and 64"), optarg);
+			}
+			result.config.burst = atoi(optarg);
+			break;
 		case '4':
 			address_family = AF_INET;
 			break;
@@ -683,6 +992,32 @@ static check_ntp_time_config_wrapper process_arguments(int argc, char **argv) {
 	return result;
 }
 
+/* the statistics of the burst, the percentiles of the offset are of absolute values */
+static void add_filter_perfdata(mp_subcheck *sc_offset, const ntp_clock_filter_result filter) {
+	struct {
+		const char *label;
+		double value;
+	} values[] = {
+		{"delay", filter.delay},
+		{"jitter", filter.jitter},
+		{"dispersion", filter.dispersion},
+		{"offset_p50", filter.offset_percentiles.p50},
+		{"offset_p90", filter.offset_percentiles.p90},
+		{"delay_p50", filter.delay_percentiles.p50},
+		{"delay_p90", filter.delay_percentiles.p90},
+		{"dispersion_p50", filter.dispersion_percentiles.p50},
+		{"dispersion_p90", filter.dispersion_percentiles.p90},
+	};
+
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		mp_perfdata perfdata = perfdata_init();
+		perfdata = mp_set_pd_value(perfdata, values[i].value);
+		perfdata.label = (char *)values[i].label;
+		perfdata.uom = "s";
+		mp_add_perfdata_to_subcheck(sc_offset, perfdata);
+	}
+}
+
 int main(int argc, char *argv[]) {
 #ifdef __OpenBSD__
 	/* - rpath is required to read --extra-opts (given up later)
@@ -726,8 +1061,14 @@ int main(int argc, char *argv[]) {
 	mp_set_ok_summary(&overall, "NTP time synchronisation seems to be working");
 
 	mp_subcheck sc_offset = mp_subcheck_init();
-	offset_request_wrapper offset_result =
-		offset_request(config.server_address, config.port, config.time_offset, config.poll_delay);
+	offset_request_wrapper offset_result;
+	if (config.burst > 0) {
+		offset_result = burst_offset_request(config.server_address, config.port,
+											 config.time_offset, config.burst, config.poll_delay);
+	} else {
+		offset_result = offset_request(config.server_address, config.port, config.time_offset,
+									   config.poll_delay);
+	}
 
 	if (offset_result.offset_result == STATE_UNKNOWN) {
 		sc_offset =
@@ -737,7 +1078,13 @@ int main(int argc, char *argv[]) {
 		mp_exit(overall);
 	}
 
-	xasprintf(&sc_offset.output, "Offset: %.6fs", offset_result.offset);
+	if (offset_result.has_filter) {
+		xasprintf(&sc_offset.output, "Offset: %.6fs (delay %.6fs, jitter %.6fs, %zu samples)",
+				  offset_result.offset, offset_result.filter.delay, offset_result.filter.jitter,
+				  offset_result.filter.number_of_samples);
+	} else {
+		xasprintf(&sc_offset.output, "Offset: %.6fs", offset_result.offset);
+	}
 
 	mp_perfdata pd_offset = perfdata_init();
 	pd_offset = mp_set_pd_value(pd_offset, fabs(offset_result.offset));
@@ -748,6 +1095,9 @@ int main(int argc, char *argv[]) {
 	sc_offset = mp_set_subcheck_state(sc_offset, mp_get_pd_status(pd_offset));
 
 	mp_add_perfdata_to_subcheck(&sc_offset, pd_offset);
+	if (offset_result.has_filter) {
+		add_filter_perfdata(&sc_offset, offset_result.filter);
+	}
 	mp_add_subcheck_to_check(&overall, sc_offset);
 
 	if (config.server_address != NULL) {
@@ -781,6 +1131,11 @@ void print_help(void) {
 	printf("    %s\n", _("Expected offset of the ntp server relative to local server (seconds)"));
 	printf(" %s\n", " --poll-delay=DELAY");
 	printf("    %s\n", _("Delay between polling to avoid KOD response (seconds, 0.0 to 5.0, default 0.5 seconds)"));
+	printf(" %s\n", "--burst=COUNT");
+	printf("    %s\n", _("Send COUNT requests (1 to 64) to every address of the server, spaced by"));
+	printf("    %s\n", _("--poll-delay, and use the response with the smallest round trip delay"));
+	printf("    %s\n", _("as offset. Adds delay, jitter, dispersion and their percentiles"));
+	printf("    %s\n", _("to the performance data"));
 	printf(UT_CONN_TIMEOUT, DEFAULT_SOCKET_TIMEOUT);
 	printf(UT_VERBOSE);
 	printf(UT_OUTPUT_FORMAT);
@@ -802,6 +1157,7 @@ void print_help(void) {
 	printf("\n");
 	printf("%s\n", _("Examples:"));
 	printf("  %s\n", ("./check_ntp_time -H ntpserv -w 0.5 -c 1"));
+	printf("  %s\n", ("./check_ntp_time -H ntpserv -w 0.5 -c 1 --burst 8 --poll-delay 0.25"));
 
 	printf(UT_SUPPORT);
 }
@@ -810,4 +1166,5 @@ void print_usage(void) {
 	printf("%s\n", _("Usage:"));
 	printf(" %s -H <host> [-4|-6] [-w <warn>] [-c <crit>] [-v verbose] [-o <time offset>]\n",
 		   progname);
+	printf("       [--burst <count>] [--poll-delay <seconds>]\n");
 }
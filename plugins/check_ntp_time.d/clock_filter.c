@@ -0,0 +1,113 @@
+#include "./clock_filter.h"
+#include "../common.h"
+#include "../../lib/utils_base.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Calculates offset, delay and dispersion of one exchange from its four
+ * timestamps (RFC 5905, 8). The dispersion of a sample is the root
+ * dispersion of the server plus its precision plus what the local clock
+ * might have drifted while waiting for the response.
+ */
+ntp_sample ntp_sample_init(double client_tx, double server_rx, double server_tx, double client_rx,
+						   double root_dispersion, int precision) {
+	ntp_sample result = {
+		.offset = ((server_rx - client_tx) + (server_tx - client_rx)) / 2,
+		.delay = (client_rx - client_tx) - (server_tx - server_rx),
+	};
+
+	// A server answering faster than it received the request does not make it negative
+	if (result.delay < 0) {
+		result.delay = 0;
+	}
+	result.dispersion =
+		root_dispersion + ldexp(1.0, precision) + (NTP_PHI * (client_rx - client_tx));
+	return result;
+}
+
+static int compare_doubles(const void *left, const void *right) {
+	double left_value = *(const double *)left;
+	double right_value = *(const double *)right;
+	if (left_value < right_value) {
+		return -1;
+	}
+	return (left_value > right_value) ? 1 : 0;
+}
+
+static int compare_delay(const void *left, const void *right) {
+	return compare_doubles(&((const ntp_sample *)left)->delay,
+						   &((const ntp_sample *)right)->delay);
+}
+
+/* Nearest rank percentiles, sorts values */
+static ntp_percentiles percentiles(double *values, size_t number_of_values) {
+	qsort(values, number_of_values, sizeof(double), compare_doubles);
+
+	ntp_percentiles result = {
+		.p50 = values[(size_t)ceil(0.5 * (double)number_of_values) - 1],
+		.p90 = values[(size_t)ceil(0.9 * (double)number_of_values) - 1],
+	};
+	return result;
+}
+
+/*
+ * The clock filter of RFC 5905, 10 on one burst: the sample with the
+ * smallest delay suffered the least from queueing and asymmetric paths
+ * and therefore provides the offset.
+ */
+ntp_clock_filter_result ntp_clock_filter(const ntp_sample *samples, size_t number_of_samples) {
+	ntp_clock_filter_result result = {
+		.errorcode = ERROR,
+		.number_of_samples = number_of_samples,
+	};
+
+	if (number_of_samples == 0) {
+		return result;
+	}
+
+	ntp_sample *sorted = calloc(number_of_samples, sizeof(ntp_sample));
+	double *values = calloc(number_of_samples, sizeof(double));
+	if (sorted == NULL || values == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+	memcpy(sorted, samples, number_of_samples * sizeof(ntp_sample));
+	qsort(sorted, number_of_samples, sizeof(ntp_sample), compare_delay);
+
+	result.errorcode = OK;
+	result.offset = sorted[0].offset;
+	result.delay = sorted[0].delay;
+
+	double squared_differences = 0;
+	for (size_t i = 0; i < number_of_samples; i++) {
+		// Samples with a larger delay count less
+		result.dispersion += ldexp(sorted[i].dispersion, -(int)(i + 1));
+		if (i > 0) {
+			double difference = sorted[i].offset - result.offset;
+			squared_differences += difference * difference;
+		}
+	}
+	if (number_of_samples > 1) {
+		result.jitter = sqrt(squared_differences / (double)(number_of_samples - 1));
+	}
+
+	for (size_t i = 0; i < number_of_samples; i++) {
+		values[i] = fabs(samples[i].offset);
+	}
+	result.offset_percentiles = percentiles(values, number_of_samples);
+
+	for (size_t i = 0; i < number_of_samples; i++) {
+		values[i] = samples[i].delay;
+	}
+	result.delay_percentiles = percentiles(values, number_of_samples);
+
+	for (size_t i = 0; i < number_of_samples; i++) {
+		values[i] = samples[i].dispersion;
+	}
+	result.dispersion_percentiles = percentiles(values, number_of_samples);
+
+	free(values);
+	free(sorted);
+	return result;
+}
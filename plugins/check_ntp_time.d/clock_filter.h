@@ -0,0 +1,43 @@
+#pragma once
+/* Header file for the burst mode clock filter of check_ntp_time in clock_filter.c */
+
+#include "../../config.h"
+#include <stddef.h>
+
+/* Upper limit for --burst */
+#define NTP_MAX_BURST 64
+
+/* Frequency tolerance of the local clock (15 ppm), as in RFC 5905 */
+#define NTP_PHI 15e-6
+
+/* One request/response exchange, all values in seconds */
+typedef struct {
+	double offset;
+	double delay;
+	double dispersion;
+} ntp_sample;
+
+typedef struct {
+	double p50;
+	double p90;
+} ntp_percentiles;
+
+typedef struct {
+	int errorcode; /* ERROR if there was no sample */
+	size_t number_of_samples;
+
+	/* The sample with the smallest delay is the most accurate one */
+	double offset;
+	double delay;
+	/* Weighted dispersion of all samples and RMS of their offsets to the selected one */
+	double dispersion;
+	double jitter;
+
+	ntp_percentiles offset_percentiles; /* of the absolute offsets */
+	ntp_percentiles delay_percentiles;
+	ntp_percentiles dispersion_percentiles;
+} ntp_clock_filter_result;
+
+ntp_sample ntp_sample_init(double client_tx, double server_rx, double server_tx, double client_rx,
+						   double root_dispersion, int precision);
+ntp_clock_filter_result ntp_clock_filter(const ntp_sample *samples, size_t number_of_samples);
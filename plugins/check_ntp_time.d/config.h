@@ -16,6 +16,7 @@ typedef struct {
 
 	bool quiet;
 	int time_offset;
+	int burst; /* requests per address in burst mode, 0 for the average of AVG_NUM responses */
 
 	mp_thresholds offset_thresholds;
 
@@ -31,6 +32,7 @@ check_ntp_time_config check_ntp_time_config_init() {
 
 		.quiet = false,
 		.time_offset = 0,
+		.burst = 0,
 
 		.offset_thresholds = mp_thresholds_init(),
 
@@ -61,41 +61,76 @@ typedef struct {
 	check_smtp_config config;
 } check_smtp_config_wrapper;
 static check_smtp_config_wrapper process_arguments(int /*argc*/, char ** /*argv*/);
+static void print_help(void);
+void print_usage(void);
+static char *smtp_quit(check_smtp_config /*config*/, char /*buffer*/[MAX_INPUT_BUFFER],
+					   np_net_reader * /*reader*/);
+static int my_close(np_net_reader * /*reader*/);
 
-int my_recv(check_smtp_config config, void *buf, int num, int socket_descriptor,
-			bool ssl_established) {
+/* Sends through the TLS session once the reader uses one */
+int my_send(void *buf, int num, np_net_reader *reader) {
 #ifdef HAVE_SSL
-	if ((config.use_starttls || config.use_ssl) && ssl_established) {
-		return np_net_ssl_read(buf, num);
+	if (reader->ssl_connection != NULL) {
+		int result = np_net_ssl_connection_write(reader->ssl_connection, buf, num);
+		np_net_timing_sent(result);
+		return result;
 	}
-	return (int)read(socket_descriptor, buf, (size_t)num);
-#else /* ifndef HAVE_SSL */
-	return read(socket_descriptor, buf, len)
 #endif
+	return (int)np_net_send(reader->socket, buf, (size_t)num);
 }
 
-int my_send(check_smtp_config config, void *buf, int num, int socket_descriptor,
-			bool ssl_established) {
 #ifdef HAVE_SSL
-	if ((config.use_starttls || config.use_ssl) && ssl_established) {
+/*
+ * Performs the TLS handshake on the connection of the reader, which reads
+ * from the TLS session afterwards
+ */
+static mp_state_enum start_tls(check_smtp_config config, np_net_reader *reader,
+							   np_net_ssl_context **context) {
+	mp_state_enum result = np_net_ssl_context_new(context, 0, NULL, NULL);
+	if (result != STATE_OK) {
+		return result;
+	}
 
-		return np_net_ssl_write(buf, num);
+	np_net_ssl_connection *connection = np_net_ssl_connection_new(
+		*context, reader->socket, (config.use_sni ? config.server_address : NULL));
+	if (connection == NULL) {
+		return STATE_CRITICAL;
 	}
-	return (int)send(socket_descriptor, buf, (size_t)num, 0);
-#else /* ifndef HAVE_SSL */
-	return send(socket_descriptor, buf, len, 0);
-#endif
+	/* the certificates of -D have to come from the server, not from the cache */
+	bool check_certificate = config.certificate_chain || config.days_till_exp_warn != 0 ||
+							 config.days_till_exp_crit != 0;
+	if (config.tls_session_cache && !check_certificate) {
+		np_net_ssl_connection_cache_sessions(connection, config.server_address,
+											 config.server_port);
+	}
+	if (np_net_ssl_handshake(connection, socket_timeout) != STATE_OK) {
+		np_net_ssl_connection_free(connection);
+		return STATE_CRITICAL;
+	}
+
+	np_net_reader_use_ssl_connection(reader, connection);
+	return STATE_OK;
 }
 
-static void print_help(void);
-void print_usage(void);
-static char *smtp_quit(check_smtp_config /*config*/, char /*buffer*/[MAX_INPUT_BUFFER],
-					   int /*socket_descriptor*/, bool /*ssl_established*/);
-static int recvline(char * /*buf*/, size_t /*bufsize*/, check_smtp_config /*config*/,
-					int /*socket_descriptor*/, bool /*ssl_established*/);
-static int recvlines(check_smtp_config /*config*/, char * /*buf*/, size_t /*bufsize*/,
-					 int /*socket_descriptor*/, bool /*ssl_established*/);
-static int my_close(int /*socket_descriptor*/);
+/* Checks every certificate of the chain and ends the check without the rest of the dialog */
+static void check_certificate_chain(check_smtp_config config, np_net_reader *reader,
+									mp_check overall) {
+	np_net_ssl_chain_result chain = np_net_ssl_connection_check_chain(reader->ssl_connection);
+	mp_subcheck sc_chain = mp_net_ssl_check_chain(&chain, (int)config.days_till_exp_warn,
+												  (int)config.days_till_exp_crit, NULL);
+	np_net_ssl_chain_result_free(&chain);
+	if (sc_chain.state != STATE_OK && config.ignore_certificate_expiration) {
+		xasprintf(&sc_chain.output, "%s. Expiration will be ignored", sc_chain.output);
+		sc_chain = mp_set_subcheck_state(sc_chain, STATE_OK);
+	}
+	mp_add_subcheck_to_check(&overall, sc_chain);
+
+	/* the server does not need to wait for the connection to time out */
+	my_send(SMTP_QUIT, strlen(SMTP_QUIT), reader);
+	my_close(reader);
+	mp_exit(overall);
+}
+#endif
 
 static int verbose = 0;
 
@@ -192,7 +227,9 @@ int main(int argc, char **argv) {
 
 	mp_subcheck sc_tcp_connect = mp_subcheck_init();
 	char buffer[MAX_INPUT_BUFFER];
-	bool ssl_established = false;
+#ifdef HAVE_SSL
+	np_net_ssl_context *tls_context = NULL;
+#endif
 
 	if (tcp_result != STATE_OK) {
 		// Connect failed
@@ -203,24 +240,25 @@ int main(int argc, char **argv) {
 	}
 
 	/* we connected */
+	np_net_reader reader;
+	np_net_reader_init(&reader, socket_descriptor);
+
 	/* If requested, send PROXY header */
 	if (config.use_proxy_prefix) {
 		if (verbose) {
 			printf("Sending header %s\n", PROXY_PREFIX);
 		}
-		my_send(config, PROXY_PREFIX, strlen(PROXY_PREFIX), socket_descriptor, ssl_established);
+		my_send(PROXY_PREFIX, strlen(PROXY_PREFIX), &reader);
 	}
 
 #ifdef HAVE_SSL
 	if (config.use_ssl) {
-		int tls_result = np_net_ssl_init_with_hostname(
-			socket_descriptor, (config.use_sni ? config.server_address : NULL));
+		mp_state_enum tls_result = start_tls(config, &reader, &tls_context);
 
 		mp_subcheck sc_tls_connection = mp_subcheck_init();
 
 		if (tls_result != STATE_OK) {
 			close(socket_descriptor);
-			np_net_ssl_cleanup();
 
 			sc_tls_connection = mp_set_subcheck_state(sc_tls_connection, STATE_CRITICAL);
 			xasprintf(&sc_tls_connection.output, "cannot create TLS context");
@@ -229,15 +267,21 @@ int main(int argc, char **argv) {
 		}
 
 		sc_tls_connection = mp_set_subcheck_state(sc_tls_connection, STATE_OK);
-		xasprintf(&sc_tls_connection.output, "TLS context established");
+		xasprintf(&sc_tls_connection.output, "TLS context established%s",
+				  np_net_ssl_connection_reused(reader.ssl_connection) ? " (session resumed)"
+																	  : "");
+		mp_net_ssl_connection_add_handshake_perfdata(reader.ssl_connection, &sc_tls_connection);
 		mp_add_subcheck_to_check(&overall, sc_tls_connection);
-		ssl_established = true;
+
+		if (config.certificate_chain) {
+			check_certificate_chain(config, &reader, overall);
+		}
 	}
 #endif
 
 	/* watch for the SMTP connection string and */
 	/* return a WARNING status if we couldn't read any data */
-	if (recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor, ssl_established) <= 0) {
+	if (np_net_read_reply(&reader, buffer, MAX_INPUT_BUFFER) <= 0) {
 		mp_subcheck sc_read_data = mp_subcheck_init();
 		sc_read_data = mp_set_subcheck_state(sc_read_data, STATE_WARNING);
 		xasprintf(&sc_read_data.output, "recv() failed");
@@ -250,10 +294,10 @@ int main(int argc, char **argv) {
 	xasprintf(&server_response, "%s", buffer);
 
 	/* send the HELO/EHLO command */
-	my_send(config, helocmd, (int)strlen(helocmd), socket_descriptor, ssl_established);
+	my_send(helocmd, (int)strlen(helocmd), &reader);
 
 	/* allow for response to helo command to reach us */
-	if (recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor, ssl_established) <= 0) {
+	if (np_net_read_reply(&reader, buffer, MAX_INPUT_BUFFER) <= 0) {
 		mp_subcheck sc_read_data = mp_subcheck_init();
 		sc_read_data = mp_set_subcheck_state(sc_read_data, STATE_WARNING);
 		xasprintf(&sc_read_data.output, "recv() failed");
@@ -269,7 +313,7 @@ int main(int argc, char **argv) {
 	}
 
 	if (config.use_starttls && !supports_tls) {
-		smtp_quit(config, buffer, socket_descriptor, ssl_established);
+		smtp_quit(config, buffer, &reader);
 
 		mp_subcheck sc_read_data = mp_subcheck_init();
 		sc_read_data = mp_set_subcheck_state(sc_read_data, STATE_WARNING);
@@ -284,10 +328,9 @@ int main(int argc, char **argv) {
 		send(socket_descriptor, SMTP_STARTTLS, strlen(SMTP_STARTTLS), 0);
 
 		mp_subcheck sc_starttls_init = mp_subcheck_init();
-		recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor,
-				  ssl_established); /* wait for it */
+		np_net_read_reply(&reader, buffer, MAX_INPUT_BUFFER); /* wait for it */
 		if (!strstr(buffer, SMTP_EXPECT)) {
-			smtp_quit(config, buffer, socket_descriptor, ssl_established);
+			smtp_quit(config, buffer, &reader);
 
 			xasprintf(&sc_starttls_init.output, "StartTLS not supported by server");
 			sc_starttls_init = mp_set_subcheck_state(sc_starttls_init, STATE_UNKNOWN);
@@ -295,11 +338,9 @@ int main(int argc, char **argv) {
 			mp_exit(overall);
 		}
 
-		mp_state_enum starttls_result = np_net_ssl_init_with_hostname(
-			socket_descriptor, (config.use_sni ? config.server_address : NULL));
+		mp_state_enum starttls_result = start_tls(config, &reader, &tls_context);
 		if (starttls_result != STATE_OK) {
 			close(socket_descriptor);
-			np_net_ssl_cleanup();
 
 			sc_starttls_init = mp_set_subcheck_state(sc_starttls_init, STATE_CRITICAL);
 			xasprintf(&sc_starttls_init.output, "failed to create StartTLS context");
@@ -307,10 +348,15 @@ int main(int argc, char **argv) {
 			mp_exit(overall);
 		}
 		sc_starttls_init = mp_set_subcheck_state(sc_starttls_init, STATE_OK);
-		xasprintf(&sc_starttls_init.output, "created StartTLS context");
+		xasprintf(&sc_starttls_init.output, "created StartTLS context%s",
+				  np_net_ssl_connection_reused(reader.ssl_connection) ? " (session resumed)"
+																	  : "");
+		mp_net_ssl_connection_add_handshake_perfdata(reader.ssl_connection, &sc_starttls_init);
 		mp_add_subcheck_to_check(&overall, sc_starttls_init);
 
-		ssl_established = true;
+		if (config.certificate_chain) {
+			check_certificate_chain(config, &reader, overall);
+		}
 
 		/*
 		 * Resend the EHLO command.
@@ -323,9 +369,8 @@ int main(int argc, char **argv) {
 		 * reason, some MTAs will not allow an AUTH LOGIN command before
 		 * we resent EHLO via TLS.
 		 */
-		if (my_send(config, helocmd, (int)strlen(helocmd), socket_descriptor, ssl_established) <=
-			0) {
-			my_close(socket_descriptor);
+		if (my_send(helocmd, (int)strlen(helocmd), &reader) <= 0) {
+			my_close(&reader);
 
 			mp_subcheck sc_ehlo = mp_subcheck_init();
 			sc_ehlo = mp_set_subcheck_state(sc_ehlo, STATE_UNKNOWN);
@@ -338,8 +383,8 @@ int main(int argc, char **argv) {
 			printf(_("sent %s"), helocmd);
 		}
 
-		if (recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor, ssl_established) <= 0) {
-			my_close(socket_descriptor);
+		if (np_net_read_reply(&reader, buffer, MAX_INPUT_BUFFER) <= 0) {
+			my_close(&reader);
 
 			mp_subcheck sc_ehlo = mp_subcheck_init();
 			sc_ehlo = mp_set_subcheck_state(sc_ehlo, STATE_UNKNOWN);
@@ -354,9 +399,9 @@ int main(int argc, char **argv) {
 	}
 
 #	ifdef MOPL_USE_OPENSSL
-	if (ssl_established) {
-		net_ssl_check_cert_result cert_check_result =
-			np_net_ssl_check_cert2(config.days_till_exp_warn, config.days_till_exp_crit);
+	if (reader.ssl_connection != NULL) {
+		net_ssl_check_cert_result cert_check_result = np_net_ssl_connection_check_cert2(
+			reader.ssl_connection, config.days_till_exp_warn, config.days_till_exp_crit);
 
 		mp_subcheck sc_cert_check = mp_subcheck_init();
 
@@ -428,8 +473,8 @@ int main(int argc, char **argv) {
 	mp_add_subcheck_to_check(&overall, sc_expect_response);
 
 	if (config.send_mail_from) {
-		my_send(config, cmd_str, (int)strlen(cmd_str), socket_descriptor, ssl_established);
-		if (recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor, ssl_established) >= 1 &&
+		my_send(cmd_str, (int)strlen(cmd_str), &reader);
+		if (np_net_read_reply(&reader, buffer, MAX_INPUT_BUFFER) >= 1 &&
 			verbose) {
 			printf("%s", buffer);
 		}
@@ -438,8 +483,8 @@ int main(int argc, char **argv) {
 	size_t counter = 0;
 	while (counter < config.ncommands) {
 		xasprintf(&cmd_str, "%s%s", config.commands[counter], "\r\n");
-		my_send(config, cmd_str, (int)strlen(cmd_str), socket_descriptor, ssl_established);
-		if (recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor, ssl_established) >= 1 &&
+		my_send(cmd_str, (int)strlen(cmd_str), &reader);
+		if (np_net_read_reply(&reader, buffer, MAX_INPUT_BUFFER) >= 1 &&
 			verbose) {
 			printf("%s", buffer);
 		}
@@ -491,15 +536,13 @@ int main(int argc, char **argv) {
 			char *abuf;
 			do {
 				/* send AUTH LOGIN */
-				my_send(config, SMTP_AUTH_LOGIN, strlen(SMTP_AUTH_LOGIN), socket_descriptor,
-						ssl_established);
+				my_send(SMTP_AUTH_LOGIN, strlen(SMTP_AUTH_LOGIN), &reader);
 
 				if (verbose) {
 					printf(_("sent %s\n"), "AUTH LOGIN");
 				}
 
-				if ((recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor,
-							   ssl_established)) <= 0) {
+				if ((np_net_read_reply(&reader, buffer, MAX_INPUT_BUFFER)) <= 0) {
 					xasprintf(&sc_auth.output, _("recv() failed after AUTH LOGIN"));
 					sc_auth = mp_set_subcheck_state(sc_auth, STATE_WARNING);
 					break;
@@ -518,13 +561,12 @@ int main(int argc, char **argv) {
 				/* encode authuser with base64 */
 				base64_encode_alloc(config.authuser, strlen(config.authuser), &abuf);
 				xasprintf(&abuf, "%s\r\n", abuf);
-				my_send(config, abuf, (int)strlen(abuf), socket_descriptor, ssl_established);
+				my_send(abuf, (int)strlen(abuf), &reader);
 				if (verbose) {
 					printf(_("sent %s\n"), abuf);
 				}
 
-				if ((recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor,
-							   ssl_established)) <= 0) {
+				if ((np_net_read_reply(&reader, buffer, MAX_INPUT_BUFFER)) <= 0) {
 					xasprintf(&sc_auth.output, "recv() failed after sending authuser");
 					sc_auth = mp_set_subcheck_state(sc_auth, STATE_CRITICAL);
 					break;
@@ -543,14 +585,13 @@ int main(int argc, char **argv) {
 				/* encode authpass with base64 */
 				base64_encode_alloc(config.authpass, strlen(config.authpass), &abuf);
 				xasprintf(&abuf, "%s\r\n", abuf);
-				my_send(config, abuf, (int)strlen(abuf), socket_descriptor, ssl_established);
+				my_send(abuf, (int)strlen(abuf), &reader);
 
 				if (verbose) {
 					printf(_("sent %s\n"), abuf);
 				}
 
-				if ((recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor,
-							   ssl_established)) <= 0) {
+				if ((np_net_read_reply(&reader, buffer, MAX_INPUT_BUFFER)) <= 0) {
 					xasprintf(&sc_auth.output, "recv() failed after sending authpass");
 					sc_auth = mp_set_subcheck_state(sc_auth, STATE_CRITICAL);
 					break;
@@ -576,10 +617,13 @@ int main(int argc, char **argv) {
 	}
 
 	/* tell the server we're done */
-	smtp_quit(config, buffer, socket_descriptor, ssl_established);
+	smtp_quit(config, buffer, &reader);
 
 	/* finally close the connection */
-	close(socket_descriptor);
+	my_close(&reader);
+#ifdef HAVE_SSL
+	np_net_ssl_context_free(tls_context);
+#endif
 
 	/* reset the alarm */
 	alarm(0);
@@ -596,6 +640,9 @@ int main(int argc, char **argv) {
 
 	mp_subcheck sc_connection_time = mp_subcheck_init();
 	xasprintf(&sc_connection_time.output, "connection time: %.3gs", elapsed_time);
+	mp_add_perfdata_to_subcheck(&sc_connection_time, pd_elapsed_time);
+	np_net_timing_finish();
+	mp_net_add_timing_perfdata(&sc_connection_time);
 	sc_connection_time =
 		mp_set_subcheck_state(sc_connection_time, mp_get_pd_status(pd_elapsed_time));
 	mp_add_subcheck_to_check(&overall, sc_connection_time);
@@ -609,6 +656,8 @@ check_smtp_config_wrapper process_arguments(int argc, char **argv) {
 		SNI_OPTION = CHAR_MAX + 1,
 		output_format_index,
 		ignore_certificate_expiration_index,
+		TLS_SESSION_CACHE_OPTION,
+		CERTIFICATE_CHAIN_OPTION,
 	};
 
 	int option = 0;
@@ -636,7 +685,9 @@ check_smtp_config_wrapper process_arguments(int argc, char **argv) {
 		{"tls", no_argument, 0, 's'},
 		{"starttls", no_argument, 0, 'S'},
 		{"sni", no_argument, 0, SNI_OPTION},
+		{"tls-session-cache", no_argument, 0, TLS_SESSION_CACHE_OPTION},
 		{"certificate", required_argument, 0, 'D'},
+		{"certificate-chain", no_argument, 0, CERTIFICATE_CHAIN_OPTION},
 		{"ignore-quit-failure", no_argument, 0, 'q'},
 		{"proxy", no_argument, 0, 'r'},
 		{"ignore-certificate-expiration", no_argument, 0, ignore_certificate_expiration_index},
@@ -813,6 +864,20 @@ check_smtp_config_wrapper process_arguments(int argc, char **argv) {
 			result.config.use_sni = true;
 #else
 			usage(_("SSL support not available - install OpenSSL and recompile"));
+#endif
+			break;
+		case TLS_SESSION_CACHE_OPTION:
+#ifdef HAVE_SSL
+			result.config.tls_session_cache = true;
+#else
+			usage(_("SSL support not available - install OpenSSL and recompile"));
+#endif
+			break;
+		case CERTIFICATE_CHAIN_OPTION:
+#ifdef MOPL_USE_OPENSSL
+			result.config.certificate_chain = true;
+#else
+			usage(_("SSL support not available - install OpenSSL and recompile"));
 #endif
 			break;
 		case 'r':
@@ -871,7 +936,8 @@ check_smtp_config_wrapper process_arguments(int argc, char **argv) {
 	}
 
 	if (!result.config.use_starttls && !result.config.use_ssl &&
-		(result.config.days_till_exp_crit != 0 || result.config.days_till_exp_warn != 0)) {
+		(result.config.days_till_exp_crit != 0 || result.config.days_till_exp_warn != 0 ||
+		 result.config.certificate_chain)) {
 		usage4(_("Set either -s/--ssl/--tls or -S/--starttls"));
 	}
 
@@ -895,10 +961,8 @@ check_smtp_config_wrapper process_arguments(int argc, char **argv) {
 	return result;
 }
 
-char *smtp_quit(check_smtp_config config, char buffer[MAX_INPUT_BUFFER], int socket_descriptor,
-				bool ssl_established) {
-	int sent_bytes =
-		my_send(config, SMTP_QUIT, strlen(SMTP_QUIT), socket_descriptor, ssl_established);
+char *smtp_quit(check_smtp_config config, char buffer[MAX_INPUT_BUFFER], np_net_reader *reader) {
+	int sent_bytes = my_send(SMTP_QUIT, strlen(SMTP_QUIT), reader);
 	if (sent_bytes < 0) {
 		if (config.ignore_send_quit_failure) {
 			if (verbose) {
@@ -914,7 +978,7 @@ char *smtp_quit(check_smtp_config config, char buffer[MAX_INPUT_BUFFER], int soc
 	}
 
 	/* read the response but don't care about problems */
-	int bytes = recvlines(config, buffer, MAX_INPUT_BUFFER, socket_descriptor, ssl_established);
+	int bytes = np_net_read_reply(reader, buffer, MAX_INPUT_BUFFER);
 	if (verbose) {
 		if (bytes < 0) {
 			printf(_("recv() failed after QUIT."));
@@ -929,70 +993,12 @@ char *smtp_quit(check_smtp_config config, char buffer[MAX_INPUT_BUFFER], int soc
 	return buffer;
 }
 
-/*
- * Receive one line, copy it into buf and nul-terminate it.  Returns the
- * number of bytes written to buf (excluding the '\0') or 0 on EOF or <0 on
- * error.
- *
- * TODO: Reading one byte at a time is very inefficient.  Replace this by a
- * function which buffers the data, move that to netutils.c and change
- * check_smtp and other plugins to use that.  Also, remove (\r)\n.
- */
-int recvline(char *buf, size_t bufsize, check_smtp_config config, int socket_descriptor,
-			 bool ssl_established) {
-	int result;
-	size_t counter;
-
-	for (counter = result = 0; counter < bufsize - 1; counter++) {
-		if ((result = my_recv(config, &buf[counter], 1, socket_descriptor, ssl_established)) != 1) {
-			break;
-		}
-		if (buf[counter] == '\n') {
-			buf[++counter] = '\0';
-			return (int)counter;
-		}
-	}
-	return (result == 1 || counter == 0) ? -2 : result; /* -2 if out of space */
-}
-
-/*
- * Receive one or more lines, copy them into buf and nul-terminate it.  Returns
- * the number of bytes written to buf (excluding the '\0') or 0 on EOF or <0 on
- * error.  Works for all protocols which format multiline replies as follows:
- *
- * ``The format for multiline replies requires that every line, except the last,
- * begin with the reply code, followed immediately by a hyphen, `-' (also known
- * as minus), followed by text.  The last line will begin with the reply code,
- * followed immediately by <SP>, optionally some text, and <CRLF>.  As noted
- * above, servers SHOULD send the <SP> if subsequent text is not sent, but
- * clients MUST be prepared for it to be omitted.'' (RFC 2821, 4.2.1)
- *
- * TODO: Move this to netutils.c.  Also, remove \r and possibly the final \n.
- */
-int recvlines(check_smtp_config config, char *buf, size_t bufsize, int socket_descriptor,
-			  bool ssl_established) {
-	int result;
-	int counter;
-
-	for (counter = 0; /* forever */; counter += result) {
-		if (!((result = recvline(buf + counter, bufsize - counter, config, socket_descriptor,
-								 ssl_established)) > 3 &&
-			  isdigit((int)buf[counter]) && isdigit((int)buf[counter + 1]) &&
-			  isdigit((int)buf[counter + 2]) && buf[counter + 3] == '-')) {
-			break;
-		}
-	}
-
-	return (result <= 0) ? result : result + counter;
-}
-
-int my_close(int socket_descriptor) {
-	int result;
-	result = close(socket_descriptor);
+int my_close(np_net_reader *reader) {
 #ifdef HAVE_SSL
-	np_net_ssl_cleanup();
+	np_net_ssl_connection_free(reader->ssl_connection);
+	reader->ssl_connection = NULL;
 #endif
-	return result;
+	return close(reader->socket);
 }
 
 void print_help(void) {
@@ -1040,6 +1046,12 @@ void print_help(void) {
 	printf("    %s\n", _("Use STARTTLS for the connection."));
 	printf(" %s\n", "--sni");
 	printf("    %s\n", _("Enable SSL/TLS hostname extension support (SNI)"));
+	printf(" %s\n", "--tls-session-cache");
+	printf("    %s\n", _("Keep the TLS session in the state directory and resume it next time"));
+	printf("    %s\n", _("No cached session is offered with -D or --certificate-chain"));
+	printf(" %s\n", "--certificate-chain");
+	printf("    %s\n", _("Check the days of -D for every certificate of the chain and stop right"));
+	printf("    %s\n", _("after the TLS handshake, without the rest of the SMTP dialog"));
 #endif
 
 	printf(" %s\n", "-A, --authtype=STRING");
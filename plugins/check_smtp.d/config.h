@@ -45,6 +45,8 @@ typedef struct {
 	bool use_ssl;
 	bool use_starttls;
 	bool use_sni;
+	bool tls_session_cache;
+	bool certificate_chain; /* stop after the handshake and check the whole chain */
 
 	bool ignore_certificate_expiration;
 #endif
@@ -86,6 +88,8 @@ check_smtp_config check_smtp_config_init(void) {
 		.use_ssl = false,
 		.use_starttls = false,
 		.use_sni = false,
+		.tls_session_cache = false,
+		.certificate_chain = false,
 
 		.ignore_certificate_expiration = false,
 #endif
@@ -40,7 +40,9 @@ const char *email = "devel@monitoring-plugins.org";
 #include "../lib/utils_base.h"
 #include "../lib/output.h"
 #include "check_snmp.d/check_snmp_helpers.h"
+#include "check_snmp.d/rate_state.h"
 
+#include <ctype.h>
 #include <strings.h>
 #include <stdint.h>
 
@@ -60,7 +62,6 @@ const char *email = "devel@monitoring-plugins.org";
 #include <net-snmp/library/snmp_impl.h>
 #include <string.h>
 #include "../gl/regex.h"
-#include "../gl/base64.h"
 #include <assert.h>
 
 const char DEFAULT_COMMUNITY[] = "public";
@@ -79,6 +80,7 @@ typedef struct proces_arguments_wrapper {
 } process_arguments_wrapper;
 
 static process_arguments_wrapper process_arguments(int /*argc*/, char ** /*argv*/);
+static char *build_peername(char *host, const char *connection_prefix, const char *port);
 static char *trim_whitespaces_and_check_quoting(char *str);
 static char *get_next_argument(char *str);
 void print_usage(void);
@@ -86,167 +88,114 @@ void print_help(void);
 
 int verbose = 0;
 
+/* Results go into the check directly or below a subcheck per agent */
 typedef struct {
-	int errorcode;
-	char *state_string;
-} gen_state_string_type;
-gen_state_string_type gen_state_string(check_snmp_state_entry *entries, size_t num_of_entries) {
-	char *encoded_string = NULL;
-	gen_state_string_type result = {.errorcode = OK, .state_string = NULL};
-
-	if (verbose > 1) {
-		printf("%s:\n", __FUNCTION__);
-		for (size_t i = 0; i < num_of_entries; i++) {
-			printf("Entry timestamp %lu: %s", entries[i].timestamp, ctime(&entries[i].timestamp));
-			switch (entries[i].type) {
-			case ASN_GAUGE:
-				printf("Type GAUGE\n");
-				break;
-			case ASN_TIMETICKS:
-				printf("Type TIMETICKS\n");
-				break;
-			case ASN_COUNTER:
-				printf("Type COUNTER\n");
-				break;
-			case ASN_UINTEGER:
-				printf("Type UINTEGER\n");
-				break;
-			case ASN_COUNTER64:
-				printf("Type COUNTER64\n");
-				break;
-			case ASN_FLOAT:
-				printf("Type FLOAT\n");
-				break;
-			case ASN_DOUBLE:
-				printf("Type DOUBLE\n");
-				break;
-			case ASN_INTEGER:
-				printf("Type INTEGER\n");
-				break;
-			}
+	mp_check *check;
+	mp_subcheck *subcheck;
+} result_target;
 
-			switch (entries[i].type) {
-			case ASN_GAUGE:
-			case ASN_TIMETICKS:
-			case ASN_COUNTER:
-			case ASN_UINTEGER:
-			case ASN_COUNTER64:
-				printf("Value %llu\n", entries[i].value.uIntVal);
-				break;
-			case ASN_FLOAT:
-			case ASN_DOUBLE:
-				printf("Value %f\n", entries[i].value.doubleVal);
-				break;
-			case ASN_INTEGER:
-				printf("Value %lld\n", entries[i].value.intVal);
-				break;
-			}
-		}
+static void add_result(result_target target, mp_subcheck result) {
+	if (target.subcheck != NULL) {
+		mp_add_subcheck_to_subcheck(target.subcheck, result);
+	} else {
+		mp_add_subcheck_to_check(target.check, result);
 	}
+}
 
-	idx_t encoded = base64_encode_alloc((const char *)entries,
-										(idx_t)(num_of_entries * sizeof(check_snmp_state_entry)),
-										&encoded_string);
-
-	if (encoded > 0 && encoded_string != NULL) {
-		// success
+/* Evaluates the values of one query and updates the rate state stored under stateKey */
+static void evaluate_responses(snmp_responces response, check_snmp_config config,
+							   state_key stateKey, time_t current_time, result_target target) {
+	check_snmp_rate_state prev_state = {.errorcode = ERROR};
+	if (config.evaluation_params.calculate_rate) {
+		// A missing, old or broken state file means there is no previous data
+		prev_state = check_snmp_rate_state_open(stateKey._filename);
 		if (verbose > 1) {
-			printf("encoded string: %s\n", encoded_string);
-			printf("encoded string length: %lu\n", strlen(encoded_string));
+			printf("Previous state: %s with %zu entries\n",
+				   (prev_state.errorcode == OK) ? "found" : "not found",
+				   prev_state.number_of_entries);
 		}
-		result.state_string = encoded_string;
-		return result;
 	}
-	result.errorcode = ERROR;
-	return result;
-}
 
-typedef struct {
-	int errorcode;
-	check_snmp_state_entry *state;
-} recover_state_data_type;
-recover_state_data_type recover_state_data(char *state_string, idx_t state_string_length) {
-	recover_state_data_type result = {.errorcode = OK, .state = NULL};
-
-	if (verbose > 1) {
-		printf("%s:\n", __FUNCTION__);
-		printf("State string: %s\n", state_string);
-		printf("State string length: %lu\n", state_string_length);
+	check_snmp_state_entry *new_state = NULL;
+	if (config.evaluation_params.calculate_rate) {
+		new_state = calloc(response.number_of_results, sizeof(check_snmp_state_entry));
+		if (new_state == NULL && response.number_of_results > 0) {
+			die(STATE_UNKNOWN, "memory allocation failed");
+		}
 	}
 
-	idx_t outlen = 0;
-	bool decoded =
-		base64_decode_alloc(state_string, state_string_length, (char **)&result.state, &outlen);
-
-	if (!decoded) {
-		if (verbose) {
-			printf("Failed to decode state string\n");
+	// In walk mode test units without any value below their OID are reported
+	bool *test_unit_has_result = NULL;
+	if (config.snmp_params.walk) {
+		test_unit_has_result = calloc(config.snmp_params.num_of_test_units, sizeof(bool));
+		if (test_unit_has_result == NULL) {
+			die(STATE_UNKNOWN, "memory allocation failed");
 		}
-		// failure to decode
-		result.errorcode = ERROR;
-		return result;
 	}
 
-	if (result.state == NULL) {
-		// Memory Error?
-		result.errorcode = ERROR;
-		return result;
-	}
+	// We got the the query results, now process them
+	for (size_t loop_index = 0; loop_index < response.number_of_results; loop_index++) {
+		if (verbose > 0) {
+			printf("loop_index: %zu\n", loop_index);
+		}
 
-	if (verbose > 1) {
-		printf("Recovered %lu entries of size %lu\n",
-			   (size_t)outlen / sizeof(check_snmp_state_entry), outlen);
+		response_value current_response = response.response_values[loop_index];
 
-		for (size_t i = 0; i < (size_t)outlen / sizeof(check_snmp_state_entry); i++) {
-			printf("Entry timestamp %lu: %s", result.state[i].timestamp,
-				   ctime(&result.state[i].timestamp));
-			switch (result.state[i].type) {
-			case ASN_GAUGE:
-				printf("Type GAUGE\n");
-				break;
-			case ASN_TIMETICKS:
-				printf("Type TIMETICKS\n");
-				break;
-			case ASN_COUNTER:
-				printf("Type COUNTER\n");
-				break;
-			case ASN_UINTEGER:
-				printf("Type UINTEGER\n");
-				break;
-			case ASN_COUNTER64:
-				printf("Type COUNTER64\n");
-				break;
-			case ASN_FLOAT:
-				printf("Type FLOAT\n");
-				break;
-			case ASN_DOUBLE:
-				printf("Type DOUBLE\n");
-				break;
-			case ASN_INTEGER:
-				printf("Type INTEGER\n");
-				break;
-			}
+		if (current_response.errorcode != OK) {
+			// Only this unit is affected, the others are evaluated as usual
+			mp_subcheck sc_failed_unit = mp_subcheck_init();
+			xasprintf(&sc_failed_unit.output, "OID: %s - %s",
+					  config.snmp_params.test_units[current_response.test_unit_index].oid,
+					  current_response.error_message);
+			sc_failed_unit = mp_set_subcheck_state(sc_failed_unit, current_response.error_state);
+			add_result(target, sc_failed_unit);
+			continue;
+		}
 
-			switch (result.state[i].type) {
-			case ASN_GAUGE:
-			case ASN_TIMETICKS:
-			case ASN_COUNTER:
-			case ASN_UINTEGER:
-			case ASN_COUNTER64:
-				printf("Value %llu\n", result.state[i].value.uIntVal);
-				break;
-			case ASN_FLOAT:
-			case ASN_DOUBLE:
-				printf("Value %f\n", result.state[i].value.doubleVal);
-				break;
-			case ASN_INTEGER:
-				printf("Value %lld\n", result.state[i].value.intVal);
-				break;
-			}
+		check_snmp_test_unit test_unit =
+			config.snmp_params.test_units[current_response.test_unit_index];
+		if (config.snmp_params.walk) {
+			test_unit = check_snmp_walk_row_unit(test_unit, current_response);
+			test_unit_has_result[current_response.test_unit_index] = true;
 		}
+
+		// Rows of a walk may come and go, so the previous value is looked up by OID
+		check_snmp_state_entry previous_unit_state = {};
+		bool have_previous_unit_state =
+			check_snmp_rate_state_lookup(&prev_state, current_response.oid,
+										 current_response.oid_length, &previous_unit_state);
+
+		check_snmp_evaluation single_eval =
+			evaluate_single_unit(current_response, config.evaluation_params, test_unit,
+								 current_time, previous_unit_state, have_previous_unit_state);
+
+		if (config.evaluation_params.calculate_rate &&
+			mp_compute_subcheck_state(single_eval.sc) != STATE_UNKNOWN) {
+			new_state[loop_index] = single_eval.state;
+		}
+
+		add_result(target, single_eval.sc);
 	}
 
-	return result;
+	for (size_t i = 0; config.snmp_params.walk && i < config.snmp_params.num_of_test_units; i++) {
+		if (!test_unit_has_result[i]) {
+			mp_subcheck sc_empty_walk = mp_subcheck_init();
+			xasprintf(&sc_empty_walk.output, "No values found below OID %s",
+					  config.snmp_params.test_units[i].oid);
+			sc_empty_walk =
+				mp_set_subcheck_state(sc_empty_walk, config.evaluation_params.nulloid_result);
+			add_result(target, sc_empty_walk);
+		}
+	}
+
+	if (config.evaluation_params.calculate_rate) {
+		// store state
+		check_snmp_rate_state_close(&prev_state);
+		if (check_snmp_rate_state_write(stateKey._filename, new_state, response.number_of_results,
+										config.evaluation_params.sync_rate_state) != OK) {
+			die(STATE_UNKNOWN, "failed to write state file %s\n", stateKey._filename);
+		}
+	}
 }
 
 int main(int argc, char **argv) {
@@ -265,6 +214,13 @@ int main(int argc, char **argv) {
 
 	np_set_args(argc, argv);
 
+	// The MIBs are not loaded here, but later for OIDs which are not in the OID cache
+	char *environment_miblist = getenv("MIBS");
+	if (environment_miblist != NULL) {
+		environment_miblist = strdup(environment_miblist);
+	}
+	setenv("MIBS", "", 1);
+
 	// Initialize net-snmp before touching the session we are going to use
 	init_snmp("check_snmp");
 
@@ -275,6 +231,13 @@ int main(int argc, char **argv) {
 
 	check_snmp_config config = paw_tmp.config;
 
+	if (config.snmp_params.miblist == NULL) {
+		config.snmp_params.miblist = (environment_miblist != NULL && environment_miblist[0] != '\0')
+										 ? environment_miblist
+										 : (char *)DEFAULT_MIBLIST;
+	}
+	check_snmp_resolve_oids(&config.snmp_params);
+
 	if (config.output_format_is_set) {
 		mp_set_format(config.output_format);
 	}
@@ -291,7 +254,42 @@ int main(int argc, char **argv) {
 		printf("current time: %s (timestamp: %lu)\n", ctime(&current_time), current_time);
 	}
 
-	snmp_responces response = do_snmp_query(config.snmp_params);
+	if (config.snmp_params.number_of_agents > 0) {
+		snmp_responces *responses = do_snmp_query_agents(config.snmp_params);
+
+		mp_check overall = mp_check_init();
+		mp_set_ok_summary(&overall, "SNMP query is OK on all agents");
+
+		for (size_t i = 0; i < config.snmp_params.number_of_agents; i++) {
+			mp_subcheck sc_agent = mp_subcheck_init();
+			xasprintf(&sc_agent.output, "Agent %s", config.snmp_params.agents[i].name);
+
+			// Every agent has its own rate state
+			state_key agent_state_key = stateKey;
+			if (config.evaluation_params.calculate_rate) {
+				char *agent_key = NULL;
+				xasprintf(&agent_key, "%s_%s", stateKey.name, config.snmp_params.agents[i].name);
+				for (char *ptr = agent_key; *ptr != '\0'; ptr++) {
+					if (!isalnum((unsigned char)*ptr)) {
+						*ptr = '_';
+					}
+				}
+				agent_state_key = np_enable_state(agent_key, 1, progname, argc, argv);
+			}
+
+			evaluate_responses(responses[i], config, agent_state_key, current_time,
+							   (result_target){.subcheck = &sc_agent});
+			mp_add_subcheck_to_check(&overall, sc_agent);
+		}
+		mp_exit(overall);
+	}
+
+	snmp_responces response;
+	if (config.snmp_params.walk) {
+		response = do_snmp_walk(config.snmp_params);
+	} else {
+		response = do_snmp_query(config.snmp_params);
+	}
 
 	mp_check overall = mp_check_init();
 
@@ -319,74 +317,53 @@ int main(int argc, char **argv) {
 		mp_exit(overall);
 	}
 
-	check_snmp_state_entry *prev_state = NULL;
-	bool have_previous_state = false;
-
-	if (config.evaluation_params.calculate_rate) {
-		state_data *previous_state = np_state_read(stateKey);
-		if (previous_state == NULL) {
-			// failed to recover state
-			// or no previous state
-			have_previous_state = false;
-		} else {
-			// sanity check
-			recover_state_data_type prev_state_wrapper =
-				recover_state_data(previous_state->data, (idx_t)previous_state->length);
+	evaluate_responses(response, config, stateKey, current_time,
+					   (result_target){.check = &overall});
+	mp_exit(overall);
+}
 
-			if (prev_state_wrapper.errorcode == OK) {
-				have_previous_state = true;
-				prev_state = prev_state_wrapper.state;
-			} else {
-				have_previous_state = false;
-				prev_state = NULL;
-			}
-		}
-	}
+/* Adds the connection prefix and the port to a host name as net-snmp expects it */
+static char *build_peername(char *host, const char *connection_prefix, const char *port) {
+	char *peername = host;
 
-	check_snmp_state_entry *new_state = NULL;
-	if (config.evaluation_params.calculate_rate) {
-		new_state = calloc(config.snmp_params.num_of_test_units, sizeof(check_snmp_state_entry));
-		if (new_state == NULL) {
-			die(STATE_UNKNOWN, "memory allocation failed");
+	if (connection_prefix != NULL) {
+		// We got something in the connection prefix
+		if (strcasecmp(connection_prefix, "udp") == 0) {
+			// The default, do nothing
+		} else if (strcasecmp(connection_prefix, "tcp") == 0) {
+			// use tcp/ipv4
+			xasprintf(&peername, "tcp:%s", host);
+		} else if (strcasecmp(connection_prefix, "tcp6") == 0 ||
+				   strcasecmp(connection_prefix, "tcpv6") == 0 ||
+				   strcasecmp(connection_prefix, "tcpipv6") == 0 ||
+				   strcasecmp(connection_prefix, "udp6") == 0 ||
+				   strcasecmp(connection_prefix, "udpipv6") == 0 ||
+				   strcasecmp(connection_prefix, "udpv6") == 0) {
+			// Man page (or net-snmp) code says IPv6 addresses should be wrapped in [], but it
+			// works anyway therefore do nothing here
+			xasprintf(&peername, "%s:%s", connection_prefix, host);
+		} else if (strcmp(connection_prefix, "tls") == 0) {
+			// TODO: Anything else to do here?
+			xasprintf(&peername, "tls:%s", host);
+		} else if (strcmp(connection_prefix, "dtls") == 0) {
+			// TODO: Anything else to do here?
+			xasprintf(&peername, "dtls:%s", host);
+		} else if (strcmp(connection_prefix, "unix") == 0) {
+			// TODO: Check whether this is a valid path?
+			xasprintf(&peername, "unix:%s", host);
+		} else if (strcmp(connection_prefix, "ipx") == 0) {
+			xasprintf(&peername, "ipx:%s", host);
+		} else {
+			// Don't know that prefix, die here
+			die(STATE_UNKNOWN, "Unknown connection prefix");
 		}
 	}
 
-	// We got the the query results, now process them
-	for (size_t loop_index = 0; loop_index < config.snmp_params.num_of_test_units; loop_index++) {
-		if (verbose > 0) {
-			printf("loop_index: %zu\n", loop_index);
-		}
-
-		check_snmp_state_entry previous_unit_state = {};
-		if (config.evaluation_params.calculate_rate && have_previous_state) {
-			previous_unit_state = prev_state[loop_index];
-		}
-
-		check_snmp_evaluation single_eval =
-			evaluate_single_unit(response.response_values[loop_index], config.evaluation_params,
-								 config.snmp_params.test_units[loop_index], current_time,
-								 previous_unit_state, have_previous_state);
-
-		if (config.evaluation_params.calculate_rate &&
-			mp_compute_subcheck_state(single_eval.sc) != STATE_UNKNOWN) {
-			new_state[loop_index] = single_eval.state;
-		}
-
-		mp_add_subcheck_to_check(&overall, single_eval.sc);
+	if (port != NULL) {
+		xasprintf(&peername, "%s:%s", peername, port);
 	}
 
-	if (config.evaluation_params.calculate_rate) {
-		// store state
-		gen_state_string_type current_state_wrapper =
-			gen_state_string(new_state, config.snmp_params.num_of_test_units);
-
-		if (current_state_wrapper.errorcode == OK) {
-			np_state_write_string(stateKey, current_time, current_state_wrapper.state_string);
-		} else {
-			die(STATE_UNKNOWN, "failed to create state string");
-		}
-	}
-	mp_exit(overall);
+	return peername;
 }
 
 /* process command-line arguments */
@@ -399,7 +376,14 @@ static process_arguments_wrapper process_arguments(int argc, char **argv) {
 		connection_prefix_index,
 		output_format_index,
 		calculate_rate,
-		rate_multiplier
+		rate_multiplier,
+		walk_index,
+		max_repetitions_index,
+		max_oids_per_pdu_index,
+		agents_index,
+		max_concurrent_agents_index,
+		no_oid_cache_index,
+		rate_state_sync_index,
 	};
 
 	static struct option longopts[] = {
@@ -440,6 +424,13 @@ static process_arguments_wrapper process_arguments(int argc, char **argv) {
 		{"output-format", required_argument, 0, output_format_index},
 		{"rate", no_argument, 0, calculate_rate},
 		{"rate-multiplier", required_argument, 0, rate_multiplier},
+		{"walk", no_argument, 0, walk_index},
+		{"max-repetitions", required_argument, 0, max_repetitions_index},
+		{"max-oids-per-pdu", required_argument, 0, max_oids_per_pdu_index},
+		{"agents", required_argument, 0, agents_index},
+		{"max-concurrent-agents", required_argument, 0, max_concurrent_agents_index},
+		{"no-oid-cache", no_argument, 0, no_oid_cache_index},
+		{"rate-state-sync", no_argument, 0, rate_state_sync_index},
 		{0, 0, 0, 0}};
 
 	if (argc < 2) {
@@ -520,6 +511,7 @@ static process_arguments_wrapper process_arguments(int argc, char **argv) {
 	char *port = NULL;
 	char *miblist = NULL;
 	char *connection_prefix = NULL;
+	char *agent_list = NULL;
 	bool snmp_version_set_explicitely = false;
 	// TODO error checking
 	while (true) {
@@ -699,15 +691,6 @@ static process_arguments_wrapper process_arguments(int argc, char **argv) {
 			check_snmp_set_thresholds(optarg, config.snmp_params.test_units, oid_counter, false);
 			break;
 		case 'o': /* object identifier */
-			if (strspn(optarg, "0123456789.,") != strlen(optarg)) {
-				/*
-				 * we have something other than digits, periods and comas,
-				 * so we have a mib variable, rather than just an SNMP OID,
-				 * so we have to actually read the mib files
-				 */
-				config.snmp_params.need_mibs = true;
-			}
-
 			for (char *ptr = strtok(optarg, ", "); ptr != NULL;
 				 ptr = strtok(NULL, ", "), tmp_oid_counter++) {
 				config.snmp_params.test_units[tmp_oid_counter].oid = strdup(ptr);
@@ -846,78 +829,98 @@ static process_arguments_wrapper process_arguments(int argc, char **argv) {
 				usage2(_("Rate multiplier must be a positive integer"), optarg);
 			}
 			break;
+		case walk_index:
+			config.snmp_params.walk = true;
+			break;
+		case max_repetitions_index:
+			if (!is_intpos(optarg)) {
+				usage2(_("Max repetitions must be a positive integer"), optarg);
+			}
+			config.snmp_params.max_repetitions = atol(optarg);
+			break;
+		case max_oids_per_pdu_index:
+			if (!is_integer(optarg) || atol(optarg) < 0) {
+				usage2(_("Max OIDs per PDU must be a non-negative integer"), optarg);
+			}
+			config.snmp_params.max_oids_per_pdu = (size_t)atol(optarg);
+			break;
+		case agents_index:
+			// May be given more than once, the lists are joined
+			if (agent_list == NULL) {
+				agent_list = strdup(optarg);
+				if (agent_list == NULL) {
+					die(STATE_UNKNOWN, "strdup failed");
+				}
+			} else {
+				xasprintf(&agent_list, "%s,%s", agent_list, optarg);
+			}
+			break;
+		case max_concurrent_agents_index:
+			if (!is_intpos(optarg)) {
+				usage2(_("Max concurrent agents must be a positive integer"), optarg);
+			}
+			config.snmp_params.max_concurrent_agents = (size_t)atol(optarg);
+			break;
+		case no_oid_cache_index:
+			config.snmp_params.use_oid_cache = false;
+			break;
+		case rate_state_sync_index:
+			config.evaluation_params.sync_rate_state = true;
+			break;
 		default:
 			die(STATE_UNKNOWN, "Unknown option");
 		}
 	}
 
-	if (config.snmp_params.snmp_session.peername == NULL) {
+	if (config.snmp_params.snmp_session.peername == NULL && agent_list == NULL) {
 		config.snmp_params.snmp_session.peername = argv[optind];
 	}
 
-	// Build true peername here if necessary
-	if (connection_prefix != NULL) {
-		// We got something in the connection prefix
-		if (strcasecmp(connection_prefix, "udp") == 0) {
-			// The default, do nothing
-		} else if (strcasecmp(connection_prefix, "tcp") == 0) {
-			// use tcp/ipv4
-			xasprintf(&config.snmp_params.snmp_session.peername, "tcp:%s",
-					  config.snmp_params.snmp_session.peername);
-		} else if (strcasecmp(connection_prefix, "tcp6") == 0 ||
-				   strcasecmp(connection_prefix, "tcpv6") == 0 ||
-				   strcasecmp(connection_prefix, "tcpipv6") == 0 ||
-				   strcasecmp(connection_prefix, "udp6") == 0 ||
-				   strcasecmp(connection_prefix, "udpipv6") == 0 ||
-				   strcasecmp(connection_prefix, "udpv6") == 0) {
-			// Man page (or net-snmp) code says IPv6 addresses should be wrapped in [], but it
-			// works anyway therefore do nothing here
-			xasprintf(&config.snmp_params.snmp_session.peername, "%s:%s", connection_prefix,
-					  config.snmp_params.snmp_session.peername);
-		} else if (strcmp(connection_prefix, "tls") == 0) {
-			// TODO: Anything else to do here?
-			xasprintf(&config.snmp_params.snmp_session.peername, "tls:%s",
-					  config.snmp_params.snmp_session.peername);
-		} else if (strcmp(connection_prefix, "dtls") == 0) {
-			// TODO: Anything else to do here?
-			xasprintf(&config.snmp_params.snmp_session.peername, "dtls:%s",
-					  config.snmp_params.snmp_session.peername);
-		} else if (strcmp(connection_prefix, "unix") == 0) {
-			// TODO: Check whether this is a valid path?
-			xasprintf(&config.snmp_params.snmp_session.peername, "unix:%s",
-					  config.snmp_params.snmp_session.peername);
-		} else if (strcmp(connection_prefix, "ipx") == 0) {
-			xasprintf(&config.snmp_params.snmp_session.peername, "ipx:%s",
-					  config.snmp_params.snmp_session.peername);
-		} else {
-			// Don't know that prefix, die here
-			die(STATE_UNKNOWN, "Unknown connection prefix");
-		}
-	}
-
 	/* Check server_address is given */
-	if (config.snmp_params.snmp_session.peername == NULL) {
+	if (config.snmp_params.snmp_session.peername == NULL && agent_list == NULL) {
 		die(STATE_UNKNOWN, _("No host specified\n"));
 	}
 
-	if (port != NULL) {
-		xasprintf(&config.snmp_params.snmp_session.peername, "%s:%s",
-				  config.snmp_params.snmp_session.peername, port);
-	}
+	if (agent_list != NULL) {
+		if (config.snmp_params.walk) {
+			usage4(_("--agents can not be combined with --walk"));
+		}
 
-	/* check whether to load locally installed MIBS (CPU/disk intensive) */
-	if (miblist == NULL) {
-		if (config.snmp_params.need_mibs) {
-			setenv("MIBLS", DEFAULT_MIBLIST, 1);
-		} else {
-			setenv("MIBLS", "NONE", 1);
-			miblist = ""; /* don't read any mib files for numeric oids */
+		// A host given with -H is polled as the first agent
+		if (config.snmp_params.snmp_session.peername != NULL) {
+			xasprintf(&agent_list, "%s,%s", config.snmp_params.snmp_session.peername, agent_list);
+		}
+
+		for (char *agent = strtok(agent_list, ", "); agent != NULL; agent = strtok(NULL, ", ")) {
+			check_snmp_agent *tmp_agents =
+				realloc(config.snmp_params.agents, (config.snmp_params.number_of_agents + 1) *
+													   sizeof(check_snmp_agent));
+			if (tmp_agents == NULL) {
+				die(STATE_UNKNOWN, "memory allocation failed");
+			}
+			config.snmp_params.agents = tmp_agents;
+			config.snmp_params.agents[config.snmp_params.number_of_agents].name = agent;
+			config.snmp_params.agents[config.snmp_params.number_of_agents].peername =
+				build_peername(agent, connection_prefix, port);
+			config.snmp_params.number_of_agents++;
+		}
+
+		if (config.snmp_params.number_of_agents == 0) {
+			die(STATE_UNKNOWN, _("No host specified\n"));
 		}
-	} else {
-		// Blatantly stolen from snmplib/snmp_parse_args
-		setenv("MIBS", miblist, 1);
 	}
 
+	if (config.snmp_params.snmp_session.peername != NULL) {
+		config.snmp_params.snmp_session.peername =
+			build_peername(config.snmp_params.snmp_session.peername, connection_prefix, port);
+	}
+
+	/*
+	 * The MIBs to load for textual OIDs (CPU/disk intensive), they are loaded
+	 * by check_snmp_resolve_oids and only if needed
+	 */
+	config.snmp_params.miblist = miblist;
+
 	// Historical default is SNMP v2c
 	if (!snmp_version_set_explicitely && config.snmp_params.snmp_session.community != NULL) {
 		config.snmp_params.snmp_session.version = SNMP_VERSION_2c;
@@ -1048,6 +1051,24 @@ void print_help(void) {
 	/* SNMP and Authentication Protocol */
 	printf(" %s\n", "-n, --next");
 	printf("    %s\n", _("Use SNMP GETNEXT instead of SNMP GET"));
+	printf(" %s\n", "--walk");
+	printf("    %s\n", _("Retrieve every value below the given OIDs (e.g. a table column) and"));
+	printf("    %s\n", _("evaluate each of them with the thresholds, label and units of its OID"));
+	printf("    %s\n", _("The walk takes at most the seconds of -t, the timeout formula below"));
+	printf("    %s\n", _("applies to each request of it"));
+	printf(" %s\n", "--max-repetitions=INTEGER");
+	printf("    %s %i\n", _("Number of values requested per GETBULK in walk mode, default:"),
+		   DEFAULT_MAX_REPETITIONS);
+	printf(" %s\n", "--max-oids-per-pdu=INTEGER");
+	printf("    %s\n", _("Split requests for many OIDs into PDUs with at most INTEGER variables,"));
+	printf("    %s %i\n", _("which are sent at once. 0 means no limit, default:"),
+		   DEFAULT_MAX_OIDS_PER_PDU);
+	printf(" %s\n", "--agents=HOST[,HOST...]");
+	printf("    %s\n", _("Query the same OIDs on all of these agents at once and report them"));
+	printf("    %s\n", _("separately. May be given more than once, a host given with -H is added"));
+	printf(" %s\n", "--max-concurrent-agents=INTEGER");
+	printf("    %s %i\n", _("Number of agents queried at the same time, default:"),
+		   DEFAULT_MAX_CONCURRENT_AGENTS);
 	printf(" %s\n", "-P, --protocol=[1|2c|3]");
 	printf("    %s\n", _("SNMP protocol version"));
 	printf(" %s\n", "-N, --context=CONTEXT");
@@ -1096,6 +1117,10 @@ void print_help(void) {
 	printf("    %s\n", _("1 = WARNING"));
 	printf("    %s\n", _("2 = CRITICAL"));
 	printf("    %s\n", _("3 = UNKNOWN"));
+	printf(" %s\n", "--no-oid-cache");
+	printf("    %s\n", _("Do not remember OIDs and their names in the state directory. With the"));
+	printf("    %s\n", _("cache the MIBs are only loaded for new OIDs, if the MIB directories"));
+	printf("    %s\n", _("change or to name the results of --next and --walk"));
 
 	/* Tests Against Integers */
 	printf(" %s\n", "-w, --warning=THRESHOLD(s)");
@@ -1124,6 +1149,13 @@ void print_help(void) {
 	printf("    %s\n", _("Units label(s) for output data (e.g., 'sec.')."));
 	printf(" %s\n", "-M, --multiplier=FLOAT");
 	printf("    %s\n", _("Multiplies current value, 0 < n < 1 works as divider, defaults to 1"));
+	printf(" %s\n", "--rate");
+	printf("    %s\n", _("Report the change per second of the values since the previous run"));
+	printf(" %s\n", "--rate-multiplier=INTEGER");
+	printf("    %s\n", _("Report the change per INTEGER seconds instead, e.g. 60 for minutes"));
+	printf(" %s\n", "--rate-state-sync");
+	printf("    %s\n", _("Sync the state file of --rate to disk after every run. Without it a"));
+	printf("    %s\n", _("crash might only cost one rate calculation"));
 	printf(UT_OUTPUT_FORMAT);
 
 	printf(UT_CONN_TIMEOUT, DEFAULT_SOCKET_TIMEOUT);
@@ -1172,5 +1204,6 @@ void print_usage(void) {
 	printf("[-l label] [-u units] [-p port-number] [-d delimiter] [-D output-delimiter]\n");
 	printf("[-m miblist] [-P snmp version] [-N context] [-L seclevel] [-U secname]\n");
 	printf("[-a authproto] [-A authpasswd] [-x privproto] [-X privpasswd] [-4|6]\n");
-	printf("[-M multiplier]\n");
+	printf("[-M multiplier] [--walk [--max-repetitions N]]\n");
+	printf("[--agents host,... [--max-concurrent-agents N]]\n");
 }
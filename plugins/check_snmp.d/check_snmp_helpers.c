@@ -7,7 +7,13 @@
 #include "output.h"
 #include "states.h"
 #include <sys/stat.h>
+#include <sys/select.h>
 #include <ctype.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <time.h>
+#include "./oid_cache.h"
+#include "../../gl/base64.h"
 
 extern int verbose;
 
@@ -97,8 +103,18 @@ check_snmp_config check_snmp_config_init() {
 			{
 				.use_getnext = false,
 
+				.max_oids_per_pdu = DEFAULT_MAX_OIDS_PER_PDU,
+
+				.walk = false,
+
+				.agents = NULL,
+				.number_of_agents = 0,
+				.max_concurrent_agents = DEFAULT_MAX_CONCURRENT_AGENTS,
+				.max_repetitions = DEFAULT_MAX_REPETITIONS,
+
 				.ignore_mib_parsing_errors = false,
-				.need_mibs = false,
+				.miblist = NULL,
+				.use_oid_cache = true,
 
 				.test_units = NULL,
 				.num_of_test_units = 0,
@@ -121,6 +137,7 @@ check_snmp_config check_snmp_config_init() {
 
 				.calculate_rate = false,
 				.rate_multiplier = 1,
+				.sync_rate_state = false,
 			},
 	};
 
@@ -134,66 +151,583 @@ check_snmp_config check_snmp_config_init() {
 	return tmp;
 }
 
-snmp_responces do_snmp_query(check_snmp_config_snmp_parameters parameters) {
-	if (parameters.ignore_mib_parsing_errors) {
+static void parse_test_unit_oid(const check_snmp_test_unit *test_unit, size_t index,
+								oid *parsed_oid, size_t *parsed_oid_length) {
+	assert(test_unit->oid != NULL);
+
+	if (test_unit->numeric_oid_length > 0) {
+		// Already resolved by check_snmp_resolve_oids
+		memcpy(parsed_oid, test_unit->numeric_oid, test_unit->numeric_oid_length * sizeof(oid));
+		*parsed_oid_length = test_unit->numeric_oid_length;
+		return;
+	}
+
+	if (verbose > 0) {
+		printf("OID %zu to parse: %s\n", index, test_unit->oid);
+	}
+
+	*parsed_oid_length = MAX_OID_LEN;
+	if (snmp_parse_oid(test_unit->oid, parsed_oid, parsed_oid_length) == NULL) {
+		snmp_perror("Parsing failure");
+		die(STATE_UNKNOWN, "Failed to parse OID\n");
+	}
+}
+
+static void apply_mib_options(const check_snmp_config_snmp_parameters *parameters) {
+	if (parameters->ignore_mib_parsing_errors) {
 		char *opt_toggle_res = snmp_mib_toggle_options("e");
 		if (opt_toggle_res != NULL) {
 			die(STATE_UNKNOWN, "Unable to disable MIB parsing errors");
 		}
 	}
+}
 
-	struct snmp_pdu *pdu = NULL;
-	if (parameters.use_getnext) {
-		pdu = snmp_pdu_create(SNMP_MSG_GETNEXT);
-	} else {
-		pdu = snmp_pdu_create(SNMP_MSG_GET);
+/* Loads the modules of a MIBS style list, "ALL" loads every module in the MIB directories */
+static void load_mibs(const char *miblist) {
+	char *modules = strdup(miblist);
+	if (modules == NULL) {
+		die(STATE_UNKNOWN, "strdup failed");
 	}
 
-	for (size_t i = 0; i < parameters.num_of_test_units; i++) {
-		assert(parameters.test_units[i].oid != NULL);
-		if (verbose > 0) {
-			printf("OID %zu to parse: %s\n", i, parameters.test_units[i].oid);
+	char *list = modules;
+	if (list[0] == '+' || list[0] == '-') {
+		// Relative to the net-snmp defaults
+#ifdef NETSNMP_DEFAULT_MIBS
+		load_mibs(NETSNMP_DEFAULT_MIBS);
+#endif
+		list++;
+	}
+
+	for (char *module = strtok(list, ":"); module != NULL; module = strtok(NULL, ":")) {
+		if (strcmp(module, "ALL") == 0) {
+			read_all_mibs();
+		} else if (netsnmp_read_module(module) == NULL && verbose > 0) {
+			printf("Failed to load MIB module %s\n", module);
 		}
+	}
+	free(modules);
+}
 
-		oid tmp_OID[MAX_OID_LEN];
-		size_t tmp_OID_len = MAX_OID_LEN;
-		if (snmp_parse_oid(parameters.test_units[i].oid, tmp_OID, &tmp_OID_len) != NULL) {
-			// success
-			snmp_add_null_var(pdu, tmp_OID, tmp_OID_len);
-		} else {
-			// failed
-			snmp_perror("Parsing failure");
-			die(STATE_UNKNOWN, "Failed to parse OID\n");
+/*
+ * Describes the MIBs textual OIDs were resolved with. Adding, removing or
+ * replacing a MIB file changes the mtime of its directory and so the key.
+ */
+static char *oid_cache_mib_key(const char *miblist) {
+	const char *mib_directories = netsnmp_get_mib_directory();
+	if (mib_directories == NULL) {
+		mib_directories = "";
+	}
+
+	char *directories = strdup(mib_directories);
+	if (directories == NULL) {
+		die(STATE_UNKNOWN, "strdup failed");
+	}
+
+	time_t newest_change = 0;
+	for (char *dir = strtok(directories, ":"); dir != NULL; dir = strtok(NULL, ":")) {
+		if (dir[0] == '+' || dir[0] == '-') {
+			dir++;
+		}
+
+		struct stat dir_stat;
+		if (stat(dir, &dir_stat) == 0 && dir_stat.st_mtime > newest_change) {
+			newest_change = dir_stat.st_mtime;
 		}
 	}
+	free(directories);
 
-	const int timeout_safety_tolerance = 5;
-	alarm((timeout_interval * (unsigned int)parameters.snmp_session.retries) +
-		  timeout_safety_tolerance);
+	char *result = NULL;
+	xasprintf(&result, "%s %lld %s", mib_directories, (long long)newest_change, miblist);
+	return result;
+}
+
+static void read_oid_cache(check_snmp_oid_cache *cache, state_key cache_state_key) {
+	state_data *previous_cache = np_state_read(cache_state_key);
+	if (previous_cache == NULL || previous_cache->data == NULL) {
+		return;
+	}
+
+	char *serialized = NULL;
+	idx_t serialized_length = 0;
+	if (!base64_decode_alloc(previous_cache->data, (idx_t)previous_cache->length, &serialized,
+							 &serialized_length) ||
+		serialized == NULL) {
+		return;
+	}
+
+	// The terminator is part of the encoded data
+	if (serialized_length == 0 || serialized[serialized_length - 1] != '\0') {
+		free(serialized);
+		return;
+	}
+
+	if (check_snmp_oid_cache_parse(cache, serialized) != OK && verbose > 0) {
+		printf("Discarding (parts of) the OID cache\n");
+	}
+	free(serialized);
+}
+
+static void write_oid_cache(const check_snmp_oid_cache *cache, state_key cache_state_key) {
+	char *serialized = check_snmp_oid_cache_serialize(cache);
+
+	char *encoded = NULL;
+	base64_encode_alloc(serialized, (idx_t)strlen(serialized) + 1, &encoded);
+	if (encoded == NULL) {
+		die(STATE_UNKNOWN, "failed to encode the OID cache");
+	}
+
+	np_state_write_string(cache_state_key, 0, encoded);
+	free(encoded);
+	free(serialized);
+}
+
+static bool is_numeric_oid(const char *oid_string) {
+	return strspn(oid_string, "0123456789.") == strlen(oid_string);
+}
 
-	struct snmp_session *active_session = snmp_open(&parameters.snmp_session);
+/*
+ * The MIBs are loaded at most once per run, either to resolve a textual OID or
+ * before the first OID without a name from the OID cache is printed. Printing
+ * always with the same MIBs keeps the output the same whether the OIDs were
+ * resolved with the cache or not.
+ */
+static const check_snmp_config_snmp_parameters *mib_parameters = NULL;
+static bool mibs_loaded = false;
+
+static void ensure_mibs_loaded(void) {
+	if (mibs_loaded || mib_parameters == NULL) {
+		return;
+	}
+	apply_mib_options(mib_parameters);
+	load_mibs(mib_parameters->miblist);
+	mibs_loaded = true;
+}
+
+/* Prints name like snprint_objid, the name of the OID of test_unit is taken from the cache */
+static int print_oid(char *buffer, size_t buffer_size, const oid *name, size_t name_length,
+					 const check_snmp_test_unit *test_unit) {
+	if (test_unit->display_name != NULL &&
+		snmp_oid_compare(name, name_length, test_unit->numeric_oid,
+						 test_unit->numeric_oid_length) == 0) {
+		return snprintf(buffer, buffer_size, "%s", test_unit->display_name);
+	}
+
+	ensure_mibs_loaded();
+	return snprint_objid(buffer, buffer_size, name, name_length);
+}
+
+/*
+ * Parses the OIDs of all test units before the query. All OIDs are looked up
+ * in the OID cache first, numeric ones can be parsed without any MIB, but the
+ * MIBs are loaded to name them once, so that they are printed the same way
+ * with and without a cache hit.
+ */
+void check_snmp_resolve_oids(check_snmp_config_snmp_parameters *parameters) {
+	struct timeval start_time;
+	gettimeofday(&start_time, NULL);
+
+	mib_parameters = parameters;
+
+	bool use_cache = parameters->use_oid_cache;
+	check_snmp_oid_cache cache = {};
+	state_key cache_state_key = {};
+	if (use_cache) {
+		char *mib_key = oid_cache_mib_key(parameters->miblist);
+		cache = check_snmp_oid_cache_init(mib_key);
+
+		// The state key is a hash of the MIB key, so that checks with different MIBs keep
+		// their own cache instead of replacing each other's on every run
+		char *key_parts[] = {"oid_cache", mib_key};
+		cache_state_key =
+			np_enable_state(NULL, CHECK_SNMP_OID_CACHE_VERSION, "check_snmp", 2, key_parts);
+		free(mib_key);
+		read_oid_cache(&cache, cache_state_key);
+	}
+
+	for (size_t i = 0; i < parameters->num_of_test_units; i++) {
+		check_snmp_test_unit *test_unit = &parameters->test_units[i];
+
+		const check_snmp_oid_cache_entry *cached = NULL;
+		if (use_cache) {
+			cached = check_snmp_oid_cache_lookup(&cache, test_unit->oid);
+		}
+
+		if (cached != NULL) {
+			memcpy(test_unit->numeric_oid, cached->numeric_oid,
+				   cached->numeric_oid_length * sizeof(oid));
+			test_unit->numeric_oid_length = cached->numeric_oid_length;
+			test_unit->display_name = strdup(cached->display_name);
+			continue;
+		}
+
+		if (!is_numeric_oid(test_unit->oid)) {
+			ensure_mibs_loaded();
+		}
+
+		parse_test_unit_oid(test_unit, i, test_unit->numeric_oid, &test_unit->numeric_oid_length);
+
+		if (use_cache) {
+			char display_name[(MAX_OID_LEN * 2) + 1] = "";
+			if (print_oid(display_name, sizeof(display_name), test_unit->numeric_oid,
+						  test_unit->numeric_oid_length, test_unit) > 0) {
+				check_snmp_oid_cache_add(&cache, test_unit->oid, test_unit->numeric_oid,
+										 test_unit->numeric_oid_length, display_name);
+				test_unit->display_name = strdup(display_name);
+			}
+		}
+	}
+
+	if (use_cache && cache.modified) {
+		write_oid_cache(&cache, cache_state_key);
+	}
+
+	if (verbose > 1) {
+		printf("Resolved %zu OIDs in %ld microseconds, MIBs were %s\n",
+			   parameters->num_of_test_units, deltime(start_time),
+			   mibs_loaded ? "loaded" : "not loaded");
+	}
+}
+
+/* Returns NULL and sets error_message if the session can not be opened */
+static struct snmp_session *try_open_snmp_session(struct snmp_session *session_template,
+												  char **error_message) {
+	struct snmp_session *active_session = snmp_open(session_template);
 	if (active_session == NULL) {
 		int pcliberr = 0;
 		int psnmperr = 0;
-		char *pperrstring = NULL;
-		snmp_error(&parameters.snmp_session, &pcliberr, &psnmperr, &pperrstring);
+		snmp_error(session_template, &pcliberr, &psnmperr, error_message);
+	}
+	return active_session;
+}
+
+static struct snmp_session *open_snmp_session(check_snmp_config_snmp_parameters *parameters) {
+	char *pperrstring = NULL;
+	struct snmp_session *active_session =
+		try_open_snmp_session(&parameters->snmp_session, &pperrstring);
+	if (active_session == NULL) {
 		die(STATE_UNKNOWN, "Failed to open SNMP session: %s\n", pperrstring);
 	}
+	return active_session;
+}
 
-	struct snmp_pdu *response = NULL;
-	int snmp_query_status = snmp_synch_response(active_session, pdu, &response);
+static void die_on_failed_query(struct snmp_session *active_session, int snmp_query_status,
+								const struct snmp_pdu *response) {
+	if (snmp_query_status == STAT_SUCCESS && response->errstat == SNMP_ERR_NOERROR) {
+		return;
+	}
 
-	if (!(snmp_query_status == STAT_SUCCESS && response->errstat == SNMP_ERR_NOERROR)) {
-		int pcliberr = 0;
-		int psnmperr = 0;
-		char *pperrstring = NULL;
-		snmp_error(active_session, &pcliberr, &psnmperr, &pperrstring);
+	int pcliberr = 0;
+	int psnmperr = 0;
+	char *pperrstring = NULL;
+	snmp_error(active_session, &pcliberr, &psnmperr, &pperrstring);
+
+	if (psnmperr == SNMPERR_TIMEOUT) {
+		// We exit with critical here for some historical reason
+		die(STATE_CRITICAL, "SNMP query ran into a timeout\n");
+	}
+	die(STATE_UNKNOWN, "SNMP query failed: %s\n", pperrstring);
+}
+
+static response_value convert_variable(const netsnmp_variable_list *vars) {
+	response_value result = {
+		.oid_length = vars->name_length,
+		.type = vars->type,
+	};
+
+	for (size_t jdx = 0; jdx < vars->name_length; jdx++) {
+		result.oid[jdx] = vars->name[jdx];
+	}
+
+	switch (vars->type) {
+	case ASN_OCTET_STR: {
+		// The value is not necessarily terminated
+		result.string_response = strndup((char *)vars->val.string, vars->val_len);
+		if (verbose) {
+			printf("Debug: Got a string as response: %s\n", result.string_response);
+		}
+	} break;
+	case ASN_OPAQUE:
+		if (verbose) {
+			printf("Debug: Got OPAQUE\n");
+		}
+		break;
+	/* Numerical values */
+	case ASN_COUNTER64: {
+		if (verbose) {
+			printf("Debug: Got counter64\n");
+		}
+		struct counter64 tmp = *(vars->val.counter64);
+		uint64_t counter = ((uint64_t)tmp.high << 32) + tmp.low;
+		result.value.uIntVal = counter;
+	} break;
+	case ASN_GAUGE: // same as ASN_UNSIGNED
+	case ASN_TIMETICKS:
+	case ASN_COUNTER:
+	case ASN_UINTEGER: {
+		if (verbose) {
+			printf("Debug: Got a Integer like\n");
+		}
+		result.value.uIntVal = (unsigned long)*(vars->val.integer);
+	} break;
+	case ASN_INTEGER: {
+		if (verbose) {
+			printf("Debug: Got a Integer\n");
+		}
+		result.value.intVal = *(vars->val.integer);
+	} break;
+	case ASN_FLOAT: {
+		if (verbose) {
+			printf("Debug: Got a float\n");
+		}
+		result.value.doubleVal = *(vars->val.floatVal);
+	} break;
+	case ASN_DOUBLE: {
+		if (verbose) {
+			printf("Debug: Got a double\n");
+		}
+		result.value.doubleVal = *(vars->val.doubleVal);
+	} break;
+	case ASN_IPADDRESS:
+		if (verbose) {
+			printf("Debug: Got an IP address\n");
+		}
+		// TODO: print address here, state always ok? or regex match?
+		break;
+	default:
+		if (verbose) {
+			printf("Debug: Got a unmatched result type: %hhu\n", vars->type);
+		}
+		// TODO: Error here?
+		break;
+	}
+
+	return result;
+}
+
+typedef struct {
+	oid name[MAX_OID_LEN];
+	size_t length;
+} parsed_oid;
+
+/* Shared by all PDUs of one query */
+typedef struct {
+	bool use_getnext;
+	const parsed_oid *oids;
+	snmp_responces *result;
+	size_t outstanding;
+	size_t sent;
+	size_t timed_out;
+} snmp_query_context;
+
+/* One PDU in flight, covering the test units [first_unit, first_unit + unit_count) */
+typedef struct {
+	snmp_query_context *context;
+	size_t first_unit;
+	size_t unit_count;
+} snmp_query_chunk;
+
+static void mark_units_failed(snmp_query_context *context, size_t first_unit, size_t unit_count,
+							  mp_state_enum state, const char *message) {
+	for (size_t i = first_unit; i < first_unit + unit_count; i++) {
+		context->result->response_values[i].test_unit_index = i;
+		context->result->response_values[i].errorcode = ERROR;
+		context->result->response_values[i].error_state = state;
+		context->result->response_values[i].error_message = message;
+	}
+}
+
+static int query_chunk_callback(int operation, struct snmp_session *session, int reqid,
+								struct snmp_pdu *response, void *magic);
+
+static void send_query_chunk(struct snmp_session *session, snmp_query_context *context,
+							 size_t first_unit, size_t unit_count) {
+	if (unit_count == 0) {
+		return;
+	}
+
+	struct snmp_pdu *pdu = snmp_pdu_create(context->use_getnext ? SNMP_MSG_GETNEXT : SNMP_MSG_GET);
+	for (size_t i = first_unit; i < first_unit + unit_count; i++) {
+		snmp_add_null_var(pdu, context->oids[i].name, context->oids[i].length);
+	}
+
+	snmp_query_chunk *chunk = malloc(sizeof(snmp_query_chunk));
+	if (chunk == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+	chunk->context = context;
+	chunk->first_unit = first_unit;
+	chunk->unit_count = unit_count;
+
+	if (verbose > 1) {
+		printf("Sending PDU for OIDs %zu to %zu\n", first_unit, first_unit + unit_count - 1);
+	}
+
+	if (snmp_async_send(session, pdu, query_chunk_callback, chunk) == 0) {
+		snmp_free_pdu(pdu);
+		free(chunk);
+		mark_units_failed(context, first_unit, unit_count, STATE_UNKNOWN,
+						  "Failed to send SNMP request");
+		return;
+	}
+	context->outstanding++;
+	context->sent++;
+}
+
+static int query_chunk_callback(int operation, struct snmp_session *session, int reqid,
+								struct snmp_pdu *response, void *magic) {
+	(void)reqid;
+	snmp_query_chunk *chunk = magic;
+	snmp_query_context *context = chunk->context;
+	context->outstanding--;
+
+	if (operation != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) {
+		// Retries are done by net-snmp already
+		context->timed_out++;
+		mark_units_failed(context, chunk->first_unit, chunk->unit_count, STATE_CRITICAL,
+						  "SNMP query ran into a timeout");
+	} else if (response->errstat == SNMP_ERR_TOOBIG && chunk->unit_count > 1) {
+		// The agent can not answer that many variables at once, try again with halves
+		size_t half = chunk->unit_count / 2;
+		if (verbose > 1) {
+			printf("Got tooBig for %zu OIDs, splitting the request\n", chunk->unit_count);
+		}
+		send_query_chunk(session, context, chunk->first_unit, half);
+		send_query_chunk(session, context, chunk->first_unit + half, chunk->unit_count - half);
+	} else if (response->errstat != SNMP_ERR_NOERROR) {
+		size_t error_index = (size_t)response->errindex;
+		if (error_index >= 1 && error_index <= chunk->unit_count && chunk->unit_count > 1) {
+			// Only one variable is at fault (e.g. noSuchName in SNMPv1), retry the others
+			size_t failed_unit = chunk->first_unit + error_index - 1;
+			mark_units_failed(context, failed_unit, 1, STATE_UNKNOWN,
+							  snmp_errstring((int)response->errstat));
+			send_query_chunk(session, context, chunk->first_unit, failed_unit - chunk->first_unit);
+			send_query_chunk(session, context, failed_unit + 1,
+							 chunk->first_unit + chunk->unit_count - failed_unit - 1);
+		} else {
+			mark_units_failed(context, chunk->first_unit, chunk->unit_count, STATE_UNKNOWN,
+							  snmp_errstring((int)response->errstat));
+		}
+	} else {
+		// Variables are returned in the order of the request
+		size_t unit_index = chunk->first_unit;
+		for (netsnmp_variable_list *vars = response->variables;
+			 vars != NULL && unit_index < chunk->first_unit + chunk->unit_count;
+			 vars = vars->next_variable, unit_index++) {
+			if (vars->type == SNMP_NOSUCHOBJECT || vars->type == SNMP_NOSUCHINSTANCE ||
+				vars->type == SNMP_ENDOFMIBVIEW) {
+				mark_units_failed(context, unit_index, 1, STATE_UNKNOWN,
+								  (vars->type == SNMP_ENDOFMIBVIEW) ? "End of MIB view"
+																	: "No such object");
+				continue;
+			}
+			context->result->response_values[unit_index] = convert_variable(vars);
+			context->result->response_values[unit_index].test_unit_index = unit_index;
+		}
+	}
+
+	free(chunk);
+	return 1;
+}
+
+/* Waits for the next response or timeout on any open session and dispatches it */
+static void process_snmp_events(void) {
+	int number_of_fds = 0;
+	int block = 1;
+	fd_set fdset;
+	struct timeval timeout;
+
+	FD_ZERO(&fdset);
+	snmp_select_info(&number_of_fds, &fdset, &timeout, &block);
+
+	int ready = select(number_of_fds, &fdset, NULL, NULL, block ? NULL : &timeout);
+	if (ready < 0) {
+		if (errno == EINTR) {
+			return;
+		}
+		die(STATE_UNKNOWN, "select failed: %s\n", strerror(errno));
+	}
+
+	if (ready > 0) {
+		snmp_read(&fdset);
+	} else {
+		snmp_timeout();
+	}
+}
+
+static parsed_oid *parse_test_unit_oids(check_snmp_config_snmp_parameters *parameters) {
+	parsed_oid *oids = calloc(parameters->num_of_test_units, sizeof(parsed_oid));
+	if (oids == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+
+	for (size_t i = 0; i < parameters->num_of_test_units; i++) {
+		parse_test_unit_oid(&parameters->test_units[i], i, oids[i].name, &oids[i].length);
+	}
+	return oids;
+}
+
+static snmp_query_context init_query_context(check_snmp_config_snmp_parameters *parameters,
+											 const parsed_oid *oids, snmp_responces *result) {
+	result->errorcode = OK;
+	result->response_values = calloc(parameters->num_of_test_units, sizeof(response_value));
+	result->number_of_results = parameters->num_of_test_units;
+	if (result->response_values == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
 
-		if (psnmperr == SNMPERR_TIMEOUT) {
-			// We exit with critical here for some historical reason
-			die(STATE_CRITICAL, "SNMP query ran into a timeout\n");
+	snmp_query_context context = {
+		.use_getnext = parameters->use_getnext,
+		.oids = oids,
+		.result = result,
+		.outstanding = 0,
+		.sent = 0,
+		.timed_out = 0,
+	};
+
+	// Units which are not answered by the agent at all stay in this state
+	mark_units_failed(&context, 0, parameters->num_of_test_units, STATE_UNKNOWN,
+					  "No value returned by the agent");
+	return context;
+}
+
+/* Sends all PDUs of a query, the answers are collected by process_snmp_events */
+static void start_query(struct snmp_session *active_session, snmp_query_context *context,
+						check_snmp_config_snmp_parameters *parameters) {
+	size_t chunk_size = parameters->max_oids_per_pdu;
+	if (chunk_size == 0) {
+		chunk_size = parameters->num_of_test_units;
+	}
+
+	for (size_t first = 0; first < parameters->num_of_test_units; first += chunk_size) {
+		size_t count = parameters->num_of_test_units - first;
+		if (count > chunk_size) {
+			count = chunk_size;
 		}
-		die(STATE_UNKNOWN, "SNMP query failed: %s\n", pperrstring);
+		send_query_chunk(active_session, context, first, count);
+	}
+}
+
+/*
+ * Retrieves the values of all test units. The OIDs are split into PDUs of at
+ * most max_oids_per_pdu variables, which are all sent at once on the same
+ * session, so the whole query takes about one round trip. A failing PDU only
+ * affects its own test units, tooBig answers are retried with smaller PDUs.
+ */
+snmp_responces do_snmp_query(check_snmp_config_snmp_parameters parameters) {
+	parsed_oid *oids = parse_test_unit_oids(&parameters);
+
+	snmp_responces result;
+	snmp_query_context context = init_query_context(&parameters, oids, &result);
+
+	const int timeout_safety_tolerance = 5;
+	alarm((timeout_interval * (unsigned int)parameters.snmp_session.retries) +
+		  timeout_safety_tolerance);
+
+	struct snmp_session *active_session = open_snmp_session(&parameters);
+
+	start_query(active_session, &context, &parameters);
+	while (context.outstanding > 0) {
+		process_snmp_events();
 	}
 
 	snmp_close(active_session);
@@ -201,100 +735,251 @@ snmp_responces do_snmp_query(check_snmp_config_snmp_parameters parameters) {
 	/* disable alarm again */
 	alarm(0);
 
-	snmp_responces result = {
-		.errorcode = OK,
-		.response_values = calloc(parameters.num_of_test_units, sizeof(response_value)),
-		.number_of_results = 0,
-	};
+	free(oids);
 
-	if (result.response_values == NULL) {
-		result.errorcode = ERROR;
-		return result;
+	if (context.sent > 0 && context.timed_out == context.sent) {
+		// We exit with critical here for some historical reason
+		die(STATE_CRITICAL, "SNMP query ran into a timeout\n");
 	}
 
-	// We got the the query results, now process them
-	for (netsnmp_variable_list *vars = response->variables;
-		 (vars && result.number_of_results <= parameters.num_of_test_units);
-		 vars = vars->next_variable, result.number_of_results++) {
-		for (size_t jdx = 0; jdx < vars->name_length; jdx++) {
-			result.response_values[result.number_of_results].oid[jdx] = vars->name[jdx];
-		}
-		result.response_values[result.number_of_results].oid_length = vars->name_length;
+	return result;
+}
+
+typedef struct {
+	struct snmp_session *active_session;
+	snmp_query_context context;
+	bool running;
+} agent_query;
 
-		switch (vars->type) {
-		case ASN_OCTET_STR: {
-			result.response_values[result.number_of_results].string_response =
-				strdup((char *)vars->val.string);
-			result.response_values[result.number_of_results].type = vars->type;
-			if (verbose) {
-				printf("Debug: Got a string as response: %s\n", vars->val.string);
+/*
+ * Queries the same test units on several agents. Up to max_concurrent_agents
+ * sessions are open at the same time and served by one select loop, so the
+ * run time is about one timeout interval per max_concurrent_agents agents
+ * which do not answer. Returns one result per agent, failures of an agent
+ * are recorded in its units.
+ */
+snmp_responces *do_snmp_query_agents(check_snmp_config_snmp_parameters parameters) {
+	size_t number_of_agents = parameters.number_of_agents;
+	size_t max_concurrent = parameters.max_concurrent_agents;
+	if (max_concurrent == 0) {
+		max_concurrent = number_of_agents;
+	}
+
+	parsed_oid *oids = parse_test_unit_oids(&parameters);
+	snmp_responces *results = calloc(number_of_agents, sizeof(snmp_responces));
+	agent_query *queries = calloc(number_of_agents, sizeof(agent_query));
+	if (results == NULL || queries == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+
+	const int timeout_safety_tolerance = 5;
+	size_t rounds = (number_of_agents + max_concurrent - 1) / max_concurrent;
+	unsigned int timeout_per_round =
+		timeout_interval * (unsigned int)parameters.snmp_session.retries;
+	alarm((timeout_per_round * (unsigned int)rounds) + timeout_safety_tolerance);
+
+	size_t next_agent = 0;
+	size_t running_agents = 0;
+	while (next_agent < number_of_agents || running_agents > 0) {
+		// Fill up the free slots
+		while (running_agents < max_concurrent && next_agent < number_of_agents) {
+			agent_query *query = &queries[next_agent];
+			query->context = init_query_context(&parameters, oids, &results[next_agent]);
+
+			struct snmp_session session_template = parameters.snmp_session;
+			session_template.peername = parameters.agents[next_agent].peername;
+
+			char *error_message = NULL;
+			query->active_session = try_open_snmp_session(&session_template, &error_message);
+			if (query->active_session == NULL) {
+				mark_units_failed(&query->context, 0, parameters.num_of_test_units, STATE_UNKNOWN,
+								  (error_message != NULL) ? error_message
+														  : "Failed to open SNMP session");
+			} else {
+				start_query(query->active_session, &query->context, &parameters);
+				query->running = true;
+				running_agents++;
+			}
+
+			if (verbose > 1) {
+				printf("Started query for agent %s\n", parameters.agents[next_agent].name);
 			}
+			next_agent++;
 		}
+
+		if (running_agents == 0) {
 			continue;
-		case ASN_OPAQUE:
-			if (verbose) {
-				printf("Debug: Got OPAQUE\n");
-			}
-			break;
-		/* Numerical values */
-		case ASN_COUNTER64: {
-			if (verbose) {
-				printf("Debug: Got counter64\n");
-			}
-			struct counter64 tmp = *(vars->val.counter64);
-			uint64_t counter = (tmp.high << 32) + tmp.low;
-			result.response_values[result.number_of_results].value.uIntVal = counter;
-			result.response_values[result.number_of_results].type = vars->type;
-		} break;
-		case ASN_GAUGE: // same as ASN_UNSIGNED
-		case ASN_TIMETICKS:
-		case ASN_COUNTER:
-		case ASN_UINTEGER: {
-			if (verbose) {
-				printf("Debug: Got a Integer like\n");
-			}
-			result.response_values[result.number_of_results].value.uIntVal =
-				(unsigned long)*(vars->val.integer);
-			result.response_values[result.number_of_results].type = vars->type;
-		} break;
-		case ASN_INTEGER: {
-			if (verbose) {
-				printf("Debug: Got a Integer\n");
+		}
+
+		process_snmp_events();
+
+		for (size_t i = 0; i < next_agent; i++) {
+			if (queries[i].running && queries[i].context.outstanding == 0) {
+				snmp_close(queries[i].active_session);
+				queries[i].running = false;
+				running_agents--;
 			}
-			result.response_values[result.number_of_results].value.intVal = *(vars->val.integer);
-			result.response_values[result.number_of_results].type = vars->type;
-		} break;
-		case ASN_FLOAT: {
-			if (verbose) {
-				printf("Debug: Got a float\n");
+		}
+	}
+
+	/* disable alarm again */
+	alarm(0);
+
+	free(queries);
+	free(oids);
+	return results;
+}
+
+static bool oid_is_in_subtree(const oid *root, size_t root_length, const oid *name,
+							  size_t name_length) {
+	if (name_length <= root_length) {
+		return false;
+	}
+	for (size_t i = 0; i < root_length; i++) {
+		if (root[i] != name[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void append_response(snmp_responces *result, size_t *allocated, response_value value) {
+	if (result->number_of_results == *allocated) {
+		*allocated = (*allocated == 0) ? 64 : *allocated * 2;
+		response_value *tmp =
+			realloc(result->response_values, *allocated * sizeof(response_value));
+		if (tmp == NULL) {
+			die(STATE_UNKNOWN, "memory allocation failed");
+		}
+		result->response_values = tmp;
+	}
+	result->response_values[result->number_of_results++] = value;
+}
+
+/*
+ * Retrieves all variables below the OID of every test unit. SNMPv2c and v3
+ * use GETBULK, so a table column with N rows takes about
+ * N / max_repetitions round trips. SNMPv1 has no GETBULK and falls back to
+ * one GETNEXT per row. Every request has the timeout and retries of the
+ * session, the whole walk ends after timeout_interval seconds.
+ */
+snmp_responces do_snmp_walk(check_snmp_config_snmp_parameters parameters) {
+	time_t deadline = time(NULL) + timeout_interval;
+
+	struct snmp_session *active_session = open_snmp_session(&parameters);
+	bool use_getbulk = parameters.snmp_session.version != SNMP_VERSION_1;
+
+	snmp_responces result = {
+		.errorcode = OK,
+		.response_values = NULL,
+		.number_of_results = 0,
+	};
+	size_t allocated = 0;
+
+	for (size_t i = 0; i < parameters.num_of_test_units; i++) {
+		oid root_oid[MAX_OID_LEN];
+		size_t root_oid_length = MAX_OID_LEN;
+		parse_test_unit_oid(&parameters.test_units[i], i, root_oid, &root_oid_length);
+
+		oid current_oid[MAX_OID_LEN];
+		size_t current_oid_length = root_oid_length;
+		memcpy(current_oid, root_oid, root_oid_length * sizeof(oid));
+
+		bool subtree_done = false;
+		while (!subtree_done) {
+			if (time(NULL) >= deadline) {
+				die(STATE_CRITICAL, "SNMP walk ran into a timeout after %u seconds, %zu results\n",
+					timeout_interval, result.number_of_results);
 			}
-			result.response_values[result.number_of_results].value.doubleVal = *(vars->val.floatVal);
-			result.response_values[result.number_of_results].type = vars->type;
-		} break;
-		case ASN_DOUBLE: {
-			if (verbose) {
-				printf("Debug: Got a double\n");
+
+			struct snmp_pdu *pdu = NULL;
+			if (use_getbulk) {
+				pdu = snmp_pdu_create(SNMP_MSG_GETBULK);
+				pdu->non_repeaters = 0;
+				pdu->max_repetitions = parameters.max_repetitions;
+			} else {
+				pdu = snmp_pdu_create(SNMP_MSG_GETNEXT);
 			}
-			result.response_values[result.number_of_results].value.doubleVal = *(vars->val.doubleVal);
-			result.response_values[result.number_of_results].type = vars->type;
-		} break;
-		case ASN_IPADDRESS:
-			if (verbose) {
-				printf("Debug: Got an IP address\n");
+			snmp_add_null_var(pdu, current_oid, current_oid_length);
+
+			struct snmp_pdu *response = NULL;
+			int snmp_query_status = snmp_synch_response(active_session, pdu, &response);
+			if (!use_getbulk && snmp_query_status == STAT_SUCCESS &&
+				response->errstat == SNMP_ERR_NOSUCHNAME) {
+				// SNMPv1 agents answer a GETNEXT past the last variable this way
+				snmp_free_pdu(response);
+				break;
 			}
-			result.response_values[result.number_of_results].type = vars->type;
+			die_on_failed_query(active_session, snmp_query_status, response);
+
+			subtree_done = true;
+			for (netsnmp_variable_list *vars = response->variables; vars != NULL;
+				 vars = vars->next_variable) {
+				if (vars->type == SNMP_ENDOFMIBVIEW || vars->type == SNMP_NOSUCHOBJECT ||
+					vars->type == SNMP_NOSUCHINSTANCE ||
+					!oid_is_in_subtree(root_oid, root_oid_length, vars->name,
+									   vars->name_length)) {
+					subtree_done = true;
+					break;
+				}
 
-			// TODO: print address here, state always ok? or regex match?
-			break;
-		default:
-			if (verbose) {
-				printf("Debug: Got a unmatched result type: %hhu\n", vars->type);
+				// Agents must return increasing OIDs, stop instead of looping forever
+				if (snmp_oid_compare(vars->name, vars->name_length, current_oid,
+									 current_oid_length) <= 0) {
+					subtree_done = true;
+					break;
+				}
+
+				response_value row = convert_variable(vars);
+				row.test_unit_index = i;
+				row.walk_root_length = root_oid_length;
+				append_response(&result, &allocated, row);
+
+				memcpy(current_oid, vars->name, vars->name_length * sizeof(oid));
+				current_oid_length = vars->name_length;
+				subtree_done = false;
 			}
-			// TODO: Error here?
+
+			snmp_free_pdu(response);
+		}
+
+		if (verbose > 0) {
+			printf("Walk below %s done, %zu results so far\n", parameters.test_units[i].oid,
+				   result.number_of_results);
+		}
+	}
+
+	snmp_close(active_session);
+
+	return result;
+}
+
+/*
+ * Derives the test unit for one row of a walk from the test unit of the
+ * walked OID: label and OID get the row index appended, thresholds and
+ * units are inherited
+ */
+check_snmp_test_unit check_snmp_walk_row_unit(check_snmp_test_unit root_unit,
+											  response_value row) {
+	char row_index[(MAX_OID_LEN * 12) + 1] = "";
+	size_t row_index_length = 0;
+	for (size_t i = row.walk_root_length; i < row.oid_length; i++) {
+		const char *separator = (row_index_length == 0) ? "" : ".";
+		int written = snprintf(row_index + row_index_length, sizeof(row_index) - row_index_length,
+							   "%s%lu", separator, (unsigned long)row.oid[i]);
+		if (written < 0 || (size_t)written >= sizeof(row_index) - row_index_length) {
 			break;
 		}
+		row_index_length += (size_t)written;
 	}
 
+	check_snmp_test_unit result = root_unit;
+	// The name of the root OID does not fit the rows
+	result.display_name = NULL;
+	xasprintf(&result.oid, "%s.%s", root_unit.oid, row_index);
+	if (root_unit.label != NULL && strcmp(root_unit.label, "") != 0) {
+		xasprintf(&result.label, "%s.%s", root_unit.label, row_index);
+	}
 	return result;
 }
 
@@ -314,7 +999,7 @@ check_snmp_evaluation evaluate_single_unit(response_value response,
 	char oid_string[(MAX_OID_LEN * 2) + 1] = {};
 
 	int oid_string_result =
-		snprint_objid(oid_string, (MAX_OID_LEN * 2) + 1, response.oid, response.oid_length);
+		print_oid(oid_string, sizeof(oid_string), response.oid, response.oid_length, &test_unit);
 	if (oid_string_result <= 0) {
 		// TODO error here
 		die(STATE_UNKNOWN, "snprint_objid failed\n");
@@ -425,17 +1110,9 @@ check_snmp_evaluation evaluate_single_unit(response_value response,
 
 		// TODO: perfdata unit counter
 		if (eval_params.calculate_rate && have_previous_state) {
-			if (prev_state.value.uIntVal > response.value.uIntVal) {
-				// overflow
-				unsigned long long tmp =
-					(UINT64_MAX - prev_state.value.uIntVal) + response.value.uIntVal;
-
-				tmp /= timeDiff;
-				pd_result_val = mp_create_pd_value(tmp);
-			} else {
-				pd_result_val = mp_create_pd_value(
-					(response.value.uIntVal - prev_state.value.uIntVal) / timeDiff);
-			}
+			// Unsigned arithmetic wraps around like the counter itself
+			uint64_t delta = response.value.uIntVal - prev_state.value.uIntVal;
+			pd_result_val = mp_create_pd_value((double)delta / timeDiff);
 		} else {
 			// It's only a counter if we cont compute rate
 			pd_num_val.uom = "c";
@@ -472,7 +1149,16 @@ check_snmp_evaluation evaluate_single_unit(response_value response,
 				printf("%s: Rate calculation (int/counter/gauge): current: %lli\n", __FUNCTION__,
 					   treated_value);
 			}
-			double rate = (treated_value - prev_state.value.intVal) / timeDiff;
+			long long delta = treated_value - prev_state.value.intVal;
+			if (response.type == ASN_COUNTER && delta < 0) {
+				// Counter32 wrapped around, multiplier and offset apply to the wrap as well
+				double wrap = 4294967296.0;
+				if (eval_params.multiplier_set) {
+					wrap *= eval_params.multiplier;
+				}
+				delta += llround(wrap);
+			}
+			double rate = (double)delta / timeDiff;
 			pd_result_val = mp_create_pd_value(rate);
 		} else {
 			pd_result_val = mp_create_pd_value(treated_value);
@@ -600,341 +1286,3 @@ check_snmp_evaluation evaluate_single_unit(response_value response,
 
 	return result;
 }
-
-char *_np_state_generate_key(int argc, char **argv);
-
-/*
- * If time=NULL, use current time. Create state file, with state format
- * version, default text. Writes version, time, and data. Avoid locking
- * problems - use mv to write and then swap. Possible loss of state data if
- * two things writing to same key at same time.
- * Will die with UNKNOWN if errors
- */
-void np_state_write_string(state_key stateKey, time_t timestamp, char *stringToStore) {
-	time_t current_time;
-	if (timestamp == 0) {
-		time(&current_time);
-	} else {
-		current_time = timestamp;
-	}
-
-	int result = 0;
-
-	/* If file doesn't currently exist, create directories */
-	if (access(stateKey._filename, F_OK) != 0) {
-		char *directories = NULL;
-		result = asprintf(&directories, "%s", stateKey._filename);
-		if (result < 0) {
-			die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
-		}
-
-		for (char *p = directories + 1; *p; p++) {
-			if (*p == '/') {
-				*p = '\0';
-				if ((access(directories, F_OK) != 0) && (mkdir(directories, S_IRWXU) != 0)) {
-					/* Can't free this! Otherwise error message is wrong! */
-					/* np_free(directories); */
-					die(STATE_UNKNOWN, _("Cannot create directory: %s"), directories);
-				}
-				*p = '/';
-			}
-		}
-
-		if (directories) {
-			free(directories);
-		}
-	}
-
-	char *temp_file = NULL;
-	result = asprintf(&temp_file, "%s.XXXXXX", stateKey._filename);
-	if (result < 0) {
-		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
-	}
-
-	int temp_file_desc = 0;
-	if ((temp_file_desc = mkstemp(temp_file)) == -1) {
-		if (temp_file) {
-			free(temp_file);
-		}
-		die(STATE_UNKNOWN, _("Cannot create temporary filename"));
-	}
-
-	FILE *temp_file_pointer = fdopen(temp_file_desc, "w");
-	if (temp_file_pointer == NULL) {
-		close(temp_file_desc);
-		unlink(temp_file);
-		if (temp_file) {
-			free(temp_file);
-		}
-		die(STATE_UNKNOWN, _("Unable to open temporary state file"));
-	}
-
-	fprintf(temp_file_pointer, "# NP State file\n");
-	fprintf(temp_file_pointer, "%d\n", NP_STATE_FORMAT_VERSION);
-	fprintf(temp_file_pointer, "%d\n", stateKey.data_version);
-	fprintf(temp_file_pointer, "%lu\n", current_time);
-	fprintf(temp_file_pointer, "%s\n", stringToStore);
-
-	fchmod(temp_file_desc, S_IRUSR | S_IWUSR | S_IRGRP);
-
-	fflush(temp_file_pointer);
-
-	result = fclose(temp_file_pointer);
-
-	fsync(temp_file_desc);
-
-	if (result != 0) {
-		unlink(temp_file);
-		if (temp_file) {
-			free(temp_file);
-		}
-		die(STATE_UNKNOWN, _("Error writing temp file"));
-	}
-
-	if (rename(temp_file, stateKey._filename) != 0) {
-		unlink(temp_file);
-		if (temp_file) {
-			free(temp_file);
-		}
-		die(STATE_UNKNOWN, _("Cannot rename state temp file"));
-	}
-
-	if (temp_file) {
-		free(temp_file);
-	}
-}
-
-/*
- * Read the state file
- */
-bool _np_state_read_file(FILE *state_file, state_key stateKey) {
-	time_t current_time;
-	time(&current_time);
-
-	/* Note: This introduces a limit of 8192 bytes in the string data */
-	char *line = (char *)calloc(1, 8192);
-	if (line == NULL) {
-		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
-	}
-
-	bool status = false;
-	enum {
-		STATE_FILE_VERSION,
-		STATE_DATA_VERSION,
-		STATE_DATA_TIME,
-		STATE_DATA_TEXT,
-		STATE_DATA_END
-	} expected = STATE_FILE_VERSION;
-
-	int failure = 0;
-	while (!failure && (fgets(line, 8192, state_file)) != NULL) {
-		size_t pos = strlen(line);
-		if (line[pos - 1] == '\n') {
-			line[pos - 1] = '\0';
-		}
-
-		if (line[0] == '#') {
-			continue;
-		}
-
-		switch (expected) {
-		case STATE_FILE_VERSION: {
-			int i = atoi(line);
-			if (i != NP_STATE_FORMAT_VERSION) {
-				failure++;
-			} else {
-				expected = STATE_DATA_VERSION;
-			}
-		} break;
-		case STATE_DATA_VERSION: {
-			int i = atoi(line);
-			if (i != stateKey.data_version) {
-				failure++;
-			} else {
-				expected = STATE_DATA_TIME;
-			}
-		} break;
-		case STATE_DATA_TIME: {
-			/* If time > now, error */
-			time_t data_time = strtoul(line, NULL, 10);
-			if (data_time > current_time) {
-				failure++;
-			} else {
-				stateKey.state_data->time = data_time;
-				expected = STATE_DATA_TEXT;
-			}
-		} break;
-		case STATE_DATA_TEXT:
-			stateKey.state_data->data = strdup(line);
-			if (stateKey.state_data->data == NULL) {
-				die(STATE_UNKNOWN, _("Cannot execute strdup: %s"), strerror(errno));
-			}
-			stateKey.state_data->length = strlen(line);
-			expected = STATE_DATA_END;
-			status = true;
-			break;
-		case STATE_DATA_END:;
-		}
-	}
-
-	if (line) {
-		free(line);
-	}
-	return status;
-}
-/*
- * Will return NULL if no data is available (first run). If key currently
- * exists, read data. If state file format version is not expected, return
- * as if no data. Get state data version number and compares to expected.
- * If numerically lower, then return as no previous state. die with UNKNOWN
- * if exceptional error.
- */
-state_data *np_state_read(state_key stateKey) {
-	/* Open file. If this fails, no previous state found */
-	FILE *statefile = fopen(stateKey._filename, "r");
-	state_data *this_state_data = (state_data *)calloc(1, sizeof(state_data));
-	if (statefile != NULL) {
-
-		if (this_state_data == NULL) {
-			die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
-		}
-
-		this_state_data->data = NULL;
-		stateKey.state_data = this_state_data;
-
-		if (_np_state_read_file(statefile, stateKey)) {
-			this_state_data->errorcode = OK;
-		} else {
-			this_state_data->errorcode = ERROR;
-		}
-
-		fclose(statefile);
-	} else {
-		// Failed to open state file
-		this_state_data->errorcode = ERROR;
-	}
-
-	return stateKey.state_data;
-}
-
-/*
- * Internal function. Returns either:
- *   envvar NAGIOS_PLUGIN_STATE_DIRECTORY
- *   statically compiled shared state directory
- */
-char *_np_state_calculate_location_prefix(void) {
-	char *env_dir;
-
-	/* Do not allow passing MP_STATE_PATH in setuid plugins
-	 * for security reasons */
-	if (!mp_suid()) {
-		env_dir = getenv("MP_STATE_PATH");
-		if (env_dir && env_dir[0] != '\0') {
-			return env_dir;
-		}
-		/* This is the former ENV, for backward-compatibility */
-		env_dir = getenv("NAGIOS_PLUGIN_STATE_DIRECTORY");
-		if (env_dir && env_dir[0] != '\0') {
-			return env_dir;
-		}
-	}
-
-	return NP_STATE_DIR_PREFIX;
-}
-
-/*
- * Initiatializer for state routines.
- * Sets variables. Generates filename. Returns np_state_key. die with
- * UNKNOWN if exception
- */
-state_key np_enable_state(char *keyname, int expected_data_version, const char *plugin_name,
-						  int argc, char **argv) {
-	state_key *this_state = (state_key *)calloc(1, sizeof(state_key));
-	if (this_state == NULL) {
-		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
-	}
-
-	char *temp_keyname = NULL;
-	if (keyname == NULL) {
-		temp_keyname = _np_state_generate_key(argc, argv);
-	} else {
-		temp_keyname = strdup(keyname);
-		if (temp_keyname == NULL) {
-			die(STATE_UNKNOWN, _("Cannot execute strdup: %s"), strerror(errno));
-		}
-	}
-
-	/* Die if invalid characters used for keyname */
-	char *tmp_char = temp_keyname;
-	while (*tmp_char != '\0') {
-		if (!(isalnum(*tmp_char) || *tmp_char == '_')) {
-			die(STATE_UNKNOWN, _("Invalid character for keyname - only alphanumerics or '_'"));
-		}
-		tmp_char++;
-	}
-	this_state->name = temp_keyname;
-	this_state->plugin_name = (char *)plugin_name;
-	this_state->data_version = expected_data_version;
-	this_state->state_data = NULL;
-
-	/* Calculate filename */
-	char *temp_filename = NULL;
-	int error = asprintf(&temp_filename, "%s/%lu/%s/%s", _np_state_calculate_location_prefix(),
-						 (unsigned long)geteuid(), plugin_name, this_state->name);
-	if (error < 0) {
-		die(STATE_UNKNOWN, _("Cannot allocate memory: %s"), strerror(errno));
-	}
-
-	this_state->_filename = temp_filename;
-
-	return *this_state;
-}
-
-/*
- * Returns a string to use as a keyname, based on an md5 hash of argv, thus
- * hopefully a unique key per service/plugin invocation. Use the extra-opts
- * parse of argv, so that uniqueness in parameters are reflected there.
- */
-char *_np_state_generate_key(int argc, char **argv) {
-	unsigned char result[256];
-
-#ifdef MOPL_USE_OPENSSL
-	/*
-	 * This code path is chosen if openssl is available (which should be the most common
-	 * scenario). Alternatively, the gnulib implementation/
-	 *
-	 */
-	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-
-	EVP_DigestInit(ctx, EVP_sha256());
-
-	for (int i = 0; i < argc; i++) {
-		EVP_DigestUpdate(ctx, argv[i], strlen(argv[i]));
-	}
-
-	EVP_DigestFinal(ctx, result, NULL);
-#else
-
-	struct sha256_ctx ctx;
-
-	for (int i = 0; i < this_monitoring_plugin->argc; i++) {
-		sha256_process_bytes(argv[i], strlen(argv[i]), &ctx);
-	}
-
-	sha256_finish_ctx(&ctx, result);
-#endif // MOPL_USE_OPENSSL
-
-	char keyname[41];
-	for (int i = 0; i < 20; ++i) {
-		sprintf(&keyname[2 * i], "%02x", result[i]);
-	}
-
-	keyname[40] = '\0';
-
-	char *keyname_copy = strdup(keyname);
-	if (keyname_copy == NULL) {
-		die(STATE_UNKNOWN, _("Cannot execute strdup: %s"), strerror(errno));
-	}
-
-	return keyname_copy;
-}
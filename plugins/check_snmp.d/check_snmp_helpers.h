@@ -1,11 +1,13 @@
 #pragma once
 
 #include "./config.h"
+#include "../../lib/utils_state.h"
 #include <net-snmp/library/asn1.h>
 
 check_snmp_test_unit check_snmp_test_unit_init();
 int check_snmp_set_thresholds(const char *, check_snmp_test_unit[], size_t, bool);
 check_snmp_config check_snmp_config_init();
+void check_snmp_resolve_oids(check_snmp_config_snmp_parameters *parameters);
 
 typedef struct {
 	oid oid[MAX_OID_LEN];
@@ -17,6 +19,14 @@ typedef struct {
 		double doubleVal;
 	} value;
 	char *string_response;
+	// index of the test unit this value belongs to
+	size_t test_unit_index;
+	// walk mode: length of the walked OID, the rest of oid is the row index
+	size_t walk_root_length;
+	// OK or ERROR if no value could be retrieved for this test unit
+	int errorcode;
+	mp_state_enum error_state;
+	const char *error_message;
 } response_value;
 
 typedef struct {
@@ -25,6 +35,10 @@ typedef struct {
 	size_t number_of_results;
 } snmp_responces;
 snmp_responces do_snmp_query(check_snmp_config_snmp_parameters parameters);
+snmp_responces do_snmp_walk(check_snmp_config_snmp_parameters parameters);
+snmp_responces *do_snmp_query_agents(check_snmp_config_snmp_parameters parameters);
+check_snmp_test_unit check_snmp_walk_row_unit(check_snmp_test_unit root_unit,
+											  response_value row);
 
 // state is similar to response, but only numerics and a timestamp
 typedef struct {
@@ -48,25 +62,3 @@ check_snmp_evaluation evaluate_single_unit(response_value response,
 										   check_snmp_test_unit test_unit, time_t query_timestamp,
 										   check_snmp_state_entry prev_state,
 										   bool have_previous_state);
-
-#define NP_STATE_FORMAT_VERSION 1
-
-typedef struct state_data_struct {
-	time_t time;
-	void *data;
-	size_t length; /* Of binary data */
-	int errorcode;
-} state_data;
-
-typedef struct state_key_struct {
-	char *name;
-	char *plugin_name;
-	int data_version;
-	char *_filename;
-	state_data *state_data;
-} state_key;
-
-state_data *np_state_read(state_key stateKey);
-state_key np_enable_state(char *keyname, int expected_data_version, const char *plugin_name,
-						  int argc, char **argv);
-void np_state_write_string(state_key stateKey, time_t timestamp, char *stringToStore);
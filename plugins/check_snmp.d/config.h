@@ -20,6 +20,9 @@
 
 #define DEFAULT_PORT    "161"
 #define DEFAULT_RETRIES 5
+#define DEFAULT_MAX_REPETITIONS 25
+#define DEFAULT_MAX_OIDS_PER_PDU 32
+#define DEFAULT_MAX_CONCURRENT_AGENTS 64
 
 typedef struct eval_method {
 	bool crit_string;
@@ -32,16 +35,43 @@ typedef struct check_snmp_test_unit {
 	char *unit_value;
 	eval_method eval_mthd;
 	mp_thresholds threshold;
+
+	// oid resolved by check_snmp_resolve_oids, before the query
+	oid numeric_oid[MAX_OID_LEN];
+	size_t numeric_oid_length;
+	// name of numeric_oid from the OID cache, printed instead of loading the MIBs
+	char *display_name;
 } check_snmp_test_unit;
 
+typedef struct check_snmp_agent {
+	char *name;     // as given on the command line
+	char *peername; // with connection prefix and port for net-snmp
+} check_snmp_agent;
+
 typedef struct {
 	struct snmp_session snmp_session;
 	// use getnet instead of get
 	bool use_getnext;
 
+	// split requests with many OIDs into PDUs of at most this many variables, 0 means no limit
+	size_t max_oids_per_pdu;
+
+	// retrieve the whole subtree below every OID, with GETBULK if possible
+	bool walk;
+	long max_repetitions;
+
+	// poll all of these agents instead of the single peername of the session
+	check_snmp_agent *agents;
+	size_t number_of_agents;
+	size_t max_concurrent_agents;
+
 	// TODO actually make these useful
 	bool ignore_mib_parsing_errors;
-	bool need_mibs;
+
+	// MIB modules loaded for textual OIDs, "ALL" for every module in the MIB directories
+	char *miblist;
+	// remember textual OIDs across runs, so the MIBs have only to be loaded for new ones
+	bool use_oid_cache;
 
 	check_snmp_test_unit *test_units;
 	size_t num_of_test_units;
@@ -68,6 +98,8 @@ typedef struct {
 	// activate rate calculation
 	bool calculate_rate;
 	unsigned int rate_multiplier;
+	// fsync the state file after every run
+	bool sync_rate_state;
 } check_snmp_evaluation_parameters;
 
 typedef struct check_snmp_config {
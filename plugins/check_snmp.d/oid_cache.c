@@ -0,0 +1,154 @@
+#include "./oid_cache.h"
+#include "../../lib/utils_base.h"
+#include "../utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The cache is kept as text, one entry per line:
+ *
+ *   <CHECK_SNMP_OID_CACHE_VERSION>
+ *   <mib_key>
+ *   <name>\t<numeric oid>\t<display name>
+ *   ...
+ *
+ * Names or keys containing tabs or newlines are never cached.
+ */
+
+static bool is_cacheable(const char *str) { return strpbrk(str, "\t\n") == NULL; }
+
+check_snmp_oid_cache check_snmp_oid_cache_init(const char *mib_key) {
+	check_snmp_oid_cache result = {
+		.mib_key = strdup(mib_key),
+		.entries = NULL,
+		.number_of_entries = 0,
+		.modified = false,
+	};
+
+	if (result.mib_key == NULL) {
+		die(STATE_UNKNOWN, "strdup failed");
+	}
+	return result;
+}
+
+const check_snmp_oid_cache_entry *check_snmp_oid_cache_lookup(const check_snmp_oid_cache *cache,
+															  const char *name) {
+	for (size_t i = 0; i < cache->number_of_entries; i++) {
+		if (strcmp(cache->entries[i].name, name) == 0) {
+			return &cache->entries[i];
+		}
+	}
+	return NULL;
+}
+
+int check_snmp_oid_cache_add(check_snmp_oid_cache *cache, const char *name,
+							 const oid *numeric_oid, size_t numeric_oid_length,
+							 const char *display_name) {
+	if (!is_cacheable(name) || !is_cacheable(display_name) || numeric_oid_length == 0 ||
+		numeric_oid_length > MAX_OID_LEN) {
+		return ERROR;
+	}
+
+	if (check_snmp_oid_cache_lookup(cache, name) != NULL) {
+		return OK;
+	}
+
+	check_snmp_oid_cache_entry *tmp = realloc(
+		cache->entries, (cache->number_of_entries + 1) * sizeof(check_snmp_oid_cache_entry));
+	if (tmp == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+	cache->entries = tmp;
+
+	check_snmp_oid_cache_entry *entry = &cache->entries[cache->number_of_entries];
+	entry->name = strdup(name);
+	entry->display_name = strdup(display_name);
+	if (entry->name == NULL || entry->display_name == NULL) {
+		die(STATE_UNKNOWN, "strdup failed");
+	}
+	memcpy(entry->numeric_oid, numeric_oid, numeric_oid_length * sizeof(oid));
+	entry->numeric_oid_length = numeric_oid_length;
+
+	cache->number_of_entries++;
+	cache->modified = true;
+	return OK;
+}
+
+/* Parses ".1.3.6.1" into numeric_oid, returns false on garbage */
+static bool parse_numeric_oid(const char *str, oid *numeric_oid, size_t *numeric_oid_length) {
+	*numeric_oid_length = 0;
+	while (*str == '.') {
+		str++;
+		if (*numeric_oid_length == MAX_OID_LEN || *str < '0' || *str > '9') {
+			return false;
+		}
+
+		char *end = NULL;
+		numeric_oid[*numeric_oid_length] = strtoul(str, &end, 10);
+		(*numeric_oid_length)++;
+		str = end;
+	}
+	return *str == '\0' && *numeric_oid_length > 0;
+}
+
+int check_snmp_oid_cache_parse(check_snmp_oid_cache *cache, const char *serialized) {
+	char *buffer = strdup(serialized);
+	if (buffer == NULL) {
+		die(STATE_UNKNOWN, "strdup failed");
+	}
+
+	char *save_ptr = NULL;
+	char *version = strtok_r(buffer, "\n", &save_ptr);
+	char *mib_key = strtok_r(NULL, "\n", &save_ptr);
+	if (version == NULL || atoi(version) != CHECK_SNMP_OID_CACHE_VERSION || mib_key == NULL ||
+		strcmp(mib_key, cache->mib_key) != 0) {
+		// Written by another version or for other MIBs
+		free(buffer);
+		return ERROR;
+	}
+
+	int result = OK;
+	for (char *line = strtok_r(NULL, "\n", &save_ptr); line != NULL;
+		 line = strtok_r(NULL, "\n", &save_ptr)) {
+		char *numeric = strchr(line, '\t');
+		char *display_name = (numeric != NULL) ? strchr(numeric + 1, '\t') : NULL;
+		if (display_name == NULL) {
+			result = ERROR;
+			continue;
+		}
+		*numeric++ = '\0';
+		*display_name++ = '\0';
+
+		oid numeric_oid[MAX_OID_LEN];
+		size_t numeric_oid_length = 0;
+		if (!parse_numeric_oid(numeric, numeric_oid, &numeric_oid_length)) {
+			result = ERROR;
+			continue;
+		}
+		check_snmp_oid_cache_add(cache, line, numeric_oid, numeric_oid_length, display_name);
+	}
+
+	// Nothing new so far
+	cache->modified = false;
+	free(buffer);
+	return result;
+}
+
+char *check_snmp_oid_cache_serialize(const check_snmp_oid_cache *cache) {
+	char *result = NULL;
+	xasprintf(&result, "%d\n%s\n", CHECK_SNMP_OID_CACHE_VERSION, cache->mib_key);
+
+	for (size_t i = 0; i < cache->number_of_entries; i++) {
+		char numeric[(MAX_OID_LEN * 21) + 1] = "";
+		size_t numeric_length = 0;
+		for (size_t j = 0; j < cache->entries[i].numeric_oid_length; j++) {
+			numeric_length += (size_t)snprintf(numeric + numeric_length,
+											   sizeof(numeric) - numeric_length, ".%lu",
+											   (unsigned long)cache->entries[i].numeric_oid[j]);
+		}
+		xasprintf(&result, "%s%s\t%s\t%s\n", result, cache->entries[i].name, numeric,
+				  cache->entries[i].display_name);
+	}
+	return result;
+}
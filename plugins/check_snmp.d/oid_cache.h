@@ -0,0 +1,39 @@
+#pragma once
+/* Header file for the textual OID cache of check_snmp in oid_cache.c */
+
+#include "./config.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define CHECK_SNMP_OID_CACHE_VERSION 1
+
+/*
+ * One OID as given on the command line with the numeric OID and
+ * the name snprint_objid printed for it when the MIBs were loaded
+ */
+typedef struct {
+	char *name;
+	oid numeric_oid[MAX_OID_LEN];
+	size_t numeric_oid_length;
+	char *display_name;
+} check_snmp_oid_cache_entry;
+
+/*
+ * The entries are only valid for the MIBs described by mib_key, a cache
+ * with a different key is discarded when it is parsed
+ */
+typedef struct {
+	char *mib_key;
+	check_snmp_oid_cache_entry *entries;
+	size_t number_of_entries;
+	bool modified;
+} check_snmp_oid_cache;
+
+check_snmp_oid_cache check_snmp_oid_cache_init(const char *mib_key);
+int check_snmp_oid_cache_parse(check_snmp_oid_cache *cache, const char *serialized);
+char *check_snmp_oid_cache_serialize(const check_snmp_oid_cache *cache);
+const check_snmp_oid_cache_entry *check_snmp_oid_cache_lookup(const check_snmp_oid_cache *cache,
+															  const char *name);
+int check_snmp_oid_cache_add(check_snmp_oid_cache *cache, const char *name,
+							 const oid *numeric_oid, size_t numeric_oid_length,
+							 const char *display_name);
@@ -0,0 +1,281 @@
+#include "./rate_state.h"
+#include "../../lib/utils_base.h"
+#include "../../lib/utils_state.h"
+#include "../utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RECORD_ALIGNMENT 8
+
+/* FNV-1a, good enough to notice truncated or half written files */
+static uint64_t rate_state_checksum(const unsigned char *data, size_t length) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static size_t align_size(size_t size) {
+	return (size + RECORD_ALIGNMENT - 1) & ~((size_t)RECORD_ALIGNMENT - 1);
+}
+
+static size_t record_size(size_t oid_length) {
+	return align_size(sizeof(check_snmp_rate_state_record) + (oid_length * sizeof(uint32_t)));
+}
+
+/* Compares an OID with the sub-identifiers of a record, like snmp_oid_compare */
+static int compare_oid(const oid *name, size_t name_length, const uint32_t *record_oid,
+					   size_t record_oid_length) {
+	size_t min_length = (name_length < record_oid_length) ? name_length : record_oid_length;
+	for (size_t i = 0; i < min_length; i++) {
+		if (name[i] != record_oid[i]) {
+			return (name[i] < record_oid[i]) ? -1 : 1;
+		}
+	}
+
+	if (name_length == record_oid_length) {
+		return 0;
+	}
+	return (name_length < record_oid_length) ? -1 : 1;
+}
+
+static int compare_entries(const void *left, const void *right) {
+	const check_snmp_state_entry *left_entry = *(const check_snmp_state_entry *const *)left;
+	const check_snmp_state_entry *right_entry = *(const check_snmp_state_entry *const *)right;
+
+	size_t min_length = (left_entry->oid_length < right_entry->oid_length)
+							? left_entry->oid_length
+							: right_entry->oid_length;
+	for (size_t i = 0; i < min_length; i++) {
+		if (left_entry->oid[i] != right_entry->oid[i]) {
+			return (left_entry->oid[i] < right_entry->oid[i]) ? -1 : 1;
+		}
+	}
+
+	if (left_entry->oid_length == right_entry->oid_length) {
+		return 0;
+	}
+	return (left_entry->oid_length < right_entry->oid_length) ? -1 : 1;
+}
+
+check_snmp_rate_state check_snmp_rate_state_open(const char *filename) {
+	check_snmp_rate_state result = {
+		.errorcode = ERROR,
+		.mapping = NULL,
+	};
+
+	int file_descriptor = open(filename, O_RDONLY);
+	if (file_descriptor < 0) {
+		// No previous state
+		return result;
+	}
+
+	struct stat file_stat;
+	if (fstat(file_descriptor, &file_stat) != 0 ||
+		(size_t)file_stat.st_size < sizeof(check_snmp_rate_state_header)) {
+		close(file_descriptor);
+		return result;
+	}
+
+	size_t mapping_length = (size_t)file_stat.st_size;
+	void *mapping = mmap(NULL, mapping_length, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	close(file_descriptor);
+	if (mapping == MAP_FAILED) {
+		return result;
+	}
+
+	const check_snmp_rate_state_header *header = mapping;
+	const unsigned char *data = (const unsigned char *)mapping + sizeof(*header);
+	size_t data_length = mapping_length - sizeof(*header);
+	// The records start aligned after the index
+	size_t index_length = align_size((size_t)header->number_of_entries * sizeof(uint32_t));
+
+	if (memcmp(header->magic, CHECK_SNMP_RATE_STATE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != CHECK_SNMP_RATE_STATE_VERSION || header->data_length != data_length ||
+		index_length > data_length ||
+		rate_state_checksum(data, data_length) != header->checksum) {
+		// Not a state file of this version or not written completely
+		munmap(mapping, mapping_length);
+		return result;
+	}
+
+	result.errorcode = OK;
+	result.mapping = mapping;
+	result.mapping_length = mapping_length;
+	result.number_of_entries = header->number_of_entries;
+	result.offsets = (const uint32_t *)data;
+	result.records = data + index_length;
+	result.records_length = data_length - index_length;
+	return result;
+}
+
+/* Returns the record at offset or NULL if it does not fit into the file */
+static const check_snmp_rate_state_record *get_record(const check_snmp_rate_state *state,
+													  uint32_t offset) {
+	if ((size_t)offset + sizeof(check_snmp_rate_state_record) > state->records_length ||
+		offset % RECORD_ALIGNMENT != 0) {
+		return NULL;
+	}
+
+	const check_snmp_rate_state_record *record =
+		(const check_snmp_rate_state_record *)(state->records + offset);
+	if (record->oid_length > MAX_OID_LEN ||
+		(size_t)offset + record_size(record->oid_length) > state->records_length) {
+		return NULL;
+	}
+	return record;
+}
+
+bool check_snmp_rate_state_lookup(const check_snmp_rate_state *state, const oid *name,
+								  size_t name_length, check_snmp_state_entry *result) {
+	if (state->errorcode != OK) {
+		return false;
+	}
+
+	size_t lower = 0;
+	size_t upper = state->number_of_entries;
+	while (lower < upper) {
+		size_t middle = lower + ((upper - lower) / 2);
+		const check_snmp_rate_state_record *record = get_record(state, state->offsets[middle]);
+		if (record == NULL) {
+			return false;
+		}
+
+		const uint32_t *record_oid = (const uint32_t *)(record + 1);
+		int comparison = compare_oid(name, name_length, record_oid, record->oid_length);
+		if (comparison < 0) {
+			upper = middle;
+		} else if (comparison > 0) {
+			lower = middle + 1;
+		} else {
+			memset(result, 0, sizeof(*result));
+			result->timestamp = (time_t)record->timestamp;
+			result->type = record->type;
+			memcpy(&result->value, &record->value, sizeof(record->value));
+			result->oid_length = record->oid_length;
+			for (size_t i = 0; i < record->oid_length; i++) {
+				result->oid[i] = record_oid[i];
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void check_snmp_rate_state_close(check_snmp_rate_state *state) {
+	if (state->mapping != NULL) {
+		munmap(state->mapping, state->mapping_length);
+	}
+	state->mapping = NULL;
+	state->errorcode = ERROR;
+}
+
+/*
+ * Writes the entries with an OID to filename. The new file replaces the old
+ * one with rename, durable additionally syncs it to disk before. Without
+ * that a crash might leave an incomplete file, which is detected by the
+ * checksum and costs one rate calculation.
+ */
+int check_snmp_rate_state_write(const char *filename, const check_snmp_state_entry *entries,
+								size_t number_of_entries, bool durable) {
+	const check_snmp_state_entry **sorted = calloc(number_of_entries, sizeof(*sorted));
+	if (sorted == NULL && number_of_entries > 0) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+
+	size_t number_of_records = 0;
+	size_t records_length = 0;
+	for (size_t i = 0; i < number_of_entries; i++) {
+		if (entries[i].oid_length == 0 || entries[i].oid_length > MAX_OID_LEN) {
+			// No value for this unit in this run
+			continue;
+		}
+		sorted[number_of_records++] = &entries[i];
+		records_length += record_size(entries[i].oid_length);
+	}
+	qsort(sorted, number_of_records, sizeof(*sorted), compare_entries);
+
+	size_t index_length = align_size(number_of_records * sizeof(uint32_t));
+	size_t data_length = index_length + records_length;
+	if (records_length > UINT32_MAX) {
+		free(sorted);
+		return ERROR;
+	}
+
+	unsigned char *buffer = calloc(1, sizeof(check_snmp_rate_state_header) + data_length);
+	if (buffer == NULL) {
+		die(STATE_UNKNOWN, "memory allocation failed");
+	}
+
+	unsigned char *data = buffer + sizeof(check_snmp_rate_state_header);
+	uint32_t *offsets = (uint32_t *)data;
+	unsigned char *records = data + index_length;
+	size_t offset = 0;
+	for (size_t i = 0; i < number_of_records; i++) {
+		check_snmp_rate_state_record *record = (check_snmp_rate_state_record *)(records + offset);
+		record->timestamp = (int64_t)sorted[i]->timestamp;
+		memcpy(&record->value, &sorted[i]->value, sizeof(record->value));
+		record->type = sorted[i]->type;
+		record->oid_length = (uint32_t)sorted[i]->oid_length;
+
+		uint32_t *record_oid = (uint32_t *)(record + 1);
+		for (size_t j = 0; j < sorted[i]->oid_length; j++) {
+			record_oid[j] = (uint32_t)sorted[i]->oid[j];
+		}
+
+		offsets[i] = (uint32_t)offset;
+		offset += record_size(sorted[i]->oid_length);
+	}
+	free(sorted);
+
+	check_snmp_rate_state_header *header = (check_snmp_rate_state_header *)buffer;
+	memcpy(header->magic, CHECK_SNMP_RATE_STATE_MAGIC, sizeof(header->magic));
+	header->version = CHECK_SNMP_RATE_STATE_VERSION;
+	header->number_of_entries = (uint32_t)number_of_records;
+	header->data_length = data_length;
+	header->checksum = rate_state_checksum(data, data_length);
+
+	np_state_create_directories(filename);
+
+	char *temp_file = NULL;
+	xasprintf(&temp_file, "%s.XXXXXX", filename);
+	int file_descriptor = mkstemp(temp_file);
+	if (file_descriptor < 0) {
+		free(buffer);
+		free(temp_file);
+		return ERROR;
+	}
+	fchmod(file_descriptor, S_IRUSR | S_IWUSR | S_IRGRP);
+
+	size_t total_length = sizeof(check_snmp_rate_state_header) + data_length;
+	size_t written = 0;
+	while (written < total_length) {
+		ssize_t result = write(file_descriptor, buffer + written, total_length - written);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			break;
+		}
+		written += (size_t)result;
+	}
+	free(buffer);
+
+	bool failed = (written != total_length) || (durable && fsync(file_descriptor) != 0);
+	if (close(file_descriptor) != 0 || failed || rename(temp_file, filename) != 0) {
+		unlink(temp_file);
+		free(temp_file);
+		return ERROR;
+	}
+
+	free(temp_file);
+	return OK;
+}
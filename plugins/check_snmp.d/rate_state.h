@@ -0,0 +1,57 @@
+#pragma once
+/* Header file for the binary --rate state of check_snmp in rate_state.c */
+
+#include "./check_snmp_helpers.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHECK_SNMP_RATE_STATE_MAGIC   "MPSNMPRT"
+#define CHECK_SNMP_RATE_STATE_VERSION 1
+
+/*
+ * Layout of a state file, all numbers in host byte order:
+ *
+ *   check_snmp_rate_state_header
+ *   uint32_t offsets[number_of_entries] sorted by OID, relative to the first record
+ *   check_snmp_rate_state_record, each followed by uint32_t oid[oid_length]
+ *
+ * The offsets and every record are padded to a multiple of 8 Byte.
+ *
+ * The checksum covers everything after the header, a file which was not
+ * written completely is therefore treated like a missing one.
+ */
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t number_of_entries;
+	uint64_t data_length;
+	uint64_t checksum;
+} check_snmp_rate_state_header;
+
+typedef struct {
+	int64_t timestamp;
+	uint64_t value;
+	uint8_t type;
+	uint8_t reserved[3];
+	uint32_t oid_length;
+} check_snmp_rate_state_record;
+
+/* A state file mapped into memory by check_snmp_rate_state_open */
+typedef struct {
+	int errorcode;
+	void *mapping;
+	size_t mapping_length;
+	size_t number_of_entries;
+	const uint32_t *offsets;
+	const unsigned char *records;
+	size_t records_length;
+} check_snmp_rate_state;
+
+check_snmp_rate_state check_snmp_rate_state_open(const char *filename);
+bool check_snmp_rate_state_lookup(const check_snmp_rate_state *state, const oid *name,
+								  size_t name_length, check_snmp_state_entry *result);
+void check_snmp_rate_state_close(check_snmp_rate_state *state);
+
+int check_snmp_rate_state_write(const char *filename, const check_snmp_state_entry *entries,
+								size_t number_of_entries, bool durable);
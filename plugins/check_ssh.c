@@ -59,6 +59,7 @@ void print_usage(void);
 
 static int ssh_connect(mp_check *overall, char *haddr, int hport, char *remote_version,
 					   char *remote_protocol);
+static mp_check check_hosts(check_ssh_config /*config*/);
 
 int main(int argc, char **argv) {
 #ifdef __OpenBSD__
@@ -93,11 +94,16 @@ int main(int argc, char **argv) {
 		mp_set_format(config.output_format);
 	}
 
+	if (config.host_count > 1) {
+		mp_exit(check_hosts(config));
+	}
+
 	mp_set_ok_summary(&overall, "SSH check was successful");
 
-	/* initialize alarm signal handling */
+	/* The steps of ssh_connect stop at their deadline, the alarm is left for a name lookup which
+	 * never returns */
 	signal(SIGALRM, socket_timeout_alarm_handler);
-	alarm(socket_timeout);
+	alarm(socket_timeout + 1);
 
 	/* ssh_connect exits if error is found */
 	ssh_connect(&overall, config.server_name, config.port, config.remote_version,
@@ -109,6 +115,34 @@ int main(int argc, char **argv) {
 }
 
 #define output_format_index CHAR_MAX + 1
+#define concurrency_index   CHAR_MAX + 2
+
+/* Sets the hosts from a comma separated list, a repeated -H replaces them */
+static void set_hosts(check_ssh_config *config, const char *list) {
+	char *copy = strdup(list);
+	if (copy == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	config->host_count = 0;
+
+	char *saveptr = NULL;
+	for (char *item = strtok_r(copy, ",", &saveptr); item != NULL;
+		 item = strtok_r(NULL, ",", &saveptr)) {
+		if (!is_host(item)) {
+			usage2(_("Invalid hostname/address"), item);
+		}
+		char **tmp = realloc(config->hosts, (config->host_count + 1) * sizeof(char *));
+		if (tmp == NULL) {
+			die(STATE_UNKNOWN, _("Allocation failed"));
+		}
+		config->hosts = tmp;
+		config->hosts[config->host_count++] = item;
+	}
+	if (config->host_count == 0) {
+		usage2(_("Invalid hostname/address"), list);
+	}
+	config->server_name = config->hosts[0];
+}
 
 /* process command-line arguments */
 process_arguments_wrapper process_arguments(int argc, char **argv) {
@@ -125,6 +159,7 @@ process_arguments_wrapper process_arguments(int argc, char **argv) {
 		{"remote-version", required_argument, 0, 'r'},
 		{"remote-protocol", required_argument, 0, 'P'},
 		{"output-format", required_argument, 0, output_format_index},
+		{"concurrency", required_argument, 0, concurrency_index},
 		{0, 0, 0, 0}};
 
 	process_arguments_wrapper result = {
@@ -183,11 +218,8 @@ process_arguments_wrapper process_arguments(int argc, char **argv) {
 		case 'P': /* remote version */
 			result.config.remote_protocol = optarg;
 			break;
-		case 'H': /* host */
-			if (!is_host(optarg)) {
-				usage2(_("Invalid hostname/address"), optarg);
-			}
-			result.config.server_name = optarg;
+		case 'H': /* host or list of hosts */
+			set_hosts(&result.config, optarg);
 			break;
 		case 'p': /* port */
 			if (is_intpos(optarg)) {
@@ -208,6 +240,12 @@ process_arguments_wrapper process_arguments(int argc, char **argv) {
 			result.config.output_format = parser.output_format;
 			break;
 		}
+		case concurrency_index:
+			if (!is_intpos(optarg)) {
+				usage2(_("Concurrency must be a positive integer"), optarg);
+			}
+			result.config.concurrency = (size_t)atoi(optarg);
+			break;
 		}
 	}
 
@@ -246,71 +284,59 @@ int ssh_connect(mp_check *overall, char *haddr, int hport, char *desired_remote_
 	struct timeval tv;
 	gettimeofday(&tv, NULL);
 
+	/* every step waits until the same deadline, no alarm is needed */
+	double deadline = np_net_deadline(socket_timeout);
 	int socket;
-	int result = my_tcp_connect(haddr, hport, &socket);
+	np_net_io_result io_result =
+		np_net_connect_until(haddr, hport, &socket, IPPROTO_TCP, deadline);
 
 	mp_subcheck connection_sc = mp_subcheck_init();
-	if (result != STATE_OK) {
+	if (io_result.status == NP_NET_TIMEOUT) {
+		connection_sc = mp_set_subcheck_state(connection_sc, socket_timeout_state);
+		xasprintf(&connection_sc.output, _("Socket timeout after %d seconds during the %s"),
+				  socket_timeout, np_net_phase_to_string(io_result.phase));
+		mp_add_subcheck_to_check(overall, connection_sc);
+		return ERROR;
+	}
+	if (io_result.status != NP_NET_OK) {
 		connection_sc = mp_set_subcheck_state(connection_sc, STATE_CRITICAL);
 		xasprintf(&connection_sc.output,
 				  "Failed to establish TCP connection to Host %s and Port %d", haddr, hport);
 		mp_add_subcheck_to_check(overall, connection_sc);
-		return result;
+		return ERROR;
 	}
 
-	char *output = (char *)calloc(BUFF_SZ + 1, sizeof(char));
-	char *buffer = NULL;
-	ssize_t recv_ret = 0;
-	char *version_control_string = NULL;
-	size_t byte_offset = 0;
-	while ((version_control_string == NULL) &&
-		   (recv_ret = recv(socket, output + byte_offset, (unsigned long)(BUFF_SZ - byte_offset),
-							0) > 0)) {
-
-		if (strchr(output, '\n')) { /* we've got at least one full line, start parsing*/
-			byte_offset = 0;
-
-			char *index = NULL;
-			while ((index = strchr(output + byte_offset, '\n')) != NULL) {
-				/*Partition the buffer so that this line is a separate string,
-				 * by replacing the newline with NUL*/
-				output[(index - output)] = '\0';
-				size_t len = strlen(output + byte_offset);
-
-				if ((len >= 4) && (strncmp(output + byte_offset, "SSH-", 4) == 0)) {
-					/*if the string starts with SSH-, this _should_ be a valid version control
-					 * string*/
-					version_control_string = output + byte_offset;
-					break;
-				}
-
-				/*the start of the next line (if one exists) will be after the current one (+ NUL)*/
-				byte_offset += (len + 1);
-			}
-
-			if (version_control_string == NULL) {
-				/* move unconsumed data to beginning of buffer */
-				memmove((void *)output, (void *)(output + byte_offset), BUFF_SZ - byte_offset);
-
-				/*start reading from end of current line chunk on next recv*/
-				byte_offset = strlen(output);
-
-				/* NUL the rest of the buffer */
-				memset(output + byte_offset, 0, BUFF_SZ - byte_offset);
-			}
-		} else {
-			byte_offset += (size_t)recv_ret;
+	/* the identification string is parsed as it arrives, whatever the chunks are */
+	ssh_banner banner;
+	ssh_banner_init(&banner);
+	char output[BUFF_SZ];
+	while (banner.status == SSH_BANNER_INCOMPLETE) {
+		io_result = np_net_recv_until(socket, output, sizeof(output), deadline);
+		if (io_result.status != NP_NET_OK) {
+			break;
 		}
+		ssh_banner_feed(&banner, output, io_result.length);
 	}
 
-	if (recv_ret < 0) {
+	if (io_result.status == NP_NET_TIMEOUT) {
+		connection_sc = mp_set_subcheck_state(connection_sc, socket_timeout_state);
+		xasprintf(&connection_sc.output,
+				  _("Socket timeout after %d seconds while waiting for the version control string"),
+				  socket_timeout);
+		mp_add_subcheck_to_check(overall, connection_sc);
+		close(socket);
+		return OK;
+	}
+
+	if (io_result.status == NP_NET_ERROR) {
 		connection_sc = mp_set_subcheck_state(connection_sc, STATE_CRITICAL);
-		xasprintf(&connection_sc.output, "%s - %s", "SSH CRITICAL - ", strerror(errno));
+		xasprintf(&connection_sc.output, "%s - %s", "SSH CRITICAL - ", strerror(io_result.error));
 		mp_add_subcheck_to_check(overall, connection_sc);
+		close(socket);
 		return OK;
 	}
 
-	if (version_control_string == NULL) {
+	if (banner.status == SSH_BANNER_INCOMPLETE) {
 		connection_sc = mp_set_subcheck_state(connection_sc, STATE_CRITICAL);
 		xasprintf(&connection_sc.output, "%s", "SSH CRITICAL - No version control string received");
 		mp_add_subcheck_to_check(overall, connection_sc);
@@ -321,65 +347,36 @@ int ssh_connect(mp_check *overall, char *haddr, int hport, char *desired_remote_
 	xasprintf(&connection_sc.output, "%s", "Initial connection succeeded");
 	mp_add_subcheck_to_check(overall, connection_sc);
 
-	/*
-	 * "When the connection has been established, both sides MUST send an
-	 * identification string.  This identification string MUST be
-	 *
-	 * SSH-protoversion-softwareversion SP comments CR LF"
-	 *		- RFC 4253:4.2
-	 */
-	strip(version_control_string);
 	if (verbose) {
-		printf("%s\n", version_control_string);
-	}
-
-	char *ssh_proto = version_control_string + 4;
-
-	/*
-	 * We assume the protoversion is of the form Major.Minor, although
-	 * this is not _strictly_ required. See
-	 *
-	 * "Both the 'protoversion' and 'softwareversion' strings MUST consist of
-	 * printable US-ASCII characters, with the exception of whitespace
-	 * characters and the minus sign (-)"
-	 *		- RFC 4253:4.2
-	 * and,
-	 *
-	 * "As stated earlier, the 'protoversion' specified for this protocol is
-	 * "2.0".  Earlier versions of this protocol have not been formally
-	 * documented, but it is widely known that they use 'protoversion' of
-	 * "1.x" (e.g., "1.5" or "1.3")."
-	 *		- RFC 4253:5
-	 */
-	char *ssh_server = ssh_proto + strspn(ssh_proto, "0123456789.") +
-					   1; /* (+1 for the '-' separating protoversion from softwareversion) */
-
-	/* If there's a space in the version string, whatever's after the space is a comment
-	 * (which is NOT part of the server name/version)*/
-	char *tmp = strchr(ssh_server, ' ');
-	if (tmp) {
-		ssh_server[tmp - ssh_server] = '\0';
+		printf("%s\n", banner.identification);
 	}
 
 	mp_subcheck protocol_validity_sc = mp_subcheck_init();
-	if (strlen(ssh_proto) == 0 || strlen(ssh_server) == 0) {
+	if (banner.status == SSH_BANNER_INVALID) {
 		protocol_validity_sc = mp_set_subcheck_state(protocol_validity_sc, STATE_CRITICAL);
-		xasprintf(&protocol_validity_sc.output, "Invalid protocol version control string %s",
-				  version_control_string);
+		if (banner.identification[0] != '\0') {
+			xasprintf(&protocol_validity_sc.output, "Invalid protocol version control string %s",
+					  banner.identification);
+		} else {
+			xasprintf(&protocol_validity_sc.output, "%s", banner.error);
+		}
 		mp_add_subcheck_to_check(overall, protocol_validity_sc);
+		close(socket);
 		return OK;
 	}
 
 	protocol_validity_sc = mp_set_subcheck_state(protocol_validity_sc, STATE_OK);
 	xasprintf(&protocol_validity_sc.output, "Valid protocol version control string %s",
-			  version_control_string);
+			  banner.identification);
 	mp_add_subcheck_to_check(overall, protocol_validity_sc);
 
-	ssh_proto[strspn(ssh_proto, "0123456789. ")] = 0;
+	char *ssh_proto = banner.protocol;
+	char *ssh_server = banner.software;
 
 	static char *rev_no = VERSION;
+	char *buffer = NULL;
 	xasprintf(&buffer, "SSH-%s-check_ssh_%s\r\n", ssh_proto, rev_no);
-	send(socket, buffer, strlen(buffer), MSG_DONTWAIT);
+	np_net_timing_sent(send(socket, buffer, strlen(buffer), MSG_DONTWAIT));
 	if (verbose) {
 		printf("%s\n", buffer);
 	}
@@ -403,6 +400,8 @@ int ssh_connect(mp_check *overall, char *haddr, int hport, char *desired_remote_
 
 	mp_subcheck protocol_version_sc = mp_subcheck_init();
 	mp_add_perfdata_to_subcheck(&protocol_version_sc, time_pd);
+	np_net_timing_finish();
+	mp_net_add_timing_perfdata(&protocol_version_sc);
 
 	if (desired_remote_protocol && strcmp(desired_remote_protocol, ssh_proto)) {
 		protocol_version_sc = mp_set_subcheck_state(protocol_version_sc, STATE_CRITICAL);
@@ -420,6 +419,123 @@ int ssh_connect(mp_check *overall, char *haddr, int hport, char *desired_remote_
 	return OK;
 }
 
+/*
+ * Checks the SSH servers of all hosts concurrently, every host gets a subcheck
+ * with the version of its server and the connect latencies are summarized.
+ */
+static mp_check check_hosts(check_ssh_config config) {
+	ssh_probe *probes = calloc(config.host_count, sizeof(ssh_probe));
+	if (probes == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	for (size_t i = 0; i < config.host_count; i++) {
+		ssh_probe_init(&probes[i], config.hosts[i], config.port);
+	}
+
+	ssh_scan(probes, config.host_count, socket_timeout, config.concurrency);
+
+	mp_check overall = mp_check_init();
+	mp_subcheck hosts_result = mp_subcheck_init();
+	size_t answered = 0;
+	size_t connected = 0;
+	double connect_time_min = 0;
+	double connect_time_max = 0;
+	double connect_time_sum = 0;
+
+	for (size_t i = 0; i < config.host_count; i++) {
+		const ssh_probe *probe = &probes[i];
+		const np_net_endpoint *endpoint = &probe->endpoint;
+		mp_subcheck host_result = mp_subcheck_init();
+
+		if (ssh_probe_connected(probe)) {
+			if (connected == 0 || endpoint->connect_time < connect_time_min) {
+				connect_time_min = endpoint->connect_time;
+			}
+			if (endpoint->connect_time > connect_time_max) {
+				connect_time_max = endpoint->connect_time;
+			}
+			connect_time_sum += endpoint->connect_time;
+			connected++;
+		}
+
+		if (probe->result != SSH_PROBE_OK) {
+			host_result = mp_set_subcheck_state(host_result, STATE_CRITICAL);
+			if (probe->result == SSH_PROBE_FAILED) {
+				xasprintf(&host_result.output, "%s:%d: %s (%s)", endpoint->host, endpoint->port,
+						  ssh_probe_result_to_string(probe->result), strerror(endpoint->error));
+			} else if (probe->result == SSH_PROBE_INVALID) {
+				xasprintf(&host_result.output, "%s:%d: %s", endpoint->host, endpoint->port,
+						  probe->banner.error);
+			} else {
+				xasprintf(&host_result.output, "%s:%d: %s", endpoint->host, endpoint->port,
+						  ssh_probe_result_to_string(probe->result));
+			}
+			mp_add_subcheck_to_subcheck(&hosts_result, host_result);
+			continue;
+		}
+
+		answered++;
+		if (verbose) {
+			printf("%s:%d: %s\n", endpoint->host, endpoint->port, probe->banner.identification);
+		}
+
+		if (config.remote_version && strcmp(config.remote_version, probe->banner.software)) {
+			host_result = mp_set_subcheck_state(host_result, STATE_CRITICAL);
+			xasprintf(&host_result.output,
+					  _("%s:%d: %s (protocol %s) version mismatch, expected '%s'"),
+					  endpoint->host, endpoint->port, probe->banner.software,
+					  probe->banner.protocol, config.remote_version);
+		} else if (config.remote_protocol &&
+				   strcmp(config.remote_protocol, probe->banner.protocol)) {
+			host_result = mp_set_subcheck_state(host_result, STATE_CRITICAL);
+			xasprintf(&host_result.output,
+					  _("%s:%d: %s (protocol %s) protocol version mismatch, expected '%s'"),
+					  endpoint->host, endpoint->port, probe->banner.software,
+					  probe->banner.protocol, config.remote_protocol);
+		} else {
+			host_result = mp_set_subcheck_state(host_result, STATE_OK);
+			xasprintf(&host_result.output,
+					  "%s:%d: SSH server version: %s (protocol version: %s) in %fs (%s)",
+					  endpoint->host, endpoint->port, probe->banner.software,
+					  probe->banner.protocol, endpoint->total_time, endpoint->address);
+		}
+
+		mp_perfdata time_pd = perfdata_init();
+		time_pd = mp_set_pd_value(time_pd, endpoint->total_time);
+		xasprintf(&time_pd.label, "%s:%d", endpoint->host, endpoint->port);
+		time_pd.uom = "s";
+		time_pd = mp_set_pd_max_value(time_pd, mp_create_pd_value(socket_timeout));
+		mp_add_perfdata_to_subcheck(&host_result, time_pd);
+		mp_add_subcheck_to_subcheck(&hosts_result, host_result);
+	}
+
+	xasprintf(&hosts_result.output, "%zu of %zu SSH servers answered", answered,
+			  config.host_count);
+
+	if (connected > 0) {
+		mp_perfdata connect_time_pd = perfdata_init();
+		connect_time_pd.uom = "s";
+
+		connect_time_pd = mp_set_pd_value(connect_time_pd, connect_time_min);
+		connect_time_pd.label = "connect_time_min";
+		mp_add_perfdata_to_subcheck(&hosts_result, connect_time_pd);
+
+		connect_time_pd = mp_set_pd_value(connect_time_pd, connect_time_sum / (double)connected);
+		connect_time_pd.label = "connect_time_avg";
+		mp_add_perfdata_to_subcheck(&hosts_result, connect_time_pd);
+
+		connect_time_pd = mp_set_pd_value(connect_time_pd, connect_time_max);
+		connect_time_pd.label = "connect_time_max";
+		mp_add_perfdata_to_subcheck(&hosts_result, connect_time_pd);
+	}
+
+	mp_add_subcheck_to_check(&overall, hosts_result);
+	mp_set_summary(&overall, hosts_result.output);
+
+	free(probes);
+	return overall;
+}
+
 void print_help(void) {
 	char *myport;
 	xasprintf(&myport, "%d", default_ssh_port);
@@ -439,6 +555,11 @@ void print_help(void) {
 	printf(UT_EXTRA_OPTS);
 
 	printf(UT_HOST_PORT, 'p', myport);
+	printf("    %s\n", _("The hostname may be a comma separated list, the SSH servers of all"));
+	printf("    %s\n", _("hosts are then checked concurrently from one process"));
+	printf(" %s\n", "--concurrency=INTEGER");
+	printf("    %s %d)\n", _("Number of hosts checked at the same time (default:"),
+		   SSH_SCAN_DEFAULT_CONCURRENCY);
 
 	printf(UT_IPv46);
 
@@ -459,6 +580,6 @@ void print_help(void) {
 
 void print_usage(void) {
 	printf("%s\n", _("Usage:"));
-	printf("%s  [-4|-6] [-t <timeout>] [-r <remote version>] [-p <port>] --hostname <host>\n",
-		   progname);
+	printf("%s  [-4|-6] [-t <timeout>] [-r <remote version>] [-p <port>]\n", progname);
+	printf("%s\n", "                  --hostname <host>[,<host>...] [--concurrency <count>]");
 }
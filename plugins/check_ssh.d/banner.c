@@ -0,0 +1,87 @@
+#include "./banner.h"
+#include "../common.h"
+#include <string.h>
+
+void ssh_banner_init(ssh_banner *banner) {
+	memset(banner, 0, sizeof(*banner));
+	banner->status = SSH_BANNER_INCOMPLETE;
+}
+
+static ssh_banner_status invalid(ssh_banner *banner, const char *error) {
+	banner->error = error;
+	banner->status = SSH_BANNER_INVALID;
+	return banner->status;
+}
+
+/*
+ * "When the connection has been established, both sides MUST send an
+ * identification string.  This identification string MUST be
+ *
+ * SSH-protoversion-softwareversion SP comments CR LF"
+ *		- RFC 4253:4.2
+ *
+ * "Both the 'protoversion' and 'softwareversion' strings MUST consist of
+ * printable US-ASCII characters, with the exception of whitespace
+ * characters and the minus sign (-)"
+ *		- RFC 4253:4.2
+ */
+static ssh_banner_status parse_identification(ssh_banner *banner) {
+	strcpy(banner->identification, banner->line);
+
+	const char *protocol = banner->line + strlen("SSH-");
+	size_t protocol_length = strcspn(protocol, "- ");
+	if (protocol_length == 0 || protocol[protocol_length] != '-') {
+		return invalid(banner, _("Invalid protocol version control string"));
+	}
+	const char *software = protocol + protocol_length + 1;
+	size_t software_length = strcspn(software, " ");
+	if (software_length == 0) {
+		return invalid(banner, _("Invalid protocol version control string"));
+	}
+
+	memcpy(banner->protocol, protocol, protocol_length);
+	banner->protocol[protocol_length] = '\0';
+	memcpy(banner->software, software, software_length);
+	banner->software[software_length] = '\0';
+	if (software[software_length] == ' ') {
+		strcpy(banner->comments, software + software_length + 1);
+	}
+	banner->status = SSH_BANNER_FOUND;
+	return banner->status;
+}
+
+/*
+ * Takes the data as it arrives, every Byte is looked at once. Servers may
+ * send other lines before the identification string, which are skipped.
+ */
+ssh_banner_status ssh_banner_feed(ssh_banner *banner, const char *data, size_t length) {
+	for (size_t i = 0; i < length && banner->status == SSH_BANNER_INCOMPLETE; i++) {
+		if (++banner->preamble > SSH_BANNER_MAX_PREAMBLE) {
+			return invalid(banner, _("No version control string in the first 8 KiB"));
+		}
+
+		if (data[i] == '\n') {
+			if (!banner->skipping) {
+				if (banner->length > 0 && banner->line[banner->length - 1] == '\r') {
+					banner->length--;
+				}
+				banner->line[banner->length] = '\0';
+				if (strncmp(banner->line, "SSH-", strlen("SSH-")) == 0) {
+					parse_identification(banner);
+				}
+			}
+			banner->skipping = false;
+			banner->length = 0;
+		} else if (banner->skipping) {
+			continue;
+		} else if (banner->length == SSH_BANNER_MAX_LENGTH) {
+			if (strncmp(banner->line, "SSH-", strlen("SSH-")) == 0) {
+				return invalid(banner, _("Version control string is longer than 255 characters"));
+			}
+			banner->skipping = true;
+		} else {
+			banner->line[banner->length++] = data[i];
+		}
+	}
+	return banner->status;
+}
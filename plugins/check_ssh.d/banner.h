@@ -0,0 +1,37 @@
+#pragma once
+/* Header file for the incremental parser of the SSH identification string in banner.c */
+
+#include "../../config.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* RFC 4253 4.2: at most 255 characters including CR and LF */
+#define SSH_BANNER_MAX_LENGTH 255
+/* Bytes of other lines a server may send before its identification string */
+#define SSH_BANNER_MAX_PREAMBLE 8192
+
+typedef enum {
+	SSH_BANNER_INCOMPLETE, /* more data is needed */
+	SSH_BANNER_FOUND,
+	SSH_BANNER_INVALID, /* see error */
+} ssh_banner_status;
+
+typedef struct {
+	ssh_banner_status status;
+	const char *error;
+
+	/* the identification string without CR LF and its parts */
+	char identification[SSH_BANNER_MAX_LENGTH + 1];
+	char protocol[SSH_BANNER_MAX_LENGTH + 1]; /* "2.0" */
+	char software[SSH_BANNER_MAX_LENGTH + 1]; /* "OpenSSH_9.6" */
+	char comments[SSH_BANNER_MAX_LENGTH + 1]; /* may be empty */
+
+	/* State of the parser */
+	char line[SSH_BANNER_MAX_LENGTH + 1];
+	size_t length;   /* of the current line */
+	bool skipping;   /* the rest of an overlong line before the identification string */
+	size_t preamble; /* Bytes before the identification string */
+} ssh_banner;
+
+void ssh_banner_init(ssh_banner *banner);
+ssh_banner_status ssh_banner_feed(ssh_banner *banner, const char *data, size_t length);
@@ -2,6 +2,7 @@
 
 #include <stddef.h>
 #include "../../lib/monitoringplug.h"
+#include "./scan.h"
 
 const int default_ssh_port = 22;
 
@@ -11,6 +12,11 @@ typedef struct check_ssh_config {
 	char *remote_version;
 	char *remote_protocol;
 
+	/* With several hosts their servers are checked concurrently */
+	char **hosts;
+	size_t host_count;
+	size_t concurrency;
+
 	bool output_format_is_set;
 	mp_output_format output_format;
 } check_ssh_config;
@@ -22,6 +28,10 @@ check_ssh_config check_ssh_config_init(void) {
 		.remote_version = NULL,
 		.remote_protocol = NULL,
 
+		.hosts = NULL,
+		.host_count = 0,
+		.concurrency = SSH_SCAN_DEFAULT_CONCURRENCY,
+
 		.output_format_is_set = false,
 	};
 
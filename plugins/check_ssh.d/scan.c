@@ -0,0 +1,135 @@
+#include "./scan.h"
+#include "../common.h"
+#include "../netutils.h"
+#include "../../lib/utils_base.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef MSG_NOSIGNAL
+#	define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_DONTWAIT
+#	define MSG_DONTWAIT 0
+#endif
+
+void ssh_probe_init(ssh_probe *probe, const char *host, int port) {
+	memset(probe, 0, sizeof(*probe));
+	np_net_endpoint_init(&probe->endpoint, host, port, probe);
+	ssh_banner_init(&probe->banner);
+}
+
+bool ssh_probe_connected(const ssh_probe *probe) {
+	return probe->result == SSH_PROBE_OK || probe->result == SSH_PROBE_CLOSED ||
+		   probe->result == SSH_PROBE_INVALID ||
+		   (probe->result == SSH_PROBE_TIMEOUT && probe->endpoint.status == NP_NET_OK);
+}
+
+const char *ssh_probe_result_to_string(ssh_probe_result result) {
+	switch (result) {
+	case SSH_PROBE_OK:
+		return _("identification received");
+	case SSH_PROBE_UNRESOLVED:
+		return _("name could not be resolved");
+	case SSH_PROBE_REFUSED:
+		return _("connection refused");
+	case SSH_PROBE_FAILED:
+		return _("connection failed");
+	case SSH_PROBE_TIMEOUT:
+		return _("timed out");
+	case SSH_PROBE_CLOSED:
+		return _("No version control string received");
+	case SSH_PROBE_INVALID:
+		return _("Invalid protocol version control string");
+	}
+	return _("unknown");
+}
+
+static void finish(ssh_probe *probe, ssh_probe_result result) {
+	probe->result = result;
+	np_net_endpoint_close(&probe->endpoint);
+}
+
+static void ready(np_net_endpoint *endpoint, void *settings) {
+	(void)settings;
+	ssh_probe *probe = endpoint->data;
+	char buffer[1024];
+	ssize_t received = recv(endpoint->socket, buffer, sizeof(buffer), 0);
+	if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+		return;
+	}
+	if (received <= 0) {
+		finish(probe, SSH_PROBE_CLOSED);
+		return;
+	}
+
+	switch (ssh_banner_feed(&probe->banner, buffer, (size_t)received)) {
+	case SSH_BANNER_FOUND: {
+		/* answer like a client would, the server logs less noise than for a dropped connection */
+		char identification[SSH_BANNER_MAX_LENGTH + 1];
+		snprintf(identification, sizeof(identification), "SSH-%s-check_ssh_%s\r\n",
+				 probe->banner.protocol, VERSION);
+		send(endpoint->socket, identification, strlen(identification), MSG_DONTWAIT | MSG_NOSIGNAL);
+		finish(probe, SSH_PROBE_OK);
+	} break;
+	case SSH_BANNER_INVALID:
+		finish(probe, SSH_PROBE_INVALID);
+		break;
+	case SSH_BANNER_INCOMPLETE:
+		break;
+	}
+}
+
+/* The server speaks first, there is nothing to do but wait for it */
+static void connected(np_net_endpoint *endpoint, void *settings) {
+	(void)settings;
+	endpoint->events = POLLIN;
+}
+
+static void expired(np_net_endpoint *endpoint, void *settings) {
+	(void)settings;
+	finish(endpoint->data, SSH_PROBE_TIMEOUT);
+}
+
+static ssh_probe_result connect_result(np_net_status status) {
+	switch (status) {
+	case NP_NET_UNRESOLVED:
+		return SSH_PROBE_UNRESOLVED;
+	case NP_NET_REFUSED:
+		return SSH_PROBE_REFUSED;
+	case NP_NET_TIMEOUT:
+		return SSH_PROBE_TIMEOUT;
+	default:
+		return SSH_PROBE_FAILED;
+	}
+}
+
+/*
+ * Checks the SSH servers with at most concurrency of them in flight at the
+ * same time in the poll loop of np_net_endpoints_run, the identification
+ * string is parsed as its Bytes arrive.
+ */
+void ssh_scan(ssh_probe *probes, size_t number_of_probes, double timeout, size_t concurrency) {
+	np_net_endpoint **endpoints = calloc(number_of_probes, sizeof(np_net_endpoint *));
+	if (number_of_probes > 0 && endpoints == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	for (size_t i = 0; i < number_of_probes; i++) {
+		endpoints[i] = &probes[i].endpoint;
+	}
+
+	const np_net_protocol protocol = {
+		.connected = connected,
+		.ready = ready,
+		.expired = expired,
+	};
+	np_net_endpoints_run(endpoints, number_of_probes, timeout, concurrency, &protocol, NULL);
+
+	for (size_t i = 0; i < number_of_probes; i++) {
+		if (probes[i].endpoint.status != NP_NET_OK) {
+			probes[i].result = connect_result(probes[i].endpoint.status);
+		}
+	}
+	free(endpoints);
+}
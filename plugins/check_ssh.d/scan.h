@@ -0,0 +1,31 @@
+#pragma once
+/* Header file for checking the SSH servers of several hosts concurrently in scan.c */
+
+#include "../../config.h"
+#include "./banner.h"
+#include "../netutils.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SSH_SCAN_DEFAULT_CONCURRENCY 32
+
+typedef enum {
+	SSH_PROBE_OK,
+	SSH_PROBE_UNRESOLVED,
+	SSH_PROBE_REFUSED,
+	SSH_PROBE_FAILED, /* any other connection error, see endpoint.error */
+	SSH_PROBE_TIMEOUT,
+	SSH_PROBE_CLOSED, /* before the identification string */
+	SSH_PROBE_INVALID,
+} ssh_probe_result;
+
+typedef struct {
+	np_net_endpoint endpoint; /* host, port, address, error and times of the connection */
+	ssh_probe_result result;
+	ssh_banner banner;
+} ssh_probe;
+
+void ssh_probe_init(ssh_probe *probe, const char *host, int port);
+void ssh_scan(ssh_probe *probes, size_t number_of_probes, double timeout, size_t concurrency);
+bool ssh_probe_connected(const ssh_probe *probe);
+const char *ssh_probe_result_to_string(ssh_probe_result result);
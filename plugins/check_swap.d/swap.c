@@ -1,6 +1,7 @@
 #include "./check_swap.d/check_swap.h"
 #include "../popen.h"
 #include "../utils.h"
+#include "../../lib/utils_meminfo.h"
 #include "common.h"
 
 extern int verbose;
@@ -31,6 +32,20 @@ swap_result get_swap_data(swap_config config) {
 		printf("Reading PROC_MEMINFO at %s\n", PROC_MEMINFO);
 	}
 
+	if (config.allswaps && verbose) {
+		mp_swaps_result swaps = mp_swaps_read(MP_PROC_SWAPS);
+		for (size_t i = 0; swaps.errorcode == OK && i < swaps.count; i++) {
+			mp_swap_device *device = &swaps.devices[i];
+			if (device->size == 0) {
+				continue;
+			}
+			double percent = 100 * ((double)device->used / (double)device->size);
+			printf("[%s %" PRIu64 "MiB (%g%%)]", device->filename,
+				   (device->size - device->used) >> 20, 100 - percent);
+		}
+		mp_swaps_free(&swaps);
+	}
+
 	return getSwapFromProcMeminfo(PROC_MEMINFO);
 #else // HAVE_PROC_MEMINFO
 #	ifdef HAVE_SWAP
@@ -65,89 +80,49 @@ swap_result get_swap_data(swap_config config) {
 }
 
 swap_result getSwapFromProcMeminfo(char proc_meminfo[]) {
-	FILE *meminfo_file_ptr;
-	meminfo_file_ptr = fopen(proc_meminfo, "r");
-
 	swap_result result = {};
 	result.errorcode = STATE_UNKNOWN;
 
-	if (meminfo_file_ptr == NULL) {
-		// failed to open meminfo file
+	mp_meminfo_result meminfo_result = mp_meminfo_read(proc_meminfo);
+	if (meminfo_result.errorcode != OK) {
+		// failed to read meminfo file
 		// errno should contain an error
-		result.errorcode = STATE_UNKNOWN;
 		return result;
 	}
+	mp_meminfo *meminfo = &meminfo_result.meminfo;
 
-	unsigned long swap_total = 0;
-	unsigned long swap_used = 0;
-	unsigned long swap_free = 0;
-
-	bool found_total = false;
-	bool found_free = false;
-
-	char input_buffer[MAX_INPUT_BUFFER];
-	char str[32];
-
-	while (fgets(input_buffer, MAX_INPUT_BUFFER - 1, meminfo_file_ptr)) {
-
+	if (mp_meminfo_has(meminfo, MP_MEMINFO_SWAP_SUMMARY)) {
 		/*
-		 * The following sscanf call looks for a line looking like: "Swap: 123
-		 * 123 123" which exists on NetBSD (at least),
-		 * The unit should be Bytes
+		 * A line looking like "Swap: 123 123 123" exists on NetBSD (at least),
+		 * the unit should be Bytes. It takes precedence over the SwapTotal and
+		 * SwapFree lines if both exist.
 		 */
-		if (sscanf(input_buffer, "%*[S]%*[w]%*[a]%*[p]%*[:] %lu %lu %lu", &swap_total, &swap_used,
-				   &swap_free) == 3) {
-			found_total = true;
-			found_free = true;
-			// Set error
-			result.errorcode = STATE_OK;
-			// Break out of fgets here, since both scanf expressions might match (NetBSD for
-			// example)
-			break;
-		}
-
-		/*
-		 * The following sscanf call looks for lines looking like:
-		 * "SwapTotal: 123" and "SwapFree: 123" This format exists at least
-		 * on Debian Linux with a 5.* kernel
-		 */
-		unsigned long tmp_KB = 0;
-		int sscanf_result = sscanf(input_buffer,
-								   "%*[S]%*[w]%*[a]%*[p]%[TotalFreCchd]%*[:] %lu "
-								   "%*[k]%*[B]",
-								   str, &tmp_KB);
-
-		if (sscanf_result == 2) {
-
-			if (verbose >= 3) {
-				printf("Got %s with %lu\n", str, tmp_KB);
-			}
-
-			/* I think this part is always in Kb, so convert to bytes */
-			if (strcmp("Total", str) == 0) {
-				swap_total = tmp_KB * 1000;
-				found_total = true;
-			} else if (strcmp("Free", str) == 0) {
-				swap_free += tmp_KB * 1000;
-				found_free = true;
-			} else if (strcmp("Cached", str) == 0) {
-				swap_free += tmp_KB * 1000;
-			}
-
-			result.errorcode = STATE_OK;
-		}
+		result.metrics.total = meminfo->swap_summary_total;
+		result.metrics.free = meminfo->swap_summary_free;
+		result.metrics.used = meminfo->swap_summary_total - meminfo->swap_summary_free;
+		result.errorcode = STATE_OK;
+		return result;
 	}
 
-	fclose(meminfo_file_ptr);
-
-	result.metrics.total = swap_total;
-	result.metrics.free = swap_free;
-	result.metrics.used = swap_total - swap_free;
+	/*
+	 * "SwapTotal: 123 kB" and "SwapFree: 123 kB" exist at least on Linux,
+	 * the parser converts them to Bytes
+	 */
+	if (!mp_meminfo_has(meminfo, MP_MEMINFO_SWAP_TOTAL | MP_MEMINFO_SWAP_FREE)) {
+		return result;
+	}
 
-	if (!found_free || !found_total) {
-		result.errorcode = STATE_UNKNOWN;
+	if (verbose >= 3) {
+		printf("Got SwapTotal with %" PRIu64 ", SwapFree with %" PRIu64
+			   " and SwapCached with %" PRIu64 "\n",
+			   meminfo->swap_total, meminfo->swap_free, meminfo->swap_cached);
 	}
 
+	result.metrics.total = meminfo->swap_total;
+	result.metrics.free = meminfo->swap_free + meminfo->swap_cached;
+	result.metrics.used = result.metrics.total - result.metrics.free;
+	result.errorcode = STATE_OK;
+
 	return result;
 }
 
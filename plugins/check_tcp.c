@@ -43,22 +43,35 @@ const char *email = "devel@monitoring-plugins.org";
 #include <ctype.h>
 #include <sys/select.h>
 
-ssize_t my_recv(int socket_descriptor, char *buf, size_t len, bool use_tls) {
+/* tls_connection is NULL for plain TCP */
+ssize_t my_recv(int socket_descriptor, char *buf, size_t len,
+				struct np_net_ssl_connection *tls_connection) {
+	ssize_t result;
 #ifdef HAVE_SSL
-	if (use_tls) {
-		return np_net_ssl_read(buf, (int)len);
-	}
+	if (tls_connection != NULL) {
+		result = np_net_ssl_connection_read(tls_connection, buf, (int)len);
+	} else
 #endif
-	return read(socket_descriptor, buf, len);
+	{
+		result = read(socket_descriptor, buf, len);
+	}
+	np_net_timing_received(result);
+	return result;
 }
 
-ssize_t my_send(int socket_descriptor, char *buf, size_t len, bool use_tls) {
+ssize_t my_send(int socket_descriptor, char *buf, size_t len,
+				struct np_net_ssl_connection *tls_connection) {
+	ssize_t result;
 #ifdef HAVE_SSL
-	if (use_tls) {
-		return np_net_ssl_write(buf, (int)len);
-	}
+	if (tls_connection != NULL) {
+		result = np_net_ssl_connection_write(tls_connection, buf, (int)len);
+	} else
 #endif
-	return write(socket_descriptor, buf, len);
+	{
+		result = write(socket_descriptor, buf, len);
+	}
+	np_net_timing_sent(result);
+	return result;
 }
 
 typedef struct {
@@ -67,6 +80,7 @@ typedef struct {
 } check_tcp_config_wrapper;
 static check_tcp_config_wrapper process_arguments(int /*argc*/, char ** /*argv*/,
 												  check_tcp_config /*config*/);
+static mp_check check_endpoints(check_tcp_config /*config*/);
 void print_help(const char *service);
 void print_usage(void);
 
@@ -249,6 +263,10 @@ int main(int argc, char **argv) {
 		mp_set_format(config.output_format);
 	}
 
+	if (config.host_count * config.port_count > 1 || config.certificate_chain) {
+		mp_exit(check_endpoints(config));
+	}
+
 	mp_set_ok_summary(&overall, "Connection succeeded");
 
 	/* set up the timer */
@@ -260,6 +278,10 @@ int main(int argc, char **argv) {
 	gettimeofday(&start_time, NULL);
 
 	int socket_descriptor = 0;
+	struct np_net_ssl_connection *tls_connection = NULL;
+#ifdef HAVE_SSL
+	np_net_ssl_context *tls_context = NULL;
+#endif
 	mp_subcheck inital_connect_result = mp_subcheck_init();
 
 	// Try initial connection
@@ -276,22 +298,54 @@ int main(int argc, char **argv) {
 		inital_connect_result = mp_set_subcheck_state(inital_connect_result, STATE_OK);
 		xasprintf(&inital_connect_result.output, "Connection to %s on port %i was a SUCCESS",
 				  config.server_address, config.server_port);
+
+		/* the time of the connect is in the time_connect perfdata of the whole check */
+		if (connect_report.winner >= 0 && connect_report.number_of_attempts > 1) {
+			xasprintf(&inital_connect_result.output, "%s (via %s)", inital_connect_result.output,
+					  connect_report.attempts[connect_report.winner].address);
+		}
 		mp_add_subcheck_to_check(&overall, inital_connect_result);
 	}
 
+	if (verbosity > 0) {
+		for (size_t i = 0; i < connect_report.number_of_attempts; i++) {
+			const np_connect_attempt *attempt = &connect_report.attempts[i];
+			printf("Connection attempt to %s: %s after %.6fs", attempt->address,
+				   np_connect_attempt_status_to_string(attempt->status), attempt->latency);
+			if (attempt->error != 0) {
+				printf(" (%s)", strerror(attempt->error));
+			}
+			printf("\n");
+		}
+	}
+
 #ifdef HAVE_SSL
 	if (config.use_tls) {
 		mp_subcheck tls_connection_result = mp_subcheck_init();
-		mp_state_enum result = np_net_ssl_init_with_hostname(
-			socket_descriptor, (config.sni_specified ? config.sni : NULL));
+		mp_state_enum result = np_net_ssl_context_new(&tls_context, 0, NULL, NULL);
+		if (result == STATE_OK) {
+			tls_connection = np_net_ssl_connection_new(
+				tls_context, socket_descriptor, (config.sni_specified ? config.sni : NULL));
+			result = (tls_connection != NULL) ? STATE_OK : STATE_CRITICAL;
+		}
+		if (result == STATE_OK) {
+			/* the certificate of -D has to come from the server, not from the cache */
+			if (config.tls_session_cache && !config.check_cert) {
+				np_net_ssl_connection_cache_sessions(tls_connection, config.server_address,
+													 config.server_port);
+			}
+			result = np_net_ssl_handshake(tls_connection, socket_timeout);
+		}
 		tls_connection_result = mp_set_subcheck_default_state(tls_connection_result, result);
 
 		if (result == STATE_OK) {
-			xasprintf(&tls_connection_result.output, "TLS connection succeeded");
+			xasprintf(&tls_connection_result.output, "TLS connection succeeded%s",
+					  np_net_ssl_connection_reused(tls_connection) ? " (session resumed)" : "");
+			mp_net_ssl_connection_add_handshake_perfdata(tls_connection, &tls_connection_result);
 
 			if (config.check_cert) {
-				result =
-					np_net_ssl_check_cert(config.days_till_exp_warn, config.days_till_exp_crit);
+				result = np_net_ssl_connection_check_cert(tls_connection, config.days_till_exp_warn,
+														  config.days_till_exp_crit);
 
 				mp_subcheck tls_certificate_lifetime_result = mp_subcheck_init();
 				tls_certificate_lifetime_result =
@@ -322,10 +376,10 @@ int main(int argc, char **argv) {
 			xasprintf(&tls_connection_result.output, "TLS connection failed");
 			mp_add_subcheck_to_check(&overall, tls_connection_result);
 
+			np_net_ssl_connection_free(tls_connection);
 			if (socket_descriptor) {
 				close(socket_descriptor);
 			}
-			np_net_ssl_cleanup();
 
 			mp_exit(overall);
 		}
@@ -333,7 +387,7 @@ int main(int argc, char **argv) {
 #endif /* HAVE_SSL */
 
 	if (config.send != NULL) { /* Something to send? */
-		my_send(socket_descriptor, config.send, strlen(config.send), config.use_tls);
+		my_send(socket_descriptor, config.send, strlen(config.send), tls_connection);
 	}
 
 	if (config.delay > 0) {
@@ -356,34 +410,40 @@ int main(int argc, char **argv) {
 
 	/* if(len) later on, we know we have a non-NULL response */
 	ssize_t len = 0;
-	char *received_buffer = NULL;
+	char *received_buffer = NULL; /* only kept for the verbose output */
+	size_t received_buffer_size = 0;
 	enum np_match_result match = NP_MATCH_NONE;
 	mp_subcheck expected_data_result = mp_subcheck_init();
 
 	if (config.server_expect_count) {
 		ssize_t received = 0;
 		char buffer[MAXBUF];
+		np_expect_matcher matcher = np_expect_matcher_init(
+			config.server_expect, (int)config.server_expect_count, config.match_flags);
 
 		/* watch for the expect string */
-		while ((received = my_recv(socket_descriptor, buffer, sizeof(buffer), config.use_tls)) >
-			   0) {
-			received_buffer = realloc(received_buffer, len + received + 1);
-
-			if (received_buffer == NULL) {
-				die(STATE_UNKNOWN, _("Allocation failed"));
+		while ((received =
+					my_recv(socket_descriptor, buffer, sizeof(buffer), tls_connection)) > 0) {
+			if (verbosity > 0) {
+				if ((size_t)(len + received) >= received_buffer_size) {
+					received_buffer_size = 2 * (size_t)(len + received) + 1;
+					received_buffer = realloc(received_buffer, received_buffer_size);
+					if (received_buffer == NULL) {
+						die(STATE_UNKNOWN, _("Allocation failed"));
+					}
+				}
+				memcpy(&received_buffer[len], buffer, received);
+				received_buffer[len + received] = '\0';
 			}
-
-			memcpy(&received_buffer[len], buffer, received);
 			len += received;
-			received_buffer[len] = '\0';
 
 			/* stop reading if user-forced */
 			if (config.maxbytes && len >= config.maxbytes) {
 				break;
 			}
 
-			if ((match = np_expect_match(received_buffer, config.server_expect,
-										 config.server_expect_count, config.match_flags)) !=
+			/* only the new data is matched, the matcher remembers the state */
+			if ((match = np_expect_matcher_feed(&matcher, buffer, (size_t)received)) !=
 				NP_MATCH_RETRY) {
 				break;
 			}
@@ -401,6 +461,7 @@ int main(int argc, char **argv) {
 				break;
 			}
 		}
+		np_expect_matcher_free(&matcher);
 
 		if (match == NP_MATCH_RETRY) {
 			match = NP_MATCH_FAILURE;
@@ -419,22 +480,19 @@ int main(int argc, char **argv) {
 			printf("received %d bytes from host\n#-raw-recv-------#\n%s\n#-raw-recv-------#\n",
 				   (int)len + 1, received_buffer);
 		}
-		/* strip whitespace from end of output */
-		while (--len > 0 && isspace(received_buffer[len])) {
-			received_buffer[len] = '\0';
-		}
 	}
 
 	if (config.quit != NULL) {
-		my_send(socket_descriptor, config.quit, strlen(config.quit), config.use_tls);
+		my_send(socket_descriptor, config.quit, strlen(config.quit), tls_connection);
 	}
 
+#ifdef HAVE_SSL
+	np_net_ssl_connection_free(tls_connection);
+	np_net_ssl_context_free(tls_context);
+#endif
 	if (socket_descriptor) {
 		close(socket_descriptor);
 	}
-#ifdef HAVE_SSL
-	np_net_ssl_cleanup();
-#endif
 
 	long microsec = deltime(start_time);
 	double elapsed_time = (double)microsec / 1.0e6;
@@ -478,6 +536,8 @@ int main(int argc, char **argv) {
 	}
 
 	mp_add_perfdata_to_subcheck(&elapsed_time_result, time_pd);
+	np_net_timing_finish();
+	mp_net_add_timing_perfdata(&elapsed_time_result);
 	mp_add_subcheck_to_check(&overall, elapsed_time_result);
 
 	/* did we get the response we hoped? */
@@ -498,11 +558,216 @@ int main(int argc, char **argv) {
 	mp_exit(overall);
 }
 
+/*
+ * Probes every combination of the given hosts and ports concurrently, the
+ * results of the endpoints are collected in one subcheck whose state comes
+ * from the reachability thresholds if there are any.
+ */
+static mp_check check_endpoints(check_tcp_config config) {
+	size_t number_of_probes = config.host_count * config.port_count;
+	tcp_probe *probes = calloc(number_of_probes, sizeof(tcp_probe));
+	if (probes == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	for (size_t i = 0; i < config.host_count; i++) {
+		for (size_t j = 0; j < config.port_count; j++) {
+			tcp_probe_init(&probes[(i * config.port_count) + j], config.hosts[i], config.ports[j]);
+		}
+	}
+
+	tcp_probe_settings settings = {
+		.send = config.send,
+		.quit = config.quit,
+		.server_expect = config.server_expect,
+		.server_expect_count = (int)config.server_expect_count,
+		.match_flags = config.match_flags,
+		.maxbytes = config.maxbytes,
+		.timeout = socket_timeout,
+		.read_timeout = READ_TIMEOUT,
+		.concurrency = config.concurrency,
+	};
+#ifdef HAVE_SSL
+	if (config.use_tls) {
+		mp_state_enum result = np_net_ssl_context_new(&settings.tls_context, 0, NULL, NULL);
+		if (result != STATE_OK) {
+			exit(result);
+		}
+		settings.sni = config.sni_specified ? config.sni : NULL;
+		settings.tls_session_cache = config.tls_session_cache;
+		settings.handshake_only = config.certificate_chain;
+	}
+#endif
+	tcp_probe_run(probes, number_of_probes, settings);
+#ifdef HAVE_SSL
+	np_net_ssl_context_free(settings.tls_context);
+#endif
+
+	mp_check overall = mp_check_init();
+	mp_subcheck endpoints_result = mp_subcheck_init();
+	size_t reachable = 0;
+
+	for (size_t i = 0; i < number_of_probes; i++) {
+		const tcp_probe *probe = &probes[i];
+		const np_net_endpoint *endpoint = &probe->endpoint;
+		mp_subcheck endpoint_result = mp_subcheck_init();
+
+		switch (probe->result) {
+		case TCP_PROBE_OK:
+			if (config.critical_time_set && endpoint->total_time > config.critical_time) {
+				endpoint_result = mp_set_subcheck_state(endpoint_result, STATE_CRITICAL);
+			} else if (config.warning_time_set && endpoint->total_time > config.warning_time) {
+				endpoint_result = mp_set_subcheck_state(endpoint_result, STATE_WARNING);
+			} else {
+				endpoint_result = mp_set_subcheck_state(endpoint_result, STATE_OK);
+			}
+			break;
+		case TCP_PROBE_REFUSED:
+			endpoint_result = mp_set_subcheck_state(endpoint_result, config.econn_refuse_state);
+			break;
+		case TCP_PROBE_MISMATCH:
+			endpoint_result = mp_set_subcheck_state(endpoint_result, config.expect_mismatch_state);
+			break;
+		default:
+			endpoint_result = mp_set_subcheck_state(endpoint_result, STATE_CRITICAL);
+			break;
+		}
+
+		if (tcp_probe_reachable(probe)) {
+			reachable++;
+			xasprintf(&endpoint_result.output, "%s:%d: %s in %fs (%s)", endpoint->host,
+					  endpoint->port, tcp_probe_result_to_string(probe->result),
+					  endpoint->total_time, endpoint->address);
+			if (config.use_tls && probe->result != TCP_PROBE_TLS_FAILED) {
+				xasprintf(&endpoint_result.output, "%s, TLS handshake in %fs%s",
+						  endpoint_result.output, probe->handshake_time,
+						  probe->tls_resumed ? " (session resumed)" : "");
+			}
+
+			mp_perfdata time_pd = perfdata_init();
+			time_pd = mp_set_pd_value(time_pd, endpoint->total_time);
+			xasprintf(&time_pd.label, "%s:%d", endpoint->host, endpoint->port);
+			time_pd.uom = "s";
+			mp_add_perfdata_to_subcheck(&endpoint_result, time_pd);
+
+#ifdef HAVE_SSL
+			if (config.certificate_chain && probe->result == TCP_PROBE_OK) {
+				char *label_prefix = NULL;
+				xasprintf(&label_prefix, "%s:%d", endpoint->host, endpoint->port);
+				mp_subcheck chain_result =
+					mp_net_ssl_check_chain(&probe->chain, config.days_till_exp_warn,
+										   config.days_till_exp_crit, label_prefix);
+				endpoint_result = mp_set_subcheck_state(
+					endpoint_result, max_state(endpoint_result.state, chain_result.state));
+				mp_add_subcheck_to_subcheck(&endpoint_result, chain_result);
+			}
+#endif
+		} else if (probe->result == TCP_PROBE_FAILED) {
+			xasprintf(&endpoint_result.output, "%s:%d: %s (%s)", endpoint->host, endpoint->port,
+					  tcp_probe_result_to_string(probe->result), strerror(endpoint->error));
+		} else {
+			xasprintf(&endpoint_result.output, "%s:%d: %s", endpoint->host, endpoint->port,
+					  tcp_probe_result_to_string(probe->result));
+		}
+		mp_add_subcheck_to_subcheck(&endpoints_result, endpoint_result);
+	}
+
+	xasprintf(&endpoints_result.output, "%zu of %zu endpoints accepted the connection", reachable,
+			  number_of_probes);
+	mp_perfdata reachable_pd = perfdata_init();
+	reachable_pd = mp_set_pd_value(reachable_pd, reachable);
+	reachable_pd.label = "reachable";
+	reachable_pd = mp_set_pd_min_value(reachable_pd, mp_create_pd_value(0));
+	reachable_pd = mp_set_pd_max_value(reachable_pd, mp_create_pd_value(number_of_probes));
+	reachable_pd = mp_pd_set_thresholds(reachable_pd, config.reachable_thresholds);
+	if (config.reachable_thresholds.warning_is_set || config.reachable_thresholds.critical_is_set) {
+		endpoints_result = mp_set_subcheck_state(endpoints_result, mp_get_pd_status(reachable_pd));
+	}
+	mp_add_perfdata_to_subcheck(&endpoints_result, reachable_pd);
+	mp_add_subcheck_to_check(&overall, endpoints_result);
+	mp_set_summary(&overall, endpoints_result.output);
+
+#ifdef HAVE_SSL
+	for (size_t i = 0; i < number_of_probes; i++) {
+		np_net_ssl_chain_result_free(&probes[i].chain);
+	}
+#endif
+	free(probes);
+	return overall;
+}
+
+/*
+ * Sets the ports from a comma separated list of ports and port ranges like 8000-8010. A repeated
+ * -p replaces the ports like it always did, only a list selects several endpoints.
+ */
+static void set_ports(check_tcp_config *config, const char *list) {
+	char *copy = strdup(list);
+	if (copy == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	config->port_count = 0;
+
+	char *saveptr = NULL;
+	for (char *item = strtok_r(copy, ",", &saveptr); item != NULL;
+		 item = strtok_r(NULL, ",", &saveptr)) {
+		char *end;
+		long first = strtol(item, &end, 10);
+		long last = first;
+		if (*end == '-') {
+			last = strtol(end + 1, &end, 10);
+		}
+		if (end == item || *end != '\0' || first < 1 || last > 65535 || first > last) {
+			usage2(_("Port must be a positive integer or a range of them"), item);
+		}
+
+		for (long port = first; port <= last; port++) {
+			int *tmp = realloc(config->ports, (config->port_count + 1) * sizeof(int));
+			if (tmp == NULL) {
+				die(STATE_UNKNOWN, _("Allocation failed"));
+			}
+			config->ports = tmp;
+			config->ports[config->port_count++] = (int)port;
+		}
+	}
+	free(copy);
+	config->server_port = config->ports[0];
+}
+
+/* Sets the hosts from a comma separated list, a repeated -H replaces them like the ports */
+static void set_hosts(check_tcp_config *config, const char *list) {
+	char *copy = strdup(list);
+	if (copy == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	config->host_count = 0;
+
+	char *saveptr = NULL;
+	for (char *item = strtok_r(copy, ",", &saveptr); item != NULL;
+		 item = strtok_r(NULL, ",", &saveptr)) {
+		char **tmp = realloc(config->hosts, (config->host_count + 1) * sizeof(char *));
+		if (tmp == NULL) {
+			die(STATE_UNKNOWN, _("Allocation failed"));
+		}
+		config->hosts = tmp;
+		config->hosts[config->host_count++] = item;
+	}
+	if (config->host_count == 0) {
+		usage2(_("Invalid hostname, address or socket"), list);
+	}
+	config->server_address = config->hosts[0];
+}
+
 /* process command-line arguments */
 static check_tcp_config_wrapper process_arguments(int argc, char **argv, check_tcp_config config) {
 	enum {
 		SNI_OPTION = CHAR_MAX + 1,
 		output_format_index,
+		CONNECTION_ATTEMPT_DELAY_OPTION,
+		SEQUENTIAL_CONNECT_OPTION,
+		CONCURRENCY_OPTION,
+		WARNING_REACHABLE_OPTION,
+		CRITICAL_REACHABLE_OPTION,
+		TLS_SESSION_CACHE_OPTION,
+		CERTIFICATE_CHAIN_OPTION,
 	};
 
 	static struct option longopts[] = {
@@ -533,6 +798,13 @@ static check_tcp_config_wrapper process_arguments(int argc, char **argv, check_t
 		{"sni", required_argument, 0, SNI_OPTION},
 		{"certificate", required_argument, 0, 'D'},
 		{"output-format", required_argument, 0, output_format_index},
+		{"connection-attempt-delay", required_argument, 0, CONNECTION_ATTEMPT_DELAY_OPTION},
+		{"sequential-connect", no_argument, 0, SEQUENTIAL_CONNECT_OPTION},
+		{"concurrency", required_argument, 0, CONCURRENCY_OPTION},
+		{"warning-reachable", required_argument, 0, WARNING_REACHABLE_OPTION},
+		{"critical-reachable", required_argument, 0, CRITICAL_REACHABLE_OPTION},
+		{"tls-session-cache", no_argument, 0, TLS_SESSION_CACHE_OPTION},
+		{"certificate-chain", no_argument, 0, CERTIFICATE_CHAIN_OPTION},
 		{0, 0, 0, 0}};
 
 	if (argc < 2) {
@@ -587,9 +859,9 @@ static check_tcp_config_wrapper process_arguments(int argc, char **argv, check_t
 		case '6': // Apparently unused TODO
 			address_family = AF_INET6;
 			break;
-		case 'H': /* hostname */
+		case 'H': /* hostname or list of them */
 			config.host_specified = true;
-			config.server_address = optarg;
+			set_hosts(&config, optarg);
 			break;
 		case 'c': /* critical */
 			config.critical_time = strtod(optarg, NULL);
@@ -609,12 +881,8 @@ static check_tcp_config_wrapper process_arguments(int argc, char **argv, check_t
 				socket_timeout = atoi(optarg);
 			}
 			break;
-		case 'p': /* port */
-			if (!is_intpos(optarg)) {
-				usage4(_("Port must be a positive integer"));
-			} else {
-				config.server_port = atoi(optarg);
-			}
+		case 'p': /* port, list of ports or port ranges */
+			set_ports(&config, optarg);
 			break;
 		case 'E':
 			escape = true;
@@ -727,11 +995,57 @@ static check_tcp_config_wrapper process_arguments(int argc, char **argv, check_t
 			config.sni = optarg;
 #else
 			die(STATE_UNKNOWN, _("Invalid option - SSL is not available"));
+#endif
+			break;
+		case TLS_SESSION_CACHE_OPTION:
+#ifdef HAVE_SSL
+			config.tls_session_cache = true;
+#else
+			die(STATE_UNKNOWN, _("Invalid option - SSL is not available"));
+#endif
+			break;
+		case CERTIFICATE_CHAIN_OPTION:
+#ifdef MOPL_USE_OPENSSL
+			config.certificate_chain = true;
+			config.use_tls = true;
+#else
+			die(STATE_UNKNOWN, _("Invalid option - SSL is not available"));
 #endif
 			break;
 		case 'A':
 			config.match_flags |= NP_MATCH_ALL;
 			break;
+		case CONNECTION_ATTEMPT_DELAY_OPTION:
+			if (!is_nonnegative(optarg)) {
+				usage2(_("Connection attempt delay must be a non-negative number"), optarg);
+			}
+			connection_attempt_delay = strtod(optarg, NULL);
+			break;
+		case SEQUENTIAL_CONNECT_OPTION:
+			sequential_connect = true;
+			break;
+		case CONCURRENCY_OPTION:
+			if (!is_intpos(optarg)) {
+				usage2(_("Concurrency must be a positive integer"), optarg);
+			}
+			config.concurrency = (size_t)atoi(optarg);
+			break;
+		case WARNING_REACHABLE_OPTION: {
+			mp_range_parsed tmp = mp_parse_range_string(optarg);
+			if (tmp.error != MP_PARSING_SUCCESS) {
+				die(STATE_UNKNOWN, "failed to parse warning reachable threshold");
+			}
+			config.reachable_thresholds =
+				mp_thresholds_set_warn(config.reachable_thresholds, tmp.range);
+		} break;
+		case CRITICAL_REACHABLE_OPTION: {
+			mp_range_parsed tmp = mp_parse_range_string(optarg);
+			if (tmp.error != MP_PARSING_SUCCESS) {
+				die(STATE_UNKNOWN, "failed to parse critical reachable threshold");
+			}
+			config.reachable_thresholds =
+				mp_thresholds_set_crit(config.reachable_thresholds, tmp.range);
+		} break;
 		case output_format_index: {
 			parsed_output_format parser = mp_parse_output_format(optarg);
 			if (!parser.parsing_success) {
@@ -754,9 +1068,44 @@ static check_tcp_config_wrapper process_arguments(int argc, char **argv, check_t
 
 	if (config.server_address == NULL) {
 		usage4(_("You must provide a server address"));
-	} else if (config.server_address[0] != '/' && !is_host(config.server_address)) {
-		die(STATE_CRITICAL, "%s %s - %s: %s\n", config.service, state_text(STATE_CRITICAL),
-			_("Invalid hostname, address or socket"), config.server_address);
+	}
+	if (config.host_count == 0) {
+		set_hosts(&config, config.server_address);
+	}
+	if (config.port_count == 0) {
+		config.ports = malloc(sizeof(int));
+		if (config.ports == NULL) {
+			die(STATE_UNKNOWN, _("Allocation failed"));
+		}
+		config.ports[0] = config.server_port;
+		config.port_count = 1;
+	}
+
+	for (size_t i = 0; i < config.host_count; i++) {
+		if (config.hosts[i][0] != '/' && !is_host(config.hosts[i])) {
+			die(STATE_CRITICAL, "%s %s - %s: %s\n", config.service, state_text(STATE_CRITICAL),
+				_("Invalid hostname, address or socket"), config.hosts[i]);
+		}
+	}
+
+	bool several_endpoints = config.host_count * config.port_count > 1;
+#ifdef HAVE_SSL
+	if (config.certificate_chain && !config.check_cert) {
+		usage4(_("--certificate-chain needs the days of -D"));
+	}
+	if (several_endpoints && config.check_cert && !config.certificate_chain) {
+		usage4(_("Certificates of several hosts or ports need --certificate-chain"));
+	}
+#endif
+	if (several_endpoints || config.certificate_chain) {
+		if (config.protocol != IPPROTO_TCP || config.delay > 0) {
+			usage4(_("Several hosts or ports need TCP without a delay"));
+		}
+		for (size_t i = 0; i < config.host_count; i++) {
+			if (config.hosts[i][0] == '/') {
+				usage4(_("Several hosts or ports can not be checked on a unix socket"));
+			}
+		}
 	}
 
 	check_tcp_config_wrapper result = {
@@ -781,9 +1130,28 @@ void print_help(const char *service) {
 	printf(UT_EXTRA_OPTS);
 
 	printf(UT_HOST_PORT, 'p', "none");
+	printf("    %s\n", _("Hostname and port may be comma separated lists, ports also with ranges"));
+	printf("    %s\n", _("like 22,80,8000-8010, every combination is then probed concurrently."));
+	printf("    %s\n", _("Repeating -H or -p replaces the earlier value"));
+	printf(" %s\n", "--concurrency=INTEGER");
+	printf("    %s %d)\n", _("Number of endpoints probed at the same time (default:"),
+		   TCP_PROBE_DEFAULT_CONCURRENCY);
+	printf(" %s\n", "--warning-reachable=RANGE");
+	printf("    %s\n", _("Warning if the number of endpoints which accepted the connection is"));
+	printf("    %s\n", _("outside of RANGE, e.g. 180: for at least 180 of them"));
+	printf(" %s\n", "--critical-reachable=RANGE");
+	printf("    %s\n", _("Critical if the number of endpoints which accepted the connection is"));
+	printf("    %s\n", _("outside of RANGE"));
 
 	printf(UT_IPv46);
 
+	printf(" %s\n", "--connection-attempt-delay=SECONDS");
+	printf("    %s\n", _("Seconds to wait for a connection before the next address of the host"));
+	printf("    %s\n", _("is tried in parallel, alternating between IPv6 and IPv4 (RFC 8305)"));
+	printf("    %s %.2f)\n", _("(default:"), NP_CONNECTION_ATTEMPT_DELAY);
+	printf(" %s\n", "--sequential-connect");
+	printf("    %s\n", _("Try the addresses of the host one after another until one accepts"));
+
 	printf(" %s\n", "-E, --escape");
 	printf("    %s\n", _("Can use \\n, \\r, \\t or \\\\ in send or quit string. Must come before "
 						 "send or quit option"));
@@ -816,6 +1184,13 @@ void print_help(const char *service) {
 	printf("    %s\n", _("Use SSL for the connection."));
 	printf(" %s\n", "--sni=STRING");
 	printf("    %s\n", _("SSL server_name"));
+	printf(" %s\n", "--tls-session-cache");
+	printf("    %s\n", _("Keep the TLS session in the state directory and resume it next time"));
+	printf("    %s\n", _("No cached session is offered with -D or --certificate-chain"));
+	printf(" %s\n", "--certificate-chain");
+	printf("    %s\n", _("Check the days of -D for every certificate of the chain, right"));
+	printf("    %s\n", _("after the TLS handshake without sending or expecting anything."));
+	printf("    %s\n", _("Several hosts and ports are checked concurrently"));
 #endif
 
 	printf(UT_WARN_CRIT);
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "../../lib/utils_tcp.h"
+#include "./probe.h"
 #include "output.h"
 #include "states.h"
+#include "thresholds.h"
 #include <netinet/in.h>
 
 typedef struct {
@@ -10,6 +12,14 @@ typedef struct {
 	bool host_specified;
 	int server_port; // TODO can this be a uint16?
 
+	/* With several hosts or ports every combination is probed concurrently */
+	char **hosts;
+	size_t host_count;
+	int *ports;
+	size_t port_count;
+	size_t concurrency;
+	mp_thresholds reachable_thresholds;
+
 	int protocol; /* most common is default */
 	char *service;
 	char *send;
@@ -23,7 +33,9 @@ typedef struct {
 	bool check_cert;
 	int days_till_exp_warn;
 	int days_till_exp_crit;
+	bool tls_session_cache;
 #endif // HAVE_SSL
+	bool certificate_chain; /* only the handshake and every certificate of the chain */
 	int match_flags;
 	mp_state_enum expect_mismatch_state;
 	unsigned int delay;
@@ -49,6 +61,13 @@ check_tcp_config check_tcp_config_init() {
 		.host_specified = false,
 		.server_port = 0,
 
+		.hosts = NULL,
+		.host_count = 0,
+		.ports = NULL,
+		.port_count = 0,
+		.concurrency = TCP_PROBE_DEFAULT_CONCURRENCY,
+		.reachable_thresholds = mp_thresholds_init(),
+
 		.protocol = IPPROTO_TCP,
 		.service = "TCP",
 		.send = NULL,
@@ -62,7 +81,9 @@ check_tcp_config check_tcp_config_init() {
 		.check_cert = false,
 		.days_till_exp_warn = 0,
 		.days_till_exp_crit = 0,
+		.tls_session_cache = false,
 #endif // HAVE_SSL
+		.certificate_chain = false,
 		.match_flags = NP_MATCH_EXACT,
 		.expect_mismatch_state = STATE_WARNING,
 		.delay = 0,
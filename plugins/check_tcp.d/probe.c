@@ -0,0 +1,374 @@
+#include "./probe.h"
+#include "../common.h"
+#include "../netutils.h"
+#include "../../lib/utils_base.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef MSG_NOSIGNAL
+#	define MSG_NOSIGNAL 0
+#endif
+
+static double now(void) {
+	struct timespec current;
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return (double)current.tv_sec + ((double)current.tv_nsec / 1e9);
+}
+
+void tcp_probe_init(tcp_probe *probe, const char *host, int port) {
+	memset(probe, 0, sizeof(*probe));
+	np_net_endpoint_init(&probe->endpoint, host, port, probe);
+	probe->phase = TCP_PROBE_CONNECTING;
+#ifdef HAVE_SSL
+	probe->chain.errorcode = ERROR;
+#endif
+}
+
+bool tcp_probe_reachable(const tcp_probe *probe) {
+	return probe->result == TCP_PROBE_OK || probe->result == TCP_PROBE_NO_DATA ||
+		   probe->result == TCP_PROBE_MISMATCH || probe->result == TCP_PROBE_TLS_FAILED;
+}
+
+const char *tcp_probe_result_to_string(tcp_probe_result result) {
+	switch (result) {
+	case TCP_PROBE_OK:
+		return _("connected");
+	case TCP_PROBE_UNRESOLVED:
+		return _("name could not be resolved");
+	case TCP_PROBE_REFUSED:
+		return _("connection refused");
+	case TCP_PROBE_FAILED:
+		return _("connection failed");
+	case TCP_PROBE_TIMEOUT:
+		return _("timed out");
+	case TCP_PROBE_NO_DATA:
+		return _("no data received");
+	case TCP_PROBE_MISMATCH:
+		return _("answer did not match");
+	case TCP_PROBE_TLS_FAILED:
+		return _("TLS handshake failed");
+	}
+	return _("unknown");
+}
+
+static ssize_t probe_send(tcp_probe *probe, const char *buffer, size_t length) {
+#ifdef HAVE_SSL
+	if (probe->tls_connection != NULL) {
+		return np_net_ssl_connection_write(probe->tls_connection, buffer, (int)length);
+	}
+#endif
+	return send(probe->endpoint.socket, buffer, length, MSG_NOSIGNAL);
+}
+
+static ssize_t probe_recv(tcp_probe *probe, char *buffer, size_t size) {
+#ifdef HAVE_SSL
+	if (probe->tls_connection != NULL) {
+		return np_net_ssl_connection_read(probe->tls_connection, buffer, (int)size);
+	}
+#endif
+	return recv(probe->endpoint.socket, buffer, size, 0);
+}
+
+/* Closes the connection of a finished probe */
+static void release(tcp_probe *probe) {
+#ifdef HAVE_SSL
+	np_net_ssl_connection_free(probe->tls_connection);
+	probe->tls_connection = NULL;
+#endif
+	np_net_endpoint_close(&probe->endpoint);
+	probe->phase = TCP_PROBE_DONE;
+}
+
+/*
+ * The result is final here. A TLS session ticket which has not arrived yet
+ * is awaited in the draining phase along with the other probes, instead of
+ * the blocking wait of np_net_ssl_connection_free.
+ */
+static void finish(tcp_probe *probe, tcp_probe_result result, const tcp_probe_settings *settings) {
+	if (settings->quit != NULL && probe->phase == TCP_PROBE_RECEIVING) {
+		probe_send(probe, settings->quit, strlen(settings->quit));
+	}
+	if (probe->matching) {
+		np_expect_matcher_free(&probe->matcher);
+		probe->matching = false;
+	}
+	probe->result = result;
+	np_net_endpoint_finish(&probe->endpoint);
+
+#ifdef HAVE_SSL
+	if (probe->tls_connection != NULL && settings->tls_session_cache &&
+		np_net_ssl_connection_ticket_pending(probe->tls_connection)) {
+		probe->phase = TCP_PROBE_DRAINING;
+		probe->drain_start = now();
+		return;
+	}
+#endif
+	release(probe);
+}
+
+#ifdef HAVE_SSL
+static void handle_draining(tcp_probe *probe) {
+	if (!np_net_ssl_connection_ticket_pending(probe->tls_connection)) {
+		release(probe);
+	}
+}
+#endif
+
+static void handle_writable(tcp_probe *probe, const tcp_probe_settings *settings);
+
+/* Moves on to the response, or is done if there is nothing to wait for */
+static void start_receiving(tcp_probe *probe, const tcp_probe_settings *settings) {
+	probe->phase = TCP_PROBE_RECEIVING;
+	if (settings->server_expect_count == 0) {
+		finish(probe, TCP_PROBE_OK, settings);
+		return;
+	}
+	probe->matcher = np_expect_matcher_init(settings->server_expect, settings->server_expect_count,
+											settings->match_flags & ~NP_MATCH_VERBOSE);
+	probe->matching = true;
+}
+
+static void start_sending(tcp_probe *probe, const tcp_probe_settings *settings) {
+	probe->last_activity = now();
+	if (settings->send == NULL) {
+		start_receiving(probe, settings);
+	} else {
+		probe->phase = TCP_PROBE_SENDING;
+		handle_writable(probe, settings);
+	}
+}
+
+#ifdef HAVE_SSL
+static void handle_handshake(tcp_probe *probe, const tcp_probe_settings *settings) {
+	switch (np_net_ssl_handshake_step(probe->tls_connection)) {
+	case NP_SSL_HANDSHAKE_DONE:
+		probe->handshake_time = np_net_ssl_connection_handshake_time(probe->tls_connection);
+		probe->tls_resumed = np_net_ssl_connection_reused(probe->tls_connection);
+		if (settings->handshake_only) {
+			probe->chain = np_net_ssl_connection_check_chain(probe->tls_connection);
+			finish(probe, TCP_PROBE_OK, settings);
+		} else {
+			start_sending(probe, settings);
+		}
+		break;
+	case NP_SSL_HANDSHAKE_WANT_READ:
+		probe->endpoint.events = POLLIN;
+		break;
+	case NP_SSL_HANDSHAKE_WANT_WRITE:
+		probe->endpoint.events = POLLOUT;
+		break;
+	case NP_SSL_HANDSHAKE_FAILED:
+		probe->handshake_time = np_net_ssl_connection_handshake_time(probe->tls_connection);
+		finish(probe, TCP_PROBE_TLS_FAILED, settings);
+		break;
+	}
+}
+
+static void start_handshake(tcp_probe *probe, const tcp_probe_settings *settings) {
+	probe->phase = TCP_PROBE_HANDSHAKING;
+	probe->tls_connection =
+		np_net_ssl_connection_new(settings->tls_context, probe->endpoint.socket, settings->sni);
+	if (probe->tls_connection == NULL) {
+		finish(probe, TCP_PROBE_TLS_FAILED, settings);
+		return;
+	}
+	/* a resumed session has no peer chain to inspect */
+	if (settings->tls_session_cache && !settings->handshake_only) {
+		np_net_ssl_connection_cache_sessions(probe->tls_connection, probe->endpoint.host,
+											 probe->endpoint.port);
+	}
+	handle_handshake(probe, settings);
+}
+#endif
+
+static void handle_writable(tcp_probe *probe, const tcp_probe_settings *settings) {
+	size_t length = strlen(settings->send);
+	ssize_t sent = probe_send(probe, settings->send + probe->sent, length - probe->sent);
+	if (sent < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			probe->endpoint.error = errno;
+			finish(probe, TCP_PROBE_FAILED, settings);
+		}
+		return;
+	}
+	probe->sent += (size_t)sent;
+	if (probe->sent == length) {
+		start_receiving(probe, settings);
+	}
+}
+
+/* Returns false if there was nothing to read */
+static bool receive(tcp_probe *probe, const tcp_probe_settings *settings) {
+	char buffer[1024];
+	ssize_t received = probe_recv(probe, buffer, sizeof(buffer));
+	if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+		return false;
+	}
+	if (received <= 0) {
+		finish(probe, (probe->received == 0) ? TCP_PROBE_NO_DATA : TCP_PROBE_MISMATCH, settings);
+		return false;
+	}
+
+	probe->received += (size_t)received;
+	probe->last_activity = now();
+
+	/* only the new data is matched, the matcher remembers the state */
+	enum np_match_result match = np_expect_matcher_feed(&probe->matcher, buffer, (size_t)received);
+	if (match == NP_MATCH_SUCCESS) {
+		finish(probe, TCP_PROBE_OK, settings);
+	} else if (match == NP_MATCH_FAILURE ||
+			   (settings->maxbytes && probe->received >= (size_t)settings->maxbytes)) {
+		finish(probe, TCP_PROBE_MISMATCH, settings);
+	}
+	return true;
+}
+
+static void handle_readable(tcp_probe *probe, const tcp_probe_settings *settings) {
+	/* a TLS session may hold more decrypted data than one read takes, poll does not see it */
+	while (receive(probe, settings)) {
+		if (probe->tls_connection == NULL || probe->phase != TCP_PROBE_RECEIVING) {
+			break;
+		}
+	}
+}
+
+/* Ends probes which waited too long, a quiet server is a mismatch like in the single check */
+static void check_deadlines(tcp_probe *probe, const tcp_probe_settings *settings) {
+	double current = now();
+#ifdef HAVE_SSL
+	if (probe->phase == TCP_PROBE_DRAINING) {
+		if (current >= probe->drain_start + (NP_SSL_TICKET_WAIT / 1000.0) ||
+			current >= probe->endpoint.end_time) {
+			np_net_ssl_connection_abandon_ticket(probe->tls_connection);
+			release(probe);
+		}
+		return;
+	}
+#endif
+	if (probe->phase == TCP_PROBE_RECEIVING &&
+		current >= probe->last_activity + settings->read_timeout) {
+		finish(probe, (probe->received == 0) ? TCP_PROBE_NO_DATA : TCP_PROBE_MISMATCH, settings);
+	} else if (probe->phase != TCP_PROBE_DONE && current >= probe->endpoint.end_time) {
+		finish(probe, TCP_PROBE_TIMEOUT, settings);
+	}
+}
+
+static double next_deadline(const tcp_probe *probe, const tcp_probe_settings *settings) {
+	double deadline = probe->endpoint.end_time;
+#ifdef HAVE_SSL
+	if (probe->phase == TCP_PROBE_DRAINING) {
+		if (probe->drain_start + (NP_SSL_TICKET_WAIT / 1000.0) < deadline) {
+			deadline = probe->drain_start + (NP_SSL_TICKET_WAIT / 1000.0);
+		}
+		return deadline;
+	}
+#endif
+	if (probe->phase == TCP_PROBE_RECEIVING &&
+		probe->last_activity + settings->read_timeout < deadline) {
+		deadline = probe->last_activity + settings->read_timeout;
+	}
+	return deadline;
+}
+
+/* The protocol of the probes for np_net_endpoints_run, the deadline follows every step */
+static void schedule(tcp_probe *probe, const tcp_probe_settings *settings) {
+	if (probe->phase == TCP_PROBE_SENDING) {
+		probe->endpoint.events = POLLOUT;
+	} else if (probe->phase == TCP_PROBE_RECEIVING || probe->phase == TCP_PROBE_DRAINING) {
+		probe->endpoint.events = POLLIN;
+	}
+	probe->endpoint.deadline = next_deadline(probe, settings);
+}
+
+static void connected(np_net_endpoint *endpoint, void *data) {
+	tcp_probe *probe = endpoint->data;
+	const tcp_probe_settings *settings = data;
+#ifdef HAVE_SSL
+	if (settings->tls_context != NULL) {
+		start_handshake(probe, settings);
+		schedule(probe, settings);
+		return;
+	}
+#endif
+	start_sending(probe, settings);
+	schedule(probe, settings);
+}
+
+static void ready(np_net_endpoint *endpoint, void *data) {
+	tcp_probe *probe = endpoint->data;
+	const tcp_probe_settings *settings = data;
+	switch (probe->phase) {
+#ifdef HAVE_SSL
+	case TCP_PROBE_HANDSHAKING:
+		handle_handshake(probe, settings);
+		break;
+	case TCP_PROBE_DRAINING:
+		handle_draining(probe);
+		break;
+#endif
+	case TCP_PROBE_SENDING:
+		handle_writable(probe, settings);
+		break;
+	case TCP_PROBE_RECEIVING:
+		handle_readable(probe, settings);
+		break;
+	default:
+		break;
+	}
+	schedule(probe, settings);
+}
+
+static void expired(np_net_endpoint *endpoint, void *data) {
+	tcp_probe *probe = endpoint->data;
+	const tcp_probe_settings *settings = data;
+	check_deadlines(probe, settings);
+	schedule(probe, settings);
+}
+
+static tcp_probe_result connect_result(np_net_status status) {
+	switch (status) {
+	case NP_NET_UNRESOLVED:
+		return TCP_PROBE_UNRESOLVED;
+	case NP_NET_REFUSED:
+		return TCP_PROBE_REFUSED;
+	case NP_NET_TIMEOUT:
+		return TCP_PROBE_TIMEOUT;
+	default:
+		return TCP_PROBE_FAILED;
+	}
+}
+
+/*
+ * Runs all probes with at most settings.concurrency of them in flight at the
+ * same time in the poll loop of np_net_endpoints_run: the connects, TLS
+ * handshakes, sends and receives are non-blocking, a finished probe makes
+ * room for the next waiting one.
+ */
+void tcp_probe_run(tcp_probe *probes, size_t number_of_probes, tcp_probe_settings settings) {
+	np_net_endpoint **endpoints = calloc(number_of_probes, sizeof(np_net_endpoint *));
+	if (number_of_probes > 0 && endpoints == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	for (size_t i = 0; i < number_of_probes; i++) {
+		endpoints[i] = &probes[i].endpoint;
+	}
+
+	const np_net_protocol protocol = {
+		.connected = connected,
+		.ready = ready,
+		.expired = expired,
+	};
+	np_net_endpoints_run(endpoints, number_of_probes, settings.timeout, settings.concurrency,
+						 &protocol, &settings);
+
+	for (size_t i = 0; i < number_of_probes; i++) {
+		if (probes[i].endpoint.status != NP_NET_OK) {
+			probes[i].result = connect_result(probes[i].endpoint.status);
+			probes[i].phase = TCP_PROBE_DONE;
+		}
+	}
+	free(endpoints);
+}
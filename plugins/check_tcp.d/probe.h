@@ -0,0 +1,74 @@
+#pragma once
+/* Header file for the concurrent probing of several endpoints in probe.c */
+
+#include "../../config.h"
+#include "../../lib/utils_tcp.h"
+#include "../netutils.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define TCP_PROBE_DEFAULT_CONCURRENCY 32
+
+typedef enum {
+	TCP_PROBE_CONNECTING,  /* left to the endpoint */
+	TCP_PROBE_HANDSHAKING, /* TLS */
+	TCP_PROBE_SENDING,
+	TCP_PROBE_RECEIVING,
+	TCP_PROBE_DRAINING, /* finished, but waiting for the TLS session ticket to cache it */
+	TCP_PROBE_DONE,
+} tcp_probe_phase;
+
+typedef enum {
+	TCP_PROBE_OK,
+	TCP_PROBE_UNRESOLVED,
+	TCP_PROBE_REFUSED,
+	TCP_PROBE_FAILED, /* any other connection error, see endpoint.error */
+	TCP_PROBE_TIMEOUT,
+	TCP_PROBE_NO_DATA,
+	TCP_PROBE_MISMATCH,
+	TCP_PROBE_TLS_FAILED,
+} tcp_probe_result;
+
+typedef struct {
+	np_net_endpoint endpoint; /* host, port, address, error and times of the connection */
+	tcp_probe_phase phase;
+	tcp_probe_result result;
+	double handshake_time; /* seconds of the TLS handshake */
+	bool tls_resumed;      /* the TLS session was resumed from the cache */
+	size_t received;       /* Bytes of the response */
+#ifdef HAVE_SSL
+	np_net_ssl_chain_result chain; /* with handshake_only */
+#endif
+
+	/* State of the probe while it runs */
+	struct np_net_ssl_connection *tls_connection;
+	double last_activity;
+	double drain_start;
+	size_t sent;
+	bool matching;
+	np_expect_matcher matcher;
+} tcp_probe;
+
+typedef struct {
+	const char *send;
+	const char *quit;
+	char **server_expect;
+	int server_expect_count;
+	int match_flags;
+	ssize_t maxbytes;
+
+	struct np_net_ssl_context *tls_context; /* NULL for plain TCP */
+	const char *sni;
+	bool tls_session_cache;
+	bool handshake_only; /* inspect the certificate chain and hang up */
+
+	double timeout;      /* for a whole probe */
+	double read_timeout; /* to wait for further data of the response */
+	size_t concurrency;  /* probes running at the same time */
+} tcp_probe_settings;
+
+void tcp_probe_init(tcp_probe *probe, const char *host, int port);
+void tcp_probe_run(tcp_probe *probes, size_t number_of_probes, tcp_probe_settings settings);
+bool tcp_probe_reachable(const tcp_probe *probe);
+const char *tcp_probe_result_to_string(tcp_probe_result result);
@@ -47,6 +47,32 @@ typedef struct {
 static check_time_config_wrapper process_arguments(int /*argc*/, char ** /*argv*/);
 static void print_help(void);
 void print_usage(void);
+static void timeout_exit(np_net_phase /*phase*/) __attribute__((noreturn));
+
+static void timeout_exit(np_net_phase phase) {
+	die(socket_timeout_state, _("TIME %s - Socket timeout after %d seconds during the %s\n"),
+		state_text(socket_timeout_state), socket_timeout, np_net_phase_to_string(phase));
+}
+
+/* the phases of the connection to the time server */
+static char *timing_perfdata(void) {
+	char *result = NULL;
+	xasprintf(&result, "%s %s", fperfdata("time_resolve", net_timing.resolve_time, "s", false, 0,
+										   false, 0, true, 0, false, 0),
+			  fperfdata("time_connect", net_timing.connect_time, "s", false, 0, false, 0, true, 0,
+						false, 0));
+	if (net_timing.first_byte_time >= 0) {
+		xasprintf(&result, "%s %s", result,
+				  fperfdata("time_firstbyte", net_timing.first_byte_time, "s", false, 0, false, 0,
+							true, 0, false, 0));
+	}
+	xasprintf(&result, "%s %s %s", result,
+			  perfdata_uint64("bytes_sent", net_timing.bytes_sent, "B", false, 0, false, 0, true,
+							  0, false, 0),
+			  perfdata_uint64("bytes_received", net_timing.bytes_received, "B", false, 0, false, 0,
+							  true, 0, false, 0));
+	return result;
+}
 
 int main(int argc, char **argv) {
 	setlocale(LC_ALL, "");
@@ -63,24 +89,26 @@ int main(int argc, char **argv) {
 
 	const check_time_config config = tmp_config.config;
 
-	/* initialize alarm signal handling */
+	/* initialize alarm signal handling, getaddrinfo has no deadline of its own */
 	signal(SIGALRM, socket_timeout_alarm_handler);
+	alarm(socket_timeout + 1);
 
-	/* set socket timeout */
-	alarm(socket_timeout);
+	/* every step waits until the same deadline */
+	double deadline = np_net_deadline(socket_timeout);
 	time_t start_time;
 	time(&start_time);
 
 	int socket;
 	mp_state_enum result = STATE_UNKNOWN;
 	/* try to connect to the host at the given port number */
-	if (config.use_udp) {
-		result = my_udp_connect(config.server_address, config.server_port, &socket);
-	} else {
-		result = my_tcp_connect(config.server_address, config.server_port, &socket);
+	np_net_io_result io_result =
+		np_net_connect_until(config.server_address, config.server_port, &socket,
+							 config.use_udp ? IPPROTO_UDP : IPPROTO_TCP, deadline);
+	if (io_result.status == NP_NET_TIMEOUT) {
+		timeout_exit(io_result.phase);
 	}
 
-	if (result != STATE_OK) {
+	if (io_result.status != NP_NET_OK) {
 		if (config.check_critical_time) {
 			result = STATE_CRITICAL;
 		} else if (config.check_warning_time) {
@@ -93,7 +121,7 @@ int main(int argc, char **argv) {
 	}
 
 	if (config.use_udp) {
-		if (send(socket, "", 0, 0) < 0) {
+		if (np_net_send(socket, "", 0) < 0) {
 			if (config.check_critical_time) {
 				result = STATE_CRITICAL;
 			} else if (config.check_warning_time) {
@@ -108,18 +136,23 @@ int main(int argc, char **argv) {
 
 	/* watch for the connection string */
 	uint32_t raw_server_time;
-	result = recv(socket, (void *)&raw_server_time, sizeof(raw_server_time), 0);
+	io_result = np_net_recv_until(socket, (void *)&raw_server_time, sizeof(raw_server_time),
+								  deadline);
 
 	/* close the connection */
 	close(socket);
+	np_net_timing_finish();
 
 	/* reset the alarm */
 	time_t end_time;
 	time(&end_time);
 	alarm(0);
+	if (io_result.status == NP_NET_TIMEOUT) {
+		timeout_exit(io_result.phase);
+	}
 
 	/* return a WARNING status if we couldn't read any data */
-	if (result <= 0) {
+	if (io_result.status != NP_NET_OK) {
 		if (config.check_critical_time) {
 			result = STATE_CRITICAL;
 		} else if (config.check_warning_time) {
@@ -141,10 +174,12 @@ int main(int argc, char **argv) {
 	}
 
 	if (result != STATE_OK) {
-		die(result, _("TIME %s - %d second response time|%s\n"), state_text(result), (int)conntime,
+		die(result, _("TIME %s - %d second response time|%s %s\n"), state_text(result),
+			(int)conntime,
 			perfdata("time", (long)conntime, "s", config.check_warning_time,
 					 (long)config.warning_time, config.check_critical_time,
-					 (long)config.critical_time, true, 0, false, 0));
+					 (long)config.critical_time, true, 0, false, 0),
+			timing_perfdata());
 	}
 
 	unsigned long server_time;
@@ -162,12 +197,13 @@ int main(int argc, char **argv) {
 		result = STATE_WARNING;
 	}
 
-	printf(_("TIME %s - %lu second time difference|%s %s\n"), state_text(result), diff_time,
+	printf(_("TIME %s - %lu second time difference|%s %s %s\n"), state_text(result), diff_time,
 		   perfdata("time", (long)conntime, "s", config.check_warning_time,
 					(long)config.warning_time, config.check_critical_time,
 					(long)config.critical_time, true, 0, false, 0),
 		   perfdata("offset", diff_time, "s", config.check_warning_diff, config.warning_diff,
-					config.check_critical_diff, config.critical_diff, true, 0, false, 0));
+					config.check_critical_diff, config.critical_diff, true, 0, false, 0),
+		   timing_perfdata());
 	return result;
 }
 
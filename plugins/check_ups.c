@@ -49,14 +49,31 @@ enum {
 	NOSUCHVAR = ERROR - 1
 };
 
+/* The variables of every UPS, all requested at once in the order of this list */
+static const char *ups_variable_names[] = {
+	"ups.status", "input.voltage", "battery.charge", "ups.load", "ups.temperature", "ups.realpower",
+};
+#define NUMBER_OF_UPS_VARIABLES (sizeof(ups_variable_names) / sizeof(ups_variable_names[0]))
+
+/* The reply lines of upsd for one UPS, NULL if there was none */
+typedef struct {
+	const char *ups_name;
+	char *replies[NUMBER_OF_UPS_VARIABLES];
+} ups_variables;
+
 // Forward declarations
 typedef struct {
 	int errorcode;
 	int ups_status;
 	int supported_options;
 } determine_status_result;
-static determine_status_result determine_status(check_ups_config /*config*/);
-static int get_ups_variable(const char * /*varname*/, char * /*buf*/, check_ups_config config);
+static determine_status_result determine_status(const ups_variables * /*variables*/);
+static int fetch_ups_variables(check_ups_config /*config*/, ups_variables * /*variables*/,
+							   np_net_io_result * /*io_result*/);
+static int get_ups_variable(const ups_variables * /*variables*/, const char * /*varname*/,
+							char * /*buf*/);
+static mp_subcheck check_ups(check_ups_config /*config*/, const ups_variables * /*variables*/,
+							 const char * /*label_prefix*/);
 
 typedef struct {
 	int errorcode;
@@ -83,30 +100,84 @@ int main(int argc, char **argv) {
 	// Config from commandline
 	check_ups_config config = tmp_config.config;
 
-	/* initialize alarm signal handling */
+	mp_check overall = mp_check_init();
+
+	mp_set_ok_summary(&overall, "UPS check is OK");
+
+	/* the session keeps its deadline by itself, except for the name lookup of the server */
 	signal(SIGALRM, socket_timeout_alarm_handler);
+	alarm(socket_timeout + 1);
 
-	/* set socket timeout */
-	alarm(socket_timeout);
+	/* one session with upsd for all variables of all UPS */
+	ups_variables *variables = calloc(config.number_of_ups, sizeof(ups_variables));
+	if (variables == NULL) {
+		die(STATE_UNKNOWN, "%s\n", _("Cannot allocate memory"));
+	}
+	for (size_t i = 0; i < config.number_of_ups; i++) {
+		variables[i].ups_name = config.ups_names[i];
+	}
+	np_net_io_result io_result;
+	if (fetch_ups_variables(config, variables, &io_result) == OK) {
+		mp_subcheck sc_session = mp_subcheck_init();
+		sc_session = mp_set_subcheck_state(sc_session, STATE_OK);
+		xasprintf(&sc_session.output, "Session with upsd took %fs", net_timing.total_time);
+		mp_net_add_timing_perfdata(&sc_session);
+		mp_add_subcheck_to_check(&overall, sc_session);
+	} else if (io_result.status != NP_NET_OK) {
+		mp_subcheck sc_session = mp_subcheck_init();
+		sc_session = mp_set_subcheck_state(sc_session, (io_result.status == NP_NET_TIMEOUT)
+														   ? socket_timeout_state
+														   : STATE_CRITICAL);
+		xasprintf(&sc_session.output, "Session with upsd failed during the %s: %s",
+				  np_net_phase_to_string(io_result.phase),
+				  np_net_status_to_string(io_result.status));
+		mp_add_subcheck_to_check(&overall, sc_session);
+	}
 
-	mp_check overall = mp_check_init();
+	if (config.number_of_ups == 1) {
+		/* keep the output of a single UPS flat */
+		mp_subcheck sc_ups = check_ups(config, &variables[0], "");
+		for (mp_subcheck_list *subcheck = sc_ups.subchecks; subcheck != NULL;
+			 subcheck = subcheck->next) {
+			mp_add_subcheck_to_check(&overall, subcheck->subcheck);
+		}
+	} else {
+		for (size_t i = 0; i < config.number_of_ups; i++) {
+			char *label_prefix = NULL;
+			xasprintf(&label_prefix, "%s_", config.ups_names[i]);
 
-	mp_set_ok_summary(&overall, "UPS check is OK");
+			mp_subcheck sc_ups = check_ups(config, &variables[i], label_prefix);
+			xasprintf(&sc_ups.output, "UPS %s", config.ups_names[i]);
+			mp_add_subcheck_to_check(&overall, sc_ups);
+		}
+	}
+
+	/* reset timeout */
+	alarm(0);
+
+	mp_exit(overall);
+}
+
+/* evaluates the variables of one UPS, the results are the subchecks of the returned subcheck */
+mp_subcheck check_ups(const check_ups_config config, const ups_variables *variables,
+					  const char *label_prefix) {
+	mp_subcheck sc_ups = mp_subcheck_init();
+	sc_ups = mp_set_subcheck_default_state(sc_ups, STATE_OK);
 
 	mp_subcheck sc_retrieve_status = mp_subcheck_init();
 	sc_retrieve_status = mp_set_subcheck_default_state(sc_retrieve_status, STATE_OK);
 
 	/* get the ups status if possible */
-	determine_status_result query_result = determine_status(config);
+	determine_status_result query_result = determine_status(variables);
 	if (query_result.errorcode != OK) {
 		sc_retrieve_status = mp_set_subcheck_state(sc_retrieve_status, STATE_CRITICAL);
 		xasprintf(&sc_retrieve_status.output, "%s", "Failed to retrieve status from UPS tools");
-		mp_add_subcheck_to_check(&overall, sc_retrieve_status);
-		mp_exit(overall);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_retrieve_status);
+		return sc_ups;
 	}
 
 	xasprintf(&sc_retrieve_status.output, "%s", "Retrieved status from UPS tools");
-	mp_add_subcheck_to_check(&overall, sc_retrieve_status);
+	mp_add_subcheck_to_subcheck(&sc_ups, sc_retrieve_status);
 
 	int ups_status_flags = query_result.ups_status;
 	int supported_options = query_result.supported_options;
@@ -177,7 +248,7 @@ int main(int argc, char **argv) {
 		}
 		xasprintf(&sc_ups_status.output, "Status: %s", sc_ups_status.output);
 		sc_ups_status = mp_set_subcheck_state(sc_ups_status, ups_state_result);
-		mp_add_subcheck_to_check(&overall, sc_ups_status);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_ups_status);
 	}
 
 	int res;
@@ -185,14 +256,14 @@ int main(int argc, char **argv) {
 	/* get the ups utility voltage if possible */
 	mp_subcheck sc_voltage = mp_subcheck_init();
 	sc_voltage = mp_set_subcheck_default_state(sc_voltage, STATE_OK);
-	res = get_ups_variable("input.voltage", temp_buffer, config);
+	res = get_ups_variable(variables, "input.voltage", temp_buffer);
 	if (res == NOSUCHVAR) {
 		supported_options &= ~UPS_UTILITY;
 	} else if (res != OK) {
 		sc_voltage = mp_set_subcheck_state(sc_voltage, STATE_CRITICAL);
 		xasprintf(&sc_voltage.output, "%s", "Failed to detect voltage");
-		mp_add_subcheck_to_check(&overall, sc_voltage);
-		mp_exit(overall);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_voltage);
+		return sc_ups;
 	} else {
 		supported_options |= UPS_UTILITY;
 
@@ -207,7 +278,7 @@ int main(int argc, char **argv) {
 			ups_utility_deviation = ups_utility_voltage - 120.0;
 		}
 		mp_perfdata pd_voltage_deviation = perfdata_init();
-		pd_voltage_deviation.label = "voltage_deviation";
+		xasprintf(&pd_voltage_deviation.label, "%svoltage_deviation", label_prefix);
 		pd_voltage_deviation.uom = "V";
 		pd_voltage_deviation.value = mp_create_pd_value(ups_utility_deviation);
 
@@ -217,25 +288,25 @@ int main(int argc, char **argv) {
 		mp_add_perfdata_to_subcheck(&sc_voltage, pd_voltage_deviation);
 
 		mp_perfdata pd_voltage = perfdata_init();
-		pd_voltage.label = "voltage";
+		xasprintf(&pd_voltage.label, "%svoltage", label_prefix);
 		pd_voltage.uom = "V";
 		pd_voltage.value = mp_create_pd_value(ups_utility_voltage);
 		mp_add_perfdata_to_subcheck(&sc_voltage, pd_voltage);
 
-		mp_add_subcheck_to_check(&overall, sc_voltage);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_voltage);
 	}
 
 	/* get the ups battery percent if possible */
 	mp_subcheck sc_battery_charge = mp_subcheck_init();
 	sc_battery_charge = mp_set_subcheck_default_state(sc_battery_charge, STATE_OK);
-	res = get_ups_variable("battery.charge", temp_buffer, config);
+	res = get_ups_variable(variables, "battery.charge", temp_buffer);
 	if (res == NOSUCHVAR) {
 		supported_options &= ~UPS_BATTPCT;
 	} else if (res != OK) {
 		sc_battery_charge = mp_set_subcheck_state(sc_battery_charge, STATE_CRITICAL);
 		xasprintf(&sc_battery_charge.output, "%s", "Failed to detect battery charge");
-		mp_add_subcheck_to_check(&overall, sc_battery_charge);
-		mp_exit(overall);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_battery_charge);
+		return sc_ups;
 	} else {
 		supported_options |= UPS_BATTPCT;
 
@@ -244,7 +315,7 @@ int main(int argc, char **argv) {
 
 		mp_perfdata pd_battery_charge = perfdata_init();
 		pd_battery_charge = mp_set_pd_value(pd_battery_charge, ups_battery_percent);
-		pd_battery_charge.label = "battery";
+		xasprintf(&pd_battery_charge.label, "%sbattery", label_prefix);
 		pd_battery_charge.uom = "%";
 		pd_battery_charge = mp_pd_set_thresholds(pd_battery_charge, config.battery_thresholds);
 		mp_add_perfdata_to_subcheck(&sc_battery_charge, pd_battery_charge);
@@ -254,11 +325,11 @@ int main(int argc, char **argv) {
 
 		// if (config.check_crit && ups_battery_percent <= config.critical_value) {
 		// } else if (config.check_warn && ups_battery_percent <= config.warning_value) {
-		mp_add_subcheck_to_check(&overall, sc_battery_charge);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_battery_charge);
 	}
 
 	/* get the ups load percent if possible */
-	res = get_ups_variable("ups.load", temp_buffer, config);
+	res = get_ups_variable(variables, "ups.load", temp_buffer);
 	mp_subcheck sc_load_percent = mp_subcheck_init();
 	sc_load_percent = mp_set_subcheck_default_state(sc_load_percent, STATE_OK);
 	if (res == NOSUCHVAR) {
@@ -266,8 +337,8 @@ int main(int argc, char **argv) {
 	} else if (res != OK) {
 		sc_load_percent = mp_set_subcheck_state(sc_load_percent, STATE_CRITICAL);
 		xasprintf(&sc_load_percent.output, "%s", "Failed to detect load");
-		mp_add_subcheck_to_check(&overall, sc_load_percent);
-		mp_exit(overall);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_load_percent);
+		return sc_ups;
 	} else {
 		supported_options |= UPS_LOADPCT;
 
@@ -275,7 +346,7 @@ int main(int argc, char **argv) {
 		xasprintf(&sc_load_percent.output, "Load: %3.1f%%", ups_load_percent);
 
 		mp_perfdata pd_load_percent = perfdata_init();
-		pd_load_percent.label = "load";
+		xasprintf(&pd_load_percent.label, "%sload", label_prefix);
 		pd_load_percent.uom = "%";
 		pd_load_percent.value = mp_create_pd_value(ups_load_percent);
 		pd_load_percent = mp_pd_set_thresholds(pd_load_percent, config.load_thresholds);
@@ -285,11 +356,11 @@ int main(int argc, char **argv) {
 
 		// if (config.check_crit && ups_load_percent >= config.critical_value) {
 		// } else if (config.check_warn && ups_load_percent >= config.warning_value) {
-		mp_add_subcheck_to_check(&overall, sc_load_percent);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_load_percent);
 	}
 
 	/* get the ups temperature if possible */
-	res = get_ups_variable("ups.temperature", temp_buffer, config);
+	res = get_ups_variable(variables, "ups.temperature", temp_buffer);
 	mp_subcheck sc_temperature = mp_subcheck_init();
 	sc_temperature = mp_set_subcheck_default_state(sc_temperature, STATE_OK);
 	if (res == NOSUCHVAR) {
@@ -297,14 +368,14 @@ int main(int argc, char **argv) {
 	} else if (res != OK) {
 		sc_temperature = mp_set_subcheck_state(sc_temperature, STATE_CRITICAL);
 		xasprintf(&sc_temperature.output, "%s", "Failed to detect temperature");
-		mp_add_subcheck_to_check(&overall, sc_temperature);
-		mp_exit(overall);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_temperature);
+		return sc_ups;
 	} else {
 		supported_options |= UPS_TEMP;
 
 		double ups_temperature = atof(temp_buffer);
 		mp_perfdata pd_temperature = perfdata_init();
-		pd_temperature.label = "temp";
+		xasprintf(&pd_temperature.label, "%stemp", label_prefix);
 
 		if (config.temp_output_c) {
 			xasprintf(&sc_temperature.output, "Temperature: %3.1fC", ups_temperature);
@@ -323,11 +394,11 @@ int main(int argc, char **argv) {
 
 		// if (config.check_crit && ups_temperature >= config.critical_value) {
 		// } else if (config.check_warn && ups_temperature >= config.warning_value) {
-		mp_add_subcheck_to_check(&overall, sc_temperature);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_temperature);
 	}
 
 	/* get the ups real power if possible */
-	res = get_ups_variable("ups.realpower", temp_buffer, config);
+	res = get_ups_variable(variables, "ups.realpower", temp_buffer);
 	mp_subcheck sc_real_power = mp_subcheck_init();
 	sc_real_power = mp_set_subcheck_default_state(sc_real_power, STATE_OK);
 	if (res == NOSUCHVAR) {
@@ -335,8 +406,8 @@ int main(int argc, char **argv) {
 	} else if (res != OK) {
 		sc_real_power = mp_set_subcheck_state(sc_real_power, STATE_CRITICAL);
 		xasprintf(&sc_real_power.output, "%s", "Failed to detect real power");
-		mp_add_subcheck_to_check(&overall, sc_real_power);
-		mp_exit(overall);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_real_power);
+		return sc_ups;
 	} else {
 		supported_options |= UPS_REALPOWER;
 
@@ -344,7 +415,7 @@ int main(int argc, char **argv) {
 		xasprintf(&sc_real_power.output, "Real power: %3.1fW", ups_realpower);
 
 		mp_perfdata pd_real_power = perfdata_init();
-		pd_real_power.label = "realpower";
+		xasprintf(&pd_real_power.label, "%srealpower", label_prefix);
 		pd_real_power = mp_set_pd_value(pd_real_power, ups_realpower);
 		pd_real_power.uom = "W";
 		pd_real_power = mp_pd_set_thresholds(pd_real_power, config.real_power_thresholds);
@@ -354,7 +425,7 @@ int main(int argc, char **argv) {
 
 		// if (config.check_crit && ups_realpower >= config.critical_value) {
 		// } else if (config.check_warn && ups_realpower >= config.warning_value) {
-		mp_add_subcheck_to_check(&overall, sc_real_power);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_real_power);
 	}
 
 	/* if the UPS does not support any options we are looking for, report an
@@ -363,17 +434,14 @@ int main(int argc, char **argv) {
 		mp_subcheck sc_any_option = mp_subcheck_init();
 		sc_any_option = mp_set_subcheck_state(sc_any_option, STATE_CRITICAL);
 		xasprintf(&sc_any_option.output, _("UPS does not support any available options\n"));
-		mp_add_subcheck_to_check(&overall, sc_any_option);
+		mp_add_subcheck_to_subcheck(&sc_ups, sc_any_option);
 	}
 
-	/* reset timeout */
-	alarm(0);
-
-	mp_exit(overall);
+	return sc_ups;
 }
 
 /* determines what options are supported by the UPS */
-determine_status_result determine_status(const check_ups_config config) {
+determine_status_result determine_status(const ups_variables *variables) {
 
 	determine_status_result result = {
 		.errorcode = OK,
@@ -382,7 +450,7 @@ determine_status_result determine_status(const check_ups_config config) {
 	};
 
 	char recv_buffer[MAX_INPUT_BUFFER];
-	int res = get_ups_variable("ups.status", recv_buffer, config);
+	int res = get_ups_variable(variables, "ups.status", recv_buffer);
 	if (res == NOSUCHVAR) {
 		return result;
 	}
@@ -433,41 +501,114 @@ determine_status_result determine_status(const check_ups_config config) {
 	return result;
 }
 
-/* gets a variable value for a specific UPS  */
-int get_ups_variable(const char *varname, char *buf, const check_ups_config config) {
-	char send_buffer[MAX_INPUT_BUFFER];
+/* Reads everything upsd sends until it closes the connection after LOGOUT
+ * or until expected_lines lines arrived, at most until the deadline */
+static char *read_ups_replies(int socket, size_t expected_lines, double deadline,
+							  np_net_io_result *io_result) {
+	size_t size = MAX_INPUT_BUFFER;
+	size_t length = 0;
+	size_t lines = 0;
+	char *buffer = malloc(size);
+	if (buffer == NULL) {
+		die(STATE_UNKNOWN, "%s\n", _("Cannot allocate memory"));
+	}
 
-	/* create the command string to send to the UPS daemon */
+	while (lines < expected_lines) {
+		if (length + 1 == size) {
+			size *= 2;
+			char *tmp = realloc(buffer, size);
+			if (tmp == NULL) {
+				die(STATE_UNKNOWN, "%s\n", _("Cannot allocate memory"));
+			}
+			buffer = tmp;
+		}
+
+		*io_result = np_net_recv_until(socket, buffer + length, size - length - 1, deadline);
+		if (io_result->status == NP_NET_CLOSED) {
+			io_result->status = NP_NET_OK;
+			break;
+		}
+		if (io_result->status != NP_NET_OK) {
+			break;
+		}
+		for (size_t i = 0; i < io_result->length; i++) {
+			if (buffer[length + i] == '\n') {
+				lines++;
+			}
+		}
+		length += io_result->length;
+	}
+
+	buffer[length] = '\0';
+	return buffer;
+}
+
+/* gets all variables of all UPS in one session: the GET VAR commands are
+ * sent at once, upsd answers each with one line in the same order */
+int fetch_ups_variables(const check_ups_config config, ups_variables *variables,
+						np_net_io_result *io_result) {
+	char *send_buffer = strdup("");
+	for (size_t i = 0; i < config.number_of_ups; i++) {
+		for (size_t j = 0; j < NUMBER_OF_UPS_VARIABLES; j++) {
+			xasprintf(&send_buffer, "%sGET VAR %s %s\n", send_buffer, variables[i].ups_name,
+					  ups_variable_names[j]);
+		}
+	}
 	/* Add LOGOUT to avoid read failure logs */
-	int res = snprintf(send_buffer, sizeof(send_buffer), "GET VAR %s %s\nLOGOUT\n", config.ups_name,
-					   varname);
-	if ((res > 0) && ((size_t)res >= sizeof(send_buffer))) {
-		printf("%s\n", _("UPS name to long for buffer"));
+	xasprintf(&send_buffer, "%sLOGOUT\n", send_buffer);
+
+	/* the whole session has one deadline */
+	double deadline = np_net_deadline(socket_timeout);
+	int socket;
+	*io_result = np_net_connect_until(config.server_address, config.server_port, &socket,
+									  IPPROTO_TCP, deadline);
+	if (io_result->status != NP_NET_OK) {
+		free(send_buffer);
 		return ERROR;
 	}
 
-	char temp_buffer[MAX_INPUT_BUFFER];
-
-	/* send the command to the daemon and get a response back */
-	if (process_tcp_request(config.server_address, config.server_port, send_buffer, temp_buffer,
-							sizeof(temp_buffer)) != STATE_OK) {
-		printf("%s\n", _("Invalid response received from host"));
+	*io_result = np_net_send_until(socket, send_buffer, strlen(send_buffer), deadline);
+	free(send_buffer);
+	if (io_result->status != NP_NET_OK) {
+		close(socket);
 		return ERROR;
 	}
 
-	char *ptr = temp_buffer;
-	int len = strlen(ptr);
-	const char *logout = "OK Goodbye\n";
-	const int logout_len = strlen(logout);
+	/* one line per variable and the answer to LOGOUT */
+	size_t number_of_replies = config.number_of_ups * NUMBER_OF_UPS_VARIABLES;
+	char *replies = read_ups_replies(socket, number_of_replies + 1, deadline, io_result);
+	close(socket);
+	np_net_timing_finish();
+
+	size_t reply = 0;
+	char *save_ptr = NULL;
+	for (char *line = strtok_r(replies, "\n", &save_ptr);
+		 line != NULL && reply < number_of_replies; line = strtok_r(NULL, "\n", &save_ptr)) {
+		variables[reply / NUMBER_OF_UPS_VARIABLES].replies[reply % NUMBER_OF_UPS_VARIABLES] =
+			strdup(line);
+		reply++;
+	}
+	free(replies);
+
+	return (reply == number_of_replies) ? OK : ERROR;
+}
 
-	if (len > logout_len && strcmp(ptr + len - logout_len, logout) == 0) {
-		len -= logout_len;
+/* gets a variable value for a specific UPS from the replies of upsd */
+int get_ups_variable(const ups_variables *variables, const char *varname, char *buf) {
+	const char *ptr = NULL;
+	for (size_t i = 0; i < NUMBER_OF_UPS_VARIABLES; i++) {
+		if (strcmp(ups_variable_names[i], varname) == 0) {
+			ptr = variables->replies[i];
+		}
 	}
-	if (len > 0 && ptr[len - 1] == '\n') {
-		ptr[len - 1] = 0;
+
+	if (ptr == NULL) {
+		printf("%s\n", _("Invalid response received from host"));
+		return ERROR;
 	}
+
 	if (strcmp(ptr, "ERR UNKNOWN-UPS") == 0) {
-		printf(_("CRITICAL - no such UPS '%s' on that host\n"), config.ups_name);
+		printf(_("CRITICAL - no such UPS '%s' on that host\n"), variables->ups_name);
 		return ERROR;
 	}
 
@@ -486,14 +627,20 @@ int get_ups_variable(const char *varname, char *buf, const check_ups_config conf
 		return ERROR;
 	}
 
-	ptr = temp_buffer + strlen(varname) + strlen(config.ups_name) + 6;
-	len = strlen(ptr);
-	if (len < 2 || ptr[0] != '"' || ptr[len - 1] != '"') {
+	/* VAR <upsname> <varname> "<value>" */
+	size_t prefix_length = strlen(variables->ups_name) + strlen(varname) + 6;
+	if (strlen(ptr) < prefix_length || strncmp(ptr, "VAR ", 4) != 0) {
+		printf("%s\n", _("Error: unable to parse variable"));
+		return ERROR;
+	}
+
+	ptr += prefix_length;
+	size_t len = strlen(ptr);
+	if (len < 2 || ptr[0] != '"' || ptr[len - 1] != '"' || len - 2 >= MAX_INPUT_BUFFER) {
 		printf("%s\n", _("Error: unable to parse variable"));
 		return ERROR;
 	}
 
-	*buf = 0;
 	strncpy(buf, ptr + 1, len - 2);
 	buf[len - 2] = 0;
 
@@ -562,9 +709,15 @@ check_ups_config_wrapper process_arguments(int argc, char **argv) {
 					 Fahrenheit) */
 			result.config.temp_output_c = true;
 			break;
-		case 'u': /* ups name */
-			result.config.ups_name = optarg;
-			break;
+		case 'u': { /* ups name, several for more than one UPS of the same upsd */
+			char **tmp = realloc(result.config.ups_names,
+								 (result.config.number_of_ups + 1) * sizeof(char *));
+			if (tmp == NULL) {
+				die(STATE_UNKNOWN, "%s\n", _("Cannot allocate memory"));
+			}
+			result.config.ups_names = tmp;
+			result.config.ups_names[result.config.number_of_ups++] = optarg;
+		} break;
 		case 'p': /* port */
 			if (is_intpos(optarg)) {
 				result.config.server_port = atoi(optarg);
@@ -665,7 +818,7 @@ check_ups_config_wrapper process_arguments(int argc, char **argv) {
 }
 
 check_ups_config_wrapper validate_arguments(check_ups_config_wrapper config_wrapper) {
-	if (config_wrapper.config.ups_name == NULL) {
+	if (config_wrapper.config.number_of_ups == 0) {
 		printf("%s\n", _("Error : no UPS indicated"));
 		config_wrapper.errorcode = ERROR;
 	}
@@ -697,7 +850,8 @@ void print_help(void) {
 	printf(UT_HOST_PORT, 'p', myport);
 
 	printf(" %s\n", "-u, --ups=STRING");
-	printf("    %s\n", _("Name of UPS"));
+	printf("    %s\n", _("Name of UPS, may be given more than once to check several UPS"));
+	printf("    %s\n", _("of the same upsd in one connection"));
 	printf(" %s\n", "-T, --temperature");
 	printf("    %s\n", _("Output of temperatures in Celsius"));
 	printf(" %s\n", "-v, --variable=STRING");
@@ -39,7 +39,8 @@ enum {
 typedef struct ups_config {
 	unsigned int server_port;
 	char *server_address;
-	char *ups_name;
+	char **ups_names;
+	size_t number_of_ups;
 
 	mp_thresholds utility_thresholds;
 	mp_thresholds battery_thresholds;
@@ -54,7 +55,8 @@ check_ups_config check_ups_config_init(void) {
 	check_ups_config tmp = {
 		.server_port = PORT,
 		.server_address = NULL,
-		.ups_name = NULL,
+		.ups_names = NULL,
+		.number_of_ups = 0,
 
 		.utility_thresholds = mp_thresholds_init(),
 		.battery_thresholds = mp_thresholds_init(),
@@ -30,15 +30,28 @@
 #include "common.h"
 #include "output.h"
 #include "states.h"
+#include <ctype.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include "netutils.h"
 
+#ifndef MSG_DONTWAIT
+#	define MSG_DONTWAIT 0
+#endif
+#ifndef MSG_NOSIGNAL
+#	define MSG_NOSIGNAL 0
+#endif
+
 unsigned int socket_timeout = DEFAULT_SOCKET_TIMEOUT;
 mp_state_enum socket_timeout_state = STATE_CRITICAL;
 mp_state_enum econn_refuse_state = STATE_CRITICAL;
 bool was_refused = false;
 
 int address_family = AF_UNSPEC;
+double connection_attempt_delay = NP_CONNECTION_ATTEMPT_DELAY;
+bool sequential_connect = false;
+np_connect_report connect_report = {.winner = -1};
+np_net_timing net_timing = {.first_byte_time = -1};
 
 /* handles socket timeouts */
 void socket_timeout_alarm_handler(int sig) {
@@ -57,120 +70,361 @@ void socket_timeout_alarm_handler(int sig) {
 	mp_exit(overall);
 }
 
-/* connects to a host on a specified tcp port, sends a string, and gets a
-	 response. loops on select-recv until timeout or eof to get all of a
-	 multi-packet answer */
-mp_state_enum process_tcp_request2(const char *server_address, const int server_port,
-								   const char *send_buffer, char *recv_buffer,
-								   const int recv_size) {
+static double now(void) {
+	struct timespec current;
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return (double)current.tv_sec + ((double)current.tv_nsec / 1e9);
+}
 
-	int socket;
+void np_net_timing_start(void) {
+	memset(&net_timing, 0, sizeof(net_timing));
+	net_timing.first_byte_time = -1;
+	net_timing.start = now();
+}
 
-	mp_state_enum connect_result =
-		np_net_connect(server_address, server_port, &socket, IPPROTO_TCP);
-	if (connect_result != STATE_OK) {
-		return STATE_CRITICAL;
+void np_net_timing_sent(ssize_t result) {
+	if (result > 0) {
+		net_timing.bytes_sent += (size_t)result;
 	}
+}
 
-	mp_state_enum result;
-	ssize_t send_result = send(socket, send_buffer, strlen(send_buffer), 0);
-	if (send_result < 0 || (size_t)send_result != strlen(send_buffer)) {
-		// printf("%s\n", _("Send failed"));
-		result = STATE_WARNING;
+void np_net_timing_received(ssize_t result) {
+	if (result <= 0) {
+		return;
 	}
+	if (net_timing.bytes_received == 0) {
+		net_timing.first_byte_time = now() - net_timing.start;
+	}
+	net_timing.bytes_received += (size_t)result;
+}
 
-	fd_set readfds;
-	ssize_t recv_length = 0;
-	while (true) {
-		/* wait up to the number of seconds for socket timeout
-		   minus one for data from the host */
-		struct timeval timeout = {
-			.tv_sec = socket_timeout - 1,
-			.tv_usec = 0,
-		};
-		FD_ZERO(&readfds);
-		FD_SET(socket, &readfds);
-		select(socket + 1, &readfds, NULL, NULL, &timeout);
-
-		/* make sure some data has arrived */
-		if (!FD_ISSET(socket, &readfds)) { /* it hasn't */
-			if (!recv_length) {
-				strcpy(recv_buffer, "");
-				// printf("%s\n", _("No data was received from host!"));
-				result = STATE_WARNING;
-			} else { /* this one failed, but previous ones worked */
-				recv_buffer[recv_length] = 0;
+void np_net_timing_finish(void) { net_timing.total_time = now() - net_timing.start; }
+
+ssize_t np_net_send(int socket, const void *buffer, size_t length) {
+	ssize_t result = send(socket, buffer, length, 0);
+	np_net_timing_sent(result);
+	return result;
+}
+
+ssize_t np_net_recv(int socket, void *buffer, size_t size) {
+	ssize_t result = recv(socket, buffer, size, 0);
+	np_net_timing_received(result);
+	return result;
+}
+
+void mp_net_add_timing_perfdata(mp_subcheck *subcheck) {
+	mp_perfdata time_pd = perfdata_init();
+	time_pd.uom = "s";
+	time_pd = mp_set_pd_min_value(time_pd, mp_create_pd_value(0));
+
+	time_pd = mp_set_pd_value(time_pd, net_timing.resolve_time);
+	time_pd.label = "time_resolve";
+	mp_add_perfdata_to_subcheck(subcheck, time_pd);
+
+	time_pd = mp_set_pd_value(time_pd, net_timing.connect_time);
+	time_pd.label = "time_connect";
+	mp_add_perfdata_to_subcheck(subcheck, time_pd);
+
+	if (net_timing.first_byte_time >= 0) {
+		time_pd = mp_set_pd_value(time_pd, net_timing.first_byte_time);
+		time_pd.label = "time_firstbyte";
+		mp_add_perfdata_to_subcheck(subcheck, time_pd);
+	}
+
+	mp_perfdata bytes_pd = perfdata_init();
+	bytes_pd.uom = "B";
+	bytes_pd = mp_set_pd_min_value(bytes_pd, mp_create_pd_value(0));
+
+	bytes_pd = mp_set_pd_value(bytes_pd, net_timing.bytes_sent);
+	bytes_pd.label = "bytes_sent";
+	mp_add_perfdata_to_subcheck(subcheck, bytes_pd);
+
+	bytes_pd = mp_set_pd_value(bytes_pd, net_timing.bytes_received);
+	bytes_pd.label = "bytes_received";
+	mp_add_perfdata_to_subcheck(subcheck, bytes_pd);
+}
+
+const char *np_connect_attempt_status_to_string(np_connect_attempt_status status) {
+	switch (status) {
+	case NP_CONNECT_NOT_TRIED:
+		return _("not tried");
+	case NP_CONNECT_PENDING:
+		return _("pending");
+	case NP_CONNECT_SUCCEEDED:
+		return _("connected");
+	case NP_CONNECT_FAILED:
+		return _("failed");
+	case NP_CONNECT_ABANDONED:
+		return _("abandoned");
+	}
+	return _("unknown");
+}
+
+/*
+ * Orders the addresses for the connection attempts, RFC 8305, 4: the
+ * family of the first address starts and the families alternate from
+ * there, within a family the order of getaddrinfo is kept. Every address
+ * gets its attempt, the list is allocated and freed by the caller.
+ */
+static const struct addrinfo **order_addresses(const struct addrinfo *addresses,
+											   size_t *number_of_addresses) {
+	size_t length = 0;
+	for (const struct addrinfo *address = addresses; address != NULL; address = address->ai_next) {
+		length++;
+	}
+
+	const struct addrinfo **first_family = calloc(length + 1, sizeof(struct addrinfo *));
+	const struct addrinfo **other_families = calloc(length + 1, sizeof(struct addrinfo *));
+	const struct addrinfo **ordered = calloc(length + 1, sizeof(struct addrinfo *));
+	if (first_family == NULL || other_families == NULL || ordered == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	size_t number_of_first = 0;
+	size_t number_of_others = 0;
+
+	for (const struct addrinfo *address = addresses; address != NULL; address = address->ai_next) {
+		if (sequential_connect || address->ai_family == addresses->ai_family) {
+			first_family[number_of_first++] = address;
+		} else {
+			other_families[number_of_others++] = address;
+		}
+	}
+
+	size_t result = 0;
+	for (size_t i = 0; i < number_of_first || i < number_of_others; i++) {
+		if (i < number_of_first) {
+			ordered[result++] = first_family[i];
+		}
+		if (i < number_of_others) {
+			ordered[result++] = other_families[i];
+		}
+	}
+	free(first_family);
+	free(other_families);
+	*number_of_addresses = result;
+	return ordered;
+}
+
+static void address_to_string(const struct addrinfo *address, char text[INET6_ADDRSTRLEN]) {
+	const void *raw_address =
+		(address->ai_family == AF_INET6)
+			? (const void *)&((const struct sockaddr_in6 *)address->ai_addr)->sin6_addr
+			: (const void *)&((const struct sockaddr_in *)address->ai_addr)->sin_addr;
+	if (inet_ntop(address->ai_family, raw_address, text, INET6_ADDRSTRLEN) == NULL) {
+		strcpy(text, "?");
+	}
+}
+
+/* Starts a non-blocking connect, returns the socket or -1 if the attempt is over already */
+static int start_attempt(const struct addrinfo *address, np_connect_attempt *attempt,
+						 bool *connected) {
+	attempt->family = address->ai_family;
+	address_to_string(address, attempt->address);
+	attempt->status = NP_CONNECT_PENDING;
+	*connected = false;
+	double start_time = now();
+
+	int socket_descriptor = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+	if (socket_descriptor < 0) {
+		/* e.g. no IPv6 support on this host */
+		attempt->status = NP_CONNECT_NOT_TRIED;
+		attempt->error = errno;
+		return -1;
+	}
+
+	int flags = fcntl(socket_descriptor, F_GETFL, 0);
+	fcntl(socket_descriptor, F_SETFL, flags | O_NONBLOCK);
+
+	if (connect(socket_descriptor, address->ai_addr, address->ai_addrlen) == 0) {
+		*connected = true;
+		attempt->latency = now() - start_time;
+	} else if (errno != EINPROGRESS) {
+		attempt->status = NP_CONNECT_FAILED;
+		attempt->error = errno;
+		attempt->latency = now() - start_time;
+		close(socket_descriptor);
+		return -1;
+	}
+	return socket_descriptor;
+}
+
+/*
+ * Connects to the first address of the list which accepts, see the comment
+ * on connection_attempt_delay. The attempts are recorded in connect_report.
+ * Returns STATE_OK with the socket in blocking mode, STATE_CRITICAL if no
+ * address could be connected to before the deadline or STATE_UNKNOWN if no
+ * socket could be created at all.
+ */
+static mp_state_enum connect_addresses(const struct addrinfo *addresses, int *socketDescriptor,
+									   double deadline, bool *timed_out) {
+	size_t number_of_addresses;
+	const struct addrinfo **ordered = order_addresses(addresses, &number_of_addresses);
+
+	free(connect_report.attempts);
+	connect_report = (np_connect_report){
+		.attempts = calloc(number_of_addresses + 1, sizeof(np_connect_attempt)),
+		.winner = -1,
+	};
+	int *sockets = calloc(number_of_addresses + 1, sizeof(int));
+	double *start_times = calloc(number_of_addresses + 1, sizeof(double));
+	struct pollfd *descriptors = calloc(number_of_addresses + 1, sizeof(struct pollfd));
+	size_t *indices = calloc(number_of_addresses + 1, sizeof(size_t));
+	if (connect_report.attempts == NULL || sockets == NULL || start_times == NULL ||
+		descriptors == NULL || indices == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	was_refused = false;
+
+	size_t started = 0;
+	size_t pending = 0;
+	bool created_socket = false;
+	double next_attempt = now();
+	*timed_out = false;
+
+	while (connect_report.winner < 0) {
+		if (started < number_of_addresses &&
+			(pending == 0 || (!sequential_connect && now() >= next_attempt))) {
+			size_t index = started++;
+			bool connected;
+			connect_report.number_of_attempts = started;
+			start_times[index] = now();
+			sockets[index] =
+				start_attempt(ordered[index], &connect_report.attempts[index], &connected);
+			if (connect_report.attempts[index].status != NP_CONNECT_NOT_TRIED) {
+				created_socket = true;
 			}
-			break;
-		} /* it has */
-
-		ssize_t recv_result =
-			recv(socket, recv_buffer + recv_length, (size_t)(recv_size - recv_length - 1), 0);
-		if (recv_result == -1) {
-			/* recv failed, bail out */
-			strcpy(recv_buffer + recv_length, "");
-			result = STATE_WARNING;
-			break;
+			if (sockets[index] < 0) {
+				if (connect_report.attempts[index].error == ECONNREFUSED) {
+					was_refused = true;
+				}
+				next_attempt = now();
+				continue;
+			}
+			pending++;
+			if (connected) {
+				connect_report.winner = (int)index;
+				break;
+			}
+			next_attempt = now() + connection_attempt_delay;
+			continue;
 		}
 
-		if (recv_result == 0) {
-			/* end of file ? */
-			recv_buffer[recv_length] = 0;
+		if (pending == 0) {
 			break;
 		}
 
-		/* we got data! */
-		recv_length += recv_result;
-		if (recv_length >= recv_size - 1) {
-			/* buffer full, we're done */
-			recv_buffer[recv_size - 1] = 0;
+		nfds_t number_of_descriptors = 0;
+		for (size_t i = 0; i < started; i++) {
+			if (connect_report.attempts[i].status == NP_CONNECT_PENDING) {
+				descriptors[number_of_descriptors].fd = sockets[i];
+				descriptors[number_of_descriptors].events = POLLOUT;
+				indices[number_of_descriptors++] = i;
+			}
+		}
+
+		double wake_up = deadline;
+		if (started < number_of_addresses && !sequential_connect && next_attempt < deadline) {
+			wake_up = next_attempt;
+		}
+		double remaining = wake_up - now();
+		int timeout = (remaining > 0) ? (int)(remaining * 1000) + 1 : 0;
+
+		int ready = poll(descriptors, number_of_descriptors, timeout);
+		if (ready < 0 && errno != EINTR) {
+			break;
+		}
+		if (ready <= 0 && now() >= deadline) {
+			*timed_out = true;
 			break;
 		}
-		/* end if(!FD_ISSET(sd,&readfds)) */
-	}
 
-	close(socket);
-	return result;
-}
+		for (nfds_t i = 0; ready > 0 && i < number_of_descriptors; i++) {
+			if (descriptors[i].revents == 0) {
+				continue;
+			}
+			size_t index = indices[i];
+			np_connect_attempt *attempt = &connect_report.attempts[index];
+			int error = 0;
+			socklen_t error_length = sizeof(error);
+			if (getsockopt(sockets[index], SOL_SOCKET, SO_ERROR, &error, &error_length) < 0) {
+				error = errno;
+			}
+			attempt->latency = now() - start_times[index];
+			pending--;
 
-/* connects to a host on a specified port, sends a string, and gets a
-   response */
-mp_state_enum process_request(const char *server_address, const int server_port, const int proto,
-							  const char *send_buffer, char *recv_buffer, const int recv_size) {
+			if (error == 0) {
+				attempt->status = NP_CONNECT_SUCCEEDED;
+				connect_report.winner = (int)index;
+				break;
+			}
 
-	mp_state_enum result = STATE_OK;
-	int socket;
-	result = np_net_connect(server_address, server_port, &socket, proto);
-	if (result != STATE_OK) {
-		return STATE_CRITICAL;
+			attempt->status = NP_CONNECT_FAILED;
+			attempt->error = error;
+			if (error == ECONNREFUSED) {
+				was_refused = true;
+			}
+			close(sockets[index]);
+			/* a failed attempt lets the next address start right away */
+			next_attempt = now();
+			ready--;
+		}
 	}
 
-	result = send_request(socket, proto, send_buffer, recv_buffer, recv_size);
+	for (size_t i = 0; i < started; i++) {
+		np_connect_attempt *attempt = &connect_report.attempts[i];
+		if ((int)i == connect_report.winner) {
+			attempt->status = NP_CONNECT_SUCCEEDED;
+		} else if (attempt->status == NP_CONNECT_PENDING) {
+			attempt->status = NP_CONNECT_ABANDONED;
+			attempt->latency = now() - start_times[i];
+			close(sockets[i]);
+		}
+	}
 
-	close(socket);
+	int winner_socket = (connect_report.winner >= 0) ? sockets[connect_report.winner] : -1;
+	free(indices);
+	free(descriptors);
+	free(start_times);
+	free(sockets);
+	free(ordered);
+	if (connect_report.winner < 0) {
+		return created_socket ? STATE_CRITICAL : STATE_UNKNOWN;
+	}
 
-	return result;
+	was_refused = false;
+	*socketDescriptor = winner_socket;
+	int flags = fcntl(*socketDescriptor, F_GETFL, 0);
+	fcntl(*socketDescriptor, F_SETFL, flags & ~O_NONBLOCK);
+	return STATE_OK;
 }
 
-/* opens a tcp or udp connection to a remote host or local socket */
-mp_state_enum np_net_connect(const char *host_name, int port, int *socketDescriptor,
-							 const int proto) {
-	/* send back STATE_UNKOWN if there's an error
-	   send back STATE_OK if we connect
-	   send back STATE_CRITICAL if we can't connect.
-	   Let upstream figure out what to send to the user. */
+mp_state_enum np_net_connect_addresses(const struct addrinfo *addresses, int *socketDescriptor) {
+	bool timed_out;
+	return connect_addresses(addresses, socketDescriptor, np_net_deadline(socket_timeout),
+							 &timed_out);
+}
+
+/*
+ * Opens a tcp or udp connection to a remote host or local socket. Returns
+ * STATE_UNKNOWN for a name which cannot be resolved or if no socket could
+ * be created, STATE_CRITICAL if the connect failed and STATE_OK otherwise,
+ * result tells why.
+ */
+static mp_state_enum connect_until(const char *host_name, int port, int *socketDescriptor,
+								   int proto, double deadline, np_net_io_result *result) {
 	bool is_socket = (host_name[0] == '/');
 	int socktype = (proto == IPPROTO_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+	np_net_timing_start();
+	*result = (np_net_io_result){.status = NP_NET_OK, .phase = NP_NET_RESOLVE};
+	was_refused = false;
 
-	struct addrinfo hints = {};
-	struct addrinfo *res = NULL;
-	int result;
 	/* as long as it doesn't start with a '/', it's assumed a host or ip */
 	if (!is_socket) {
-		memset(&hints, 0, sizeof(hints));
-		hints.ai_family = address_family;
-		hints.ai_protocol = proto;
-		hints.ai_socktype = socktype;
+		struct addrinfo hints = {
+			.ai_family = address_family,
+			.ai_protocol = proto,
+			.ai_socktype = socktype,
+		};
 
 		size_t len = strlen(host_name);
 		/* check for an [IPv6] address (and strip the brackets) */
@@ -180,153 +434,668 @@ mp_state_enum np_net_connect(const char *host_name, int port, int *socketDescrip
 		}
 
 		char host[MAX_HOST_ADDRESS_LENGTH];
-
 		if (len >= sizeof(host)) {
+			result->status = NP_NET_UNRESOLVED;
 			return STATE_UNKNOWN;
 		}
-
 		memcpy(host, host_name, len);
 		host[len] = '\0';
 
 		char port_str[6];
 		snprintf(port_str, sizeof(port_str), "%d", port);
+		/* getaddrinfo has no portable non-blocking form, its time counts afterwards */
+		struct addrinfo *res = NULL;
 		int getaddrinfo_err = getaddrinfo(host, port_str, &hints, &res);
-
+		net_timing.resolve_time = now() - net_timing.start;
 		if (getaddrinfo_err != 0) {
-			// printf("%s\n", gai_strerror(result));
+			result->status = NP_NET_UNRESOLVED;
 			return STATE_UNKNOWN;
 		}
+		if (now() >= deadline) {
+			freeaddrinfo(res);
+			result->status = NP_NET_TIMEOUT;
+			return STATE_CRITICAL;
+		}
 
-		struct addrinfo *addressPointer = res;
-		while (addressPointer) {
-			/* attempt to create a socket */
-			*socketDescriptor =
-				socket(addressPointer->ai_family, socktype, addressPointer->ai_protocol);
+		result->phase = NP_NET_CONNECT;
+		bool timed_out;
+		mp_state_enum connect_result =
+			connect_addresses(res, socketDescriptor, deadline, &timed_out);
+		net_timing.connect_time = now() - net_timing.start - net_timing.resolve_time;
+		freeaddrinfo(res);
 
-			if (*socketDescriptor < 0) {
-				// printf("%s\n", _("Socket creation failed"));
-				freeaddrinfo(addressPointer);
-				return STATE_UNKNOWN;
-			}
+		if (connect_result == STATE_UNKNOWN) {
+			result->status = NP_NET_ERROR;
+			result->error = connect_report.attempts[0].error;
+		} else if (timed_out) {
+			result->status = NP_NET_TIMEOUT;
+		} else if (was_refused) {
+			result->status = NP_NET_REFUSED;
+		} else if (connect_result != STATE_OK) {
+			result->status = NP_NET_ERROR;
+			result->error = connect_report.attempts[connect_report.number_of_attempts - 1].error;
+		}
+		return connect_result;
+	}
 
-			/* attempt to open a connection */
-			result =
-				connect(*socketDescriptor, addressPointer->ai_addr, addressPointer->ai_addrlen);
+	/* else the hostname is interpreted as a path to a unix socket */
+	result->phase = NP_NET_CONNECT;
+	connect_report.number_of_attempts = 0;
+	connect_report.winner = -1;
+	if (strlen(host_name) >= UNIX_PATH_MAX) {
+		die(STATE_UNKNOWN, _("Supplied path too long unix domain socket"));
+	}
 
-			if (result == 0) {
-				was_refused = false;
-				break;
-			}
+	struct sockaddr_un su = {};
+	su.sun_family = AF_UNIX;
+	strncpy(su.sun_path, host_name, UNIX_PATH_MAX);
+	*socketDescriptor = socket(PF_UNIX, SOCK_STREAM, 0);
 
-			if (result < 0) {
-				switch (errno) {
-				case ECONNREFUSED:
-					was_refused = true;
-					break;
-				}
-			}
+	if (*socketDescriptor < 0) {
+		die(STATE_UNKNOWN, _("Socket creation failed"));
+	}
+
+	/* a local socket accepts or refuses right away */
+	int connect_result = connect(*socketDescriptor, (struct sockaddr *)&su, sizeof(su));
+	net_timing.connect_time = now() - net_timing.start;
+	if (connect_result == 0) {
+		return STATE_OK;
+	}
+	result->error = errno;
+	if (errno == ECONNREFUSED) {
+		was_refused = true;
+		result->status = NP_NET_REFUSED;
+	} else {
+		result->status = NP_NET_ERROR;
+	}
+	return STATE_CRITICAL;
+}
+
+/* opens a tcp or udp connection to a remote host or local socket */
+mp_state_enum np_net_connect(const char *host_name, int port, int *socketDescriptor,
+							 const int proto) {
+	/* send back STATE_UNKOWN if there's an error
+	   send back STATE_OK if we connect
+	   send back STATE_CRITICAL if we can't connect.
+	   Let upstream figure out what to send to the user. */
+	np_net_io_result io_result;
+	mp_state_enum result = connect_until(host_name, port, socketDescriptor, proto,
+										 np_net_deadline(socket_timeout), &io_result);
+	if (result != STATE_CRITICAL || !was_refused) {
+		return result;
+	}
+
+	switch (econn_refuse_state) { /* a user-defined expected outcome */
+	case STATE_OK:
+	case STATE_WARNING:  /* user wants WARN or OK on refusal, or... */
+	case STATE_CRITICAL: /* user did not set econn_refuse_state, or wanted critical */
+		return STATE_CRITICAL;
+	default: /* it's a logic error if we do not end up in STATE_(OK|WARNING|CRITICAL) */
+		return STATE_UNKNOWN;
+	}
+}
+
+double np_net_deadline(double seconds) { return now() + seconds; }
+
+const char *np_net_status_to_string(np_net_status status) {
+	switch (status) {
+	case NP_NET_OK:
+		return _("OK");
+	case NP_NET_UNRESOLVED:
+		return _("name could not be resolved");
+	case NP_NET_REFUSED:
+		return _("connection refused");
+	case NP_NET_TIMEOUT:
+		return _("timed out");
+	case NP_NET_CLOSED:
+		return _("connection closed");
+	case NP_NET_ERROR:
+		return _("failed");
+	}
+	return _("unknown");
+}
+
+const char *np_net_phase_to_string(np_net_phase phase) {
+	switch (phase) {
+	case NP_NET_RESOLVE:
+		return _("name lookup");
+	case NP_NET_CONNECT:
+		return _("connect");
+	case NP_NET_SEND:
+		return _("send");
+	case NP_NET_RECEIVE:
+		return _("receive");
+	}
+	return _("unknown");
+}
+
+np_net_io_result np_net_connect_until(const char *host_name, int port, int *socketDescriptor,
+									  int proto, double deadline) {
+	np_net_io_result result;
+	connect_until(host_name, port, socketDescriptor, proto, deadline, &result);
+	return result;
+}
+
+/* The addresses of a host, looked up once for all of its endpoints */
+typedef struct {
+	const char *host;
+	struct addrinfo *addresses; /* NULL if the lookup failed */
+} resolved_host;
 
-			close(*socketDescriptor);
-			addressPointer = addressPointer->ai_next;
+static const struct addrinfo *lookup_host(resolved_host *hosts, size_t *number_of_hosts,
+										  const char *host) {
+	for (size_t i = 0; i < *number_of_hosts; i++) {
+		if (strcmp(hosts[i].host, host) == 0) {
+			return hosts[i].addresses;
 		}
+	}
 
-		freeaddrinfo(res);
+	struct addrinfo hints = {
+		.ai_family = address_family,
+		.ai_socktype = SOCK_STREAM,
+		.ai_protocol = IPPROTO_TCP,
+	};
+	resolved_host *entry = &hosts[(*number_of_hosts)++];
+	entry->host = host;
+	if (getaddrinfo(host, NULL, &hints, &entry->addresses) != 0) {
+		entry->addresses = NULL;
+	}
+	return entry->addresses;
+}
 
-	} else {
-		/* else the hostname is interpreted as a path to a unix socket */
-		if (strlen(host_name) >= UNIX_PATH_MAX) {
-			die(STATE_UNKNOWN, _("Supplied path too long unix domain socket"));
+void np_net_endpoint_init(np_net_endpoint *endpoint, const char *host, int port, void *data) {
+	memset(endpoint, 0, sizeof(*endpoint));
+	endpoint->host = host;
+	endpoint->port = port;
+	endpoint->data = data;
+	endpoint->phase = NP_NET_ENDPOINT_WAITING;
+	endpoint->socket = -1;
+}
+
+void np_net_endpoint_finish(np_net_endpoint *endpoint) {
+	endpoint->total_time = now() - endpoint->start_time;
+}
+
+/* Closes the sockets of the attempts which are still connecting */
+static void abandon_attempts(np_net_endpoint *endpoint) {
+	for (size_t i = 0; i < endpoint->next_address; i++) {
+		if (endpoint->attempts[i] >= 0) {
+			close(endpoint->attempts[i]);
+			endpoint->attempts[i] = -1;
 		}
+	}
+	endpoint->pending_attempts = 0;
+}
 
-		struct sockaddr_un su = {};
-		su.sun_family = AF_UNIX;
-		strncpy(su.sun_path, host_name, UNIX_PATH_MAX);
-		*socketDescriptor = socket(PF_UNIX, SOCK_STREAM, 0);
+void np_net_endpoint_close(np_net_endpoint *endpoint) {
+	abandon_attempts(endpoint);
+	free(endpoint->ordered);
+	free(endpoint->attempts);
+	endpoint->ordered = NULL;
+	endpoint->attempts = NULL;
+	endpoint->number_of_addresses = 0;
+	endpoint->next_address = 0;
+	if (endpoint->socket >= 0) {
+		close(endpoint->socket);
+		endpoint->socket = -1;
+	}
+	if (endpoint->total_time == 0) {
+		np_net_endpoint_finish(endpoint);
+	}
+	endpoint->phase = NP_NET_ENDPOINT_DONE;
+}
+
+static void attempt_failed(np_net_endpoint *endpoint, size_t index, int error) {
+	close(endpoint->attempts[index]);
+	endpoint->attempts[index] = -1;
+	if (error == ECONNREFUSED) {
+		endpoint->status = NP_NET_REFUSED;
+	} else {
+		endpoint->status = NP_NET_ERROR;
+		endpoint->error = error;
+	}
+}
+
+/* The attempt of index won, the others are abandoned */
+static void endpoint_connected(np_net_endpoint *endpoint, size_t index,
+							   const np_net_protocol *protocol, void *settings) {
+	endpoint->socket = endpoint->attempts[index];
+	endpoint->attempts[index] = -1;
+	abandon_attempts(endpoint);
+	address_to_string(endpoint->ordered[index], endpoint->address);
+	endpoint->status = NP_NET_OK;
+	endpoint->error = 0;
+	endpoint->connect_time = now() - endpoint->start_time;
+	endpoint->phase = NP_NET_ENDPOINT_CONNECTED;
+	endpoint->events = POLLIN;
+	protocol->connected(endpoint, settings);
+}
 
-		if (*socketDescriptor < 0) {
-			die(STATE_UNKNOWN, _("Socket creation failed"));
+/*
+ * Starts the attempt of the next address which does not fail right away,
+ * the one after it is due connection_attempt_delay later. The endpoint is
+ * over once no address is left and no attempt is connecting any more.
+ */
+static void start_next_attempt(np_net_endpoint *endpoint, const np_net_protocol *protocol,
+							   void *settings) {
+	while (endpoint->next_address < endpoint->number_of_addresses) {
+		size_t index = endpoint->next_address++;
+		const struct addrinfo *address = endpoint->ordered[index];
+		endpoint->attempts[index] = -1;
+
+		struct sockaddr_storage target;
+		memcpy(&target, address->ai_addr, address->ai_addrlen);
+		if (address->ai_family == AF_INET6) {
+			((struct sockaddr_in6 *)&target)->sin6_port = htons(endpoint->port);
+		} else {
+			((struct sockaddr_in *)&target)->sin_port = htons(endpoint->port);
+		}
+		address_to_string(address, endpoint->address);
+
+		int socket_descriptor = socket(address->ai_family, SOCK_STREAM, IPPROTO_TCP);
+		if (socket_descriptor < 0) {
+			/* e.g. no IPv6 support on this host */
+			endpoint->status = NP_NET_ERROR;
+			endpoint->error = errno;
+			continue;
 		}
+		fcntl(socket_descriptor, F_SETFL, fcntl(socket_descriptor, F_GETFL, 0) | O_NONBLOCK);
+		endpoint->attempts[index] = socket_descriptor;
 
-		result = connect(*socketDescriptor, (struct sockaddr *)&su, sizeof(su));
-		if (result < 0 && errno == ECONNREFUSED) {
-			was_refused = true;
+		if (connect(socket_descriptor, (struct sockaddr *)&target, address->ai_addrlen) == 0) {
+			endpoint_connected(endpoint, index, protocol, settings);
+			return;
 		}
+		if (errno == EINPROGRESS) {
+			endpoint->pending_attempts++;
+			endpoint->next_attempt = now() + connection_attempt_delay;
+			return;
+		}
+		attempt_failed(endpoint, index, errno);
+	}
+	if (endpoint->pending_attempts == 0) {
+		np_net_endpoint_close(endpoint);
 	}
+}
 
-	if (result == 0) {
-		return STATE_OK;
+/* True if the next address is due while the others are still connecting */
+static bool next_attempt_due(const np_net_endpoint *endpoint, double time) {
+	return !sequential_connect && endpoint->phase == NP_NET_ENDPOINT_CONNECTING &&
+		   endpoint->next_address < endpoint->number_of_addresses &&
+		   time >= endpoint->next_attempt;
+}
+
+static void start_endpoint(np_net_endpoint *endpoint, resolved_host *hosts,
+						   size_t *number_of_hosts, double timeout, double end_of_run,
+						   const np_net_protocol *protocol, void *settings) {
+	endpoint->start_time = now();
+	endpoint->end_time = endpoint->start_time + timeout;
+	if (endpoint->end_time > end_of_run) {
+		endpoint->end_time = end_of_run;
+	}
+	endpoint->deadline = endpoint->end_time;
+	if (endpoint->start_time >= end_of_run) {
+		/* no slot became free in time */
+		endpoint->status = NP_NET_TIMEOUT;
+		np_net_endpoint_close(endpoint);
+		return;
+	}
+
+	const struct addrinfo *addresses = endpoint->addresses;
+	if (addresses == NULL) {
+		addresses = lookup_host(hosts, number_of_hosts, endpoint->host);
+	}
+	if (addresses == NULL) {
+		endpoint->status = NP_NET_UNRESOLVED;
+		np_net_endpoint_close(endpoint);
+		return;
+	}
+	endpoint->ordered = order_addresses(addresses, &endpoint->number_of_addresses);
+	endpoint->attempts = calloc(endpoint->number_of_addresses + 1, sizeof(int));
+	if (endpoint->attempts == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	endpoint->next_address = 0;
+	endpoint->pending_attempts = 0;
+	endpoint->phase = NP_NET_ENDPOINT_CONNECTING;
+	start_next_attempt(endpoint, protocol, settings);
+}
+
+/* A connecting attempt is over, a failed one lets the next address start right away */
+static void handle_attempt(np_net_endpoint *endpoint, size_t index,
+						   const np_net_protocol *protocol, void *settings) {
+	int error = 0;
+	socklen_t error_length = sizeof(error);
+	if (getsockopt(endpoint->attempts[index], SOL_SOCKET, SO_ERROR, &error, &error_length) < 0) {
+		error = errno;
+	}
+	endpoint->pending_attempts--;
+	if (error == 0) {
+		endpoint_connected(endpoint, index, protocol, settings);
+	} else {
+		attempt_failed(endpoint, index, error);
+		start_next_attempt(endpoint, protocol, settings);
+	}
+}
+
+/* What a descriptor of the poll loop belongs to, attempt is NO_ATTEMPT for the connection */
+#define NO_ATTEMPT SIZE_MAX
+typedef struct {
+	np_net_endpoint *endpoint;
+	size_t attempt;
+} poll_owner;
+
+void np_net_endpoints_run(np_net_endpoint **endpoints, size_t number_of_endpoints, double timeout,
+						  size_t concurrency, const np_net_protocol *protocol, void *settings) {
+	if (concurrency == 0) {
+		concurrency = 1;
+	}
+
+	resolved_host *hosts = calloc(number_of_endpoints, sizeof(resolved_host));
+	size_t *running = calloc(concurrency, sizeof(size_t));
+	if ((number_of_endpoints > 0 && hosts == NULL) || running == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
 	}
+	struct pollfd *descriptors = NULL;
+	poll_owner *owners = NULL;
+	size_t descriptors_size = 0;
+	size_t number_of_hosts = 0;
+	size_t number_running = 0;
+	size_t next = 0;
+	double end_of_run = now() + timeout;
 
-	if (was_refused) {
-		switch (econn_refuse_state) { /* a user-defined expected outcome */
-		case STATE_OK:
-		case STATE_WARNING:  /* user wants WARN or OK on refusal, or... */
-		case STATE_CRITICAL: /* user did not set econn_refuse_state, or wanted critical */
-			if (is_socket) {
-				// printf("connect to file socket %s: %s\n", host_name, strerror(errno));
-			} else {
-				// printf("connect to address %s and port %d: %s\n", host_name, port,
-				// strerror(errno));
+	/* getaddrinfo blocks, so the names are looked up before any connection is in flight */
+	for (size_t i = 0; i < number_of_endpoints && now() < end_of_run; i++) {
+		if (endpoints[i]->addresses == NULL) {
+			lookup_host(hosts, &number_of_hosts, endpoints[i]->host);
+		}
+	}
+
+	while (true) {
+		/* fill the free slots */
+		while (number_running < concurrency && next < number_of_endpoints) {
+			start_endpoint(endpoints[next], hosts, &number_of_hosts, timeout, end_of_run,
+						   protocol, settings);
+			if (endpoints[next]->phase != NP_NET_ENDPOINT_DONE) {
+				running[number_running++] = next;
 			}
-			return STATE_CRITICAL;
+			next++;
+		}
+		if (number_running == 0) {
 			break;
-		default: /* it's a logic error if we do not end up in STATE_(OK|WARNING|CRITICAL) */
-			return STATE_UNKNOWN;
+		}
+
+		/* a connecting endpoint waits for all of its attempts, a connected one for its events */
+		size_t number_of_descriptors = 0;
+		for (size_t i = 0; i < number_running; i++) {
+			const np_net_endpoint *endpoint = endpoints[running[i]];
+			number_of_descriptors += (endpoint->phase == NP_NET_ENDPOINT_CONNECTING)
+										 ? endpoint->pending_attempts
+										 : 1;
+		}
+		if (number_of_descriptors > descriptors_size) {
+			descriptors = realloc(descriptors, number_of_descriptors * sizeof(struct pollfd));
+			owners = realloc(owners, number_of_descriptors * sizeof(poll_owner));
+			if (descriptors == NULL || owners == NULL) {
+				die(STATE_UNKNOWN, _("Allocation failed"));
+			}
+			descriptors_size = number_of_descriptors;
+		}
+
+		double wake_up = endpoints[running[0]]->deadline;
+		number_of_descriptors = 0;
+		for (size_t i = 0; i < number_running; i++) {
+			np_net_endpoint *endpoint = endpoints[running[i]];
+			if (endpoint->deadline < wake_up) {
+				wake_up = endpoint->deadline;
+			}
+			if (endpoint->phase != NP_NET_ENDPOINT_CONNECTING) {
+				descriptors[number_of_descriptors] =
+					(struct pollfd){.fd = endpoint->socket, .events = endpoint->events};
+				owners[number_of_descriptors++] =
+					(poll_owner){.endpoint = endpoint, .attempt = NO_ATTEMPT};
+				continue;
+			}
+			for (size_t attempt = 0; attempt < endpoint->next_address; attempt++) {
+				if (endpoint->attempts[attempt] >= 0) {
+					descriptors[number_of_descriptors] =
+						(struct pollfd){.fd = endpoint->attempts[attempt], .events = POLLOUT};
+					owners[number_of_descriptors++] =
+						(poll_owner){.endpoint = endpoint, .attempt = attempt};
+				}
+			}
+			if (next_attempt_due(endpoint, wake_up)) {
+				wake_up = endpoint->next_attempt;
+			}
+		}
+
+		double remaining = wake_up - now();
+		int poll_timeout = (remaining > 0) ? (int)(remaining * 1000) + 1 : 0;
+		if (poll(descriptors, number_of_descriptors, poll_timeout) < 0 && errno != EINTR) {
+			die(STATE_UNKNOWN, _("poll failed: %s"), strerror(errno));
+		}
+
+		for (size_t i = 0; i < number_of_descriptors; i++) {
+			np_net_endpoint *endpoint = owners[i].endpoint;
+			if (descriptors[i].revents == 0) {
+				continue;
+			}
+			if (owners[i].attempt != NO_ATTEMPT) {
+				/* another attempt of the endpoint may have won in the meantime */
+				if (endpoint->phase == NP_NET_ENDPOINT_CONNECTING &&
+					endpoint->attempts[owners[i].attempt] >= 0) {
+					handle_attempt(endpoint, owners[i].attempt, protocol, settings);
+				}
+			} else if (endpoint->phase == NP_NET_ENDPOINT_CONNECTED) {
+				protocol->ready(endpoint, settings);
+			}
+		}
+
+		size_t still_running = 0;
+		for (size_t i = 0; i < number_running; i++) {
+			np_net_endpoint *endpoint = endpoints[running[i]];
+			if (next_attempt_due(endpoint, now())) {
+				start_next_attempt(endpoint, protocol, settings);
+			}
+			if (endpoint->phase == NP_NET_ENDPOINT_CONNECTING && now() >= endpoint->end_time) {
+				endpoint->status = NP_NET_TIMEOUT;
+				np_net_endpoint_close(endpoint);
+			} else if (endpoint->phase == NP_NET_ENDPOINT_CONNECTED &&
+					   now() >= endpoint->deadline) {
+				protocol->expired(endpoint, settings);
+			}
+			if (endpoint->phase != NP_NET_ENDPOINT_DONE) {
+				running[still_running++] = running[i];
+			}
+		}
+		number_running = still_running;
+	}
+
+	for (size_t i = 0; i < number_of_hosts; i++) {
+		if (hosts[i].addresses != NULL) {
+			freeaddrinfo(hosts[i].addresses);
+		}
+	}
+	free(owners);
+	free(descriptors);
+	free(running);
+	free(hosts);
+}
+
+/* Waits in poll until the socket is ready for events, false at the deadline */
+static bool wait_until(int socket, short events, double deadline, int *error) {
+	while (true) {
+		struct pollfd descriptor = {.fd = socket, .events = events};
+		double remaining = deadline - now();
+		int ready = poll(&descriptor, 1, (remaining > 0) ? (int)(remaining * 1000) + 1 : 0);
+		if (ready > 0) {
+			return true;
+		}
+		if (ready < 0 && errno != EINTR) {
+			*error = errno;
+			return false;
+		}
+		if (remaining <= 0) {
+			return false;
+		}
+	}
+}
+
+np_net_io_result np_net_send_until(int socket, const void *buffer, size_t length,
+								   double deadline) {
+	np_net_io_result result = {.status = NP_NET_OK, .phase = NP_NET_SEND};
+	while (result.length < length) {
+		if (!wait_until(socket, POLLOUT, deadline, &result.error)) {
+			result.status = (result.error != 0) ? NP_NET_ERROR : NP_NET_TIMEOUT;
 			break;
 		}
-	} else {
-		if (is_socket) {
-			// printf("connect to file socket %s: %s\n", host_name, strerror(errno));
+		ssize_t sent = send(socket, (const char *)buffer + result.length, length - result.length,
+							MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+			continue;
+		}
+		if (sent < 0) {
+			result.status = (errno == EPIPE) ? NP_NET_CLOSED : NP_NET_ERROR;
+			result.error = errno;
+			break;
+		}
+		np_net_timing_sent(sent);
+		result.length += (size_t)sent;
+	}
+	return result;
+}
+
+np_net_io_result np_net_recv_until(int socket, void *buffer, size_t size, double deadline) {
+	np_net_io_result result = {.status = NP_NET_OK, .phase = NP_NET_RECEIVE};
+	while (true) {
+		if (!wait_until(socket, POLLIN, deadline, &result.error)) {
+			result.status = (result.error != 0) ? NP_NET_ERROR : NP_NET_TIMEOUT;
+			return result;
+		}
+		ssize_t received = recv(socket, buffer, size, MSG_DONTWAIT);
+		if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+			continue;
+		}
+		if (received < 0) {
+			result.status = (errno == ECONNRESET) ? NP_NET_CLOSED : NP_NET_ERROR;
+			result.error = errno;
+		} else if (received == 0) {
+			result.status = NP_NET_CLOSED;
 		} else {
-			// printf("connect to address %s and port %d: %s\n", host_name, port, strerror(errno));
+			np_net_timing_received(received);
+			result.length = (size_t)received;
 		}
-		return STATE_CRITICAL;
+		return result;
 	}
 }
 
-mp_state_enum send_request(const int socket, const int proto, const char *send_buffer,
-						   char *recv_buffer, const int recv_size) {
-	mp_state_enum result = STATE_OK;
+static ssize_t np_net_reader_plain_read(np_net_reader *reader, void *buffer, size_t size) {
+	return recv(reader->socket, buffer, size, 0);
+}
+
+void np_net_reader_init(np_net_reader *reader, int socket) {
+	reader->socket = socket;
+	reader->read = np_net_reader_plain_read;
+	reader->start = 0;
+	reader->end = 0;
+	reader->reads = 0;
+	reader->ssl_connection = NULL;
+}
 
-	ssize_t send_result = send(socket, send_buffer, strlen(send_buffer), 0);
-	if (send_result < 0 || (size_t)send_result != strlen(send_buffer)) {
-		// printf("%s\n", _("Send failed"));
-		result = STATE_WARNING;
+/* Reads whatever is available into the free part of the buffer */
+static ssize_t np_net_reader_fill(np_net_reader *reader) {
+	if (reader->start == reader->end) {
+		reader->start = 0;
+		reader->end = 0;
+	} else if (reader->start > 0) {
+		memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+		reader->end -= reader->start;
+		reader->start = 0;
 	}
 
-	/* wait up to the number of seconds for socket timeout minus one
-	   for data from the host */
-	struct timeval timestamp = {
-		.tv_sec = socket_timeout - 1,
-		.tv_usec = 0,
-	};
-	fd_set readfds;
-	FD_ZERO(&readfds);
-	FD_SET(socket, &readfds);
-	select(socket + 1, &readfds, NULL, NULL, &timestamp);
-
-	/* make sure some data has arrived */
-	if (!FD_ISSET(socket, &readfds)) {
-		strcpy(recv_buffer, "");
-		// printf("%s\n", _("No data was received from host!"));
-		result = STATE_WARNING;
-	} else {
-		ssize_t recv_result = recv(socket, recv_buffer, (size_t)(recv_size - 1), 0);
-		if (recv_result == -1) {
-			strcpy(recv_buffer, "");
-			if (proto != IPPROTO_TCP) {
-				// printf("%s\n", _("Receive failed"));
-			}
-			result = STATE_WARNING;
-		} else {
-			recv_buffer[recv_result] = 0;
+	ssize_t received;
+	do {
+		reader->reads++;
+		received = reader->read(reader, reader->buffer + reader->end,
+								sizeof(reader->buffer) - reader->end);
+	} while (received < 0 && errno == EINTR);
+
+	if (received > 0) {
+		reader->end += (size_t)received;
+	}
+	np_net_timing_received(received);
+	return received;
+}
+
+/*
+ * Copies one line including its (\r)\n into line and nul-terminates it.
+ * Returns the number of Bytes copied (excluding the '\0'), 0 on EOF, <0 on
+ * error or -2 if the line does not fit, line holds the beginning then. A
+ * last line without newline is returned as it is.
+ */
+int np_net_read_line(np_net_reader *reader, char *line, size_t size) {
+	if (size == 0) {
+		return -2;
+	}
+
+	size_t used = 0;
+	while (true) {
+		size_t available = reader->end - reader->start;
+		char *newline = memchr(reader->buffer + reader->start, '\n', available);
+		size_t length = (newline != NULL)
+							? (size_t)(newline - (reader->buffer + reader->start)) + 1
+							: available;
+		bool complete = newline != NULL;
+		if (used + length > size - 1) {
+			length = size - 1 - used;
+			complete = false;
+		}
+
+		memcpy(line + used, reader->buffer + reader->start, length);
+		reader->start += length;
+		used += length;
+		line[used] = '\0';
+
+		if (complete) {
+			return (int)used;
+		}
+		if (used == size - 1) {
+			return -2;
+		}
+
+		ssize_t received = np_net_reader_fill(reader);
+		if (received <= 0) {
+			return (used > 0) ? (int)used : (int)received;
 		}
+	}
+}
 
-		/* die returned string */
-		recv_buffer[recv_size - 1] = 0;
+/*
+ * Reads one reply of SMTP, LMTP or FTP into reply. A reply starting with
+ * the code and a hyphen continues up to the line which starts with the same
+ * code followed by a space or the end of the line (RFC 5321, 4.2.1 and RFC
+ * 959, 4.2), FTP allows lines without the code in between. Returns like
+ * np_net_read_line for the whole reply.
+ */
+int np_net_read_reply(np_net_reader *reader, char *reply, size_t size) {
+	int result = np_net_read_line(reader, reply, size);
+	if (result <= 3 || !isdigit((int)reply[0]) || !isdigit((int)reply[1]) ||
+		!isdigit((int)reply[2]) || reply[3] != '-') {
+		return result;
 	}
 
-	return result;
+	size_t used = (size_t)result;
+	while (true) {
+		result = np_net_read_line(reader, reply + used, size - used);
+		if (result <= 0) {
+			return result;
+		}
+		char *line = reply + used;
+		used += (size_t)result;
+		if (result >= 3 && strncmp(line, reply, 3) == 0 && line[3] != '-') {
+			return (int)used;
+		}
+	}
 }
 
 bool is_host(const char *address) {
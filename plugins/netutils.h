@@ -50,26 +50,196 @@
 #	define HOST_MAX_BYTES 255
 #endif
 
-/* process_request and wrapper macros */
-#define process_tcp_request(addr, port, sbuf, rbuf, rsize)                                         \
-	process_request(addr, port, IPPROTO_TCP, sbuf, rbuf, rsize)
-#define process_udp_request(addr, port, sbuf, rbuf, rsize)                                         \
-	process_request(addr, port, IPPROTO_UDP, sbuf, rbuf, rsize)
-mp_state_enum process_tcp_request2(const char *server_address, int server_port,
-								   const char *send_buffer, char *recv_buffer, int recv_size);
-mp_state_enum process_request(const char *server_address, int server_port, int proto,
-							  const char *send_buffer, char *recv_buffer, int recv_size);
-
 /* my_connect and wrapper macros */
 #define my_tcp_connect(addr, port, s) np_net_connect(addr, port, s, IPPROTO_TCP)
 #define my_udp_connect(addr, port, s) np_net_connect(addr, port, s, IPPROTO_UDP)
 mp_state_enum np_net_connect(const char *host_name, int port, int *socketDescriptor, int proto);
 
-/* send_request and wrapper macros */
-#define send_tcp_request(s, sbuf, rbuf, rsize) send_request(s, IPPROTO_TCP, sbuf, rbuf, rsize)
-#define send_udp_request(s, sbuf, rbuf, rsize) send_request(s, IPPROTO_UDP, sbuf, rbuf, rsize)
-mp_state_enum send_request(int socket, int proto, const char *send_buffer, char *recv_buffer,
-						   int recv_size);
+/*
+ * A name with several addresses is connected to like RFC 8305 ("Happy
+ * Eyeballs") describes: the address families take turns and the next
+ * address is tried after connection_attempt_delay seconds without waiting
+ * for the previous one, the first connection wins. With sequential_connect
+ * every address gets its own turn in the order of getaddrinfo.
+ */
+#define NP_CONNECTION_ATTEMPT_DELAY 0.25
+
+typedef enum {
+	NP_CONNECT_NOT_TRIED,
+	NP_CONNECT_PENDING,
+	NP_CONNECT_SUCCEEDED,
+	NP_CONNECT_FAILED,
+	NP_CONNECT_ABANDONED, /* another address connected first */
+} np_connect_attempt_status;
+
+typedef struct {
+	char address[INET6_ADDRSTRLEN];
+	int family;
+	np_connect_attempt_status status;
+	int error;      /* errno of a failed attempt */
+	double latency; /* seconds from starting the attempt until it was finished */
+} np_connect_attempt;
+
+typedef struct {
+	np_connect_attempt *attempts; /* one for every address */
+	size_t number_of_attempts;
+	int winner; /* index of the connected attempt, -1 if there is none */
+} np_connect_report;
+
+mp_state_enum np_net_connect_addresses(const struct addrinfo *addresses, int *socketDescriptor);
+const char *np_connect_attempt_status_to_string(np_connect_attempt_status status);
+
+/*
+ * Where the time of the last connection went, measured on CLOCK_MONOTONIC.
+ * np_net_connect starts it over, the send and receive calls of netutils
+ * and the TLS handshake add to it. Plugins with their own send and receive
+ * code report the Bytes with np_net_timing_sent and np_net_timing_received.
+ */
+typedef struct {
+	double start;           /* of the name lookup */
+	double resolve_time;    /* seconds of the name lookup */
+	double connect_time;    /* seconds of the connect after the lookup */
+	double handshake_time;  /* seconds of the TLS handshake, 0 without TLS */
+	double first_byte_time; /* seconds from the start to the first Byte received, -1 before */
+	double total_time;      /* seconds from the start to np_net_timing_finish */
+	size_t bytes_sent;
+	size_t bytes_received;
+} np_net_timing;
+
+void np_net_timing_start(void);
+void np_net_timing_sent(ssize_t result);
+void np_net_timing_received(ssize_t result);
+void np_net_timing_finish(void);
+ssize_t np_net_send(int socket, const void *buffer, size_t length);
+ssize_t np_net_recv(int socket, void *buffer, size_t size);
+/*
+ * time_resolve, time_connect, time_firstbyte and the Bytes of the last
+ * connection, the TLS handshake has its own perfdata in the TLS calls
+ */
+void mp_net_add_timing_perfdata(mp_subcheck *subcheck);
+
+/*
+ * Operations with a deadline instead of alarm(): they wait in poll until an
+ * absolute CLOCK_MONOTONIC time from np_net_deadline and fail on their own
+ * instead of ending the plugin, which can report the phase and go on with
+ * other targets. The lookup of a name cannot be interrupted, it fails if
+ * it ended after the deadline.
+ */
+typedef enum {
+	NP_NET_OK,
+	NP_NET_UNRESOLVED,
+	NP_NET_REFUSED,
+	NP_NET_TIMEOUT,
+	NP_NET_CLOSED, /* by the peer */
+	NP_NET_ERROR,  /* see error */
+} np_net_status;
+
+typedef enum {
+	NP_NET_RESOLVE,
+	NP_NET_CONNECT,
+	NP_NET_SEND,
+	NP_NET_RECEIVE,
+} np_net_phase;
+
+typedef struct {
+	np_net_status status;
+	np_net_phase phase; /* which the status belongs to */
+	int error;          /* errno of NP_NET_ERROR */
+	size_t length;      /* Bytes sent or received */
+} np_net_io_result;
+
+double np_net_deadline(double seconds);
+np_net_io_result np_net_connect_until(const char *host_name, int port, int *socketDescriptor,
+									  int proto, double deadline);
+/* sends everything unless the deadline passes first */
+np_net_io_result np_net_send_until(int socket, const void *buffer, size_t length,
+								   double deadline);
+/* receives what is there as soon as anything is there, like recv */
+np_net_io_result np_net_recv_until(int socket, void *buffer, size_t size, double deadline);
+const char *np_net_status_to_string(np_net_status status);
+const char *np_net_phase_to_string(np_net_phase phase);
+
+/*
+ * Many endpoints at once: np_net_endpoints_run keeps at most concurrency of
+ * them in flight with non-blocking sockets in one poll loop, a finished one
+ * makes room for the next. Every host is looked up once before the loop and
+ * its addresses are tried like np_net_connect does, staggered by
+ * connection_attempt_delay and the first connection wins. The protocol of the
+ * plugin takes over a connected endpoint, sets the events it waits for and
+ * its deadline and ends it with np_net_endpoint_close by end_time at the
+ * latest. The whole run takes timeout seconds at most: end_time is
+ * start_time + timeout but not after the end of the run, a connect still
+ * pending then and an endpoint which got no slot in time end with
+ * NP_NET_TIMEOUT.
+ */
+typedef enum {
+	NP_NET_ENDPOINT_WAITING, /* not started yet */
+	NP_NET_ENDPOINT_CONNECTING,
+	NP_NET_ENDPOINT_CONNECTED, /* driven by the protocol */
+	NP_NET_ENDPOINT_DONE,
+} np_net_endpoint_phase;
+
+typedef struct {
+	const char *host;
+	int port;
+	const struct addrinfo *addresses; /* of host, looked up unless set before the run */
+	void *data;                       /* of the plugin */
+
+	np_net_endpoint_phase phase;
+	np_net_status status; /* of the connect, NP_NET_OK once connected */
+	int error;            /* errno of NP_NET_ERROR */
+	char address[INET6_ADDRSTRLEN]; /* connected to, or tried last */
+	double start_time;              /* CLOCK_MONOTONIC */
+	double end_time;                /* CLOCK_MONOTONIC, the endpoint times out then */
+	double connect_time;            /* seconds until the connection was established */
+	double total_time;              /* seconds until np_net_endpoint_finish */
+
+	int socket;
+	short events;    /* the protocol waits for */
+	double deadline; /* CLOCK_MONOTONIC, the protocol is called back then */
+
+	/* the addresses in the order of the attempts and the sockets of the attempts, -1 once over */
+	const struct addrinfo **ordered;
+	int *attempts;
+	size_t number_of_addresses;
+	size_t next_address;
+	size_t pending_attempts;
+	double next_attempt; /* CLOCK_MONOTONIC, the next address is due then */
+} np_net_endpoint;
+
+typedef struct {
+	void (*connected)(np_net_endpoint *endpoint, void *settings);
+	void (*ready)(np_net_endpoint *endpoint, void *settings); /* the events occurred */
+	void (*expired)(np_net_endpoint *endpoint, void *settings); /* the deadline passed */
+} np_net_protocol;
+
+void np_net_endpoint_init(np_net_endpoint *endpoint, const char *host, int port, void *data);
+/* The result is final, the connection may stay open a bit longer */
+void np_net_endpoint_finish(np_net_endpoint *endpoint);
+/* Closes the connection, finishes the endpoint unless it was finished before */
+void np_net_endpoint_close(np_net_endpoint *endpoint);
+void np_net_endpoints_run(np_net_endpoint **endpoints, size_t number_of_endpoints, double timeout,
+						  size_t concurrency, const np_net_protocol *protocol, void *settings);
+
+/*
+ * Buffered reader for line based protocols. It fills its buffer with as
+ * much as the socket or TLS session has available instead of reading byte
+ * by byte, data beyond the current line stays for the next call.
+ */
+#define NP_NET_READER_BUFFER_SIZE 8192
+typedef struct np_net_reader {
+	int socket;
+	ssize_t (*read)(struct np_net_reader *reader, void *buffer, size_t size);
+	char buffer[NP_NET_READER_BUFFER_SIZE];
+	size_t start; /* first unconsumed Byte */
+	size_t end;
+	unsigned long reads; /* number of read calls on the socket or TLS session */
+	struct np_net_ssl_connection *ssl_connection;
+} np_net_reader;
+
+void np_net_reader_init(np_net_reader *reader, int socket);
+int np_net_read_line(np_net_reader *reader, char *line, size_t size);
+int np_net_read_reply(np_net_reader *reader, char *reply, size_t size);
 
 /* "is_*" wrapper macros and functions */
 bool is_host(const char *);
@@ -86,6 +256,10 @@ extern mp_state_enum socket_timeout_state;
 extern mp_state_enum econn_refuse_state;
 extern bool was_refused;
 extern int address_family;
+extern double connection_attempt_delay;
+extern bool sequential_connect;
+extern np_connect_report connect_report; /* of the last np_net_connect */
+extern np_net_timing net_timing;         /* of the last np_net_connect */
 
 void socket_timeout_alarm_handler(int) __attribute__((noreturn));
 
@@ -110,6 +284,58 @@ int np_net_ssl_init_with_hostname_version_and_cert(int socket, char *host_name,
 void np_net_ssl_cleanup(void);
 int np_net_ssl_write(const void *buf, int num);
 int np_net_ssl_read(void *buf, int num);
+void np_net_reader_use_ssl(np_net_reader *reader);
+
+/*
+ * Keeps the TLS sessions of connections to host_name and port in the shared
+ * state database, keyed with the SNI as well, and offers them for
+ * resumption on the next run. Call before np_net_ssl_init_*.
+ */
+#	define NP_SSL_SESSION_CACHE_VERSION 1
+void np_net_ssl_cache_sessions(const char *host_name, int port);
+bool np_net_ssl_session_reused(void);
+double np_net_ssl_handshake_time(void); /* seconds */
+void mp_net_ssl_add_handshake_perfdata(mp_subcheck *subcheck);
+
+/*
+ * TLS with several connections at once: a context holds the protocol
+ * version and the client certificate and is shared, every connection has
+ * its own session. The handshake can be driven step by step on a
+ * non-blocking socket, so one poll loop serves many connections. The calls
+ * above are wrappers for a single connection.
+ */
+typedef struct np_net_ssl_context np_net_ssl_context;
+typedef struct np_net_ssl_connection np_net_ssl_connection;
+
+typedef enum {
+	NP_SSL_HANDSHAKE_DONE,
+	NP_SSL_HANDSHAKE_WANT_READ,  /* wait until the socket is readable */
+	NP_SSL_HANDSHAKE_WANT_WRITE, /* wait until the socket is writable */
+	NP_SSL_HANDSHAKE_FAILED,
+} np_net_ssl_handshake_status;
+
+mp_state_enum np_net_ssl_context_new(np_net_ssl_context **context, int version, const char *cert,
+									 const char *privkey);
+void np_net_ssl_context_free(np_net_ssl_context *context);
+
+np_net_ssl_connection *np_net_ssl_connection_new(np_net_ssl_context *context, int socket,
+												 const char *host_name);
+void np_net_ssl_connection_cache_sessions(np_net_ssl_connection *connection,
+										  const char *host_name, int port);
+np_net_ssl_handshake_status np_net_ssl_handshake_step(np_net_ssl_connection *connection);
+mp_state_enum np_net_ssl_handshake(np_net_ssl_connection *connection, double timeout);
+int np_net_ssl_connection_read(np_net_ssl_connection *connection, void *buffer, int size);
+int np_net_ssl_connection_write(np_net_ssl_connection *connection, const void *buffer, int size);
+bool np_net_ssl_connection_reused(const np_net_ssl_connection *connection);
+double np_net_ssl_connection_handshake_time(const np_net_ssl_connection *connection);
+void mp_net_ssl_connection_add_handshake_perfdata(const np_net_ssl_connection *connection,
+												  mp_subcheck *subcheck);
+/* Milliseconds to wait for a TLS 1.3 session ticket the plugin did not read */
+#	define NP_SSL_TICKET_WAIT 100
+bool np_net_ssl_connection_ticket_pending(np_net_ssl_connection *connection);
+void np_net_ssl_connection_abandon_ticket(np_net_ssl_connection *connection);
+void np_net_ssl_connection_free(np_net_ssl_connection *connection);
+void np_net_reader_use_ssl_connection(np_net_reader *reader, np_net_ssl_connection *connection);
 
 typedef enum {
 	ALL_OK,
@@ -130,8 +356,37 @@ typedef struct {
 } net_ssl_check_cert_result;
 net_ssl_check_cert_result np_net_ssl_check_cert2(unsigned int days_till_exp_warn,
 												 unsigned int days_till_exp_crit);
+net_ssl_check_cert_result np_net_ssl_connection_check_cert2(np_net_ssl_connection *connection,
+															unsigned int days_till_exp_warn,
+															unsigned int days_till_exp_crit);
 
 mp_state_enum np_net_ssl_check_cert(int days_till_exp_warn, int days_till_exp_crit);
+mp_state_enum np_net_ssl_connection_check_cert(np_net_ssl_connection *connection,
+											   int days_till_exp_warn, int days_till_exp_crit);
 mp_subcheck mp_net_ssl_check_cert(int days_till_exp_warn, int days_till_exp_crit);
+
+/*
+ * Expiration of every certificate the server presented, the leaf first.
+ * Needs only the handshake, not a single Byte of the protocol.
+ */
+#	define NP_SSL_MAX_CN_LENGTH 256
+typedef struct {
+	char common_name[NP_SSL_MAX_CN_LENGTH];
+	double remaining_seconds;
+	retrieve_expiration_date_errors errors;
+} np_net_ssl_chain_certificate;
+
+typedef struct {
+	int errorcode; /* ERROR if the server presented no certificate */
+	size_t number_of_certificates;
+	np_net_ssl_chain_certificate *certificates;
+	size_t soonest; /* index of the certificate which expires first */
+} np_net_ssl_chain_result;
+
+np_net_ssl_chain_result np_net_ssl_connection_check_chain(np_net_ssl_connection *connection);
+void np_net_ssl_chain_result_free(np_net_ssl_chain_result *chain);
+/* Reports the soonest expiry, with the lifetime of every certificate as perfdata */
+mp_subcheck mp_net_ssl_check_chain(const np_net_ssl_chain_result *chain, int days_till_exp_warn,
+								   int days_till_exp_crit, const char *label_prefix);
 #endif /* HAVE_SSL */
 #endif /* _NETUTILS_H_ */
@@ -31,31 +31,101 @@
 #include "common.h"
 #include "netutils.h"
 #include "../lib/monitoringplug.h"
+#include "../lib/utils_state.h"
+#include "../lib/utils_state_db.h"
 #include "states.h"
+#include <fcntl.h>
+#include <poll.h>
 
 #ifdef HAVE_SSL
-static SSL_CTX *ctx = NULL;
-static SSL *s = NULL;
+struct np_net_ssl_context {
+	SSL_CTX *ctx;
+};
 
-int np_net_ssl_init(int sd) { return np_net_ssl_init_with_hostname(sd, NULL); }
+struct np_net_ssl_connection {
+	SSL *ssl;
+	char *host_name; /* SNI */
+	bool handshake_started;
+	double handshake_start;
+	double handshake_time;
+	char *session_cache_key; /* NULL without session cache */
+	bool session_stored;
+	bool ticket_abandoned; /* do not wait for a session ticket any more */
+};
 
-int np_net_ssl_init_with_hostname(int sd, char *host_name) {
-	return np_net_ssl_init_with_hostname_and_version(sd, host_name, 0);
-}
+/* The context and connection behind the calls without connection argument */
+static np_net_ssl_context *legacy_context = NULL;
+static np_net_ssl_connection *legacy_connection = NULL;
+/* Set by np_net_ssl_cache_sessions for the next legacy connection */
+static char *legacy_cache_host = NULL;
+static int legacy_cache_port = 0;
 
-int np_net_ssl_init_with_hostname_and_version(int sd, char *host_name, int version) {
-	return np_net_ssl_init_with_hostname_version_and_cert(sd, host_name, version, NULL, NULL);
+static double seconds_now(void) {
+	struct timespec current;
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return (double)current.tv_sec + ((double)current.tv_nsec / 1e9);
 }
 
-int np_net_ssl_init_with_hostname_version_and_cert(int sd, char *host_name, int version, char *cert,
-												   char *privkey) {
-	long options = 0;
+#	ifdef MOPL_USE_OPENSSL
 
-	if ((ctx = SSL_CTX_new(TLS_client_method())) == NULL) {
-		printf("%s\n", _("CRITICAL - Cannot create SSL context."));
-		return STATE_CRITICAL;
+/* Offers the cached session of the server for resumption if it is still valid */
+static void load_cached_session(np_net_ssl_connection *connection) {
+	char *filename = np_state_database_filename();
+	np_state_db database = np_state_db_open(filename);
+	np_state_db_entry entry = np_state_db_get(&database, connection->session_cache_key);
+	np_state_db_close(&database);
+	free(filename);
+	if (entry.errorcode != OK) {
+		return;
 	}
 
+	const unsigned char *data = (const unsigned char *)entry.data;
+	SSL_SESSION *session = NULL;
+	if (entry.data_version == NP_SSL_SESSION_CACHE_VERSION) {
+		session = d2i_SSL_SESSION(NULL, &data, (long)entry.length);
+	}
+	if (session != NULL && SSL_SESSION_is_resumable(session) &&
+		time(NULL) < SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session)) {
+		SSL_set_session(connection->ssl, session);
+	}
+	SSL_SESSION_free(session);
+	free(entry.data);
+}
+
+/*
+ * Called by OpenSSL for every new session, with TLS 1.3 the tickets arrive
+ * after the handshake while the plugin reads. Failing to store one only
+ * costs the resumption next time, so errors are ignored.
+ */
+static int store_new_session(SSL *ssl, SSL_SESSION *session) {
+	np_net_ssl_connection *connection = SSL_get_app_data(ssl);
+	int length = i2d_SSL_SESSION(session, NULL);
+	if (length <= 0 || connection == NULL || connection->session_cache_key == NULL) {
+		return 0;
+	}
+	unsigned char *data = malloc((size_t)length);
+	if (data == NULL) {
+		return 0;
+	}
+	unsigned char *end = data;
+	i2d_SSL_SESSION(session, &end);
+
+	char *filename = np_state_database_filename();
+	np_state_create_directories(filename);
+	np_state_db database = np_state_db_open(filename);
+	np_state_db_put(&database, connection->session_cache_key, NP_SSL_SESSION_CACHE_VERSION,
+					time(NULL), (const char *)data, (size_t)length);
+	np_state_db_close(&database);
+	free(filename);
+	free(data);
+	connection->session_stored = true;
+	return 0; /* the session is not kept */
+}
+#	endif /* MOPL_USE_OPENSSL */
+
+/* Protocol version and client certificate, returns STATE_OK or why they can not be used */
+static mp_state_enum configure_context(SSL_CTX *ctx, int version, const char *cert,
+									   const char *privkey) {
 	switch (version) {
 	case MP_SSLv2: /* SSLv2 protocol */
 		printf("%s\n", _("UNKNOWN - SSL protocol version 2 is not supported by your SSL library."));
@@ -145,50 +215,362 @@ int np_net_ssl_init_with_hostname_version_and_cert(int sd, char *host_name, int
 		}
 #	endif
 	}
+
+	return STATE_OK;
+}
+
+mp_state_enum np_net_ssl_context_new(np_net_ssl_context **context, int version, const char *cert,
+									 const char *privkey) {
+	*context = NULL;
+	SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+	if (ctx == NULL) {
+		printf("%s\n", _("CRITICAL - Cannot create SSL context."));
+		return STATE_CRITICAL;
+	}
+
+	mp_state_enum result = configure_context(ctx, version, cert, privkey);
+	if (result != STATE_OK) {
+		SSL_CTX_free(ctx);
+		return result;
+	}
+
+	long options = 0;
 #	ifdef SSL_OP_NO_TICKET
+	/* enabled again by connections with session cache */
 	options |= SSL_OP_NO_TICKET;
 #	endif
 	SSL_CTX_set_options(ctx, options);
 	SSL_CTX_set_mode(ctx, SSL_MODE_AUTO_RETRY);
-	if ((s = SSL_new(ctx)) != NULL) {
+#	ifdef MOPL_USE_OPENSSL
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, store_new_session);
+#	endif
+
+	*context = calloc(1, sizeof(np_net_ssl_context));
+	if (*context == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	(*context)->ctx = ctx;
+	return STATE_OK;
+}
+
+/* The connections of the context have to be freed before */
+void np_net_ssl_context_free(np_net_ssl_context *context) {
+	if (context != NULL) {
+		SSL_CTX_free(context->ctx);
+		free(context);
+	}
+}
+
+np_net_ssl_connection *np_net_ssl_connection_new(np_net_ssl_context *context, int socket,
+												 const char *host_name) {
+	SSL *ssl = SSL_new(context->ctx);
+	if (ssl == NULL) {
+		return NULL;
+	}
+	np_net_ssl_connection *connection = calloc(1, sizeof(np_net_ssl_connection));
+	if (connection == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	connection->ssl = ssl;
+	SSL_set_app_data(ssl, connection);
 #	ifdef SSL_set_tlsext_host_name
-		if (host_name != NULL) {
-			SSL_set_tlsext_host_name(s, host_name);
+	if (host_name != NULL) {
+		connection->host_name = strdup(host_name);
+		SSL_set_tlsext_host_name(ssl, host_name);
+	}
+#	endif
+	SSL_set_fd(ssl, socket);
+	return connection;
+}
+
+/*
+ * Keeps the sessions of this connection in the shared state database, see
+ * np_net_ssl_cache_sessions. Call before the handshake.
+ */
+void np_net_ssl_connection_cache_sessions(np_net_ssl_connection *connection,
+										  const char *host_name, int port) {
+#	ifdef MOPL_USE_OPENSSL
+	free(connection->session_cache_key);
+	xasprintf(&connection->session_cache_key, "tls_session/%s:%d/%s", host_name, port,
+			  (connection->host_name != NULL) ? connection->host_name : "");
+#		ifdef SSL_OP_NO_TICKET
+	SSL_clear_options(connection->ssl, SSL_OP_NO_TICKET);
+#		endif
+	load_cached_session(connection);
+#	else
+	(void)connection;
+	(void)host_name;
+	(void)port;
+#	endif
+}
+
+/*
+ * Advances the handshake as far as possible without blocking if the socket
+ * is non-blocking. On WANT_READ or WANT_WRITE the caller waits until the
+ * socket is readable or writable and calls again.
+ */
+np_net_ssl_handshake_status np_net_ssl_handshake_step(np_net_ssl_connection *connection) {
+	if (!connection->handshake_started) {
+		connection->handshake_started = true;
+		connection->handshake_start = seconds_now();
+	}
+
+	int result = SSL_connect(connection->ssl);
+	if (result == 1) {
+		connection->handshake_time = seconds_now() - connection->handshake_start;
+		return NP_SSL_HANDSHAKE_DONE;
+	}
+	switch (SSL_get_error(connection->ssl, result)) {
+	case SSL_ERROR_WANT_READ:
+		return NP_SSL_HANDSHAKE_WANT_READ;
+	case SSL_ERROR_WANT_WRITE:
+		return NP_SSL_HANDSHAKE_WANT_WRITE;
+	default:
+		connection->handshake_time = seconds_now() - connection->handshake_start;
+		return NP_SSL_HANDSHAKE_FAILED;
+	}
+}
+
+/* Performs the whole handshake, waiting at most timeout seconds for the server */
+mp_state_enum np_net_ssl_handshake(np_net_ssl_connection *connection, double timeout) {
+	int socket = SSL_get_fd(connection->ssl);
+	int flags = fcntl(socket, F_GETFL, 0);
+	fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+
+	double deadline = seconds_now() + timeout;
+	np_net_ssl_handshake_status status = np_net_ssl_handshake_step(connection);
+	while (status == NP_SSL_HANDSHAKE_WANT_READ || status == NP_SSL_HANDSHAKE_WANT_WRITE) {
+		struct pollfd descriptor = {
+			.fd = socket,
+			.events = (status == NP_SSL_HANDSHAKE_WANT_READ) ? POLLIN : POLLOUT,
+		};
+		double remaining = deadline - seconds_now();
+		if (remaining <= 0 ||
+			(poll(&descriptor, 1, (int)(remaining * 1000) + 1) < 0 && errno != EINTR)) {
+			status = NP_SSL_HANDSHAKE_FAILED;
+			break;
+		}
+		status = np_net_ssl_handshake_step(connection);
+	}
+
+	fcntl(socket, F_SETFL, flags);
+	/* a blocking handshake follows np_net_connect, the concurrent ones go step by step */
+	net_timing.handshake_time = connection->handshake_time;
+	return (status == NP_SSL_HANDSHAKE_DONE) ? STATE_OK : STATE_CRITICAL;
+}
+
+/* -1 with errno EAGAIN if the session has to wait for a non-blocking socket */
+static int io_result(np_net_ssl_connection *connection, int result) {
+	if (result <= 0) {
+		int error = SSL_get_error(connection->ssl, result);
+		if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+			errno = EAGAIN;
+			return -1;
 		}
+	}
+	return result;
+}
+
+int np_net_ssl_connection_read(np_net_ssl_connection *connection, void *buffer, int size) {
+	return io_result(connection, SSL_read(connection->ssl, buffer, size));
+}
+
+int np_net_ssl_connection_write(np_net_ssl_connection *connection, const void *buffer, int size) {
+	return io_result(connection, SSL_write(connection->ssl, buffer, size));
+}
+
+bool np_net_ssl_connection_reused(const np_net_ssl_connection *connection) {
+#	ifdef MOPL_USE_OPENSSL
+	return SSL_session_reused(connection->ssl);
+#	else
+	(void)connection;
+	return false;
 #	endif
-		SSL_set_fd(s, sd);
-		if (SSL_connect(s) == 1) {
-			return OK;
-		} else {
-			printf("%s\n", _("CRITICAL - Cannot make SSL connection."));
-#	ifdef MOPL_USE_OPENSSL /* XXX look into ERR_error_string */
-			ERR_print_errors_fp(stdout);
-#	endif /* MOPL_USE_OPENSSL */
+}
+
+double np_net_ssl_connection_handshake_time(const np_net_ssl_connection *connection) {
+	return connection->handshake_time;
+}
+
+/* Handshake time and, with the session cache, whether the session was resumed */
+void mp_net_ssl_connection_add_handshake_perfdata(const np_net_ssl_connection *connection,
+												  mp_subcheck *subcheck) {
+	mp_perfdata handshake_time_pd = perfdata_init();
+	handshake_time_pd = mp_set_pd_value(handshake_time_pd, connection->handshake_time);
+	handshake_time_pd.label = "tls_handshake_time";
+	handshake_time_pd.uom = "s";
+	mp_add_perfdata_to_subcheck(subcheck, handshake_time_pd);
+
+	if (connection->session_cache_key != NULL) {
+		mp_perfdata resumed_pd = perfdata_init();
+		resumed_pd = mp_set_pd_value(resumed_pd, np_net_ssl_connection_reused(connection) ? 1 : 0);
+		resumed_pd.label = "tls_resumed";
+		mp_add_perfdata_to_subcheck(subcheck, resumed_pd);
+	}
+}
+
+/*
+ * TLS 1.3 tickets follow the handshake, a plugin which did not read anything
+ * has not seen them yet. Processes what arrived so far without blocking and
+ * returns true while the ticket of a connection caching its sessions is still
+ * missing, a poll loop waits for the socket to become readable meanwhile.
+ */
+bool np_net_ssl_connection_ticket_pending(np_net_ssl_connection *connection) {
+#	ifdef MOPL_USE_OPENSSL
+	if (connection->session_cache_key == NULL || connection->session_stored ||
+		connection->ticket_abandoned || !SSL_is_init_finished(connection->ssl)) {
+		return false;
+	}
+
+	int socket = SSL_get_fd(connection->ssl);
+	int flags = fcntl(socket, F_GETFL, 0);
+	fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+	char byte;
+	int peeked = SSL_peek(connection->ssl, &byte, 1);
+	int error = SSL_get_error(connection->ssl, peeked);
+	fcntl(socket, F_SETFL, flags);
+
+	/* application data or the end of the connection, no ticket can follow unread */
+	if (peeked > 0 || (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)) {
+		connection->ticket_abandoned = true;
+	}
+	return !connection->session_stored && !connection->ticket_abandoned;
+#	else
+	(void)connection;
+	return false;
+#	endif
+}
+
+/* np_net_ssl_connection_free does not wait for the session ticket then */
+void np_net_ssl_connection_abandon_ticket(np_net_ssl_connection *connection) {
+	connection->ticket_abandoned = true;
+}
+
+/* Shuts the TLS session down, the socket stays open */
+void np_net_ssl_connection_free(np_net_ssl_connection *connection) {
+	if (connection == NULL) {
+		return;
+	}
+#	ifdef MOPL_USE_OPENSSL
+	/* a blocking wait for the ticket, see np_net_ssl_connection_ticket_pending */
+	if (connection->session_cache_key != NULL && !connection->session_stored &&
+		!connection->ticket_abandoned && SSL_is_init_finished(connection->ssl)) {
+		struct pollfd descriptor = {.fd = SSL_get_fd(connection->ssl), .events = POLLIN};
+		if (poll(&descriptor, 1, NP_SSL_TICKET_WAIT) > 0) {
+			int flags = fcntl(descriptor.fd, F_GETFL, 0);
+			fcntl(descriptor.fd, F_SETFL, flags | O_NONBLOCK);
+			char byte;
+			SSL_peek(connection->ssl, &byte, 1);
+			fcntl(descriptor.fd, F_SETFL, flags);
 		}
-	} else {
+	}
+#	endif
+#	ifdef SSL_set_tlsext_host_name
+	SSL_set_tlsext_host_name(connection->ssl, NULL);
+#	endif
+	SSL_shutdown(connection->ssl);
+	SSL_free(connection->ssl);
+	free(connection->host_name);
+	free(connection->session_cache_key);
+	free(connection);
+}
+
+static ssize_t np_net_reader_ssl_read(np_net_reader *reader, void *buffer, size_t size) {
+	return SSL_read(reader->ssl_connection->ssl, buffer, (int)size);
+}
+
+/*
+ * Switches the reader to the TLS session. Data received in plain text
+ * before the handshake is dropped, a server may not inject it into the
+ * encrypted part of a STARTTLS session.
+ */
+void np_net_reader_use_ssl_connection(np_net_reader *reader, np_net_ssl_connection *connection) {
+	reader->read = np_net_reader_ssl_read;
+	reader->ssl_connection = connection;
+	reader->start = 0;
+	reader->end = 0;
+}
+
+/* The calls without connection argument work on one connection at a time */
+
+void np_net_ssl_cache_sessions(const char *host_name, int port) {
+	free(legacy_cache_host);
+	legacy_cache_host = strdup(host_name);
+	legacy_cache_port = port;
+}
+
+bool np_net_ssl_session_reused(void) {
+	return legacy_connection != NULL && np_net_ssl_connection_reused(legacy_connection);
+}
+
+double np_net_ssl_handshake_time(void) {
+	return (legacy_connection != NULL) ? legacy_connection->handshake_time : 0;
+}
+
+void mp_net_ssl_add_handshake_perfdata(mp_subcheck *subcheck) {
+	if (legacy_connection != NULL) {
+		mp_net_ssl_connection_add_handshake_perfdata(legacy_connection, subcheck);
+	}
+}
+
+int np_net_ssl_init(int sd) { return np_net_ssl_init_with_hostname(sd, NULL); }
+
+int np_net_ssl_init_with_hostname(int sd, char *host_name) {
+	return np_net_ssl_init_with_hostname_and_version(sd, host_name, 0);
+}
+
+int np_net_ssl_init_with_hostname_and_version(int sd, char *host_name, int version) {
+	return np_net_ssl_init_with_hostname_version_and_cert(sd, host_name, version, NULL, NULL);
+}
+
+int np_net_ssl_init_with_hostname_version_and_cert(int sd, char *host_name, int version, char *cert,
+												   char *privkey) {
+	np_net_ssl_cleanup();
+
+	mp_state_enum result = np_net_ssl_context_new(&legacy_context, version, cert, privkey);
+	if (result != STATE_OK) {
+		return result;
+	}
+
+	legacy_connection = np_net_ssl_connection_new(legacy_context, sd, host_name);
+	if (legacy_connection == NULL) {
 		printf("%s\n", _("CRITICAL - Cannot initiate SSL handshake."));
+		return STATE_CRITICAL;
+	}
+	if (legacy_cache_host != NULL) {
+		np_net_ssl_connection_cache_sessions(legacy_connection, legacy_cache_host,
+											 legacy_cache_port);
 	}
+
+	if (np_net_ssl_handshake(legacy_connection, socket_timeout) == STATE_OK) {
+		return OK;
+	}
+	printf("%s\n", _("CRITICAL - Cannot make SSL connection."));
+#	ifdef MOPL_USE_OPENSSL /* XXX look into ERR_error_string */
+	ERR_print_errors_fp(stdout);
+#	endif /* MOPL_USE_OPENSSL */
 	return STATE_CRITICAL;
 }
 
 void np_net_ssl_cleanup() {
-	if (s) {
-#	ifdef SSL_set_tlsext_host_name
-		SSL_set_tlsext_host_name(s, NULL);
-#	endif
-		SSL_shutdown(s);
-		SSL_free(s);
-		if (ctx) {
-			SSL_CTX_free(ctx);
-			ctx = NULL;
-		}
-		s = NULL;
-	}
+	np_net_ssl_connection_free(legacy_connection);
+	legacy_connection = NULL;
+	np_net_ssl_context_free(legacy_context);
+	legacy_context = NULL;
+}
+
+int np_net_ssl_write(const void *buf, int num) {
+	return np_net_ssl_connection_write(legacy_connection, buf, num);
 }
 
-int np_net_ssl_write(const void *buf, int num) { return SSL_write(s, buf, num); }
+int np_net_ssl_read(void *buf, int num) {
+	return np_net_ssl_connection_read(legacy_connection, buf, num);
+}
 
-int np_net_ssl_read(void *buf, int num) { return SSL_read(s, buf, num); }
+void np_net_reader_use_ssl(np_net_reader *reader) {
+	np_net_reader_use_ssl_connection(reader, legacy_connection);
+}
 
 mp_state_enum np_net_ssl_check_certificate(X509 *certificate, int days_till_exp_warn,
 										   int days_till_exp_crit) {
@@ -412,9 +794,16 @@ retrieve_expiration_time_result np_net_ssl_get_cert_expiration(X509 *certificate
 
 net_ssl_check_cert_result np_net_ssl_check_cert2(unsigned int days_till_exp_warn,
 												 unsigned int days_till_exp_crit) {
+	return np_net_ssl_connection_check_cert2(legacy_connection, days_till_exp_warn,
+											 days_till_exp_crit);
+}
+
+net_ssl_check_cert_result np_net_ssl_connection_check_cert2(np_net_ssl_connection *connection,
+															unsigned int days_till_exp_warn,
+															unsigned int days_till_exp_crit) {
 #	ifdef MOPL_USE_OPENSSL
 	X509 *certificate = NULL;
-	certificate = SSL_get_peer_certificate(s);
+	certificate = SSL_get_peer_certificate(connection->ssl);
 
 	retrieve_expiration_time_result expiration_date = np_net_ssl_get_cert_expiration(certificate);
 
@@ -446,9 +835,15 @@ net_ssl_check_cert_result np_net_ssl_check_cert2(unsigned int days_till_exp_warn
 }
 
 mp_state_enum np_net_ssl_check_cert(int days_till_exp_warn, int days_till_exp_crit) {
+	return np_net_ssl_connection_check_cert(legacy_connection, days_till_exp_warn,
+											days_till_exp_crit);
+}
+
+mp_state_enum np_net_ssl_connection_check_cert(np_net_ssl_connection *connection,
+											   int days_till_exp_warn, int days_till_exp_crit) {
 #	ifdef MOPL_USE_OPENSSL
 	X509 *certificate = NULL;
-	certificate = SSL_get_peer_certificate(s);
+	certificate = SSL_get_peer_certificate(connection->ssl);
 	return (np_net_ssl_check_certificate(certificate, days_till_exp_warn, days_till_exp_crit));
 #	else  /* ifndef MOPL_USE_OPENSSL */
 	printf("%s\n", _("WARNING - Plugin does not support checking certificates."));
@@ -588,4 +983,111 @@ mp_subcheck mp_net_ssl_check_certificate(X509 *certificate, int days_till_exp_wa
 	return sc_cert;
 #	endif /* MOPL_USE_OPENSSL */
 }
+
+np_net_ssl_chain_result np_net_ssl_connection_check_chain(np_net_ssl_connection *connection) {
+	np_net_ssl_chain_result result = {
+		.errorcode = ERROR,
+	};
+#	ifdef MOPL_USE_OPENSSL
+	/* on the client side the chain starts with the leaf */
+	STACK_OF(X509) *chain = SSL_get_peer_cert_chain(connection->ssl);
+	int length = (chain != NULL) ? sk_X509_num(chain) : 0;
+	if (length <= 0) {
+		return result;
+	}
+
+	result.certificates = calloc((size_t)length, sizeof(np_net_ssl_chain_certificate));
+	if (result.certificates == NULL) {
+		die(STATE_UNKNOWN, _("Allocation failed"));
+	}
+	result.number_of_certificates = (size_t)length;
+
+	for (int i = 0; i < length; i++) {
+		X509 *certificate = sk_X509_value(chain, i);
+		np_net_ssl_chain_certificate *entry = &result.certificates[i];
+
+		X509_NAME *subject = X509_get_subject_name(certificate);
+		if (subject == NULL ||
+			X509_NAME_get_text_by_NID(subject, NID_commonName, entry->common_name,
+									  sizeof(entry->common_name)) == -1) {
+			strcpy(entry->common_name, _("Unknown CN"));
+		}
+
+		/* compares the ASN.1 time directly, without the detour through struct tm and TZ */
+		int days;
+		int seconds;
+		if (!ASN1_TIME_diff(&days, &seconds, NULL, X509_get_notAfter(certificate))) {
+			entry->errors = WRONG_TIME_FORMAT_IN_CERTIFICATE;
+			continue;
+		}
+		entry->remaining_seconds = ((double)days * 86400) + seconds;
+		entry->errors = ALL_OK;
+
+		const np_net_ssl_chain_certificate *soonest = &result.certificates[result.soonest];
+		if (soonest->errors != ALL_OK || entry->remaining_seconds < soonest->remaining_seconds) {
+			result.soonest = (size_t)i;
+		}
+	}
+	result.errorcode = OK;
+#	else
+	(void)connection;
+#	endif /* MOPL_USE_OPENSSL */
+	return result;
+}
+
+void np_net_ssl_chain_result_free(np_net_ssl_chain_result *chain) {
+	free(chain->certificates);
+	chain->certificates = NULL;
+	chain->number_of_certificates = 0;
+}
+
+mp_subcheck mp_net_ssl_check_chain(const np_net_ssl_chain_result *chain, int days_till_exp_warn,
+								   int days_till_exp_crit, const char *label_prefix) {
+	mp_subcheck sc_chain = mp_subcheck_init();
+	if (chain->errorcode != OK) {
+		xasprintf(&sc_chain.output, _("No server certificate present to inspect"));
+		return mp_set_subcheck_state(sc_chain, STATE_CRITICAL);
+	}
+
+	mp_thresholds thresholds = mp_thresholds_init();
+	char *range = NULL;
+	xasprintf(&range, "%d:", days_till_exp_warn * 86400);
+	thresholds = mp_thresholds_set_warn(thresholds, mp_parse_range_string(range).range);
+	xasprintf(&range, "%d:", days_till_exp_crit * 86400);
+	thresholds = mp_thresholds_set_crit(thresholds, mp_parse_range_string(range).range);
+
+	mp_state_enum state = STATE_OK;
+	for (size_t i = 0; i < chain->number_of_certificates; i++) {
+		const np_net_ssl_chain_certificate *certificate = &chain->certificates[i];
+		if (certificate->errors != ALL_OK) {
+			state = STATE_CRITICAL;
+			continue;
+		}
+		mp_perfdata lifetime_pd = perfdata_init();
+		lifetime_pd = mp_set_pd_value(lifetime_pd, certificate->remaining_seconds);
+		if (label_prefix != NULL) {
+			xasprintf(&lifetime_pd.label, "%s %s", label_prefix, certificate->common_name);
+		} else {
+			lifetime_pd.label = strdup(certificate->common_name);
+		}
+		lifetime_pd.uom = "s";
+		lifetime_pd = mp_pd_set_thresholds(lifetime_pd, thresholds);
+		state = max_state(state, mp_get_pd_status(lifetime_pd));
+		mp_add_perfdata_to_subcheck(&sc_chain, lifetime_pd);
+	}
+
+	const np_net_ssl_chain_certificate *soonest = &chain->certificates[chain->soonest];
+	int days = (int)(soonest->remaining_seconds / 86400);
+	if (soonest->errors != ALL_OK) {
+		xasprintf(&sc_chain.output, _("Wrong time format in certificate '%s'"),
+				  soonest->common_name);
+	} else if (soonest->remaining_seconds < 0) {
+		xasprintf(&sc_chain.output, _("Certificate '%s' expired %d day(s) ago (%zu in chain)"),
+				  soonest->common_name, -days, chain->number_of_certificates);
+	} else {
+		xasprintf(&sc_chain.output, _("Certificate '%s' expires in %d day(s) (%zu in chain)"),
+				  soonest->common_name, days, chain->number_of_certificates);
+	}
+	return mp_set_subcheck_state(sc_chain, state);
+}
 #endif /* HAVE_SSL */
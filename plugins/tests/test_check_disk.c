@@ -25,7 +25,7 @@ void np_test_mount_entry_regex(struct mount_entry *dummy_mount_list, char *regst
 							   int expect, char *desc);
 
 int main(int argc, char **argv) {
-	plan_tests(35);
+	plan_tests(67);
 
 	struct name_list *exclude_filesystem = NULL;
 	ok(np_find_name(exclude_filesystem, "/var/log") == false, "/var/log not in list");
@@ -43,6 +43,47 @@ int main(int argc, char **argv) {
 
 	ok(np_find_name(exclude_filesystem, "iso9660") == false, "Make sure no clashing in variables");
 
+	mp_int_string_set exclude_filesystem_set = mp_int_string_set_init(exclude_filesystem);
+	ok(mp_int_string_set_contains(&exclude_filesystem_set, "/var/log") &&
+		   mp_int_string_set_contains(&exclude_filesystem_set, "/home") &&
+		   !mp_int_string_set_contains(&exclude_filesystem_set, "/var") &&
+		   !mp_int_string_set_contains(&exclude_filesystem_set, "iso9660"),
+	   "string set finds the same names as the list");
+	mp_int_string_set empty_set = mp_int_string_set_init(NULL);
+	ok(!mp_int_string_set_contains(&empty_set, "/var/log"), "empty string set contains nothing");
+
+	/* The compiled regex set has to agree with np_find_regmatch on every name */
+	const char *set_patterns[] = {"iso9660", "tmp.*",     "ext[234]", "(nfs|cifs)4?",
+								  "a)",      "fuse\\..*", "x(y",      "([a-c])\\1"};
+	const int set_cflags[] = {REG_EXTENDED, REG_EXTENDED, REG_EXTENDED, REG_EXTENDED,
+							  0,            REG_EXTENDED, 0,            REG_EXTENDED};
+	const char *set_names[] = {"iso9660", "iso96600", "tmpfs", "tmp",      "xtmpfs", "ext3",
+							   "ext5",    "ext34",    "nfs",   "nfs4",     "cifs44", "a)",
+							   "a",       "fuse.sshfs", "fuse", "x(y",     "aa",     "ab",
+							   "",        "NFS"};
+	struct regex_list *set_list = NULL;
+	bool all_compiled = true;
+	for (size_t index = 0; index < sizeof(set_patterns) / sizeof(set_patterns[0]); index++) {
+		if (np_add_regex(&set_list, set_patterns[index], set_cflags[index]) != 0) {
+			all_compiled = false;
+		}
+	}
+	ok(all_compiled, "all patterns for the regex set compiled");
+
+	mp_int_regex_set regex_set = mp_int_regex_set_init(set_list);
+	ok(regex_set.literals.length == 1 && regex_set.combined_is_set &&
+		   regex_set.remaining_length == 3,
+	   "literal, combinable and remaining patterns are told apart");
+	size_t disagreements = 0;
+	for (size_t index = 0; index < sizeof(set_names) / sizeof(set_names[0]); index++) {
+		if (np_find_regmatch(set_list, set_names[index]) !=
+			mp_int_regex_set_match(&regex_set, set_names[index])) {
+			diag("regex set disagrees on '%s'", set_names[index]);
+			disagreements++;
+		}
+	}
+	ok(disagreements == 0, "regex set matches exactly the same names as the list");
+
 	/*
 	for (temp_name = exclude_filesystem; temp_name; temp_name = temp_name->next) {
 		printf("Name: %s\n", temp_name->name);
@@ -92,6 +133,47 @@ int main(int argc, char **argv) {
 	np_test_mount_entry_regex(dummy_mount_list, strdup("(/homE)|(/Var)"), cflags | REG_ICASE, 2,
 							  strdup("grouped regi pathname match:"));
 
+	/* A long -i/-I list compiled into one search set has to ignore the same entries as trying
+	 * every pattern on its own */
+	struct regex_list *ignore_list = NULL;
+	all_compiled = true;
+	for (int index = 0; index < 200; index++) {
+		char pattern[32];
+		snprintf(pattern, sizeof(pattern), "^/srv/data%d$|sd%dx", index, index);
+		if (np_add_regex(&ignore_list, pattern, cflags) != 0) {
+			all_compiled = false;
+		}
+	}
+	if (np_add_regex(&ignore_list, "C1T0", cflags | REG_ICASE) != 0 ||
+		np_add_regex(&ignore_list, "(0)d\\1", cflags) != 0 ||
+		np_add_regex(&ignore_list, "^/home$", cflags) != 0) {
+		all_compiled = false;
+	}
+	mp_int_regex_search_set ignore_set = mp_int_regex_search_set_init(ignore_list);
+	ok(all_compiled && ignore_set.length == 203 && ignore_set.combined_length == 2 &&
+		   ignore_set.remaining_length == 1,
+	   "ignore patterns are combined per cflags, back references are kept apart");
+	int ignore_matches = 0;
+	disagreements = 0;
+	me = dummy_mount_list;
+	for (int index = 0; index < 3; index++, me = me->me_next) {
+		bool expected = false;
+		for (struct regex_list *pattern = ignore_list; pattern; pattern = pattern->next) {
+			expected = expected || np_regex_match_mount_entry(me, &pattern->regex);
+		}
+		bool matched = mp_int_regex_search_set_match_mount_entry(&ignore_set, me);
+		if (matched != expected) {
+			diag("ignore set disagrees on '%s'", me->me_mountdir);
+			disagreements++;
+		}
+		if (matched) {
+			ignore_matches++;
+		}
+	}
+	ok(disagreements == 0 && ignore_matches == 3,
+	   "ignore set matches the same mount entries as each pattern on its own");
+	mp_int_regex_search_set_free(&ignore_set);
+
 	filesystem_list test_paths = filesystem_list_init();
 	mp_int_fs_list_append(&test_paths, "/home/groups");
 	mp_int_fs_list_append(&test_paths, "/var");
@@ -191,6 +273,160 @@ int main(int argc, char **argv) {
 	ok(!found, "last (/home) element successfully deleted");
 	ok(count == 2, "two elements remaining");
 
+	/* stacked mounts: the last entry for a mount point hides the earlier ones */
+	struct mount_entry *stacked_mount_list = NULL;
+	mtail = &stacked_mount_list;
+	const char *stacked_mounts[][2] = {
+		{"/dev/sda1", "/"},
+		{"/dev/sda2", "/var"},
+		{"tmpfs", "/var"},
+		{"tmpfs", "/"},
+	};
+	for (size_t index = 0; index < sizeof(stacked_mounts) / sizeof(stacked_mounts[0]); index++) {
+		me = (struct mount_entry *)calloc(1, sizeof *me);
+		me->me_devname = strdup(stacked_mounts[index][0]);
+		me->me_mountdir = strdup(stacked_mounts[index][1]);
+		*mtail = me;
+		mtail = &me->me_next;
+	}
+
+	mp_int_mount_index *stacked_index = mp_int_mount_index_build(stacked_mount_list);
+	ok(stacked_index->length == 4, "Mount index contains all mount entries");
+
+	filesystem_list stacked_paths = filesystem_list_init();
+	parameter_list_elem *var_log = mp_int_fs_list_append(&stacked_paths, "/var/log");
+	parameter_list_elem *variable = mp_int_fs_list_append(&stacked_paths, "/variable");
+	parameter_list_elem *etc = mp_int_fs_list_append(&stacked_paths, "/etc");
+	parameter_list_elem *sda2 = mp_int_fs_list_append(&stacked_paths, "/dev/sda2");
+	mp_int_fs_list_set_best_match_indexed(stacked_paths, stacked_index, false);
+
+	ok(var_log->best_match && !strcmp(var_log->best_match->me_devname, "tmpfs") &&
+		   !strcmp(var_log->best_match->me_mountdir, "/var"),
+	   "/var/log got the last mount on /var");
+	ok(variable->best_match && !strcmp(variable->best_match->me_mountdir, "/var"),
+	   "/variable is matched by prefix like before");
+	ok(etc->best_match && !strcmp(etc->best_match->me_devname, "tmpfs") &&
+		   !strcmp(etc->best_match->me_mountdir, "/"),
+	   "/etc got the last mount on /");
+	ok(sda2->best_match && !strcmp(sda2->best_match->me_mountdir, "/var"),
+	   "/dev/sda2 got matched by device name");
+	mp_int_mount_index_free(stacked_index);
+
+	mp_int_mountinfo_result mountinfo = mp_int_read_mountinfo("./var/proc_mountinfo");
+	ok(mountinfo.errorcode == OK, "mountinfo file was read");
+	ok(mountinfo.lines_read == 8, "mountinfo has 8 lines");
+	int mountinfo_entries = 0;
+	struct mount_entry *cdrom = NULL;
+	struct mount_entry *nfs = NULL;
+	struct mount_entry *proc = NULL;
+	for (me = mountinfo.mount_list; me; me = me->me_next) {
+		mountinfo_entries++;
+		if (!strcmp(me->me_type, "iso9660")) {
+			cdrom = me;
+		} else if (!strcmp(me->me_type, "nfs4")) {
+			nfs = me;
+		} else if (!strcmp(me->me_type, "proc")) {
+			proc = me;
+		}
+	}
+	ok(mountinfo_entries == 8, "all mountinfo entries are materialized");
+	ok(mountinfo.mount_list && !strcmp(mountinfo.mount_list->me_mountdir, "/") &&
+		   !strcmp(mountinfo.mount_list->me_devname, "/dev/sda2"),
+	   "first mountinfo entry is / on /dev/sda2");
+	ok(cdrom && !strcmp(cdrom->me_mountdir, "/media/cd rom"), "escaped mount point is unescaped");
+	ok(nfs && nfs->me_remote && !nfs->me_dummy, "nfs mount is remote");
+	ok(proc && proc->me_dummy && !proc->me_remote, "proc mount is dummy");
+	ok(mp_int_read_mountinfo("./var/does_not_exist").errorcode == ERROR,
+	   "missing mountinfo file is reported");
+
+	/* without a path every top-most mount is checked unless it is excluded */
+	struct mount_entry *selection_mount_list = NULL;
+	mtail = &selection_mount_list;
+	const char *selection_mounts[][3] = {
+		{"/dev/sda1", "/", "ext4"},
+		{"/dev/sdb1", "/data", "ext4"},
+		{"tmpfs", "/data", "tmpfs"},
+		{"/dev/sdc1", "/srv", "xfs"},
+		{"/dev/loop0", "/media", "iso9660"},
+		{"proc", "/proc", "proc"},
+	};
+	for (size_t index = 0; index < sizeof(selection_mounts) / sizeof(selection_mounts[0]);
+		 index++) {
+		me = (struct mount_entry *)calloc(1, sizeof *me);
+		me->me_devname = strdup(selection_mounts[index][0]);
+		me->me_mountdir = strdup(selection_mounts[index][1]);
+		me->me_type = strdup(selection_mounts[index][2]);
+		me->me_dummy = !strcmp(me->me_type, "proc");
+		*mtail = me;
+		mtail = &me->me_next;
+	}
+	mp_int_mount_index *selection_index = mp_int_mount_index_build(selection_mount_list);
+	struct mount_entry *selected[6];
+
+	mp_int_mount_filter filter = mp_int_mount_filter_init(NULL, NULL, NULL);
+	size_t number_selected = mp_int_mount_index_select(selection_index, &filter, selected);
+	ok(number_selected == 4 && !strcmp(selected[0]->me_mountdir, "/") &&
+		   !strcmp(selected[1]->me_devname, "tmpfs") &&
+		   !strcmp(selected[2]->me_mountdir, "/srv") &&
+		   !strcmp(selected[3]->me_mountdir, "/media"),
+	   "Only the top-most mount of a directory is selected, dummies are not");
+
+	struct regex_list *fs_exclude_list = NULL;
+	struct name_list *device_path_exclude_list = NULL;
+	np_add_regex(&fs_exclude_list, "tmp.*", REG_EXTENDED);
+	np_add_name(&device_path_exclude_list, "/media");
+	filter = mp_int_mount_filter_init(fs_exclude_list, NULL, device_path_exclude_list);
+	number_selected = mp_int_mount_index_select(selection_index, &filter, selected);
+	ok(number_selected == 2 && !strcmp(selected[0]->me_mountdir, "/") &&
+		   !strcmp(selected[1]->me_mountdir, "/srv"),
+	   "An excluded top-most mount hides the filesystem below instead of exposing it");
+
+	struct regex_list *fs_include_list = NULL;
+	np_add_regex(&fs_include_list, "ext4", REG_EXTENDED);
+	filter = mp_int_mount_filter_init(NULL, fs_include_list, NULL);
+	number_selected = mp_int_mount_index_select(selection_index, &filter, selected);
+	ok(number_selected == 1 && !strcmp(selected[0]->me_mountdir, "/"),
+	   "Only included types are selected");
+	mp_int_mount_index_free(selection_index);
+
+	/* fill rate retention */
+	mp_int_fill_state fill_state = mp_int_fill_state_parse(NULL);
+	ok(fill_state.length == 0, "no fill state without previous data");
+
+	uint64_t root_key = mp_int_fill_state_key("/");
+	uint64_t var_key = mp_int_fill_state_key("/var");
+	mp_int_fill_state_entry root_entry = mp_int_fill_state_update(NULL, root_key, 1000, 60, 0.5);
+	ok(!root_entry.fill_rate_is_set, "no fill rate from a single sample");
+	mp_int_fill_state_insert(&fill_state, root_entry);
+	mp_int_fill_state_insert(&fill_state,
+							 mp_int_fill_state_update(NULL, var_key, 5000, 60, 0.5));
+
+	char *serialized_fill_state = mp_int_fill_state_serialize(fill_state);
+	mp_int_fill_state parsed_fill_state = mp_int_fill_state_parse(serialized_fill_state);
+	ok(parsed_fill_state.length == 2, "fill state survives serialization");
+
+	mp_int_fill_state_entry *previous_root = mp_int_fill_state_find(parsed_fill_state, root_key);
+	ok(previous_root && previous_root->used_bytes == 1000, "fill state found by key");
+
+	root_entry = mp_int_fill_state_update(previous_root, root_key, 4600, 60, 0.5);
+	ok(root_entry.fill_rate_is_set && root_entry.fill_rate == 60,
+	   "first fill rate is the sample itself");
+	root_entry = mp_int_fill_state_update(&root_entry, root_key, 4600, 60, 0.5);
+	ok(root_entry.fill_rate == 30, "fill rate is exponentially weighted");
+	ok(mp_int_time_to_full(root_entry, 3000) == 100, "time to full from free space and rate");
+
+	root_entry = mp_int_fill_state_update(&root_entry, root_key, 1000, 60, 0.5);
+	ok(mp_int_time_to_full(root_entry, 3000) < 0, "no time to full for a shrinking usage");
+
+	mp_int_fill_state_insert(&parsed_fill_state, root_entry);
+	parsed_fill_state =
+		mp_int_fill_state_parse(mp_int_fill_state_serialize(parsed_fill_state));
+	previous_root = mp_int_fill_state_find(parsed_fill_state, root_key);
+	ok(parsed_fill_state.length == 2 && previous_root && previous_root->fill_rate_is_set &&
+		   previous_root->fill_rate == root_entry.fill_rate &&
+		   mp_int_fill_state_parse("garbage;12:x:-;").length == 0,
+	   "fill rates are retained and malformed entries skipped");
+
 	return exit_status();
 }
 
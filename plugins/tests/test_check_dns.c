@@ -0,0 +1,201 @@
+/*****************************************************************************
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "../common.h"
+#include "../check_dns.d/dns_client.h"
+#include "../../lib/utils_base.h"
+#include "../../tap/tap.h"
+
+void print_usage(void) {}
+
+const char *progname = "test_check_dns";
+
+/* Turns a query into a response with the given flags and answer count */
+static size_t make_response(uint8_t *message, const char *name, uint16_t type, uint8_t flags,
+							uint8_t rcode, uint16_t answers, bool edns) {
+	size_t length = dns_build_query(message, DNS_MAX_QUERY_LENGTH, 0x1234, name, type, false);
+	message[2] |= 0x80 | flags;
+	message[3] = rcode;
+	message[7] = answers;
+	message[11] = edns ? 1 : 0;
+	return length;
+}
+
+/* Appends a record owned by the question name (compression pointer to offset 12) */
+static size_t add_record(uint8_t *message, size_t length, uint16_t type, const uint8_t *rdata,
+						 uint16_t rdata_length) {
+	const uint8_t header[] = {0xC0, 0x0C, type >> 8, type & 0xFF, 0, 1, 0, 0, 0x0E, 0x10,
+							  rdata_length >> 8, rdata_length & 0xFF};
+	memcpy(message + length, header, sizeof(header));
+	memcpy(message + length + sizeof(header), rdata, rdata_length);
+	return length + sizeof(header) + rdata_length;
+}
+
+static size_t add_opt(uint8_t *message, size_t length, uint8_t extended_rcode) {
+	const uint8_t opt[] = {0, 0, 41, 0x04, 0xD0, extended_rcode, 0, 0, 0, 0, 0};
+	memcpy(message + length, opt, sizeof(opt));
+	return length + sizeof(opt);
+}
+
+int main(void) {
+	plan_tests(24);
+
+	uint8_t query[DNS_MAX_QUERY_LENGTH];
+	size_t length = dns_build_query(query, sizeof(query), 0xBEEF, "example.com", DNS_TYPE_A, true);
+	const uint8_t expected_query[] = {
+		0xBE, 0xEF, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 1,                    /* header, RD */
+		7,    'e',  'x',  'a',  'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0, /* name */
+		0,    1,    0,    1,                                               /* A, IN */
+		0,    0,    41,   0x04, 0xD0, 0, 0, 0, 0, 0, 0,                    /* OPT */
+	};
+	ok(length == sizeof(expected_query) && memcmp(query, expected_query, length) == 0,
+	   "Query with EDNS0 in wire format");
+
+	uint8_t with_dot[DNS_MAX_QUERY_LENGTH];
+	size_t length_with_dot =
+		dns_build_query(with_dot, sizeof(with_dot), 0xBEEF, "example.com.", DNS_TYPE_A, true);
+	ok(length_with_dot == length && memcmp(query, with_dot, length) == 0,
+	   "Trailing dot does not change the query");
+
+	length = dns_build_query(query, sizeof(query), 1, "example.com", DNS_TYPE_AAAA, false);
+	ok(length == 29 && query[11] == 0 && query[26] == 28, "Query without EDNS0");
+
+	ok(dns_build_query(query, sizeof(query), 1, "a..example.com", DNS_TYPE_A, true) == 0,
+	   "Empty label is rejected");
+	char long_label[80];
+	memset(long_label, 'x', 64);
+	strcpy(long_label + 64, ".com");
+	ok(dns_build_query(query, sizeof(query), 1, long_label, DNS_TYPE_A, true) == 0,
+	   "Label longer than 63 characters is rejected");
+	char long_name[300];
+	for (int i = 0; i < 30; i++) {
+		memcpy(long_name + (i * 9), "abcdefgh.", 9);
+	}
+	strcpy(long_name + 270, "com");
+	ok(dns_build_query(query, sizeof(query), 1, long_name, DNS_TYPE_A, true) == 0,
+	   "Name longer than 255 Byte is rejected");
+
+	/* www.example.com is a CNAME for host.example.com with two addresses */
+	uint8_t message[1024];
+	length = make_response(message, "www.example.com", DNS_TYPE_A, 0x04, 0, 3, true);
+	const uint8_t cname[] = {4, 'h', 'o', 's', 't', 0xC0, 0x10};
+	length = add_record(message, length, DNS_TYPE_CNAME, cname, sizeof(cname));
+	const uint8_t address1[] = {192, 0, 2, 1};
+	const uint8_t address2[] = {192, 0, 2, 2};
+	length = add_record(message, length, DNS_TYPE_A, address1, 4);
+	length = add_record(message, length, DNS_TYPE_A, address2, 4);
+	length = add_opt(message, length, 0);
+
+	dns_response response = dns_parse_response(message, length);
+	ok(response.errorcode == OK && response.id == 0x1234, "Response parsed");
+	ok(response.authoritative && !response.truncated && response.edns &&
+		   response.rcode == DNS_RCODE_NOERROR,
+	   "Flags of the response");
+	ok(!strcmp(response.question_name, "www.example.com.") &&
+		   response.question_type == DNS_TYPE_A,
+	   "Question of the response");
+	ok(response.number_of_answers == 2 && !strcmp(response.answers[0].data, "192.0.2.1") &&
+		   !strcmp(response.answers[1].data, "192.0.2.2") && response.answers[0].ttl == 3600,
+	   "Addresses without the CNAME");
+	dns_response_free(&response);
+
+	length = make_response(message, "www.example.com", DNS_TYPE_CNAME, 0, 0, 1, false);
+	length = add_record(message, length, DNS_TYPE_CNAME, cname, sizeof(cname));
+	response = dns_parse_response(message, length);
+	ok(response.errorcode == OK && !response.authoritative && !response.edns &&
+		   response.number_of_answers == 1 &&
+		   !strcmp(response.answers[0].data, "host.example.com."),
+	   "Compressed CNAME target");
+	dns_response_free(&response);
+
+	length = make_response(message, "example.com", DNS_TYPE_AAAA, 0, 0, 1, false);
+	const uint8_t address6[] = {0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+	length = add_record(message, length, DNS_TYPE_AAAA, address6, 16);
+	response = dns_parse_response(message, length);
+	ok(response.number_of_answers == 1 && !strcmp(response.answers[0].data, "2001:db8::1"),
+	   "IPv6 address");
+	dns_response_free(&response);
+
+	length = make_response(message, "example.com", DNS_TYPE_MX, 0, 0, 1, false);
+	const uint8_t mx[] = {0, 10, 4, 'm', 'a', 'i', 'l', 0xC0, 0x0C};
+	length = add_record(message, length, DNS_TYPE_MX, mx, sizeof(mx));
+	response = dns_parse_response(message, length);
+	ok(response.number_of_answers == 1 && !strcmp(response.answers[0].data, "10 mail.example.com."),
+	   "MX record with preference");
+	dns_response_free(&response);
+
+	length = make_response(message, "example.com", DNS_TYPE_TXT, 0, 0, 1, false);
+	const uint8_t txt[] = {6, 'v', '=', 's', 'p', 'f', '1', 4, ' ', '-', 'a', 'l'};
+	length = add_record(message, length, DNS_TYPE_TXT, txt, sizeof(txt));
+	response = dns_parse_response(message, length);
+	ok(response.number_of_answers == 1 && !strcmp(response.answers[0].data, "v=spf1 -al"),
+	   "TXT strings are concatenated");
+	dns_response_free(&response);
+
+	length = make_response(message, "missing.example.com", DNS_TYPE_A, 0x04, DNS_RCODE_NXDOMAIN,
+						   0, false);
+	response = dns_parse_response(message, length);
+	ok(response.errorcode == OK && response.rcode == DNS_RCODE_NXDOMAIN &&
+		   response.number_of_answers == 0,
+	   "NXDOMAIN");
+	dns_response_free(&response);
+
+	length = make_response(message, "example.com", DNS_TYPE_A, 0, 0, 0, true);
+	length = add_opt(message, length, 1);
+	response = dns_parse_response(message, length);
+	ok(response.errorcode == OK && response.rcode == 16, "Extended rcode from the OPT record");
+	dns_response_free(&response);
+
+	/* A truncated response announces more records than it contains */
+	length = make_response(message, "www.example.com", DNS_TYPE_A, 0x02, 0, 3, false);
+	length = add_record(message, length, DNS_TYPE_A, address1, 4);
+	response = dns_parse_response(message, length);
+	ok(response.errorcode == OK && response.truncated && response.number_of_answers == 1,
+	   "Truncated response keeps the complete records");
+	dns_response_free(&response);
+
+	message[2] &= ~0x02;
+	response = dns_parse_response(message, length);
+	ok(response.errorcode == ERROR, "Missing records are an error without truncation");
+	dns_response_free(&response);
+
+	length = make_response(message, "example.com", DNS_TYPE_PTR, 0, 0, 1, false);
+	const uint8_t loop[] = {0xC0, (uint8_t)(length + 12)};
+	length = add_record(message, length, DNS_TYPE_PTR, loop, sizeof(loop));
+	response = dns_parse_response(message, length);
+	ok(response.errorcode == ERROR, "Compression loop is detected");
+	dns_response_free(&response);
+
+	message[2] &= ~0x80;
+	ok(dns_parse_response(message, length).errorcode == ERROR, "Query is not a response");
+
+	char name[DNS_MAX_NAME_LENGTH + 1];
+	ok(dns_reverse_name("192.0.2.1", name, sizeof(name)) &&
+		   !strcmp(name, "1.2.0.192.in-addr.arpa."),
+	   "Reverse name of an IPv4 address");
+	ok(dns_reverse_name("2001:db8::1", name, sizeof(name)) &&
+		   !strcmp(name, "1.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0."
+						 "0.0.0.0.0.0.0.0.8.b.d.0.1.0.0.2.ip6.arpa."),
+	   "Reverse name of an IPv6 address");
+	ok(!dns_reverse_name("www.example.com", name, sizeof(name)), "No reverse name for a name");
+
+	ok(dns_type_from_string("aaaa") == DNS_TYPE_AAAA && dns_type_from_string("BOGUS") == -1,
+	   "Record types by name");
+
+	return exit_status();
+}
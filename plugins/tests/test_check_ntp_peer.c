@@ -0,0 +1,102 @@
+/*****************************************************************************
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "../common.h"
+#include "../check_ntp_peer.d/readvar.h"
+#include "../../lib/utils_base.h"
+#include "../../tap/tap.h"
+#include <arpa/inet.h>
+
+void print_usage(void) {}
+
+const char *progname = "test_check_ntp_peer";
+
+/* A READVAR response carrying data at offset, with the more bit unless it is the last one */
+static ntp_control_message fragment(const char *data, size_t offset, bool last) {
+	ntp_control_message result = {
+		.op = REM_RESP | 0x02 /* READVAR */ | (last ? 0 : REM_MORE),
+		.offset = htons((uint16_t)offset),
+		.count = htons((uint16_t)strlen(data)),
+	};
+	memcpy(result.data, data, strlen(data));
+	return result;
+}
+
+int main(void) {
+	plan_tests(11);
+
+	ntp_readvar single = {};
+	ntp_control_message message = fragment("stratum=2,offset=-0.125,jitter=0.5", 0, true);
+	ok(ntp_readvar_add_fragment(&single, &message) == OK && single.done &&
+		   strcmp(single.data, "stratum=2,offset=-0.125,jitter=0.5") == 0,
+	   "A single fragment completes the response");
+	free(single.data);
+
+	/* The variable list in three fragments, the last one arrives first */
+	const char *variables = "stratum=3,offset=1.5,jitter=0.25";
+	ntp_control_message first = fragment("stratum=3,", 0, false);
+	ntp_control_message second = fragment("offset=1.5,", 10, false);
+	ntp_control_message third = fragment("jitter=0.25", 21, true);
+
+	ntp_readvar reordered = {};
+	ok(ntp_readvar_add_fragment(&reordered, &third) == OK && !reordered.done,
+	   "The last fragment alone does not complete the response");
+	ok(ntp_readvar_add_fragment(&reordered, &first) == OK && !reordered.done,
+	   "A missing fragment in the middle keeps the response incomplete");
+	ok(ntp_readvar_add_fragment(&reordered, &first) == OK && !reordered.done &&
+		   reordered.number_of_fragments == 2,
+	   "A duplicate fragment is ignored");
+	ok(ntp_readvar_add_fragment(&reordered, &second) == OK && reordered.done,
+	   "The response is complete once all fragments arrived");
+	ok(reordered.done && strcmp(reordered.data, variables) == 0,
+	   "Out of order fragments are reassembled in order");
+
+	char *stratum = np_extract_ntpvar(reordered.data, "stratum");
+	char *offset = np_extract_ntpvar(reordered.data, "offset");
+	char *jitter = np_extract_ntpvar(reordered.data, "jitter");
+	ok(stratum != NULL && strcmp(stratum, "3") == 0 && offset != NULL &&
+		   strcmp(offset, "1.5") == 0 && jitter != NULL && strcmp(jitter, "0.25") == 0,
+	   "All variables can be read from the reassembled list");
+	free(reordered.data);
+
+	ntp_readvar in_order = {};
+	ntp_readvar_add_fragment(&in_order, &first);
+	ntp_readvar_add_fragment(&in_order, &second);
+	ok(!in_order.done, "The response is incomplete before the last fragment");
+	ntp_readvar_add_fragment(&in_order, &third);
+	ok(in_order.done && strcmp(in_order.data, variables) == 0,
+	   "Fragments in order are reassembled as well");
+	free(in_order.data);
+
+	/* One variable per fragment, one fragment more than allowed */
+	ntp_readvar overflow = {};
+	bool all_accepted = true;
+	for (size_t i = 0; i < MAX_READVAR_FRAGMENTS; i++) {
+		message = fragment("x", i, false);
+		if (ntp_readvar_add_fragment(&overflow, &message) != OK) {
+			all_accepted = false;
+		}
+	}
+	ok(all_accepted && !overflow.done, "MAX_READVAR_FRAGMENTS fragments are accepted");
+	message = fragment("y", MAX_READVAR_FRAGMENTS, true);
+	ok(ntp_readvar_add_fragment(&overflow, &message) == ERROR && !overflow.done,
+	   "One more fragment is refused");
+	free(overflow.data);
+
+	return exit_status();
+}
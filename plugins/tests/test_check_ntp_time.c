@@ -0,0 +1,80 @@
+/*****************************************************************************
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "../common.h"
+#include "../check_ntp_time.d/clock_filter.h"
+#include "../../lib/utils_base.h"
+#include "../../tap/tap.h"
+#include <math.h>
+
+void print_usage(void) {}
+
+const char *progname = "test_check_ntp_time";
+
+static bool close_to(double value, double expected) { return fabs(value - expected) < 1e-9; }
+
+int main(void) {
+	plan_tests(12);
+
+	/* Server clock 0.1s ahead, 20ms on the way there, 10ms back, 5ms in the server */
+	ntp_sample sample = ntp_sample_init(0.0, 0.120, 0.125, 0.035, 0.001, -20);
+	ok(close_to(sample.offset, 0.105), "Offset from the four timestamps");
+	ok(close_to(sample.delay, 0.030), "Delay without the time in the server");
+	ok(close_to(sample.dispersion, 0.001 + ldexp(1.0, -20) + (NTP_PHI * 0.035)),
+	   "Dispersion of the sample");
+
+	sample = ntp_sample_init(0.0, 0.002, 0.003, 0.0005, 0.0, -20);
+	ok(sample.delay == 0, "Negative delay is clamped");
+
+	ok(ntp_clock_filter(NULL, 0).errorcode == ERROR, "No filter result without samples");
+
+	ntp_sample samples[] = {
+		{.offset = 0.010, .delay = 0.050, .dispersion = 0.002},
+		{.offset = -0.004, .delay = 0.090, .dispersion = 0.004},
+		{.offset = 0.001, .delay = 0.010, .dispersion = 0.001},
+		{.offset = 0.020, .delay = 0.070, .dispersion = 0.003},
+		{.offset = 0.003, .delay = 0.030, .dispersion = 0.001},
+	};
+	ntp_clock_filter_result filter = ntp_clock_filter(samples, 5);
+	ok(filter.errorcode == OK && filter.number_of_samples == 5, "Filter result for 5 samples");
+	ok(close_to(filter.offset, 0.001) && close_to(filter.delay, 0.010),
+	   "Offset of the sample with the smallest delay");
+
+	/* sorted by delay: 0.001, 0.001, 0.002, 0.003, 0.004 */
+	ok(close_to(filter.dispersion, (0.001 / 2) + (0.001 / 4) + (0.002 / 8) + (0.003 / 16) +
+									   (0.004 / 32)),
+	   "Dispersion weighted by delay rank");
+	ok(close_to(filter.jitter, sqrt(((0.002 * 0.002) + (0.009 * 0.009) + (0.019 * 0.019) +
+									 (0.005 * 0.005)) /
+									4)),
+	   "Jitter is the RMS of the offset differences");
+
+	ok(close_to(filter.offset_percentiles.p50, 0.004) &&
+		   close_to(filter.offset_percentiles.p90, 0.020),
+	   "Percentiles of the absolute offsets");
+	ok(close_to(filter.delay_percentiles.p50, 0.050) &&
+		   close_to(filter.delay_percentiles.p90, 0.090),
+	   "Percentiles of the delays");
+
+	filter = ntp_clock_filter(samples, 1);
+	ok(close_to(filter.offset, 0.010) && filter.jitter == 0 &&
+		   close_to(filter.offset_percentiles.p90, 0.010),
+	   "A single sample");
+
+	return exit_status();
+}
@@ -25,6 +25,8 @@
 
 #include "utils_base.c"
 #include "../check_snmp.d/check_snmp_helpers.h"
+#include "../check_snmp.d/oid_cache.h"
+#include "../check_snmp.d/rate_state.h"
 
 char *_np_state_generate_key(int argc, char **argv);
 char *_np_state_calculate_location_prefix(void);
@@ -171,5 +173,96 @@ int main(int argc, char **argv) {
 	np_state_write_string(0, "Bad file");
 	*/
 
+	/* OID cache */
+	const char *mib_key = "/usr/share/snmp/mibs 1700000000 ALL";
+	check_snmp_oid_cache oid_cache = check_snmp_oid_cache_init(mib_key);
+	oid if_in_octets[] = {1, 3, 6, 1, 2, 1, 2, 2, 1, 10, 1};
+	ok(check_snmp_oid_cache_add(&oid_cache, "IF-MIB::ifInOctets.1", if_in_octets,
+								OID_LENGTH(if_in_octets), "IF-MIB::ifInOctets.1") == OK,
+	   "Added OID to the cache");
+	ok(check_snmp_oid_cache_add(&oid_cache, "bad\tname", if_in_octets, OID_LENGTH(if_in_octets),
+								"bad") == ERROR,
+	   "Names with tabs are not cached");
+	ok(oid_cache.modified, "Cache is modified");
+
+	char *serialized_cache = check_snmp_oid_cache_serialize(&oid_cache);
+	ok(strcmp(serialized_cache, "1\n/usr/share/snmp/mibs 1700000000 ALL\n"
+								"IF-MIB::ifInOctets.1\t.1.3.6.1.2.1.2.2.1.10.1\t"
+								"IF-MIB::ifInOctets.1\n") == 0,
+	   "Serialized the cache");
+
+	check_snmp_oid_cache read_cache = check_snmp_oid_cache_init(mib_key);
+	ok(check_snmp_oid_cache_parse(&read_cache, serialized_cache) == OK, "Parsed the cache");
+	ok(!read_cache.modified, "Parsed cache is not modified");
+	const check_snmp_oid_cache_entry *cached_oid =
+		check_snmp_oid_cache_lookup(&read_cache, "IF-MIB::ifInOctets.1");
+	ok(cached_oid != NULL && cached_oid->numeric_oid_length == OID_LENGTH(if_in_octets) &&
+		   memcmp(cached_oid->numeric_oid, if_in_octets, sizeof(if_in_octets)) == 0,
+	   "Found the numeric OID in the parsed cache");
+	ok(check_snmp_oid_cache_lookup(&read_cache, "IF-MIB::ifOutOctets.1") == NULL,
+	   "Unknown OID is not in the cache");
+
+	check_snmp_oid_cache changed_mibs =
+		check_snmp_oid_cache_init("/usr/share/snmp/mibs 1700000001 ALL");
+	ok(check_snmp_oid_cache_parse(&changed_mibs, serialized_cache) == ERROR &&
+		   changed_mibs.number_of_entries == 0,
+	   "Cache is discarded if the MIB directory changed");
+
+	check_snmp_oid_cache broken_cache = check_snmp_oid_cache_init("key");
+	const char *broken_serialized = "1\nkey\n"
+									"sysDescr.0\t.1.3.x\tsysDescr.0\n"
+									"sysName.0\t.1.3.6.1.2.1.1.5.0\tSNMPv2-MIB::sysName.0\n";
+	ok(check_snmp_oid_cache_parse(&broken_cache, broken_serialized) == ERROR &&
+		   broken_cache.number_of_entries == 1,
+	   "Broken lines of the cache are skipped");
+
+	/* Binary state for --rate */
+	check_snmp_state_entry rate_entries[3] = {};
+	oid if_in_octets_2[] = {1, 3, 6, 1, 2, 1, 2, 2, 1, 10, 2};
+	memcpy(rate_entries[0].oid, if_in_octets_2, sizeof(if_in_octets_2));
+	rate_entries[0].oid_length = OID_LENGTH(if_in_octets_2);
+	rate_entries[0].timestamp = 1234567890;
+	rate_entries[0].type = ASN_COUNTER;
+	rate_entries[0].value.intVal = 4294967000;
+	// rate_entries[1] got no value and is not stored
+	memcpy(rate_entries[2].oid, if_in_octets, sizeof(if_in_octets));
+	rate_entries[2].oid_length = OID_LENGTH(if_in_octets);
+	rate_entries[2].timestamp = 1234567891;
+	rate_entries[2].type = ASN_COUNTER64;
+	rate_entries[2].value.uIntVal = 18446744073709551000ULL;
+
+	unlink("var/rate_state");
+	ok(check_snmp_rate_state_write("var/rate_state", rate_entries, 3, false) == OK,
+	   "Wrote rate state");
+
+	check_snmp_rate_state rate_state = check_snmp_rate_state_open("var/rate_state");
+	ok(rate_state.errorcode == OK && rate_state.number_of_entries == 2, "Mapped rate state");
+
+	check_snmp_state_entry previous_entry;
+	ok(check_snmp_rate_state_lookup(&rate_state, if_in_octets, OID_LENGTH(if_in_octets),
+									&previous_entry) &&
+		   previous_entry.timestamp == 1234567891 && previous_entry.type == ASN_COUNTER64 &&
+		   previous_entry.value.uIntVal == 18446744073709551000ULL,
+	   "Found Counter64 entry by OID");
+	ok(check_snmp_rate_state_lookup(&rate_state, if_in_octets_2, OID_LENGTH(if_in_octets_2),
+									&previous_entry) &&
+		   previous_entry.value.intVal == 4294967000,
+	   "Found Counter32 entry by OID");
+	ok(!check_snmp_rate_state_lookup(&rate_state, if_in_octets, OID_LENGTH(if_in_octets) - 1,
+									 &previous_entry),
+	   "Prefix of an OID is not found");
+	check_snmp_rate_state_close(&rate_state);
+
+	FILE *rate_state_file = fopen("var/rate_state", "r+");
+	fseek(rate_state_file, -2, SEEK_END);
+	fputc('X', rate_state_file);
+	fclose(rate_state_file);
+	rate_state = check_snmp_rate_state_open("var/rate_state");
+	ok(rate_state.errorcode == ERROR, "Damaged rate state is ignored");
+	unlink("var/rate_state");
+
+	rate_state = check_snmp_rate_state_open("var/statefile");
+	ok(rate_state.errorcode == ERROR, "Text state of older versions is ignored");
+
 	np_cleanup();
 }
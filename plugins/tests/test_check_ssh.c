@@ -0,0 +1,142 @@
+/*****************************************************************************
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "../common.h"
+#include "../check_ssh.d/banner.h"
+#include "../check_ssh.d/scan.h"
+#include "../../tap/tap.h"
+#include <sys/wait.h>
+
+void print_usage(void) {}
+
+const char *progname = "test_check_ssh";
+
+static int listen_on_loopback(int *listener, int backlog) {
+	*listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t address_length = sizeof(address);
+	bind(*listener, (struct sockaddr *)&address, sizeof(address));
+	listen(*listener, backlog);
+	getsockname(*listener, (struct sockaddr *)&address, &address_length);
+	return ntohs(address.sin_port);
+}
+
+/* Sends the banners to one client each in small pieces and hangs up */
+static void banner_server(int listener, const char **banners, int clients) {
+	for (int i = 0; i < clients; i++) {
+		int client = accept(listener, NULL, NULL);
+		for (const char *next = banners[i]; *next != '\0'; next += 3) {
+			send(client, next, strnlen(next, 3), 0);
+			usleep(1000);
+		}
+		close(client);
+	}
+	_exit(0);
+}
+
+int main(void) {
+	plan_tests(12);
+
+	ssh_banner banner;
+	ssh_banner_init(&banner);
+	ok(ssh_banner_feed(&banner, "SSH-2.0-Open", 12) == SSH_BANNER_INCOMPLETE &&
+		   ssh_banner_feed(&banner, "SSH_9.6 Ubuntu\r", 15) == SSH_BANNER_INCOMPLETE &&
+		   ssh_banner_feed(&banner, "\nrest", 5) == SSH_BANNER_FOUND,
+	   "Identification string split across several reads");
+	ok(!strcmp(banner.protocol, "2.0") && !strcmp(banner.software, "OpenSSH_9.6") &&
+		   !strcmp(banner.comments, "Ubuntu") &&
+		   !strcmp(banner.identification, "SSH-2.0-OpenSSH_9.6 Ubuntu"),
+	   "Parts of the identification string");
+
+	const char preamble[] = "Welcome\r\n\nSSH is not here yet\nSSH-1.99-dropbear\n";
+	ssh_banner_init(&banner);
+	ok(ssh_banner_feed(&banner, preamble, strlen(preamble)) == SSH_BANNER_FOUND &&
+		   !strcmp(banner.protocol, "1.99") && !strcmp(banner.software, "dropbear") &&
+		   banner.comments[0] == '\0',
+	   "Other lines before the identification string are skipped");
+
+	char long_line[400];
+	memset(long_line, 'x', 300);
+	strcpy(long_line + 300, "\nSSH-2.0-x\n");
+	ssh_banner_init(&banner);
+	ok(ssh_banner_feed(&banner, long_line, strlen(long_line)) == SSH_BANNER_FOUND,
+	   "Overlong line before the identification string is skipped");
+
+	memcpy(long_line, "SSH-", 4);
+	ssh_banner_init(&banner);
+	ok(ssh_banner_feed(&banner, long_line, strlen(long_line)) == SSH_BANNER_INVALID,
+	   "Overlong identification string is invalid");
+
+	ssh_banner_init(&banner);
+	ok(ssh_banner_feed(&banner, "SSH-2.0\r\n", 9) == SSH_BANNER_INVALID, "Missing software");
+	ssh_banner_init(&banner);
+	ok(ssh_banner_feed(&banner, "SSH-2.0- comment\n", 17) == SSH_BANNER_INVALID,
+	   "Empty software");
+
+	char noise[1024];
+	memset(noise, 'y', sizeof(noise));
+	noise[sizeof(noise) - 1] = '\n';
+	ssh_banner_init(&banner);
+	ssh_banner_status status = SSH_BANNER_INCOMPLETE;
+	for (int i = 0; i < 9 && status == SSH_BANNER_INCOMPLETE; i++) {
+		status = ssh_banner_feed(&banner, noise, sizeof(noise));
+	}
+	ok(status == SSH_BANNER_INVALID, "Endless preamble is invalid");
+
+	int closed_listener;
+	int closed = listen_on_loopback(&closed_listener, 1);
+	close(closed_listener);
+	int banner_listener;
+	int port = listen_on_loopback(&banner_listener, 4);
+	const char *banners[] = {"SSH-2.0-OpenSSH_9.6\r\n", "220 smtp.example.com ESMTP\r\n",
+							 "SSH-2.0\r\n"};
+
+	pid_t server = fork();
+	if (server == 0) {
+		banner_server(banner_listener, banners, 3);
+	}
+	close(banner_listener);
+
+	ssh_probe probes[5];
+	ssh_probe_init(&probes[0], "127.0.0.1", port);
+	ssh_probe_init(&probes[1], "127.0.0.1", port);
+	ssh_probe_init(&probes[2], "127.0.0.1", port);
+	ssh_probe_init(&probes[3], "127.0.0.1", closed);
+	ssh_probe_init(&probes[4], "host.invalid", closed);
+	ssh_scan(probes, 5, 2, 1);
+
+	ok(probes[0].result == SSH_PROBE_OK && !strcmp(probes[0].banner.software, "OpenSSH_9.6") &&
+		   !strcmp(probes[0].endpoint.address, "127.0.0.1") &&
+		   probes[0].endpoint.connect_time <= probes[0].endpoint.total_time,
+	   "Identification string received in pieces");
+	ok(probes[1].result == SSH_PROBE_CLOSED && probes[2].result == SSH_PROBE_INVALID &&
+		   ssh_probe_connected(&probes[1]) && ssh_probe_connected(&probes[2]),
+	   "Other protocol and invalid identification string");
+	ok(probes[3].result == SSH_PROBE_REFUSED && probes[4].result == SSH_PROBE_UNRESOLVED &&
+		   !ssh_probe_connected(&probes[3]),
+	   "Closed port and unknown host");
+
+	int status_code = 0;
+	waitpid(server, &status_code, 0);
+	ok(WIFEXITED(status_code) && WEXITSTATUS(status_code) == 0, "Banner server finished");
+
+	return exit_status();
+}
@@ -0,0 +1,180 @@
+/*****************************************************************************
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "../common.h"
+#include "../netutils.h"
+#include "../check_tcp.d/probe.h"
+#include "../../tap/tap.h"
+#include <sys/wait.h>
+
+void print_usage(void) {}
+
+const char *progname = "test_check_tcp";
+
+#ifdef HAVE_SSL
+#	define BANNER_CLIENTS 3
+#else
+#	define BANNER_CLIENTS 2
+#endif
+
+static int listen_on_loopback(int *listener, int backlog) {
+	*listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t address_length = sizeof(address);
+	bind(*listener, (struct sockaddr *)&address, sizeof(address));
+	listen(*listener, backlog);
+	getsockname(*listener, (struct sockaddr *)&address, &address_length);
+	return ntohs(address.sin_port);
+}
+
+/* Greets the given number of clients with a banner and hangs up */
+static void banner_server(int listener, int clients) {
+	for (int i = 0; i < clients; i++) {
+		int client = accept(listener, NULL, NULL);
+		const char banner[] = "SSH-2.0-OpenSSH_9.6\r\n";
+		send(client, banner, strlen(banner), 0);
+		close(client);
+	}
+	_exit(0);
+}
+
+static double seconds_since(const struct timespec *start) {
+	struct timespec current;
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return (double)(current.tv_sec - start->tv_sec) +
+		   ((double)(current.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+int main(void) {
+	plan_tests(12);
+
+	int closed_listener;
+	int closed = listen_on_loopback(&closed_listener, 1);
+	close(closed_listener);
+	int silent_listener;
+	int silent = listen_on_loopback(&silent_listener, 16);
+	int banner_listener;
+	int banner = listen_on_loopback(&banner_listener, 4);
+
+	pid_t server = fork();
+	if (server == 0) {
+		banner_server(banner_listener, BANNER_CLIENTS);
+	}
+	close(banner_listener);
+
+	tcp_probe_settings settings = {
+		.timeout = 2,
+		.read_timeout = 0.1,
+		.concurrency = TCP_PROBE_DEFAULT_CONCURRENCY,
+	};
+
+	tcp_probe probes[6];
+	tcp_probe_init(&probes[0], "127.0.0.1", closed);
+	tcp_probe_init(&probes[1], "127.0.0.1", silent);
+	tcp_probe_init(&probes[2], "host.invalid", silent);
+	tcp_probe_run(probes, 3, settings);
+	ok(probes[0].result == TCP_PROBE_REFUSED && !tcp_probe_reachable(&probes[0]),
+	   "Closed port is refused");
+	ok(probes[1].result == TCP_PROBE_OK && !strcmp(probes[1].endpoint.address, "127.0.0.1") &&
+		   probes[1].endpoint.connect_time <= probes[1].endpoint.total_time,
+	   "Open port without expect string");
+	ok(probes[2].result == TCP_PROBE_UNRESOLVED, "Unknown host");
+
+	char *expect[] = {"SSH-"};
+	settings.server_expect = expect;
+	settings.server_expect_count = 1;
+	tcp_probe_init(&probes[0], "127.0.0.1", banner);
+	tcp_probe_init(&probes[1], "127.0.0.1", silent);
+	tcp_probe_run(probes, 2, settings);
+	ok(probes[0].result == TCP_PROBE_OK && probes[0].received == 21, "Banner matches");
+	ok(probes[1].result == TCP_PROBE_NO_DATA && tcp_probe_reachable(&probes[1]),
+	   "Silent server sends no data");
+
+	char *other_expect[] = {"220"};
+	settings.server_expect = other_expect;
+	tcp_probe_init(&probes[0], "127.0.0.1", banner);
+	tcp_probe_run(probes, 1, settings);
+	ok(probes[0].result == TCP_PROBE_MISMATCH, "Banner does not match");
+
+#ifdef HAVE_SSL
+	np_net_ssl_context_new(&settings.tls_context, 0, NULL, NULL);
+	tcp_probe_init(&probes[0], "127.0.0.1", banner);
+	tcp_probe_run(probes, 1, settings);
+	ok(probes[0].result == TCP_PROBE_TLS_FAILED && tcp_probe_reachable(&probes[0]) &&
+		   probes[0].tls_connection == NULL,
+	   "TLS handshake with a plain text server fails");
+	np_net_ssl_context_free(settings.tls_context);
+	settings.tls_context = NULL;
+#else
+	skip(1, "TLS is not available");
+#endif
+
+	/* Six silent servers, two at a time take three read timeouts */
+	settings.concurrency = 2;
+	for (size_t i = 0; i < 6; i++) {
+		tcp_probe_init(&probes[i], "127.0.0.1", silent);
+	}
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	tcp_probe_run(probes, 6, settings);
+	double elapsed = seconds_since(&start);
+	bool all_silent = true;
+	for (size_t i = 0; i < 6; i++) {
+		all_silent &= probes[i].result == TCP_PROBE_NO_DATA;
+	}
+	ok(all_silent && elapsed >= 0.3 && elapsed < 1.5,
+	   "Concurrency limits the probes in flight (%.3fs)", elapsed);
+
+#ifdef HAVE_SSL
+	np_net_ssl_chain_certificate certificates[] = {
+		{.common_name = "leaf.example", .remaining_seconds = 90 * 86400, .errors = ALL_OK},
+		{.common_name = "Intermediate", .remaining_seconds = 19 * 86400, .errors = ALL_OK},
+	};
+	np_net_ssl_chain_result chain = {
+		.errorcode = OK,
+		.number_of_certificates = 2,
+		.certificates = certificates,
+		.soonest = 1,
+	};
+	mp_subcheck chain_result = mp_net_ssl_check_chain(&chain, 30, 10, "host:443");
+	ok(chain_result.state == STATE_WARNING && strstr(chain_result.output, "Intermediate") &&
+		   strstr(chain_result.output, "19 day"),
+	   "Intermediate certificate expiring first decides the state");
+
+	certificates[1].remaining_seconds = -86400;
+	chain_result = mp_net_ssl_check_chain(&chain, 30, 10, NULL);
+	ok(chain_result.state == STATE_CRITICAL && strstr(chain_result.output, "expired"),
+	   "Expired certificate in the chain is critical");
+
+	chain.errorcode = ERROR;
+	chain_result = mp_net_ssl_check_chain(&chain, 30, 10, NULL);
+	ok(chain_result.state == STATE_CRITICAL, "No certificate is critical");
+#else
+	skip(3, "TLS is not available");
+#endif
+
+	int status = 0;
+	waitpid(server, &status, 0);
+	ok(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Banner server finished");
+
+	close(silent_listener);
+	return exit_status();
+}
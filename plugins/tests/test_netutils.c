@@ -0,0 +1,423 @@
+/*****************************************************************************
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ *****************************************************************************/
+
+#include "../common.h"
+#include "../netutils.h"
+#include "../../tap/tap.h"
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#define EHLO_EXTENSIONS 60
+
+void print_usage(void) {}
+
+const char *progname = "test_netutils";
+
+static void send_string(int socket, const char *string) { send(socket, string, strlen(string), 0); }
+
+/* Waits for one command line of the client */
+static void read_command(int socket) {
+	char character;
+	while (recv(socket, &character, 1, 0) == 1 && character != '\n') {
+	}
+}
+
+/*
+ * A fake SMTP server for one session. Every reply goes out with one send,
+ * except the one which is split in the middle of a line.
+ */
+static void fake_smtp_server(int listener) {
+	int socket = accept(listener, NULL, NULL);
+	send_string(socket, "220 mail.example.com ESMTP ready\r\n");
+
+	read_command(socket);
+	char *ehlo_reply = strdup("250-mail.example.com\r\n");
+	for (int i = 1; i < EHLO_EXTENSIONS; i++) {
+		xasprintf(&ehlo_reply, "%s250-X-EXTENSION-%02d some capability parameters\r\n",
+				  ehlo_reply, i);
+	}
+	xasprintf(&ehlo_reply, "%s250 STARTTLS\r\n", ehlo_reply);
+	send_string(socket, ehlo_reply);
+
+	read_command(socket);
+	send_string(socket, "250-first part of a line ");
+	usleep(50000);
+	send_string(socket, "continued\r\n250 OK\r\n");
+
+	/* Pipelined: two replies in one segment */
+	read_command(socket);
+	send_string(socket, "250 sender OK\r\n250 recipient OK\r\n");
+
+	/* FTP style multi-line reply with lines without the code */
+	read_command(socket);
+	send_string(socket, "214-The following commands are recognized.\r\n"
+						" USER PASS QUIT\r\n"
+						"214-not the end\r\n"
+						"214 Help OK.\r\n");
+
+	read_command(socket);
+	send_string(socket, "221 Bye");
+	close(socket);
+	_exit(0);
+}
+
+/* A listening socket on an IPv4 address, any free port for port 0, returns its port */
+static int listen_on(const char *text, int port, int *listener, int backlog) {
+	*listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+	};
+	inet_pton(AF_INET, text, &address.sin_addr);
+	socklen_t address_length = sizeof(address);
+	bind(*listener, (struct sockaddr *)&address, sizeof(address));
+	listen(*listener, backlog);
+	getsockname(*listener, (struct sockaddr *)&address, &address_length);
+	return ntohs(address.sin_port);
+}
+
+/* A listening socket on the loopback interface, returns its port */
+static int listen_on_loopback(int *listener, int backlog) {
+	return listen_on("127.0.0.1", 0, listener, backlog);
+}
+
+/* Port without listener, connections to it are refused */
+static int closed_port(void) {
+	int listener;
+	int port = listen_on_loopback(&listener, 1);
+	close(listener);
+	return port;
+}
+
+#define MAX_TEST_ADDRESSES 20
+typedef struct {
+	struct addrinfo list[MAX_TEST_ADDRESSES];
+	struct sockaddr_storage addresses[MAX_TEST_ADDRESSES];
+	size_t length;
+} address_list;
+
+static void add_address(address_list *list, int family, const char *text, int port) {
+	struct addrinfo *entry = &list->list[list->length];
+	struct sockaddr_storage *storage = &list->addresses[list->length];
+	memset(entry, 0, sizeof(*entry));
+	memset(storage, 0, sizeof(*storage));
+	if (family == AF_INET6) {
+		struct sockaddr_in6 *address = (struct sockaddr_in6 *)storage;
+		address->sin6_family = AF_INET6;
+		address->sin6_port = htons(port);
+		inet_pton(AF_INET6, text, &address->sin6_addr);
+		entry->ai_addrlen = sizeof(*address);
+	} else {
+		struct sockaddr_in *address = (struct sockaddr_in *)storage;
+		address->sin_family = AF_INET;
+		address->sin_port = htons(port);
+		inet_pton(AF_INET, text, &address->sin_addr);
+		entry->ai_addrlen = sizeof(*address);
+	}
+	entry->ai_family = family;
+	entry->ai_socktype = SOCK_STREAM;
+	entry->ai_protocol = IPPROTO_TCP;
+	entry->ai_addr = (struct sockaddr *)storage;
+	if (list->length > 0) {
+		list->list[list->length - 1].ai_next = entry;
+	}
+	list->length++;
+}
+
+static double seconds_since(const struct timespec *start) {
+	struct timespec current;
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return (double)(current.tv_sec - start->tv_sec) +
+		   ((double)(current.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+static void test_connection_attempts(void) {
+	int refused = closed_port();
+	address_list list = {0};
+	add_address(&list, AF_INET, "127.0.0.1", refused);
+	add_address(&list, AF_INET, "127.0.0.2", refused);
+	add_address(&list, AF_INET6, "::1", refused);
+
+	int socket_descriptor = -1;
+	ok(np_net_connect_addresses(list.list, &socket_descriptor) == STATE_CRITICAL && was_refused,
+	   "No address accepts");
+	ok(connect_report.number_of_attempts == 3 && connect_report.winner == -1 &&
+		   !strcmp(connect_report.attempts[0].address, "127.0.0.1") &&
+		   !strcmp(connect_report.attempts[1].address, "::1") &&
+		   !strcmp(connect_report.attempts[2].address, "127.0.0.2"),
+	   "Address families alternate");
+
+	sequential_connect = true;
+	np_net_connect_addresses(list.list, &socket_descriptor);
+	ok(!strcmp(connect_report.attempts[1].address, "127.0.0.2"),
+	   "Sequential attempts keep the order");
+
+	/* Connections to a listener with a full backlog wait for the SYN retransmission */
+	int full_listener;
+	int full = listen_on_loopback(&full_listener, 0);
+	int filler = -1;
+	my_tcp_connect("127.0.0.1", full, &filler);
+	int listener;
+	int port = listen_on_loopback(&listener, 4);
+
+	list = (address_list){0};
+	add_address(&list, AF_INET, "127.0.0.1", refused);
+	add_address(&list, AF_INET, "127.0.0.1", port);
+	ok(np_net_connect_addresses(list.list, &socket_descriptor) == STATE_OK &&
+		   connect_report.winner == 1 &&
+		   connect_report.attempts[0].status == NP_CONNECT_FAILED &&
+		   connect_report.attempts[0].error == ECONNREFUSED && !was_refused,
+	   "Sequential attempt after a refused one");
+	close(socket_descriptor);
+
+	sequential_connect = false;
+	connection_attempt_delay = 0.05;
+	list = (address_list){0};
+	add_address(&list, AF_INET, "127.0.0.1", full);
+	add_address(&list, AF_INET, "127.0.0.1", port);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	mp_state_enum result = np_net_connect_addresses(list.list, &socket_descriptor);
+	double elapsed = seconds_since(&start);
+	ok(result == STATE_OK && connect_report.winner == 1 &&
+		   connect_report.attempts[0].status == NP_CONNECT_ABANDONED &&
+		   connect_report.attempts[1].status == NP_CONNECT_SUCCEEDED,
+	   "Second address wins while the first one hangs");
+	ok(elapsed >= 0.05 && elapsed < 0.5 && connect_report.attempts[1].latency < elapsed,
+	   "Second attempt started after the delay instead of the timeout (%.3fs)", elapsed);
+	ok(!(fcntl(socket_descriptor, F_GETFL, 0) & O_NONBLOCK), "Connected socket is blocking");
+	close(socket_descriptor);
+
+	/* more addresses than a fixed list would hold, the last one accepts */
+	list = (address_list){0};
+	char text[INET_ADDRSTRLEN];
+	for (int i = 2; i < MAX_TEST_ADDRESSES + 1; i++) {
+		snprintf(text, sizeof(text), "127.0.0.%d", i);
+		add_address(&list, AF_INET, text, port);
+	}
+	add_address(&list, AF_INET, "127.0.0.1", port);
+	ok(np_net_connect_addresses(list.list, &socket_descriptor) == STATE_OK &&
+		   connect_report.number_of_attempts == MAX_TEST_ADDRESSES &&
+		   connect_report.winner == MAX_TEST_ADDRESSES - 1,
+	   "Every address of a long list is tried");
+	close(socket_descriptor);
+
+	close(filler);
+	close(full_listener);
+	close(listener);
+	connection_attempt_delay = NP_CONNECTION_ATTEMPT_DELAY;
+}
+
+/* A protocol with nothing to say */
+static void hang_up(np_net_endpoint *endpoint, void *settings) {
+	(void)settings;
+	np_net_endpoint_close(endpoint);
+}
+
+static void test_endpoints(void) {
+	int listener;
+	int port = listen_on_loopback(&listener, 4);
+	address_list list = {0};
+	add_address(&list, AF_INET, "127.0.0.2", 0);
+	add_address(&list, AF_INET, "127.0.0.1", 0);
+
+	np_net_endpoint endpoints[3];
+	np_net_endpoint_init(&endpoints[0], "localhost", port, NULL);
+	endpoints[0].addresses = list.list;
+	np_net_endpoint_init(&endpoints[1], "localhost", closed_port(), NULL);
+	endpoints[1].addresses = list.list;
+	np_net_endpoint_init(&endpoints[2], "host.invalid", port, NULL);
+	np_net_endpoint *pointers[] = {&endpoints[0], &endpoints[1], &endpoints[2]};
+	const np_net_protocol protocol = {.connected = hang_up, .ready = hang_up, .expired = hang_up};
+	np_net_endpoints_run(pointers, 3, 2, 2, &protocol, NULL);
+
+	ok(endpoints[0].status == NP_NET_OK && endpoints[0].phase == NP_NET_ENDPOINT_DONE &&
+		   !strcmp(endpoints[0].address, "127.0.0.1") &&
+		   endpoints[0].connect_time <= endpoints[0].total_time,
+	   "The next address is tried after a refused one");
+	ok(endpoints[1].status == NP_NET_REFUSED && !strcmp(endpoints[1].address, "127.0.0.1"),
+	   "Refused once every address refused");
+	ok(endpoints[2].status == NP_NET_UNRESOLVED, "Unknown host");
+	close(listener);
+
+	/* 127.0.0.1 hangs with a full backlog, 127.0.0.2 accepts on the same port */
+	int full_listener;
+	int full = listen_on("127.0.0.1", 0, &full_listener, 0);
+	int filler = -1;
+	my_tcp_connect("127.0.0.1", full, &filler);
+	listen_on("127.0.0.2", full, &listener, 4);
+	list = (address_list){0};
+	add_address(&list, AF_INET, "127.0.0.1", 0);
+	add_address(&list, AF_INET, "127.0.0.2", 0);
+	connection_attempt_delay = 0.05;
+	np_net_endpoint_init(&endpoints[0], "localhost", full, NULL);
+	endpoints[0].addresses = list.list;
+	np_net_endpoints_run(pointers, 1, 2, 1, &protocol, NULL);
+	ok(endpoints[0].status == NP_NET_OK && !strcmp(endpoints[0].address, "127.0.0.2") &&
+		   endpoints[0].connect_time >= 0.05 && endpoints[0].connect_time < 0.5,
+	   "The next address starts after the delay while the first one hangs (%.3fs)",
+	   endpoints[0].connect_time);
+	connection_attempt_delay = NP_CONNECTION_ATTEMPT_DELAY;
+
+	/* the second endpoint waits for the slot of the first one, both hang */
+	list = (address_list){0};
+	add_address(&list, AF_INET, "127.0.0.1", 0);
+	for (size_t i = 0; i < 2; i++) {
+		np_net_endpoint_init(&endpoints[i], "localhost", full, NULL);
+		endpoints[i].addresses = list.list;
+	}
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	np_net_endpoints_run(pointers, 2, 0.2, 1, &protocol, NULL);
+	double elapsed = seconds_since(&start);
+	ok(endpoints[0].status == NP_NET_TIMEOUT && endpoints[1].status == NP_NET_TIMEOUT &&
+		   elapsed >= 0.2 && elapsed < 0.35,
+	   "Waiting endpoints time out with the whole run (%.3fs)", elapsed);
+	close(filler);
+	close(full_listener);
+	close(listener);
+}
+
+int main(void) {
+	plan_tests(32);
+
+	test_connection_attempts();
+	test_endpoints();
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t address_length = sizeof(address);
+	bind(listener, (struct sockaddr *)&address, sizeof(address));
+	listen(listener, 1);
+	getsockname(listener, (struct sockaddr *)&address, &address_length);
+
+	pid_t server = fork();
+	if (server == 0) {
+		fake_smtp_server(listener);
+	}
+	close(listener);
+
+	int socket_descriptor = -1;
+	ok(my_tcp_connect("127.0.0.1", ntohs(address.sin_port), &socket_descriptor) == STATE_OK,
+	   "Connected to the fake SMTP server");
+
+	np_net_reader reader;
+	np_net_reader_init(&reader, socket_descriptor);
+	char reply[MAX_INPUT_BUFFER];
+
+	int length = np_net_read_reply(&reader, reply, sizeof(reply));
+	ok(length == 34 && !strcmp(reply, "220 mail.example.com ESMTP ready\r\n"), "Greeting read");
+	ok(net_timing.bytes_received == 34 && net_timing.bytes_sent == 0 &&
+		   net_timing.first_byte_time >= net_timing.resolve_time + net_timing.connect_time,
+	   "Timing of the connection up to the greeting");
+
+	const char ehlo[] = "EHLO client.example.com\r\n";
+	np_net_send(socket_descriptor, ehlo, strlen(ehlo));
+	ok(net_timing.bytes_sent == strlen(ehlo), "Sent Bytes are counted");
+	unsigned long reads_before = reader.reads;
+	length = np_net_read_reply(&reader, reply, sizeof(reply));
+	unsigned long ehlo_reads = reader.reads - reads_before;
+	ok(length > 0 && strstr(reply, "250-X-EXTENSION-59 ") != NULL &&
+		   !strcmp(reply + length - 14, "250 STARTTLS\r\n"),
+	   "Multi-line EHLO reply read completely");
+	ok(ehlo_reads <= 3, "EHLO reply of %d Byte took %lu reads instead of one per Byte", length,
+	   ehlo_reads);
+
+	send_string(socket_descriptor, "NOOP\r\n");
+	length = np_net_read_reply(&reader, reply, sizeof(reply));
+	ok(!strcmp(reply, "250-first part of a line continued\r\n250 OK\r\n"),
+	   "Line split over two segments is joined");
+
+	send_string(socket_descriptor, "MAIL FROM:<>\r\n");
+	np_net_read_reply(&reader, reply, sizeof(reply));
+	ok(!strcmp(reply, "250 sender OK\r\n"), "First pipelined reply");
+	reads_before = reader.reads;
+	np_net_read_reply(&reader, reply, sizeof(reply));
+	ok(!strcmp(reply, "250 recipient OK\r\n") && reader.reads == reads_before,
+	   "Second pipelined reply comes from the buffer");
+
+	send_string(socket_descriptor, "HELP\r\n");
+	np_net_read_reply(&reader, reply, sizeof(reply));
+	ok(strstr(reply, " USER PASS QUIT\r\n") != NULL &&
+		   !strcmp(reply + strlen(reply) - 14, "214 Help OK.\r\n"),
+	   "FTP style reply ends at the line with the code and a space");
+
+	send_string(socket_descriptor, "QUIT\r\n");
+	char small[6];
+	ok(np_net_read_line(&reader, small, sizeof(small)) == -2 && !strcmp(small, "221 B"),
+	   "Line longer than the buffer is reported");
+	ok(np_net_read_line(&reader, reply, sizeof(reply)) == 2 && !strcmp(reply, "ye"),
+	   "Rest of the line stays for the next call");
+	ok(np_net_read_line(&reader, reply, sizeof(reply)) == 0, "EOF after the last line");
+	close(socket_descriptor);
+
+	/* A last line without newline */
+	int sockets[2];
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+	send_string(sockets[1], "250-one\r\n250 last");
+	close(sockets[1]);
+	np_net_reader_init(&reader, sockets[0]);
+	length = np_net_read_reply(&reader, reply, sizeof(reply));
+	ok(length == 17 && !strcmp(reply, "250-one\r\n250 last"), "Reply without final newline");
+	close(sockets[0]);
+
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+	send_string(sockets[1], "250-unfinished\r\n");
+	close(sockets[1]);
+	np_net_reader_init(&reader, sockets[0]);
+	ok(np_net_read_reply(&reader, reply, sizeof(reply)) == 0, "Unfinished reply is EOF");
+	close(sockets[0]);
+
+	/* Operations with a deadline instead of an alarm */
+	socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	np_net_io_result io_result =
+		np_net_recv_until(sockets[0], reply, sizeof(reply), np_net_deadline(0.2));
+	double elapsed = seconds_since(&start);
+	ok(io_result.status == NP_NET_TIMEOUT && io_result.phase == NP_NET_RECEIVE &&
+		   elapsed >= 0.2 && elapsed < 1,
+	   "Receive times out at the deadline (%.3fs)", elapsed);
+	send_string(sockets[1], "late");
+	close(sockets[1]);
+	io_result = np_net_recv_until(sockets[0], reply, sizeof(reply), np_net_deadline(1));
+	np_net_io_result closed_result =
+		np_net_recv_until(sockets[0], reply, sizeof(reply), np_net_deadline(1));
+	ok(io_result.status == NP_NET_OK && io_result.length == 4 &&
+		   closed_result.status == NP_NET_CLOSED,
+	   "Receive returns the data and then the closed connection");
+	close(sockets[0]);
+
+	io_result = np_net_connect_until("127.0.0.1", closed_port(), &socket_descriptor, IPPROTO_TCP,
+									 np_net_deadline(1));
+	np_net_io_result unresolved = np_net_connect_until("host.invalid", 22, &socket_descriptor,
+													   IPPROTO_TCP, np_net_deadline(1));
+	ok(io_result.status == NP_NET_REFUSED && io_result.phase == NP_NET_CONNECT &&
+		   unresolved.status == NP_NET_UNRESOLVED && unresolved.phase == NP_NET_RESOLVE,
+	   "Failed connects tell the phase");
+
+	int status = 0;
+	waitpid(server, &status, 0);
+	ok(WIFEXITED(status) && WEXITSTATUS(status) == 0, "Fake SMTP server finished");
+
+	return exit_status();
+}